@@ -15,6 +15,8 @@
 #import "NoticeControl.h"
 #import "UserManager.h"
 #import "UserInfo.h"
+#import "VersionCache.h"
+#import "PeerSimulator.h"
 #import "DebugLog.h"
 
 #import <SystemConfiguration/SystemConfiguration.h>
@@ -88,6 +90,7 @@ typedef NSMutableArray<ReceiveControl*>		_RecvCtrlList;
 @property(copy)		NSString*				scKeyHostName;	// DynamicStore Key [for LocalHostName]
 @property(copy)		NSString*				scKeyNetIPv4;	// DynamicStore Key [for Global IPv4]
 @property(copy)		NSString*				scKeyIFIPv4;	// DynamicStore Key [for IF IPv4 Address]
+@property(copy)		NSString*				scPatIFIPv4;	// DynamicStore Pattern [for All IF IPv4 Address]
 
 @property(copy)		NSString*				primaryNIC;		// ネットワークインタフェース
 
@@ -158,8 +161,11 @@ static void _DynamicStoreCallback(SCDynamicStoreRef	store,
 			_scKeyHostName	= (NSString*)SCDynamicStoreKeyCreateHostNames(NULL);
 			_scKeyNetIPv4 = (NSString*)SCDynamicStoreKeyCreateNetworkGlobalEntity(
 																				  NULL, kSCDynamicStoreDomainState, kSCEntNetIPv4);
+			_scPatIFIPv4	= (NSString*)SCDynamicStoreKeyCreateNetworkInterfaceEntity(
+																				  NULL, kSCDynamicStoreDomainState, kSCCompAnyRegex, kSCEntNetIPv4);
 			NSArray<NSString*>* keys = @[_scKeyHostName, _scKeyNetIPv4];
-			if (!SCDynamicStoreSetNotificationKeys(_scDynStore, (CFArrayRef)keys, NULL)) {
+			NSArray<NSString*>* pats = @[_scPatIFIPv4];
+			if (!SCDynamicStoreSetNotificationKeys(_scDynStore, (CFArrayRef)keys, (CFArrayRef)pats)) {
 				ERR(@"dynamic store notification set error");
 			}
 			_runLoopSource = SCDynamicStoreCreateRunLoopSource(NULL, _scDynStore, 0);
@@ -187,6 +193,7 @@ static void _DynamicStoreCallback(SCDynamicStoreRef	store,
 	[_iconSmallAbsence release];
 	[_iconSmallAbsenceReverse release];
 	[_lastDockDraggedDate release];
+	[_scPatIFIPv4 release];
 	[_scKeyIFIPv4 release];
 	[_scKeyNetIPv4 release];
 	[_scKeyHostName release];
@@ -555,6 +562,14 @@ static void _DynamicStoreCallback(SCDynamicStoreRef	store,
 	TRC(@"Broadcast entry");
 	[MessageCenter.sharedCenter broadcastEntry];
 
+#if defined(IPMSG_DEBUG)
+	// 負荷試験（起動引数 -PeerSimulatorPeers <仮想ユーザ数> 指定時のみ。結果はデバッグログ）
+	NSInteger simPeers = [NSUserDefaults.standardUserDefaults integerForKey:@"PeerSimulatorPeers"];
+	if (simPeers > 0) {
+		[PeerSimulator runSuiteWithPeerCount:(NSUInteger)simPeers];
+	}
+#endif
+
 	TRC(@"Complete");
 }
 
@@ -621,6 +636,7 @@ static void _DynamicStoreCallback(SCDynamicStoreRef	store,
 
 	// 初期設定の保存
 	[cfg save];
+	[VersionCache.sharedCache save];
 
 	// 送受信サーバの終了
 	[mc shutdownServer];
@@ -980,6 +996,10 @@ void _DynamicStoreCallback(SCDynamicStoreRef	store,
 				[ntcCenter postNotificationName:kIPMsgHostNameChangedNotification object:nil];
 				[msgCenter broadcastAbsence];
 			}
+		} else if ([key hasPrefix:@"State:/Network/Interface/"] && [key hasSuffix:@"/IPv4"]) {
+			// プライマリ以外のNIC（VPN・仮想ブリッジ等）の増減はブロードキャスト先のみ更新
+			DBG(@"<SC>NIC IPv4 changed (key:%@) -> Refresh broadcast targets", key);
+			[msgCenter refreshBroadcastTargets];
 		} else {
 			DBG(@"<SC>No action defined for key:%@", key);
 		}
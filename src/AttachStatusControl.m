@@ -11,6 +11,8 @@
 #import "SendAttachment.h"
 #import "RecvFile.h"
 #import "MessageCenter.h"
+#import "BandwidthShaper.h"
+#import "Config.h"
 #import "DebugLog.h"
 
 /*============================================================================*
@@ -22,6 +24,21 @@ static NSString* ATTACHPNL_SIZE_H	= @"AttachStatusPanelHeight";
 static NSString* ATTACHPNL_POS_X	= @"AttachStatusPanelOriginX";
 static NSString* ATTACHPNL_POS_Y	= @"AttachStatusPanelOriginY";
 
+static const NSTimeInterval _RATE_UPDATE_INTERVAL	= 1.0;	// 送信レート表示更新間隔
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface AttachStatusControl()
+
+@property(copy)		NSString*	baseTitle;		// パネルタイトル（送信状況表示なし）
+@property(retain)	NSTimer*	rateTimer;		// 送信状況表示更新タイマ
+
+- (void)updateTransferRate;
+
+@end
+
 /*============================================================================*
  * クラス実装
  *============================================================================*/
@@ -52,6 +69,9 @@ static NSString* ATTACHPNL_POS_Y	= @"AttachStatusPanelOriginY";
 - (void)dealloc
 {
 	[NSNotificationCenter.defaultCenter removeObserver:self];
+	[_rateTimer invalidate];
+	[_rateTimer release];
+	[_baseTitle release];
 	[super dealloc];
 }
 
@@ -93,6 +113,33 @@ static NSString* ATTACHPNL_POS_Y	= @"AttachStatusPanelOriginY";
 	});
 }
 
+// 送信状況（送信レート・帯域上限）をタイトルに表示
+- (void)updateTransferRate
+{
+	BandwidthShaper*	shaper	= BandwidthShaper.sharedShaper;
+	Config*				config	= Config.sharedConfig;
+	NSMutableString*	title	= [NSMutableString stringWithString:self.baseTitle];
+	if (shaper.activeTransfers > 0) {
+		[title appendFormat:NSLocalizedString(@"AttachStatus.Rate", nil),
+							shaper.activeTransfers, shaper.currentRate / 1024.0];
+	}
+	if ((config.attachRateLimit > 0) || (config.attachPeerRateLimit > 0) || (config.attachTransferRateLimit > 0)) {
+		NSString* (^limitStr)(NSUInteger) = ^(NSUInteger limit) {
+			if (limit == 0) {
+				return NSLocalizedString(@"AttachStatus.Unlimited", nil);
+			}
+			return [NSString stringWithFormat:@"%luKB/s", limit];
+		};
+		[title appendFormat:NSLocalizedString(@"AttachStatus.Limit", nil),
+							limitStr(config.attachRateLimit),
+							limitStr(config.attachPeerRateLimit),
+							limitStr(config.attachTransferRateLimit)];
+	}
+	if (![self.panel.title isEqualToString:title]) {
+		self.panel.title = title;
+	}
+}
+
 /*----------------------------------------------------------------------------*/
 #pragma mark - NSOutlineView
 /*----------------------------------------------------------------------------*/
@@ -214,6 +261,17 @@ static NSString* ATTACHPNL_POS_Y	= @"AttachStatusPanelOriginY";
 	}
 	[self.panel setFrame:windowFrame display:NO];
 	self.panel.floatingPanel = NO;
+
+	// 送信状況表示（表示中のみ更新）
+	self.baseTitle = self.panel.title;
+	__weak typeof(self) weakSelf = self;
+	self.rateTimer = [NSTimer scheduledTimerWithTimeInterval:_RATE_UPDATE_INTERVAL
+													 repeats:YES
+													   block:^(NSTimer* _Nonnull timer) {
+		if (weakSelf.panel.visible) {
+			[weakSelf updateTransferRate];
+		}
+	}];
 }
 
 @end
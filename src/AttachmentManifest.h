@@ -0,0 +1,64 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: AttachmentManifest.h
+ *	Module		: 送信フォルダ内容一覧クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 一覧項目種別（送信順に並ぶ）
+typedef NS_ENUM(NSInteger, ManifestEntryType)
+{
+	MANIFEST_ENTRY_FILE,			// 通常ファイル
+	MANIFEST_ENTRY_DIRECTORY,		// ディレクトリ（配下の項目が続く）
+	MANIFEST_ENTRY_RET_PARENT		// 親ディレクトリ復帰
+};
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 一覧項目
+@interface ManifestEntry : NSObject
+
+@property(readonly)	ManifestEntryType						type;	// 種別
+@property(readonly)	NSString*								path;	// パス（親ディレクトリ復帰はnil）
+@property(readonly)	NSDictionary<NSFileAttributeKey, id>*	attrs;	// ファイル属性
+@property(readonly)	BOOL									hidden;	// 非表示ファイル
+
+@end
+
+// 添付フォルダ配下の送信内容一覧（バックグラウンドで作成し、変更を監視して作り直す）
+@interface AttachmentManifest : NSObject
+
+@property(readonly)	NSString*					path;		// フォルダパス
+@property(readonly)	BOOL						ready;		// 作成済み（作成後に変更なし）
+@property(readonly)	NSArray<ManifestEntry*>*	entries;	// 送信順の項目（未作成・変更検知後はnil）
+@property(readonly)	NSUInteger					fileCount;	// 配下のファイル数（未作成時は0）
+@property(readonly)	UInt64						totalSize;	// 配下のファイルサイズ合計（未作成時は0）
+
+// ファクトリ（作成・監視を開始する）
++ (instancetype)manifestWithPath:(NSString*)path;
+
+// 非表示ファイル判定（一覧作成と都度走査の送信で共用）
++ (BOOL)isHiddenPath:(NSString*)path;
+
+// 初期化（作成・監視を開始する）
+- (instancetype)initWithPath:(NSString*)path;
+
+// 作成済みの値をまとめて取得（未作成時はNO）
+- (BOOL)getFileCount:(NSUInteger*)count totalSize:(UInt64*)size;
+
+// 一覧破棄・作り直し（送信時に内容の不一致を検出した場合など）
+- (void)invalidate;
+
+// 監視停止（解放前に呼ぶ）
+- (void)stop;
+
+@end
@@ -0,0 +1,401 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: AttachmentManifest.m
+ *	Module		: 送信フォルダ内容一覧クラス
+ *============================================================================*/
+
+#import <CoreServices/CoreServices.h>
+#import "AttachmentManifest.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+static const CFTimeInterval	_WATCH_LATENCY	= 1.0;		// 変更通知をまとめる間隔（秒）
+static char					_QueueKey;					// 作成キュー判定用
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface ManifestEntry()
+
+- (instancetype)initWithType:(ManifestEntryType)type
+						path:(NSString*)path
+					   attrs:(NSDictionary<NSFileAttributeKey, id>*)attrs
+					  hidden:(BOOL)hidden;
+
+@end
+
+@interface AttachmentManifest()
+{
+	NSArray<ManifestEntry*>*	_entries;
+	NSUInteger					_fileCount;
+	UInt64						_totalSize;
+	NSUInteger					_generation;	// 変更検知・停止毎に更新（作成中の一覧は破棄される）
+	BOOL						_stopped;
+	dispatch_queue_t			_queue;			// 一覧作成・変更通知（直列）
+	FSEventStreamRef			_stream;
+}
+
+- (void)rebuild;
+- (void)buildGeneration:(NSUInteger)gen;
+- (BOOL)collect:(NSString*)path
+		  attrs:(NSDictionary<NSFileAttributeKey, id>*)attrs
+		   into:(NSMutableArray<ManifestEntry*>*)list
+		  count:(NSUInteger*)count
+		   size:(UInt64*)size
+	 generation:(NSUInteger)gen;
+- (BOOL)isCurrentGeneration:(NSUInteger)gen;
+- (void)releaseStream;
+
+@end
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// フォルダ配下変更通知
+static void _StreamCallback(ConstFSEventStreamRef			stream,
+							void*							info,
+							size_t							numEvents,
+							void*							eventPaths,
+							const FSEventStreamEventFlags	eventFlags[],
+							const FSEventStreamEventId		eventIds[])
+{
+	AttachmentManifest* manifest = (AttachmentManifest*)info;
+	DBG(@"manifest changed(%@,%zu events)", manifest.path, numEvents);
+	[manifest invalidate];
+}
+
+/*============================================================================*
+ * クラス実装（一覧項目）
+ *============================================================================*/
+
+@implementation ManifestEntry
+
+// 初期化
+- (instancetype)initWithType:(ManifestEntryType)type
+						path:(NSString*)path
+					   attrs:(NSDictionary<NSFileAttributeKey, id>*)attrs
+					  hidden:(BOOL)hidden
+{
+	self = [super init];
+	if (self) {
+		_type	= type;
+		_path	= [path copy];
+		_attrs	= [attrs retain];
+		_hidden	= hidden;
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_path release];
+	[_attrs release];
+	[super dealloc];
+}
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation AttachmentManifest
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)manifestWithPath:(NSString*)path
+{
+	return [[[AttachmentManifest alloc] initWithPath:path] autorelease];
+}
+
+/*----------------------------------------------------------------------------*
+ * クラスメソッド
+ *----------------------------------------------------------------------------*/
+
+// 非表示ファイル判定
++ (BOOL)isHiddenPath:(NSString*)path
+{
+	id value;
+	NSURL* fileURL = [NSURL fileURLWithPath:path];
+	if ([fileURL getResourceValue:&value forKey:NSURLIsHiddenKey error:nil]) {
+		return [value boolValue];
+	}
+	return NO;
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithPath:(NSString*)path
+{
+	self = [super init];
+	if (self) {
+		_path	= [path copy];
+		_queue	= dispatch_queue_create("jp.ishwt.ipmsg.manifest", DISPATCH_QUEUE_SERIAL);
+		dispatch_queue_set_specific(_queue, &_QueueKey, &_QueueKey, NULL);
+
+		// 先に監視を始める（作成中の変更も検知する）
+		FSEventStreamContext ctx = { 0, self, NULL, NULL, NULL };
+		_stream = FSEventStreamCreate(kCFAllocatorDefault,
+									  _StreamCallback,
+									  &ctx,
+									  (CFArrayRef)@[path],
+									  kFSEventStreamEventIdSinceNow,
+									  _WATCH_LATENCY,
+									  kFSEventStreamCreateFlagWatchRoot);
+		if (!_stream) {
+			// 変更を検知できない一覧は使わない（送信時は従来通り都度走査）
+			WRN(@"manifest watch failed(%@)", path);
+			_stopped = YES;
+			return self;
+		}
+		FSEventStreamSetDispatchQueue(_stream, _queue);
+		if (!FSEventStreamStart(_stream)) {
+			WRN(@"manifest watch start failed(%@)", path);
+			[self releaseStream];
+			_stopped = YES;
+			return self;
+		}
+		[self rebuild];
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[self stop];
+	dispatch_release(_queue);
+	[_entries release];
+	[_path release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * プロパティアクセス
+ *----------------------------------------------------------------------------*/
+
+// 作成済み
+- (BOOL)ready
+{
+	@synchronized (self) {
+		return (_entries != nil);
+	}
+}
+
+// 送信順の項目
+- (NSArray<ManifestEntry*>*)entries
+{
+	@synchronized (self) {
+		return [[_entries retain] autorelease];
+	}
+}
+
+// 配下のファイル数
+- (NSUInteger)fileCount
+{
+	@synchronized (self) {
+		return _fileCount;
+	}
+}
+
+// 配下のファイルサイズ合計
+- (UInt64)totalSize
+{
+	@synchronized (self) {
+		return _totalSize;
+	}
+}
+
+// 作成済みの値をまとめて取得
+- (BOOL)getFileCount:(NSUInteger*)count totalSize:(UInt64*)size
+{
+	@synchronized (self) {
+		if (!_entries) {
+			return NO;
+		}
+		if (count) {
+			*count = _fileCount;
+		}
+		if (size) {
+			*size = _totalSize;
+		}
+		return YES;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 一覧管理
+ *----------------------------------------------------------------------------*/
+
+// 一覧破棄・作り直し
+- (void)invalidate
+{
+	@synchronized (self) {
+		[_entries release];
+		_entries	= nil;
+		_fileCount	= 0;
+		_totalSize	= 0;
+		_generation++;
+		if (_stopped) {
+			return;
+		}
+	}
+	[self rebuild];
+}
+
+// 監視停止
+- (void)stop
+{
+	@synchronized (self) {
+		_generation++;
+		_stopped = YES;
+	}
+	if (dispatch_get_specific(&_QueueKey) == &_QueueKey) {
+		// 作成キュー上（最後の参照が作成処理だった場合）
+		[self releaseStream];
+	} else {
+		// 通知・作成処理の終了を待って停止
+		dispatch_sync(_queue, ^{
+			[self releaseStream];
+		});
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// 一覧作成要求
+- (void)rebuild
+{
+	NSUInteger gen;
+	@synchronized (self) {
+		gen = _generation;
+	}
+	dispatch_async(_queue, ^{
+		[self buildGeneration:gen];
+	});
+}
+
+// 一覧作成（作成キュー上で実行）
+- (void)buildGeneration:(NSUInteger)gen
+{
+	@autoreleasepool {
+		if (![self isCurrentGeneration:gen]) {
+			return;
+		}
+		CFAbsoluteTime	start	= CFAbsoluteTimeGetCurrent();
+		NSDictionary*	attrs	= [NSFileManager.defaultManager attributesOfItemAtPath:self.path error:nil];
+		if (![attrs[NSFileType] isEqualToString:NSFileTypeDirectory]) {
+			WRN(@"manifest target is not directory(%@)", self.path);
+			return;
+		}
+		NSMutableArray<ManifestEntry*>*	list	= [NSMutableArray array];
+		NSUInteger						count	= 0;
+		UInt64							size	= 0;
+		if (![self collect:self.path attrs:attrs into:list count:&count size:&size generation:gen]) {
+			DBG(@"manifest build canceled(%@)", self.path);
+			return;
+		}
+		@synchronized (self) {
+			if (gen != _generation) {
+				DBG(@"manifest build discarded(%@)", self.path);
+				return;
+			}
+			[_entries release];
+			_entries	= [list copy];
+			_fileCount	= count;
+			_totalSize	= size;
+		}
+		DBG(@"manifest built(%@,files=%lu,size=%llu,entries=%lu,%.3fs)",
+			self.path, count, size, list.count, CFAbsoluteTimeGetCurrent() - start);
+	}
+}
+
+// ディレクトリ走査（送信処理と同じ順序で項目を並べる。破棄された場合NO）
+- (BOOL)collect:(NSString*)path
+		  attrs:(NSDictionary<NSFileAttributeKey, id>*)attrs
+		   into:(NSMutableArray<ManifestEntry*>*)list
+		  count:(NSUInteger*)count
+		   size:(UInt64*)size
+	 generation:(NSUInteger)gen
+{
+	NSFileManager* fm = NSFileManager.defaultManager;
+
+	ManifestEntry* dir = [[ManifestEntry alloc] initWithType:MANIFEST_ENTRY_DIRECTORY
+														path:path
+													   attrs:attrs
+													  hidden:[AttachmentManifest isHiddenPath:path]];
+	[list addObject:dir];
+	[dir release];
+
+	NSArray<NSString*>* files = [fm contentsOfDirectoryAtPath:path error:NULL];
+	for (NSString* file in files) {
+		if (![self isCurrentGeneration:gen]) {
+			return NO;
+		}
+		@autoreleasepool {
+			NSString*		child		= [path stringByAppendingPathComponent:file];
+			NSDictionary*	childAttrs	= [fm attributesOfItemAtPath:child error:NULL];
+			NSString*		type		= childAttrs[NSFileType];
+			if ([type isEqualToString:NSFileTypeRegular]) {
+				ManifestEntry* entry = [[ManifestEntry alloc] initWithType:MANIFEST_ENTRY_FILE
+																	  path:child
+																	 attrs:childAttrs
+																	hidden:[AttachmentManifest isHiddenPath:child]];
+				[list addObject:entry];
+				[entry release];
+				*count	+= 1;
+				*size	+= [childAttrs[NSFileSize] unsignedLongLongValue];
+			} else if ([type isEqualToString:NSFileTypeDirectory]) {
+				if (![self collect:child attrs:childAttrs into:list count:count size:size generation:gen]) {
+					return NO;
+				}
+			} else {
+				TRC(@"manifest skip unsupported(%@,%@)", type, child);
+			}
+		}
+	}
+
+	ManifestEntry* ret = [[ManifestEntry alloc] initWithType:MANIFEST_ENTRY_RET_PARENT
+														path:nil
+													   attrs:nil
+													  hidden:NO];
+	[list addObject:ret];
+	[ret release];
+	return YES;
+}
+
+// 作成継続判定
+- (BOOL)isCurrentGeneration:(NSUInteger)gen
+{
+	@synchronized (self) {
+		return (!_stopped && (gen == _generation));
+	}
+}
+
+// 監視解放（作成キュー上で呼ぶ）
+- (void)releaseStream
+{
+	if (_stream) {
+		FSEventStreamStop(_stream);
+		FSEventStreamInvalidate(_stream);
+		FSEventStreamRelease(_stream);
+		_stream = NULL;
+	}
+}
+
+@end
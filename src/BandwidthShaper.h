@@ -0,0 +1,49 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: BandwidthShaper.h
+ *	Module		: 添付ファイル送信帯域制御クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import <netinet/in.h>
+
+@class BandwidthShaper;
+@class CryptoStream;
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 転送毎の帯域制御情報
+@interface BandwidthTransfer : NSObject
+
+@property(readonly)	UInt64			bytesSent;	// 送信済バイト数
+@property(retain)	CryptoStream*	cipher;		// 送信データ暗号化（nilは平文）
+
+// 帯域制御付き送信（全量送信するかエラーまで戻らない）
+- (BOOL)send:(int)sock bytes:(const void*)bytes length:(size_t)len;
+
+// 認証タグ送信（暗号化転送時のみ。前回のタグ以降に送ったデータが対象）
+- (BOOL)sendTag:(int)sock;
+
+@end
+
+// 添付ファイル送信の帯域制御（全体／相手毎／転送毎のトークンバケット）
+@interface BandwidthShaper : NSObject
+
+@property(readonly)	double		currentRate;		// 直近の送信レート（バイト/秒）
+@property(readonly)	NSUInteger	activeTransfers;	// 送信中の転送数
+
+// 共有インスタンス
++ (instancetype)sharedShaper;
+
+// 転送開始／終了
+- (BandwidthTransfer*)beginTransferTo:(struct sockaddr_in)addr socket:(int)sock;
+- (void)endTransfer:(BandwidthTransfer*)transfer;
+
+// 制御パケット送信通知（直後の添付送信を短時間譲らせる。個別宛の応答パケットのみ通知する）
+- (void)noteControlTraffic;
+
+@end
@@ -0,0 +1,346 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: BandwidthShaper.m
+ *	Module		: 添付ファイル送信帯域制御クラス
+ *============================================================================*/
+
+#import "BandwidthShaper.h"
+#import "CryptoStream.h"
+#import "Config.h"
+#import "RuntimeMetrics.h"
+#import "DebugLog.h"
+
+#import <sys/socket.h>
+#import <netinet/ip.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _SLICE_SIZE		(64 * 1024)		// 帯域判定単位（バイト）
+#define _BURST_SECONDS	(0.25)			// バケット容量（上限レートでの秒数）
+#define _MAX_WAIT		(0.5)			// 1回の待ち時間上限（設定変更を早く反映するため）
+#define _CONTROL_YIELD	(0.005)			// 制御パケット送信後に添付送信を譲る時間
+#define _YIELD_LIMIT	(0.05)			// 譲る時間の合計上限（_RATE_WINDOW毎）
+#define _RATE_WINDOW	(1.0)			// 送信レート計測間隔
+#define _TOS_BULK		(0x20)			// 添付送信ソケットのDSCP（CS1：低優先）
+
+// トークンバケット
+typedef struct {
+	double			tokens;		// 残量（バイト、負数は超過分）
+	CFAbsoluteTime	last;		// 最終補充時刻
+} _TokenBucket;
+
+// 補充して消費し、超過分を解消するまでの待ち時間を返す（rateが0以下は無制限）
+static NSTimeInterval _BucketConsume(_TokenBucket* b, double rate, size_t bytes, CFAbsoluteTime now)
+{
+	if (rate <= 0) {
+		b->tokens	= 0;
+		b->last		= now;
+		return 0;
+	}
+	b->tokens	= MIN(rate * _BURST_SECONDS, b->tokens + (now - b->last) * rate);
+	b->last		= now;
+	b->tokens	-= bytes;
+	return (b->tokens < 0) ? (-b->tokens / rate) : 0;
+}
+
+/*============================================================================*
+ * 内部クラス
+ *============================================================================*/
+
+// 相手毎のバケット
+@interface BandwidthPeer : NSObject
+{
+@public
+	_TokenBucket	bucket;
+}
+@property(assign)	NSInteger	transfers;	// 送信中の転送数
+@end
+
+@implementation BandwidthPeer
+@end
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface BandwidthShaper()
+{
+	_TokenBucket	globalBucket;	// 全体バケット
+}
+
+@property(retain)	NSMutableDictionary<NSNumber*,BandwidthPeer*>*	peers;			// 相手毎バケット（アドレス毎）
+@property(assign)	CFAbsoluteTime									controlUntil;	// 制御パケット優先期限
+@property(assign)	CFAbsoluteTime									yieldStart;		// 譲った時間の計測開始時刻
+@property(assign)	NSTimeInterval									yieldTotal;		// 計測中に譲った時間
+@property(assign)	CFAbsoluteTime									windowStart;	// レート計測開始時刻
+@property(assign)	UInt64											windowBytes;	// レート計測中の送信量
+@property(assign)	double											lastRate;		// 前回計測レート
+@property(assign)	NSUInteger										activeTransfers;
+
+- (BOOL)waitForSlice:(size_t)len transfer:(BandwidthTransfer*)transfer;
+
+@end
+
+@interface BandwidthTransfer()
+{
+@public
+	_TokenBucket	bucket;		// 転送毎バケット
+}
+
+@property(assign)	BandwidthShaper*	shaper;		// 帯域制御（共有インスタンスのため非保持）
+@property(retain)	BandwidthPeer*		peer;		// 相手毎バケット
+@property(retain)	NSNumber*			peerKey;	// 相手アドレス
+@property(assign)	CFAbsoluteTime		startAt;	// 転送開始時刻
+@property(assign)	UInt64				bytesSent;
+@property(retain)	NSMutableData*		cipherBuffer;	// 暗号化作業領域（1スライス分）
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation BandwidthTransfer
+
+// 解放
+- (void)dealloc
+{
+	[_peer release];
+	[_peerKey release];
+	[_cipher release];
+	[_cipherBuffer release];
+	[super dealloc];
+}
+
+// 帯域制御付き送信
+- (BOOL)send:(int)sock bytes:(const void*)bytes length:(size_t)len
+{
+	const char* ptr = bytes;
+	while (len > 0) {
+		size_t slice	= MIN(len, (size_t)_SLICE_SIZE);
+		size_t sent		= 0;
+		[self.shaper waitForSlice:slice transfer:self];
+		const char* out = ptr;
+		if (self.cipher) {
+			// 暗号化はスライス単位でまとめて行う
+			if (!self.cipherBuffer) {
+				self.cipherBuffer = [NSMutableData dataWithLength:_SLICE_SIZE];
+			}
+			if (![self.cipher encrypt:ptr to:self.cipherBuffer.mutableBytes length:slice]) {
+				return NO;
+			}
+			out = self.cipherBuffer.bytes;
+		}
+		while (sent < slice) {
+			ssize_t n = send(sock, &out[sent], slice - sent, 0);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				ERR(@"send error(%s,remain=%zu)", strerror(errno), len - sent);
+				return NO;
+			}
+			sent += (size_t)n;
+		}
+		ptr				+= slice;
+		len				-= slice;
+		self.bytesSent	+= slice;
+		MetricsIncrement(METRICS_ATTACH_BYTES_SENT, slice);
+	}
+	return YES;
+}
+
+// 認証タグ送信（タグ自体は暗号化しない。小さいため帯域制御の対象外）
+- (BOOL)sendTag:(int)sock
+{
+	if (!self.cipher) {
+		return YES;
+	}
+	NSData*	tag		= [self.cipher tag];
+	size_t	sent	= 0;
+	while (sent < tag.length) {
+		ssize_t n = send(sock, &((const char*)tag.bytes)[sent], tag.length - sent, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERR(@"tag send error(%s)", strerror(errno));
+			return NO;
+		}
+		sent += (size_t)n;
+	}
+	return YES;
+}
+
+@end
+
+@implementation BandwidthShaper
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)sharedShaper
+{
+	static BandwidthShaper*	sharedShaper = nil;
+	static dispatch_once_t	once;
+
+	dispatch_once(&once, ^{
+		sharedShaper = [[BandwidthShaper alloc] init];
+	});
+
+	return sharedShaper;
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		_peers			= [[NSMutableDictionary alloc] init];
+		_windowStart	= CFAbsoluteTimeGetCurrent();
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_peers release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 転送管理
+ *----------------------------------------------------------------------------*/
+
+// 転送開始
+- (BandwidthTransfer*)beginTransferTo:(struct sockaddr_in)addr socket:(int)sock
+{
+	// 添付送信は低優先でマーキング（UDPの制御パケットを優先させる）
+	int tos = _TOS_BULK;
+	if (setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+		WRN(@"IP_TOS set error(%s)", strerror(errno));
+	}
+
+	BandwidthTransfer* transfer = [[[BandwidthTransfer alloc] init] autorelease];
+	transfer.shaper		= self;
+	transfer.peerKey	= @(addr.sin_addr.s_addr);
+	transfer.startAt	= CFAbsoluteTimeGetCurrent();
+	@synchronized (self) {
+		BandwidthPeer* peer = self.peers[transfer.peerKey];
+		if (!peer) {
+			peer = [[[BandwidthPeer alloc] init] autorelease];
+			self.peers[transfer.peerKey] = peer;
+		}
+		peer.transfers++;
+		transfer.peer = peer;
+		self.activeTransfers++;
+	}
+	return transfer;
+}
+
+// 転送終了
+- (void)endTransfer:(BandwidthTransfer*)transfer
+{
+	@synchronized (self) {
+		transfer.peer.transfers--;
+		if (transfer.peer.transfers <= 0) {
+			[self.peers removeObjectForKey:transfer.peerKey];
+		}
+		self.activeTransfers--;
+	}
+	MetricsObserve(METRICS_UPLOAD_DURATION, CFAbsoluteTimeGetCurrent() - transfer.startAt);
+	TRC(@"transfer finished(%llu bytes)", transfer.bytesSent);
+}
+
+// 制御パケット送信通知
+- (void)noteControlTraffic
+{
+	@synchronized (self) {
+		if (self.activeTransfers == 0) {
+			return;
+		}
+		// 応答が続いても添付送信が止まりきらないよう、譲る時間は一定時間毎の上限まで
+		CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+		if (now - self.yieldStart >= _RATE_WINDOW) {
+			self.yieldStart	= now;
+			self.yieldTotal	= 0;
+		}
+		CFAbsoluteTime	until	= now + _CONTROL_YIELD;
+		NSTimeInterval	added	= until - MAX(self.controlUntil, now);
+		if ((added <= 0) || (self.yieldTotal + added > _YIELD_LIMIT)) {
+			return;
+		}
+		self.yieldTotal		+= added;
+		self.controlUntil	= until;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * プロパティアクセス
+ *----------------------------------------------------------------------------*/
+
+// 直近の送信レート
+- (double)currentRate
+{
+	@synchronized (self) {
+		CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - self.windowStart;
+		if (elapsed >= _RATE_WINDOW * 2) {
+			// 計測区間が途切れている（送信が止まっている）
+			return self.windowBytes / elapsed;
+		}
+		return self.lastRate;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// 送信前の待ち合わせ（待った場合YES）
+- (BOOL)waitForSlice:(size_t)len transfer:(BandwidthTransfer*)transfer
+{
+	BOOL waited = NO;
+	// 初回に消費し、以降は超過分が解消するまで待つ（待ち中の設定変更も反映）
+	for (size_t consume = len; ; consume = 0) {
+		Config*			config	= Config.sharedConfig;
+		double			global	= config.attachRateLimit * 1024.0;
+		double			perPeer	= config.attachPeerRateLimit * 1024.0;
+		double			perXfer	= config.attachTransferRateLimit * 1024.0;
+		NSTimeInterval	wait	= 0;
+		@synchronized (self) {
+			CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+			wait = MAX(wait, _BucketConsume(&globalBucket, global, consume, now));
+			wait = MAX(wait, _BucketConsume(&transfer.peer->bucket, perPeer, consume, now));
+			wait = MAX(wait, _BucketConsume(&transfer->bucket, perXfer, consume, now));
+			// 制御パケット優先（直近に送信があれば少し譲る）
+			if (now < self.controlUntil) {
+				wait = MAX(wait, self.controlUntil - now);
+			}
+			// レート計測
+			self.windowBytes += consume;
+			if (now - self.windowStart >= _RATE_WINDOW) {
+				self.lastRate		= self.windowBytes / (now - self.windowStart);
+				self.windowStart	= now;
+				self.windowBytes	= 0;
+			}
+		}
+		if (wait <= 0) {
+			break;
+		}
+		[NSThread sleepForTimeInterval:MIN(wait, _MAX_WAIT)];
+		waited = YES;
+	}
+	return waited;
+}
+
+@end
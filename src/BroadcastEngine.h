@@ -0,0 +1,46 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: BroadcastEngine.h
+ *	Module		: ブロードキャスト送信先管理クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import <netinet/in.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 送受信経路
+typedef NS_ENUM(NSInteger, BroadcastTransport)
+{
+	BROADCAST_TRANSPORT_BROADCAST,		// ブロードキャスト
+	BROADCAST_TRANSPORT_MULTICAST,		// マルチキャスト
+	BROADCAST_TRANSPORT_UNICAST			// 個別宛先
+};
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// NIC毎の直接ブロードキャスト・マルチキャスト・個別指定アドレス・ダイアルアップユーザへの一括送信
+@interface BroadcastEngine : NSObject
+
+@property(readonly)	NSUInteger	numberOfTargets;	// 送信先数（ダイアルアップユーザ除く）
+@property(readonly)	BOOL		multicastEnabled;	// マルチキャスト使用中
+
+// 送信先再構築（NIC列挙・個別指定アドレス解決・マルチキャストグループ参加。ネットワーク・設定変更時に呼ぶ）
+- (void)refreshWithPort:(UInt16)port socket:(int)sock;
+
+// 全送信先へ送信（送信できた宛先数を返す）
+- (NSUInteger)sendPacket:(const void*)packet length:(size_t)len socket:(int)sock;
+
+// 受信パケットの経路判定（宛先アドレスから）
+- (BroadcastTransport)transportForDestination:(struct in_addr)dst;
+
+// 自マシンのアドレス判定（送信先再構築時に列挙した全NICのアドレス・ループバック）
+- (BOOL)isLocalAddress:(struct in_addr)addr;
+
+@end
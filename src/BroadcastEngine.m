@@ -0,0 +1,436 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: BroadcastEngine.m
+ *	Module		: ブロードキャスト送信先管理クラス
+ *============================================================================*/
+
+#import "BroadcastEngine.h"
+#import "Config.h"
+#import "UserManager.h"
+#import "UserInfo.h"
+#import "RuntimeMetrics.h"
+#import "DebugLog.h"
+
+#import <sys/socket.h>
+#import <net/if.h>
+#import <netinet/in.h>
+#import <arpa/inet.h>
+#import <ifaddrs.h>
+
+/*============================================================================*
+ * 構造体定義
+ *============================================================================*/
+
+// 送信先
+typedef struct {
+	struct sockaddr_in	addr;		// 宛先
+	unsigned int		ifIndex;	// 送出NIC（0:経路表に従う）
+	struct in_addr		source;		// 送信元アドレス（ifIndex指定時のみ有効）
+	BroadcastTransport	transport;	// 経路
+} _BroadcastTarget;
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface BroadcastEngine()
+{
+	_BroadcastTarget*	targets;		// 送信先（NIC・個別指定）
+	NSUInteger			targetCount;
+	struct in_addr		group;			// 参加中マルチキャストグループ
+	struct in_addr*		joined;			// グループ参加NIC（アドレス）
+	NSUInteger			joinedCount;
+	in_addr_t*			dialups;		// ダイアルアップユーザアドレス
+	NSUInteger			dialupCount;
+	in_addr_t*			locals;			// 自マシンのNICアドレス
+	NSUInteger			localCount;
+}
+
+@property(assign)	UInt16	portNo;			// 送信先ポート
+@property(assign)	BOOL	dialupDirty;	// ダイアルアップ索引再作成要
+@property(assign)	BOOL	multicastEnabled;
+
+- (void)userListChanged:(NSNotification*)aNotification;
+- (void)rebuildDialupIndex;
+- (void)joinGroup:(struct in_addr)newGroup interfaces:(struct in_addr*)list count:(NSUInteger)count socket:(int)sock;
+
+@end
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 送信先追加（同一宛先は追加しない。マルチキャストはNIC毎に1つ）
+static BOOL _AddTarget(_BroadcastTarget* list, NSUInteger* count, NSUInteger max, BroadcastTransport transport,
+					   in_addr_t addr, UInt16 port, unsigned int ifIndex, struct in_addr source)
+{
+	for (NSUInteger i = 0; i < *count; i++) {
+		if ((list[i].addr.sin_addr.s_addr == addr) &&
+			((transport != BROADCAST_TRANSPORT_MULTICAST) || (list[i].ifIndex == ifIndex))) {
+			return NO;
+		}
+	}
+	if (*count >= max) {
+		return NO;
+	}
+	_BroadcastTarget* t = &list[(*count)++];
+	memset(t, 0, sizeof(*t));
+	t->addr.sin_len			= sizeof(t->addr);
+	t->addr.sin_family		= AF_INET;
+	t->addr.sin_port		= htons(port);
+	t->addr.sin_addr.s_addr	= addr;
+	t->ifIndex				= ifIndex;
+	t->source				= source;
+	t->transport			= transport;
+	return YES;
+}
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation BroadcastEngine
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		_dialupDirty = YES;
+		[NSNotificationCenter.defaultCenter addObserver:self
+											   selector:@selector(userListChanged:)
+												   name:kIPMsgUserListChangedNotification
+												 object:nil];
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[NSNotificationCenter.defaultCenter removeObserver:self];
+	free(targets);
+	free(joined);
+	free(dialups);
+	free(locals);
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 送信先管理
+ *----------------------------------------------------------------------------*/
+
+// 送信先再構築
+- (void)refreshWithPort:(UInt16)port socket:(int)sock
+{
+	Config* config = Config.sharedConfig;
+
+	// 個別指定アドレス（ホスト名はここで解決しておき送信毎には解決しない）
+	NSArray<NSString*>*	configured	= config.broadcastAddresses;
+
+	// マルチキャストグループ（不正な指定は使用しない）
+	struct in_addr	mcast		= { INADDR_ANY };
+	NSString*		mcastStr	= config.multicastAddress;
+	if (mcastStr.length > 0) {
+		if ((inet_aton(mcastStr.UTF8String, &mcast) == 0) || !IN_MULTICAST(ntohl(mcast.s_addr))) {
+			WRN(@"invalid multicast address(%@)", mcastStr);
+			mcast.s_addr = INADDR_ANY;
+		}
+	}
+	BOOL useMulticast	= (mcast.s_addr != INADDR_ANY);
+	BOOL useBroadcast	= (!useMulticast || config.multicastWithBroadcast);
+
+	// NIC列挙
+	struct ifaddrs* ifList = NULL;
+	if (getifaddrs(&ifList) != 0) {
+		ERR(@"getifaddrs error(%s)", strerror(errno));
+		ifList = NULL;
+	}
+	NSUInteger ifCount = 0;
+	for (struct ifaddrs* ifa = ifList; ifa; ifa = ifa->ifa_next) {
+		ifCount++;
+	}
+
+	NSUInteger			max			= ifCount * 2 + configured.count + 2;
+	NSUInteger			count		= 0;
+	NSUInteger			bcastCount	= 0;
+	NSUInteger			mcastCount	= 0;
+	_BroadcastTarget*	list		= calloc(max, sizeof(_BroadcastTarget));
+	struct in_addr*		ifAddrs		= calloc(ifCount + 1, sizeof(struct in_addr));
+	in_addr_t*			localList	= calloc(ifCount + 1, sizeof(in_addr_t));
+	NSUInteger			localNum	= 0;
+	if (!list || !ifAddrs || !localList) {
+		ERR(@"calloc error(%lu)", max);
+		free(list);
+		free(ifAddrs);
+		free(localList);
+		freeifaddrs(ifList);
+		return;
+	}
+	struct in_addr any = { INADDR_ANY };
+	for (struct ifaddrs* ifa = ifList; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || (ifa->ifa_addr->sa_family != AF_INET) || !ifa->ifa_netmask) {
+			continue;
+		}
+		unsigned int flags = ifa->ifa_flags;
+		if (!(flags & IFF_UP)) {
+			continue;
+		}
+		// 自マシンのアドレス（自分の送信パケットは送出したNICのアドレスから届く）
+		localList[localNum++] = ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr;
+		if (!(flags & IFF_RUNNING) || (flags & IFF_LOOPBACK)) {
+			continue;
+		}
+		struct in_addr	addr	= ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+		unsigned int	ifIndex	= if_nametoindex(ifa->ifa_name);
+		if (useBroadcast && (flags & IFF_BROADCAST)) {
+			// ブロードキャストできないNIC（VPNのポイントツーポイント等）は対象外
+			in_addr_t mask	= ((struct sockaddr_in*)ifa->ifa_netmask)->sin_addr.s_addr;
+			in_addr_t bcast	= addr.s_addr | ~mask;
+			if (ifa->ifa_broadaddr && (ifa->ifa_broadaddr->sa_family == AF_INET)) {
+				bcast = ((struct sockaddr_in*)ifa->ifa_broadaddr)->sin_addr.s_addr;
+			}
+			if (_AddTarget(list, &count, max, BROADCAST_TRANSPORT_BROADCAST, bcast, port, ifIndex, addr)) {
+				struct in_addr b = { bcast };
+				DBG(@"broadcast target %s(%s)", inet_ntoa(b), ifa->ifa_name);
+				bcastCount++;
+			}
+		}
+		if (useMulticast && (flags & IFF_MULTICAST)) {
+			if (_AddTarget(list, &count, max, BROADCAST_TRANSPORT_MULTICAST, mcast.s_addr, port, ifIndex, addr)) {
+				DBG(@"multicast target %s(%s)", inet_ntoa(mcast), ifa->ifa_name);
+				ifAddrs[mcastCount++] = addr;
+			}
+		}
+	}
+	freeifaddrs(ifList);
+	if (useBroadcast && (bcastCount == 0)) {
+		// NICが見つからなければ従来通りリミテッドブロードキャスト
+		_AddTarget(list, &count, max, BROADCAST_TRANSPORT_BROADCAST, htonl(INADDR_BROADCAST), port, 0, any);
+	}
+	if (useMulticast && (mcastCount == 0)) {
+		// マルチキャスト可能なNICが見つからなければ経路表に従う
+		_AddTarget(list, &count, max, BROADCAST_TRANSPORT_MULTICAST, mcast.s_addr, port, 0, any);
+		ifAddrs[mcastCount++] = any;
+	}
+	for (NSString* address in configured) {
+		in_addr_t addr = inet_addr(address.UTF8String);
+		if (addr != INADDR_NONE) {
+			_AddTarget(list, &count, max, BROADCAST_TRANSPORT_UNICAST, addr, port, 0, any);
+		}
+	}
+
+	if (useMulticast) {
+		// 越えられるルータ数（ループバックは既定のまま有効：自分のENTRYも受信する）
+		u_char ttl = (u_char)config.multicastTTL;
+		if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0) {
+			WRN(@"multicast TTL error(%u,%s)", ttl, strerror(errno));
+		}
+	}
+
+	@synchronized (self) {
+		free(targets);
+		targets		= list;
+		targetCount	= count;
+		free(locals);
+		locals		= localList;
+		localCount	= localNum;
+		self.portNo	= port;
+		[self joinGroup:mcast interfaces:ifAddrs count:(useMulticast ? mcastCount : 0) socket:sock];
+		self.multicastEnabled = useMulticast;
+	}
+	free(ifAddrs);
+	DBG(@"broadcast targets refreshed(%lu targets,port=%u,broadcast=%s,multicast=%s)",
+		count, port, BOOLSTR(useBroadcast), BOOLSTR(useMulticast));
+}
+
+// 送信先数
+- (NSUInteger)numberOfTargets
+{
+	@synchronized (self) {
+		return targetCount;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 送信
+ *----------------------------------------------------------------------------*/
+
+- (NSUInteger)sendPacket:(const void*)packet length:(size_t)len socket:(int)sock
+{
+	if (self.dialupDirty) {
+		[self rebuildDialupIndex];
+	}
+
+	struct iovec	iov;
+	struct msghdr	msg;
+	union {
+		struct cmsghdr	hdr;
+		char			buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+	} control;
+
+	iov.iov_base = (void*)packet;
+	iov.iov_len  = len;
+
+	NSUInteger counts[3] = { 0, 0, 0 };		// 経路毎送信数
+	@synchronized (self) {
+		// NIC毎の直接ブロードキャスト・マルチキャストは送出NICと送信元を指定（送信元ポートは受信ソケットのまま）
+		for (NSUInteger i = 0; i < targetCount; i++) {
+			_BroadcastTarget* t = &targets[i];
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name	= &t->addr;
+			msg.msg_namelen	= sizeof(t->addr);
+			msg.msg_iov		= &iov;
+			msg.msg_iovlen	= 1;
+			if (t->ifIndex != 0) {
+				memset(&control, 0, sizeof(control));
+				msg.msg_control		= control.buf;
+				msg.msg_controllen	= sizeof(control.buf);
+				struct cmsghdr* cmsg	= CMSG_FIRSTHDR(&msg);
+				cmsg->cmsg_level		= IPPROTO_IP;
+				cmsg->cmsg_type			= IP_PKTINFO;
+				cmsg->cmsg_len			= CMSG_LEN(sizeof(struct in_pktinfo));
+				struct in_pktinfo* info	= (struct in_pktinfo*)CMSG_DATA(cmsg);
+				info->ipi_ifindex		= t->ifIndex;
+				info->ipi_spec_dst		= t->source;
+			}
+			if (sendmsg(sock, &msg, 0) < 0) {
+				WRN(@"broadcast send error(%s,if=%u,%s)", inet_ntoa(t->addr.sin_addr), t->ifIndex, strerror(errno));
+			} else {
+				counts[t->transport]++;
+			}
+		}
+		// ダイアルアップユーザは個別送信
+		struct sockaddr_in to;
+		memset(&to, 0, sizeof(to));
+		to.sin_len		= sizeof(to);
+		to.sin_family	= AF_INET;
+		to.sin_port		= htons(self.portNo);
+		for (NSUInteger i = 0; i < dialupCount; i++) {
+			to.sin_addr.s_addr = dialups[i];
+			if (sendto(sock, packet, len, 0, (struct sockaddr*)&to, sizeof(to)) >= 0) {
+				counts[BROADCAST_TRANSPORT_UNICAST]++;
+			}
+		}
+	}
+	MetricsIncrement(METRICS_BROADCAST_SENT, counts[BROADCAST_TRANSPORT_BROADCAST]);
+	MetricsIncrement(METRICS_MULTICAST_SENT, counts[BROADCAST_TRANSPORT_MULTICAST]);
+	MetricsIncrement(METRICS_DIRECTED_SENT, counts[BROADCAST_TRANSPORT_UNICAST]);
+	return counts[0] + counts[1] + counts[2];
+}
+
+// 受信経路判定
+- (BroadcastTransport)transportForDestination:(struct in_addr)dst
+{
+	if (IN_MULTICAST(ntohl(dst.s_addr))) {
+		return BROADCAST_TRANSPORT_MULTICAST;
+	}
+	if (dst.s_addr == htonl(INADDR_BROADCAST)) {
+		return BROADCAST_TRANSPORT_BROADCAST;
+	}
+	@synchronized (self) {
+		for (NSUInteger i = 0; i < targetCount; i++) {
+			if ((targets[i].transport == BROADCAST_TRANSPORT_BROADCAST) && (targets[i].addr.sin_addr.s_addr == dst.s_addr)) {
+				return BROADCAST_TRANSPORT_BROADCAST;
+			}
+		}
+	}
+	return BROADCAST_TRANSPORT_UNICAST;
+}
+
+// 自マシンのアドレス判定
+- (BOOL)isLocalAddress:(struct in_addr)addr
+{
+	if ((ntohl(addr.s_addr) >> IN_CLASSA_NSHIFT) == IN_LOOPBACKNET) {
+		return YES;
+	}
+	@synchronized (self) {
+		for (NSUInteger i = 0; i < localCount; i++) {
+			if (locals[i] == addr.s_addr) {
+				return YES;
+			}
+		}
+	}
+	return NO;
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// マルチキャストグループ参加（前回の参加は解除する。ロック中に呼ぶ）
+- (void)joinGroup:(struct in_addr)newGroup interfaces:(struct in_addr*)list count:(NSUInteger)count socket:(int)sock
+{
+	struct ip_mreq mreq;
+	for (NSUInteger i = 0; i < joinedCount; i++) {
+		mreq.imr_multiaddr	= group;
+		mreq.imr_interface	= joined[i];
+		setsockopt(sock, IPPROTO_IP, IP_DROP_MEMBERSHIP, &mreq, sizeof(mreq));
+	}
+	free(joined);
+	joined		= NULL;
+	joinedCount	= 0;
+	group		= newGroup;
+	if (count == 0) {
+		return;
+	}
+	joined = calloc(count, sizeof(struct in_addr));
+	if (!joined) {
+		ERR(@"calloc error(%lu)", count);
+		return;
+	}
+	for (NSUInteger i = 0; i < count; i++) {
+		mreq.imr_multiaddr	= newGroup;
+		mreq.imr_interface	= list[i];
+		if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+			char ifStr[INET_ADDRSTRLEN];
+			inet_ntop(AF_INET, &list[i], ifStr, sizeof(ifStr));
+			WRN(@"multicast join error(if=%s,%s)", ifStr, strerror(errno));
+			continue;
+		}
+		joined[joinedCount++] = list[i];
+	}
+	DBG(@"multicast group %s joined(%lu interfaces)", inet_ntoa(newGroup), joinedCount);
+}
+
+// ユーザ一覧変更（次回送信時にダイアルアップ索引を作り直す）
+- (void)userListChanged:(NSNotification*)aNotification
+{
+	self.dialupDirty = YES;
+}
+
+// ダイアルアップ索引再作成
+- (void)rebuildDialupIndex
+{
+	self.dialupDirty = NO;
+	NSArray<UserInfo*>*	users	= UserManager.sharedManager.users;
+	in_addr_t*			list	= NULL;
+	NSUInteger			count	= 0;
+	for (UserInfo* user in users) {
+		if (!user.dialupConnect) {
+			continue;
+		}
+		if (!list) {
+			list = malloc(sizeof(in_addr_t) * users.count);
+			if (!list) {
+				ERR(@"malloc error(%lu)", users.count);
+				return;
+			}
+		}
+		list[count++] = user.address.sin_addr.s_addr;
+	}
+	@synchronized (self) {
+		free(dialups);
+		dialups		= list;
+		dialupCount	= count;
+	}
+	TRC(@"dialup index rebuilt(%lu users)", count);
+}
+
+@end
@@ -43,6 +43,10 @@ typedef NS_ENUM(NSInteger, IPMsgIconBoundType)
 @property(assign)	BOOL				dialup;						// ダイアルアップ接続
 @property(readonly)	NSArray<NSString*>*	broadcastAddresses;			// ブロードキャストアドレス一覧
 @property(readonly) NSUInteger			numberOfBroadcasts;			// ブロードキャストアドレス数
+@property(assign)	BOOL				hostListServer;				// ホストリスト配信（GETLISTに応答する）
+@property(copy)		NSString*			multicastAddress;			// マルチキャストグループ（空:使用しない）
+@property(assign)	NSUInteger			multicastTTL;				// マルチキャストTTL（越えられるルータ数）
+@property(assign)	BOOL				multicastWithBroadcast;		// マルチキャスト使用時もブロードキャストを併用（旧版向け）
 // アップデート
 @property(assign)	BOOL				updateAutomaticCheck;		// 更新自動チェック
 @property(assign)	NSTimeInterval		updateCheckInterval;		// 更新チェック間隔
@@ -59,6 +63,10 @@ typedef NS_ENUM(NSInteger, IPMsgIconBoundType)
 @property(assign)	BOOL				hideReceiveWindowOnReply;	// 送信時受信ウィンドウをクローズ
 @property(assign)	BOOL				noticeSealOpened;			// 開封確認を行う
 @property(assign)	BOOL				allowSendingToMultiUser;	// 複数ユーザ宛送信を許可
+@property(assign)	NSUInteger			largeMessageThreshold;		// 本文をTCPで受け渡すサイズ（バイト、0:しない）
+@property(assign)	NSUInteger			attachRateLimit;			// 添付送信帯域上限：全体（KB/秒、0:無制限）
+@property(assign)	NSUInteger			attachPeerRateLimit;		// 添付送信帯域上限：相手毎（KB/秒、0:無制限）
+@property(assign)	NSUInteger			attachTransferRateLimit;	// 添付送信帯域上限：転送毎（KB/秒、0:無制限）
 @property(retain)	NSFont*				sendMessageFont;			// 送信ウィンドウメッセージ部フォント
 @property(readonly)	NSFont*				defaultSendMessageFont;		// 送信ウィンドウメッセージ標準フォント
 // 受信
@@ -69,6 +77,7 @@ typedef NS_ENUM(NSInteger, IPMsgIconBoundType)
 @property(assign)	BOOL				nonPopupWhenAbsence;		// 不在時ノンポップアップ受信
 @property(assign)	IPMsgIconBoundType	iconBoundModeInNonPopup;	// ノンポップアップ受信時アイコンバウンド種別
 @property(assign)	BOOL				useClickableURL;			// クリッカブルURLを使用する
+@property(assign)	NSUInteger			downloadStreams;			// 大きな添付ファイルの最大同時接続数（1:分割しない）
 @property(retain)	NSFont*				receiveMessageFont;			// 受信ウィンドウメッセージ部フォント
 @property(readonly)	NSFont*				defaultReceiveMessageFont;	// 受信ウィンドウメッセージ標準フォント
 // ログ
@@ -78,6 +87,7 @@ typedef NS_ENUM(NSInteger, IPMsgIconBoundType)
 @property(assign)	BOOL				alternateLogEnabled;		// 重要ログを使用する
 @property(assign)	BOOL				logWithSelectedRange;		// 選択範囲を記録する
 @property(copy)		NSString*			alternateLogFile;			// 重要ログファイルパス
+@property(assign)	BOOL				logIndexEnabled;			// 検索用索引を作成する
 // 送受信ウィンドウ
 @property(assign)	NSSize				sendWindowSize;				// 送信ウィンドウサイズ
 @property(assign)	float				sendWindowSplit;			// 送信ウィンドウ分割位置
@@ -14,6 +14,7 @@
 
 #import "Config.h"
 #import "RefuseInfo.h"
+#import "RefuseMatcher.h"
 #import "DebugLog.h"
 
 /*============================================================================*
@@ -36,6 +37,10 @@ static NSString* GEN_USE_STATUS_BAR		= @"UseStatusBarMenu";
 static NSString* NET_PORT_NO			= @"PortNo";
 static NSString* NET_BROADCAST			= @"Broadcast";
 static NSString* NET_DIALUP				= @"Dialup";
+static NSString* NET_HOSTLIST_SERVER	= @"HostListServer";
+static NSString* NET_MULTICAST_ADDR		= @"MulticastAddress";
+static NSString* NET_MULTICAST_TTL		= @"MulticastTTL";
+static NSString* NET_MULTICAST_BCAST	= @"MulticastWithBroadcast";
 
 // 送信
 static NSString* SEND_QUOT_STR			= @"QuotationString";
@@ -44,6 +49,10 @@ static NSString* SEND_SEAL_CHECK		= @"SealCheckDefaultOn";
 static NSString* SEND_HIDE_REPLY		= @"HideRecieveWindowWhenSendReply";
 static NSString* SEND_OPENSEAL_CHECK	= @"CheckSealOpened";
 static NSString* SEND_MULTI_USER_CHECK	= @"AllowSendingToMutipleUser";
+static NSString* SEND_LARGE_MSG_SIZE	= @"LargeMessageThreshold";
+static NSString* SEND_ATTACH_RATE		= @"AttachRateLimit";
+static NSString* SEND_ATTACH_PEER_RATE	= @"AttachPeerRateLimit";
+static NSString* SEND_ATTACH_XFER_RATE	= @"AttachTransferRateLimit";
 static NSString* SEND_MSG_FONT_NAME		= @"SendMessageFontName";
 static NSString* SEND_MSG_FONT_SIZE		= @"SendMessageFontSize";
 
@@ -54,6 +63,7 @@ static NSString* RECV_NON_POPUP			= @"NonPopupReceive";
 static NSString* RECV_ABSENCE_NONPOPUP	= @"NonPopupReceiveWhenAbsenceMode";
 static NSString* RECV_BOUND_IN_NONPOPUP	= @"DockIconBoundInNonPopupReceive";
 static NSString* RECV_CLICKABLE_URL		= @"UseClickableURL";
+static NSString* RECV_DL_STREAMS		= @"DownloadStreams";
 static NSString* RECV_MSG_FONT_NAME		= @"ReceiveMessageFontName";
 static NSString* RECV_MSG_FONT_SIZE		= @"ReceiveMessageFontSize";
 
@@ -70,6 +80,7 @@ static NSString* LOG_STD_FILE			= @"StandardLogFile";
 static NSString* LOG_ALT_ON				= @"AlternateLogEnabled";
 static NSString* LOG_ALT_SELECTION		= @"AlternateLogWithSelectedRange";
 static NSString* LOG_ALT_FILE			= @"AlternateLogFile";
+static NSString* LOG_INDEX_ON			= @"LogIndexEnabled";
 
 // ウィンドウ位置／サイズ／設定
 static NSString* RCVWIN_SIZE_W			= @"ReceiveWindowWidth";
@@ -83,6 +94,9 @@ static NSString* SNDSEARCH_GROUP		= @"SendWindowSearchByGroupName";
 static NSString* SNDSEARCH_HOST			= @"SendWindowSearchByHostName";
 static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 
+// 稼働中も反映する設定（defaultsコマンド等による変更を監視）
+static void* _RateLimitObserveContext	= &_RateLimitObserveContext;
+
 @interface Config() {
 	NSMutableDictionary*	sendUserListColDisp;
 	NSFont*					sendWindowMessageFont;
@@ -96,6 +110,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 @property(retain)	NSMutableArray<NSDictionary*>*	absenceList;
 @property(retain)	NSSound*						receiveSound;
 @property(retain)	NSMutableArray<RefuseInfo*>*	refuseList;
+@property(retain)	RefuseMatcher*					refuseMatcher;
 
 - (NSMutableArray<RefuseInfo*>*)convertRefuseDefaultsToInfo:(NSArray<NSDictionary*>*)array;
 - (NSArray<NSDictionary*>*)convertRefuseInfoToDefaults:(NSArray<RefuseInfo*>*)array;
@@ -157,6 +172,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 		// ネットワーク
 		NET_PORT_NO				: @2425,
 		NET_DIALUP				: @NO,
+		NET_HOSTLIST_SERVER		: @NO,
+		NET_MULTICAST_ADDR		: @"",
+		NET_MULTICAST_TTL		: @8,
+		NET_MULTICAST_BCAST		: @YES,
 		// 送信
 		SEND_QUOT_STR			: @">",
 		SEND_DOCK_SEND			: @NO,
@@ -164,6 +183,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 		SEND_HIDE_REPLY			: @YES,
 		SEND_OPENSEAL_CHECK		: @YES,
 		SEND_MULTI_USER_CHECK	: @YES,
+		SEND_LARGE_MSG_SIZE		: @8192,
+		SEND_ATTACH_RATE		: @0,
+		SEND_ATTACH_PEER_RATE	: @0,
+		SEND_ATTACH_XFER_RATE	: @0,
 		// 受信
 		RECV_SOUND				: @"",
 		RECV_QUOT_CHECK			: @YES,
@@ -171,6 +194,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 		RECV_BOUND_IN_NONPOPUP	: @(IPMSG_BOUND_ONECE),
 		RECV_ABSENCE_NONPOPUP	: @NO,
 		RECV_CLICKABLE_URL		: @YES,
+		RECV_DL_STREAMS			: @8,
 		// ログ
 		LOG_STD_ON				: @YES,
 		LOG_STD_CHAIN			: @YES,
@@ -178,6 +202,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 		LOG_ALT_ON				: @YES,
 		LOG_ALT_SELECTION		: @NO,
 		LOG_ALT_FILE			: @"~/Documents/ipmsg_alt_log.txt",
+		LOG_INDEX_ON			: @NO,
 		// 送信ウィンドウ
 		SNDSEARCH_USER			: @YES,
 		SNDSEARCH_GROUP			: @YES,
@@ -238,6 +263,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	// ネットワーク
 	_portNo						= [defaults integerForKey:NET_PORT_NO];
 	_dialup						= [defaults boolForKey:NET_DIALUP];
+	_hostListServer				= [defaults boolForKey:NET_HOSTLIST_SERVER];
+	_multicastAddress			= [[defaults stringForKey:NET_MULTICAST_ADDR] copy];
+	_multicastTTL				= (NSUInteger)MIN(MAX([defaults integerForKey:NET_MULTICAST_TTL], 1), 255);
+	_multicastWithBroadcast		= [defaults boolForKey:NET_MULTICAST_BCAST];
 	dic							= [defaults dictionaryForKey:NET_BROADCAST];
 	_broadcastHostList			= [[NSMutableArray alloc] initWithArray:dic[@"Host"]];
 	_broadcastIPList			= [[NSMutableArray alloc] initWithArray:dic[@"IPAddress"]];
@@ -248,6 +277,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	_hideReceiveWindowOnReply	= [defaults boolForKey:SEND_HIDE_REPLY];
 	_noticeSealOpened			= [defaults boolForKey:SEND_OPENSEAL_CHECK];
 	_allowSendingToMultiUser	= [defaults boolForKey:SEND_MULTI_USER_CHECK];
+	_largeMessageThreshold		= (NSUInteger)MAX([defaults integerForKey:SEND_LARGE_MSG_SIZE], 0);
+	_attachRateLimit			= (NSUInteger)MAX([defaults integerForKey:SEND_ATTACH_RATE], 0);
+	_attachPeerRateLimit		= (NSUInteger)MAX([defaults integerForKey:SEND_ATTACH_PEER_RATE], 0);
+	_attachTransferRateLimit	= (NSUInteger)MAX([defaults integerForKey:SEND_ATTACH_XFER_RATE], 0);
 	str							= [defaults stringForKey:SEND_MSG_FONT_NAME];
 	fVal						= [defaults floatForKey:SEND_MSG_FONT_SIZE];
 	if (str && (fVal > 0)) {
@@ -261,6 +294,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	_nonPopupWhenAbsence		= [defaults boolForKey:RECV_ABSENCE_NONPOPUP];
 	_iconBoundModeInNonPopup	= [defaults integerForKey:RECV_BOUND_IN_NONPOPUP];
 	_useClickableURL			= [defaults boolForKey:RECV_CLICKABLE_URL];
+	_downloadStreams			= (NSUInteger)MIN(MAX([defaults integerForKey:RECV_DL_STREAMS], 1), 16);
 	str							= [defaults stringForKey:RECV_MSG_FONT_NAME];
 	fVal						= [defaults floatForKey:RECV_MSG_FONT_SIZE];
 	if (str && (fVal > 0)) {
@@ -283,6 +317,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	_alternateLogEnabled		= [defaults boolForKey:LOG_ALT_ON];
 	_logWithSelectedRange		= [defaults boolForKey:LOG_ALT_SELECTION];
 	_alternateLogFile			= [defaults stringForKey:LOG_ALT_FILE];
+	_logIndexEnabled			= [defaults boolForKey:LOG_INDEX_ON];
 
 	// 送受信ウィンドウ
 	size.width					= [defaults floatForKey:SNDWIN_SIZE_W];
@@ -393,12 +428,21 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 
 	DBG(@"======== Init Config complated ========");
 
+	// 添付送信帯域上限は設定画面がないため、外部からの変更を監視して反映する
+	for (NSString* key in @[SEND_ATTACH_RATE, SEND_ATTACH_PEER_RATE, SEND_ATTACH_XFER_RATE]) {
+		[defaults addObserver:self forKeyPath:key options:0 context:_RateLimitObserveContext];
+	}
+
 	return self;
 }
 
 // 解放
 - (void)dealloc
 {
+	NSUserDefaults* defaults = NSUserDefaults.standardUserDefaults;
+	for (NSString* key in @[SEND_ATTACH_RATE, SEND_ATTACH_PEER_RATE, SEND_ATTACH_XFER_RATE]) {
+		[defaults removeObserver:self forKeyPath:key context:_RateLimitObserveContext];
+	}
 	[_userName release];
 	[_groupName release];
 	[_password release];
@@ -406,9 +450,11 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	[_rsa2048PublicKeyModulus release];
 	[_broadcastHostList release];
 	[_broadcastIPList release];
+	[_multicastAddress release];
 	[_quoteString release];
 	[_absenceList release];
 	[_refuseList release];
+	[_refuseMatcher release];
 	[sendWindowMessageFont release];
 	[sendUserListColDisp release];
 	[_receiveSound release];
@@ -445,6 +491,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	// ネットワーク
 	[def setInteger:self.portNo forKey:NET_PORT_NO];
 	[def setBool:self.dialup forKey:NET_DIALUP];
+	[def setBool:self.hostListServer forKey:NET_HOSTLIST_SERVER];
+	[def setObject:self.multicastAddress forKey:NET_MULTICAST_ADDR];
+	[def setInteger:self.multicastTTL forKey:NET_MULTICAST_TTL];
+	[def setBool:self.multicastWithBroadcast forKey:NET_MULTICAST_BCAST];
 	[def setObject:@{@"Host":self.broadcastHostList,
 					 @"IPAddress":self.broadcastIPList}
 			forKey:NET_BROADCAST];
@@ -456,6 +506,10 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	[def setBool:self.hideReceiveWindowOnReply forKey:SEND_HIDE_REPLY];
 	[def setBool:self.noticeSealOpened forKey:SEND_OPENSEAL_CHECK];
 	[def setBool:self.allowSendingToMultiUser forKey:SEND_MULTI_USER_CHECK];
+	[def setInteger:self.largeMessageThreshold forKey:SEND_LARGE_MSG_SIZE];
+	[def setInteger:self.attachRateLimit forKey:SEND_ATTACH_RATE];
+	[def setInteger:self.attachPeerRateLimit forKey:SEND_ATTACH_PEER_RATE];
+	[def setInteger:self.attachTransferRateLimit forKey:SEND_ATTACH_XFER_RATE];
 	if (self.sendMessageFont) {
 		[def setObject:self.sendMessageFont.fontName forKey:SEND_MSG_FONT_NAME];
 		[def setFloat:self.sendMessageFont.pointSize forKey:SEND_MSG_FONT_SIZE];
@@ -467,6 +521,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	[def setBool:self.nonPopupWhenAbsence forKey:RECV_ABSENCE_NONPOPUP];
 	[def setInteger:self.iconBoundModeInNonPopup forKey:RECV_BOUND_IN_NONPOPUP];
 	[def setBool:self.useClickableURL forKey:RECV_CLICKABLE_URL];
+	[def setInteger:self.downloadStreams forKey:RECV_DL_STREAMS];
 	if (self.receiveMessageFont) {
 		[def setObject:self.receiveMessageFont.fontName forKey:RECV_MSG_FONT_NAME];
 		[def setFloat:self.receiveMessageFont.pointSize forKey:RECV_MSG_FONT_SIZE];
@@ -488,6 +543,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	[def setBool:self.alternateLogEnabled forKey:LOG_ALT_ON];
 	[def setBool:self.logWithSelectedRange forKey:LOG_ALT_SELECTION];
 	[def setObject:self.alternateLogFile forKey:LOG_ALT_FILE];
+	[def setBool:self.logIndexEnabled forKey:LOG_INDEX_ON];
 
 	// 送受信ウィンドウ位置／サイズ
 	[def setFloat:self.sendWindowSize.width forKey:SNDWIN_SIZE_W];
@@ -681,6 +737,27 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	sendUserListColDisp[identifier] = @(!hidden);
 }
 
+// 添付送信帯域上限の変更反映（送信中の転送にも次の送信単位から反映される）
+- (void)observeValueForKeyPath:(NSString*)keyPath
+					  ofObject:(id)object
+						change:(NSDictionary<NSKeyValueChangeKey,id>*)change
+					   context:(void*)context
+{
+	if (context != _RateLimitObserveContext) {
+		[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+		return;
+	}
+	NSInteger val = MAX([NSUserDefaults.standardUserDefaults integerForKey:keyPath], 0);
+	if ([keyPath isEqualToString:SEND_ATTACH_RATE]) {
+		self.attachRateLimit = (NSUInteger)val;
+	} else if ([keyPath isEqualToString:SEND_ATTACH_PEER_RATE]) {
+		self.attachPeerRateLimit = (NSUInteger)val;
+	} else if ([keyPath isEqualToString:SEND_ATTACH_XFER_RATE]) {
+		self.attachTransferRateLimit = (NSUInteger)val;
+	}
+	DBG(@"rate limit changed(%@=%ld)", keyPath, val);
+}
+
 /*----------------------------------------------------------------------------*
  * 「受信」関連
  *----------------------------------------------------------------------------*/
@@ -891,6 +968,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	@try {
 		@synchronized (self.refuseList) {
 			[self.refuseList addObject:info];
+			self.refuseMatcher = nil;
 		}
 	} @catch (NSException* exception) {
 		ERR(@"%@(info=%@)", exception, info);
@@ -902,6 +980,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	@try {
 		@synchronized (self.refuseList) {
 			[self.refuseList insertObject:info atIndex:index];
+			self.refuseMatcher = nil;
 		}
 	} @catch (NSException* exception) {
 		ERR(@"%@(info=%@,index=%lu)", exception, info, index);
@@ -913,6 +992,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	@try {
 		@synchronized (self.refuseList) {
 			[self.refuseList replaceObjectAtIndex:index withObject:info];
+			self.refuseMatcher = nil;
 		}
 	} @catch (NSException* exception) {
 		ERR(@"%@(info=%@,index=%lu)", exception, info, index);
@@ -926,6 +1006,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 			RefuseInfo* obj = [self.refuseList[index] retain];
 			[self.refuseList removeObjectAtIndex:index];
 			[self.refuseList insertObject:obj atIndex:index - 1];
+			self.refuseMatcher = nil;
 			[obj release];
 		}
 	} @catch (NSException* exception) {
@@ -940,6 +1021,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 			RefuseInfo* obj = [self.refuseList[index] retain];
 			[self.refuseList removeObjectAtIndex:index];
 			[self.refuseList insertObject:obj atIndex:index + 1];
+			self.refuseMatcher = nil;
 			[obj release];
 		}
 	} @catch (NSException* exception) {
@@ -952,6 +1034,7 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 	@try {
 		@synchronized (self.refuseList) {
 			[self.refuseList removeObjectAtIndex:index];
+			self.refuseMatcher = nil;
 		}
 	} @catch (NSException* exception) {
 		ERR(@"%@(index=%lu)", exception, index);
@@ -961,13 +1044,33 @@ static NSString* SNDSEARCH_LOGON		= @"SendWindowSearchByLogOnName";
 - (BOOL)matchRefuseCondition:(UserInfo*)user
 {
 	@synchronized (self.refuseList) {
-		for (RefuseInfo* info in self.refuseList) {
-			if ([info match:user]) {
-				return YES;
-			}
+		// 判定構造は拒否条件変更後の初回判定時にのみ再構築
+		if (!self.refuseMatcher) {
+			self.refuseMatcher = [RefuseMatcher matcherWithRefuseList:self.refuseList];
 		}
+		#ifdef IPMSG_LOG_TRC_ENABLED
+			// 従来の条件毎判定との結果／処理時間比較
+			NSDate*	start	= [NSDate date];
+			BOOL	legacy	= NO;
+			for (RefuseInfo* info in self.refuseList) {
+				if ([info match:user]) {
+					legacy = YES;
+					break;
+				}
+			}
+			NSTimeInterval	t1		= -start.timeIntervalSinceNow;
+			BOOL			ret		= [self.refuseMatcher match:user];
+			NSTimeInterval	t2		= -start.timeIntervalSinceNow - t1;
+			TRC(@"refuse match(%@,rules=%lu,legacy=%s:%.1fus,compiled=%s:%.1fus)", user,
+				self.refuseList.count, BOOLSTR(legacy), t1 * 1000000.0, BOOLSTR(ret), t2 * 1000000.0);
+			if (ret != legacy) {
+				ERR(@"refuse match mismatch(%@)", user);
+			}
+			return ret;
+		#else
+			return [self.refuseMatcher match:user];
+		#endif
 	}
-	return NO;
 }
 
 /*----------------------------------------------------------------------------*
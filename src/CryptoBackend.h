@@ -0,0 +1,68 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: CryptoBackend.h
+ *	Module		: 暗号処理実装クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import <Security/Security.h>
+
+@class RSAPublicKey;
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 共通鍵暗号方式
+typedef NS_ENUM(NSInteger, CryptoCipher)
+{
+	CRYPTO_CIPHER_AES256,			// AES256(CBC,PKCS7)
+	CRYPTO_CIPHER_BLOWFISH128		// Blowfish128(CBC,PKCS7)
+};
+
+// 署名ダイジェスト方式
+typedef NS_ENUM(NSInteger, CryptoDigest)
+{
+	CRYPTO_DIGEST_SHA1,
+	CRYPTO_DIGEST_SHA256
+};
+
+/*============================================================================*
+ * プロトコル定義
+ *============================================================================*/
+
+// 暗号処理実装（CryptoManagerから差し替え可能）
+@protocol CryptoBackend <NSObject>
+
+@property(readonly)	NSString*	name;		// 実装名（ログ用）
+@property(readonly)	BOOL		supportGCM;	// AES256-GCM利用可否
+
+// 秘密鍵登録（鍵チェーンの鍵を渡し、以降はbitSizeで指定する）
+- (BOOL)setPrivateKey:(SecKeyRef)key bitSize:(NSInteger)bitSize;
+
+// 公開鍵暗号
+- (NSData*)encryptRSA:(NSData*)srcData key:(RSAPublicKey*)key;
+- (NSData*)decryptRSA:(NSData*)srcData bitSize:(NSInteger)bitSize;
+
+// 署名
+- (NSData*)sign:(NSData*)data digest:(CryptoDigest)digest bitSize:(NSInteger)bitSize;
+- (BOOL)verify:(NSData*)sign data:(NSData*)data digest:(CryptoDigest)digest key:(RSAPublicKey*)key;
+
+// 共通鍵暗号（鍵長チェック済みで呼ばれる）
+- (NSData*)crypt:(NSData*)srcData cipher:(CryptoCipher)cipher encrypt:(BOOL)encrypt key:(NSData*)key iv:(NSData*)iv;
+
+// 認証付き暗号（AES256-GCM。暗号文の末尾に認証タグを付加し、復号時にタグ不一致ならnil）
+- (NSData*)sealGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad;
+- (NSData*)openGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad;
+
+@end
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// Security.framework／CommonCrypto実装（標準）
+@interface SystemCryptoBackend : NSObject <CryptoBackend>
+@end
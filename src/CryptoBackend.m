@@ -0,0 +1,524 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: CryptoBackend.m
+ *	Module		: 暗号処理実装クラス
+ *============================================================================*/
+
+#import "CryptoBackend.h"
+#import "RSAPublicKey.h"
+#import "DebugLog.h"
+
+#import <CommonCrypto/CommonCrypto.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _CRYPTOR_CACHE	(4)			// 使い回す共通鍵暗号コンテキスト数
+#define _CRYPTOR_KEY_MAX	(32)		// 使い回し対象の最大鍵長（AES256）
+#define _GCM_TAG_SIZE	(16)		// GCM認証タグ長
+#define _GCM_BLOCK_SIZE	(16)		// GCMブロック長
+#define _GCM_BATCH		(64)		// 鍵ストリームを一度に作るブロック数
+
+/*============================================================================*
+ * ローカル関数（AES-GCM）
+ *		CommonCryptoの公開APIにはGCMがないため、公開APIのAES-ECBで
+ *		カウンタブロックとハッシュ鍵を作り、GHASHは自前で計算する（SP800-38D）
+ *============================================================================*/
+
+// 128bitブロック（ビッグエンディアンで上位・下位64bit）
+typedef struct {
+	uint64_t	hi;
+	uint64_t	lo;
+} _Block128;
+
+static _Block128 _BlockLoad(const uint8_t* p)
+{
+	_Block128 b = { 0, 0 };
+	for (int i = 0; i < 8; i++) {
+		b.hi = (b.hi << 8) | p[i];
+		b.lo = (b.lo << 8) | p[i + 8];
+	}
+	return b;
+}
+
+static void _BlockStore(_Block128 b, uint8_t* p)
+{
+	for (int i = 7; i >= 0; i--) {
+		p[i]		= (uint8_t)b.hi;
+		p[i + 8]	= (uint8_t)b.lo;
+		b.hi >>= 8;
+		b.lo >>= 8;
+	}
+}
+
+// GF(2^128)乗算（分岐なし）
+static _Block128 _GFMul(_Block128 x, _Block128 h)
+{
+	_Block128 z = { 0, 0 };
+	_Block128 v = h;
+	for (int i = 0; i < 128; i++) {
+		uint64_t bit	= (i < 64) ? ((x.hi >> (63 - i)) & 1) : ((x.lo >> (127 - i)) & 1);
+		uint64_t mask	= 0 - bit;
+		z.hi ^= v.hi & mask;
+		z.lo ^= v.lo & mask;
+		uint64_t lsb	= v.lo & 1;
+		v.lo = (v.lo >> 1) | (v.hi << 63);
+		v.hi = (v.hi >> 1) ^ (0xE100000000000000ULL & (0 - lsb));
+	}
+	return z;
+}
+
+// GHASH更新（末尾の端数ブロックは0詰め）
+static void _GHashUpdate(_Block128* y, _Block128 h, const uint8_t* data, size_t len)
+{
+	while (len > 0) {
+		uint8_t	block[_GCM_BLOCK_SIZE] = { 0 };
+		size_t	n = MIN(len, sizeof(block));
+		memcpy(block, data, n);
+		_Block128 b = _BlockLoad(block);
+		y->hi ^= b.hi;
+		y->lo ^= b.lo;
+		*y = _GFMul(*y, h);
+		data	+= n;
+		len		-= n;
+	}
+}
+
+// GHASH長さブロック
+static void _GHashLength(_Block128* y, _Block128 h, UInt64 len1, UInt64 len2)
+{
+	y->hi ^= len1 * 8;
+	y->lo ^= len2 * 8;
+	*y = _GFMul(*y, h);
+}
+
+// カウンタ更新（下位32bitのみ）
+static void _Inc32(uint8_t* ctr)
+{
+	for (int i = _GCM_BLOCK_SIZE - 1; i >= _GCM_BLOCK_SIZE - 4; i--) {
+		if (++ctr[i] != 0) {
+			break;
+		}
+	}
+}
+
+// AES-GCM処理（暗号化・復号共通。inを変換してoutへ、計算した認証タグをtagへ）
+static BOOL _AESGCM(BOOL encrypt, NSData* key, NSData* iv, NSData* aad,
+					const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag)
+{
+	CCCryptorRef	ecb		= NULL;
+	CCCryptorStatus	ret		= CCCryptorCreate(kCCEncrypt, kCCAlgorithmAES, kCCOptionECBMode,
+											  key.bytes, key.length, NULL, &ecb);
+	if (ret != kCCSuccess) {
+		ERR(@"AES-GCM key setup failed(ret=%d,keyLen=%lu)", ret, key.length);
+		return NO;
+	}
+	uint8_t		block[_GCM_BLOCK_SIZE]	= { 0 };
+	uint8_t		j0[_GCM_BLOCK_SIZE]		= { 0 };
+	uint8_t		ctr[_GCM_BLOCK_SIZE];
+	uint8_t		stream[_GCM_BLOCK_SIZE * _GCM_BATCH];
+	size_t		moved;
+
+	// ハッシュ鍵 H = E(K, 0)
+	ret = CCCryptorUpdate(ecb, block, sizeof(block), block, sizeof(block), &moved);
+	_Block128 h = _BlockLoad(block);
+
+	// 初期カウンタ J0（96bitはIV||1、それ以外はIVのGHASH）
+	if (iv.length == 12) {
+		memcpy(j0, iv.bytes, 12);
+		j0[_GCM_BLOCK_SIZE - 1] = 1;
+	} else {
+		_Block128 y = { 0, 0 };
+		_GHashUpdate(&y, h, iv.bytes, iv.length);
+		_GHashLength(&y, h, 0, iv.length);
+		_BlockStore(y, j0);
+	}
+
+	// 鍵ストリームとの排他的論理和（カウンタ J0+1 から）
+	memcpy(ctr, j0, sizeof(ctr));
+	for (size_t off = 0; (off < len) && (ret == kCCSuccess); ) {
+		size_t n		= MIN(len - off, sizeof(stream));
+		size_t blocks	= (n + _GCM_BLOCK_SIZE - 1) / _GCM_BLOCK_SIZE;
+		for (size_t b = 0; b < blocks; b++) {
+			_Inc32(ctr);
+			memcpy(&stream[b * _GCM_BLOCK_SIZE], ctr, _GCM_BLOCK_SIZE);
+		}
+		ret = CCCryptorUpdate(ecb, stream, blocks * _GCM_BLOCK_SIZE, stream, sizeof(stream), &moved);
+		for (size_t i = 0; i < n; i++) {
+			out[off + i] = in[off + i] ^ stream[i];
+		}
+		off += n;
+	}
+
+	// 認証タグ T = E(K, J0) xor GHASH(A, C)
+	_Block128 s = { 0, 0 };
+	_GHashUpdate(&s, h, aad.bytes, aad.length);
+	_GHashUpdate(&s, h, encrypt ? out : in, len);
+	_GHashLength(&s, h, aad.length, len);
+	if (ret == kCCSuccess) {
+		memcpy(block, j0, sizeof(block));
+		ret = CCCryptorUpdate(ecb, block, sizeof(block), block, sizeof(block), &moved);
+	}
+	_Block128 t = _BlockLoad(block);
+	t.hi ^= s.hi;
+	t.lo ^= s.lo;
+	_BlockStore(t, tag);
+
+	memset(stream, 0, sizeof(stream));
+	CCCryptorRelease(ecb);
+	if (ret != kCCSuccess) {
+		ERR(@"AES-GCM block encrypt failed(ret=%d)", ret);
+		return NO;
+	}
+	return YES;
+}
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 署名方式
+static SecKeyAlgorithm _SignAlgorithm(CryptoDigest digest)
+{
+	return (digest == CRYPTO_DIGEST_SHA256) ? kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256
+											: kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1;
+}
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+// 共通鍵暗号コンテキスト（同じ方式・鍵ならCCCryptorResetでIVだけ差し替えて使い回す）
+typedef struct {
+	CCCryptorRef	cryptor;
+	CCOperation		op;
+	CCAlgorithm		alg;
+	size_t			keyLen;
+	uint8_t			key[_CRYPTOR_KEY_MAX];
+	uint64_t		lastUse;					// 最終使用順（追い出し判定用）
+} _CryptorEntry;
+
+@interface SystemCryptoBackend()
+{
+	SecKeyRef		privateKey2048;
+	SecKeyRef		privateKey1024;
+	_CryptorEntry	cryptors[_CRYPTOR_CACHE];
+	uint64_t		cryptorUse;
+	NSLock*			cryptorLock;
+}
+
+- (SecKeyRef)privateKeyForBitSize:(NSInteger)bitSize;
+- (CCCryptorRef)cryptorFor:(CCOperation)op algorithm:(CCAlgorithm)alg key:(NSData*)key iv:(NSData*)iv;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation SystemCryptoBackend
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		cryptorLock = [[NSLock alloc] init];
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	if (privateKey2048) {
+		CFRelease(privateKey2048);
+	}
+	if (privateKey1024) {
+		CFRelease(privateKey1024);
+	}
+	for (NSUInteger i = 0; i < _CRYPTOR_CACHE; i++) {
+		if (cryptors[i].cryptor) {
+			CCCryptorRelease(cryptors[i].cryptor);
+		}
+	}
+	memset(cryptors, 0, sizeof(cryptors));
+	[cryptorLock release];
+	[super dealloc];
+}
+
+// 実装名
+- (NSString*)name
+{
+	return @"Security.framework/CommonCrypto";
+}
+
+// AES256-GCM利用可否（自前構成のGCMは既知解テストでの確認のみで検証済みの実装ではないため、
+// 検証済みのAEADが使えるようになるまでは相手に通知しない）
+- (BOOL)supportGCM
+{
+	return NO;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 秘密鍵
+/*----------------------------------------------------------------------------*/
+
+// 秘密鍵登録（鍵チェーンの鍵参照を保持して使う。鍵の値はプロセス内に取り出さない）
+- (BOOL)setPrivateKey:(SecKeyRef)key bitSize:(NSInteger)bitSize
+{
+	SecKeyRef session = (SecKeyRef)CFRetain(key);
+	@synchronized (self) {
+		SecKeyRef* slot = NULL;
+		switch (bitSize) {
+		case 2048:
+			slot = &privateKey2048;
+			break;
+		case 1024:
+			slot = &privateKey1024;
+			break;
+		default:
+			ERR(@"Unsupported keySize(%ld)", bitSize);
+			CFRelease(session);
+			return NO;
+		}
+		if (*slot) {
+			CFRelease(*slot);
+		}
+		*slot = session;
+	}
+	return YES;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 公開鍵暗号
+/*----------------------------------------------------------------------------*/
+
+// RSA暗号化
+- (NSData*)encryptRSA:(NSData*)srcData key:(RSAPublicKey*)key
+{
+	CFErrorRef	error		= NULL;
+	CFDataRef	resultData	= SecKeyCreateEncryptedData(key.nativeKey,
+														kSecKeyAlgorithmRSAEncryptionPKCS1,
+														(__bridge CFDataRef)srcData,
+														&error);
+	if (!resultData) {
+		ERR(@"EncryptError(%@)", (__bridge NSError*)error);
+		CFRelease(error);
+		return nil;
+	}
+	return [(__bridge NSData*)resultData autorelease];
+}
+
+// RSA復号化
+- (NSData*)decryptRSA:(NSData*)srcData bitSize:(NSInteger)bitSize
+{
+	SecKeyRef privateKey = [self privateKeyForBitSize:bitSize];
+	if (!privateKey) {
+		ERR(@"Unsupported keySize(%ld)", bitSize);
+		return nil;
+	}
+	CFErrorRef	error		= NULL;
+	CFDataRef	resultData	= SecKeyCreateDecryptedData(privateKey,
+														kSecKeyAlgorithmRSAEncryptionPKCS1,
+														(__bridge CFDataRef)srcData,
+														&error);
+	CFRelease(privateKey);
+	if (!resultData) {
+		ERR(@"DecryptError(%@)", (__bridge NSError*)error);
+		CFRelease(error);
+		return nil;
+	}
+	return [(__bridge NSData*)resultData autorelease];
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 署名
+/*----------------------------------------------------------------------------*/
+
+// 署名作成
+- (NSData*)sign:(NSData*)data digest:(CryptoDigest)digest bitSize:(NSInteger)bitSize
+{
+	SecKeyRef privateKey = [self privateKeyForBitSize:bitSize];
+	if (!privateKey) {
+		ERR(@"invalid privateKeyBitSize(%ld)", bitSize);
+		return nil;
+	}
+	SecKeyAlgorithm	algorithm	= _SignAlgorithm(digest);
+	CFErrorRef		error		= NULL;
+	CFDataRef		resultData	= SecKeyCreateSignature(privateKey,
+														algorithm,
+														(__bridge CFDataRef)data,
+														&error);
+	CFRelease(privateKey);
+	if (!resultData) {
+		ERR(@"CreateSignature Error(algo=%@,%@)", (__bridge NSString*)algorithm, (__bridge NSError*)error);
+		CFRelease(error);
+		return nil;
+	}
+	return [(__bridge NSData*)resultData autorelease];
+}
+
+// 署名検証
+- (BOOL)verify:(NSData*)sign data:(NSData*)data digest:(CryptoDigest)digest key:(RSAPublicKey*)key
+{
+	SecKeyAlgorithm	algorithm	= _SignAlgorithm(digest);
+	CFErrorRef		error		= NULL;
+	Boolean result = SecKeyVerifySignature(key.nativeKey,
+										   algorithm,
+										   (__bridge CFDataRef)data,
+										   (__bridge CFDataRef)sign,
+										   &error);
+	if (!result) {
+		ERR(@"VerifySignature Error(algo=%@,%@)", (__bridge NSString*)algorithm, (__bridge NSError*)error);
+		CFRelease(error);
+		return NO;
+	}
+	return YES;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 共通鍵暗号
+/*----------------------------------------------------------------------------*/
+
+// 暗号化／復号化（AESはCommonCrypto内でハードウェア命令が使われる）
+- (NSData*)crypt:(NSData*)srcData cipher:(CryptoCipher)cipher encrypt:(BOOL)encrypt key:(NSData*)key iv:(NSData*)iv
+{
+	CCAlgorithm	alg		= (cipher == CRYPTO_CIPHER_AES256) ? kCCAlgorithmAES : kCCAlgorithmBlowfish;
+	const char*	name	= (cipher == CRYPTO_CIPHER_AES256) ? "AES" : "Blowfish";
+	CCOperation	op		= encrypt ? kCCEncrypt : kCCDecrypt;
+
+	// コンテキストは使い回し（使用中はロックで占有）、出力は必要量だけ確保する
+	[cryptorLock lock];
+	CCCryptorRef cryptor = [self cryptorFor:op algorithm:alg key:key iv:iv];
+	if (!cryptor) {
+		[cryptorLock unlock];
+		ERR(@"CCCryptorCreate(%s) failed", name);
+		return nil;
+	}
+	size_t			bufSize	= CCCryptorGetOutputLength(cryptor, srcData.length, true);
+	NSMutableData*	result	= [NSMutableData dataWithLength:bufSize];
+	size_t			moved1	= 0;
+	size_t			moved2	= 0;
+	CCCryptorStatus	ret		= CCCryptorUpdate(cryptor, srcData.bytes, srcData.length, result.mutableBytes, bufSize, &moved1);
+	if (ret == kCCSuccess) {
+		ret = CCCryptorFinal(cryptor, &((char*)result.mutableBytes)[moved1], bufSize - moved1, &moved2);
+	}
+	[cryptorLock unlock];
+	if (ret != kCCSuccess) {
+		ERR(@"CCCrypt(%s) failed(ret=%d)", name, ret);
+		return nil;
+	}
+	result.length = moved1 + moved2;
+	return result;
+}
+
+// AES256-GCM暗号化（出力は暗号文＋認証タグ）
+- (NSData*)sealGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad
+{
+	if (iv.length == 0) {
+		ERR(@"AES-GCM iv empty");
+		return nil;
+	}
+	NSMutableData*	result	= [NSMutableData dataWithLength:srcData.length + _GCM_TAG_SIZE];
+	uint8_t*		out		= result.mutableBytes;
+	if (!_AESGCM(YES, key, iv, aad, srcData.bytes, srcData.length, out, &out[srcData.length])) {
+		return nil;
+	}
+	return result;
+}
+
+// AES256-GCM復号化（認証タグ検証込み）
+- (NSData*)openGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad
+{
+	if ((srcData.length < _GCM_TAG_SIZE) || (iv.length == 0)) {
+		ERR(@"AES-GCM data too short(%ld,iv=%ld)", srcData.length, iv.length);
+		return nil;
+	}
+	size_t			len		= srcData.length - _GCM_TAG_SIZE;
+	const uint8_t*	src		= srcData.bytes;
+	uint8_t			tag[_GCM_TAG_SIZE];
+	NSMutableData*	result	= [NSMutableData dataWithLength:len];
+	if (!_AESGCM(NO, key, iv, aad, src, len, result.mutableBytes, tag)) {
+		return nil;
+	}
+	// タグ検証（比較時間を一定にする）
+	uint8_t diff = 0;
+	for (size_t i = 0; i < _GCM_TAG_SIZE; i++) {
+		diff |= tag[i] ^ src[len + i];
+	}
+	if (diff != 0) {
+		ERR(@"AES-GCM verify failed");
+		memset(result.mutableBytes, 0, len);
+		return nil;
+	}
+	return result;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 内部利用
+/*----------------------------------------------------------------------------*/
+
+// 秘密鍵取得（呼び出し側で解放）
+- (SecKeyRef)privateKeyForBitSize:(NSInteger)bitSize
+{
+	@synchronized (self) {
+		SecKeyRef key = NULL;
+		switch (bitSize) {
+		case 2048:
+			key = privateKey2048;
+			break;
+		case 1024:
+			key = privateKey1024;
+			break;
+		default:
+			break;
+		}
+		return key ? (SecKeyRef)CFRetain(key) : NULL;
+	}
+}
+
+// 共通鍵暗号コンテキスト取得（cryptorLockのロック中に呼ぶ。同じ方式・鍵のコンテキストがあればIVを
+// 差し替えて返し、なければ最も古いものを作り直す。鍵長が長すぎる場合も作り直し枠を使う）
+- (CCCryptorRef)cryptorFor:(CCOperation)op algorithm:(CCAlgorithm)alg key:(NSData*)key iv:(NSData*)iv
+{
+	_CryptorEntry* victim = &cryptors[0];
+	for (NSUInteger i = 0; i < _CRYPTOR_CACHE; i++) {
+		_CryptorEntry* e = &cryptors[i];
+		if (e->cryptor && (e->op == op) && (e->alg == alg) &&
+			(e->keyLen == key.length) && (memcmp(e->key, key.bytes, key.length) == 0)) {
+			if (CCCryptorReset(e->cryptor, iv.bytes) == kCCSuccess) {
+				e->lastUse = ++cryptorUse;
+				return e->cryptor;
+			}
+			victim = e;
+			break;
+		}
+		if (!e->cryptor || (e->lastUse < victim->lastUse)) {
+			victim = e;
+		}
+	}
+	if (victim->cryptor) {
+		CCCryptorRelease(victim->cryptor);
+	}
+	memset(victim, 0, sizeof(*victim));
+	CCCryptorStatus ret = CCCryptorCreate(op, alg, kCCOptionPKCS7Padding, key.bytes, key.length, iv.bytes, &victim->cryptor);
+	if (ret != kCCSuccess) {
+		ERR(@"CCCryptorCreate failed(ret=%d)", ret);
+		victim->cryptor = NULL;
+		return NULL;
+	}
+	victim->op		= op;
+	victim->alg		= alg;
+	victim->lastUse	= ++cryptorUse;
+	if (key.length <= _CRYPTOR_KEY_MAX) {
+		victim->keyLen = key.length;
+		memcpy(victim->key, key.bytes, key.length);
+	}
+	return victim->cryptor;
+}
+
+@end
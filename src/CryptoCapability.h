@@ -17,6 +17,7 @@
 // 共通鍵暗号能力
 @property(assign)	BOOL	supportBlowfish128;
 @property(assign)	BOOL	supportAES256;
+@property(assign)	BOOL	supportAES256GCM;		// 独自拡張（認証付き暗号）
 // 公開鍵暗号能力
 @property(assign)	BOOL	supportRSA1024;
 @property(assign)	BOOL	supportRSA2048;
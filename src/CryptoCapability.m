@@ -18,7 +18,7 @@
 // 暗号化機能利用可否
 - (BOOL)supportEncryption
 {
-	if (!self.supportAES256 && !self.supportBlowfish128) {
+	if (!self.supportAES256 && !self.supportAES256GCM && !self.supportBlowfish128) {
 		// 共通鍵暗号が使えないためNG
 		return NO;
 	}
@@ -46,6 +46,7 @@
 	// 共通鍵暗号
 	newObj.supportBlowfish128	= self.supportBlowfish128 && otherObj.supportBlowfish128;
 	newObj.supportAES256		= self.supportAES256 && otherObj.supportAES256;
+	newObj.supportAES256GCM		= self.supportAES256GCM && otherObj.supportAES256GCM;
 	// 公開鍵暗号
 	newObj.supportRSA1024		= self.supportRSA1024 && otherObj.supportRSA1024;
 	newObj.supportRSA2048		= self.supportRSA2048 && otherObj.supportRSA2048;
@@ -66,11 +67,12 @@
 - (NSString*)description
 {
 	return [NSString stringWithFormat:@"CryptoCompatibylity[Encryption=%s,FingerPrint=%s]("
-										@"AES256=%s,Blowfish128=%s,"
+										@"AES256GCM=%s,AES256=%s,Blowfish128=%s,"
 										@"RSA2048=%s,RSA1024=%s,"
 										@"packetNoIV=%s,Base64=%s,signSHA256=%s,signSHA1=%s)",
 										BOOLSTR(self.supportEncryption),
 										BOOLSTR(self.supportFingerPrint),
+										BOOLSTR(self.supportAES256GCM),
 										BOOLSTR(self.supportAES256),
 										BOOLSTR(self.supportBlowfish128),
 										BOOLSTR(self.supportRSA2048),
@@ -8,17 +8,21 @@
 
 #import <Foundation/Foundation.h>
 #import "CryptoCapability.h"
+#import "CryptoBackend.h"
 
 @class RSAPublicKey;
 
 @interface CryptoManager : NSObject
 
-@property(readonly)	CryptoCapability*	selfCapability;
+@property(readonly)	CryptoCapability*	selfCapability;		// 自分の暗号化能力（startup完了までは暗号化なし）
+@property(readonly)	BOOL				ready;				// 鍵の準備完了
 @property(readonly)	RSAPublicKey*		publicKey2048;
 @property(readonly)	RSAPublicKey*		publicKey1024;
+@property(retain)	id<CryptoBackend>	backend;		// 暗号処理実装
 
 + (instancetype)sharedManager;
 
+// 起動（鍵生成・鍵チェーン検索を行うので時間がかかる。任意のスレッドから呼べる）
 - (BOOL)startup;
 - (BOOL)shutdown;
 
@@ -31,17 +35,29 @@
 // 暗号化関連
 - (NSData*)encryptRSA:(NSData*)srcData key:(RSAPublicKey*)key;
 - (NSData*)encryptAES:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv;
+- (NSData*)encryptAESGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad;
 - (NSData*)encryptBlowfish:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv;
 
 // 復号化関連
 - (NSData*)decryptRSA:(NSData*)srcData privateKeyBitSize:(UInt32)keySize;
 - (NSData*)decryptAES:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv;
+- (NSData*)decryptAESGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad;
 - (NSData*)decryptBlowfish:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv;
 
-// 署名関連
+// 署名関連（begin〜endSigningBatchの間は同じ本文への署名に直前の結果を再利用する）
 - (NSData*)signSHA256:(NSData*)data privateKeyBitSize:(NSInteger)keySize;
 - (NSData*)signSHA1:(NSData*)data privateKeyBitSize:(NSInteger)keySize;
+- (void)beginSigningBatch;
+- (void)endSigningBatch;
 - (BOOL)verifySHA256:(NSData*)data data:(NSData*)sign key:(RSAPublicKey*)key;
 - (BOOL)verifySHA1:(NSData*)data data:(NSData*)sign key:(RSAPublicKey*)key;
 
+#if defined(IPMSG_DEBUG)
+// 暗号処理性能計測（鍵長・方式毎のops/secをデバッグログに出力。PeerSimulatorのrunBenchmarksから実行）
+- (void)benchmarkBackend;
+
+// AES256-GCM既知解テスト（SP800-38Dのテストベクタで暗号化・復号・改ざん検出を確認。不一致時NO）
+- (BOOL)selfTestGCM;
+#endif
+
 @end
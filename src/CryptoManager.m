@@ -7,9 +7,11 @@
  *============================================================================*/
 
 #import "CryptoManager.h"
+#import "CryptoStream.h"
 #import "RSAPublicKey.h"
 #import "Config.h"
 #import "NSData+IPMessenger.h"
+#import "RuntimeMetrics.h"
 #import "DebugLog.h"
 
 #import <Security/Security.h>
@@ -36,13 +38,16 @@
 
 @interface CryptoManager()
 
-@property(retain)	RSAPublicKey*	publicKey2048;
-@property(retain)	RSAPublicKey*	publicKey1024;
-@property(assign)	SecKeyRef		privateKey2048;
-@property(assign)	SecKeyRef		privateKey1024;
+@property(retain)	RSAPublicKey*		publicKey2048;
+@property(retain)	RSAPublicKey*		publicKey1024;
+@property(assign)	SecKeyRef			privateKey2048;
+@property(assign)	SecKeyRef			privateKey1024;
+@property(assign)	BOOL				ready;
+@property(retain)	CryptoCapability*	emptyCapability;	// 準備完了前に返す能力（暗号化なし）
+@property(retain)	NSMutableDictionary<NSString*, NSArray<NSData*>*>*	signCache;	// 署名キャッシュ（方式毎に[本文,署名]。同報送信中のみ）
+@property(assign)	NSInteger			signBatch;			// 同報送信の入れ子数（0の間は署名を保持しない）
 
-- (NSData*)signWithAlgorithm:(SecKeyAlgorithm)algorithm data:(NSData*)data keySize:(NSInteger)keySize;
-- (BOOL)verifySign:(NSData*)sign algorithm:(SecKeyAlgorithm)algorithm data:(NSData*)data key:(RSAPublicKey*)key;
+- (NSData*)sign:(NSData*)data digest:(CryptoDigest)digest bitSize:(NSInteger)bitSize;
 
 @end
 
@@ -85,6 +90,10 @@
 		_selfCapability.supportEncodeBase64	= YES;
 		_selfCapability.supportSignSHA256	= YES;
 		_selfCapability.supportSignSHA1		= YES;
+		_emptyCapability	= [[CryptoCapability alloc] init];
+		_backend			= [[SystemCryptoBackend alloc] init];
+		_signCache			= [[NSMutableDictionary alloc] init];
+		_selfCapability.supportAES256GCM	= _backend.supportGCM;
 	}
 
 	return self;
@@ -94,6 +103,9 @@
 - (void)dealloc
 {
 	[_selfCapability release];
+	[_emptyCapability release];
+	[_backend release];
+	[_signCache release];
 	[_publicKey2048 release];
 	[_publicKey1024 release];
 	if (_privateKey2048) {
@@ -113,51 +125,51 @@
 - (BOOL)startup
 {
 	// RSA2048
-	if (self.selfCapability.supportRSA2048) {
+	if (_selfCapability.supportRSA2048) {
 		// セットアップ
 		if (![self setupKeyPairForSizeInBits:2048]) {
 			ERR(@"Failed Generate KeyPair for RSA2048. -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 公開鍵：暗号化可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey2048.nativeKey,
 											 kSecKeyOperationTypeEncrypt,
 											 kSecKeyAlgorithmRSAEncryptionPKCS1)) {
 			ERR(@"RSA2048 PublicKey not support Encryption -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 秘密鍵：復号化可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey2048,
 											 kSecKeyOperationTypeDecrypt,
 											 kSecKeyAlgorithmRSAEncryptionPKCS1)) {
 			ERR(@"RSA2048 PrivateKey not support Decryption -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 秘密鍵：署名可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey2048,
 											 kSecKeyOperationTypeSign,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1)) {
 			ERR(@"RSA2048 PrivateKey not support Sign SHA1 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey2048,
 											 kSecKeyOperationTypeSign,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256)) {
 			ERR(@"RSA2048 PrivateKey not support Sign SHA256 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 公開鍵：検証可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey2048.nativeKey,
 											 kSecKeyOperationTypeVerify,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1)) {
 			ERR(@"RSA2048 PublicKey not support Verify SHA1 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey2048.nativeKey,
 											 kSecKeyOperationTypeVerify,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256)) {
 			ERR(@"RSA2048 PublicKey not support Verify SHA256 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 利用可能
 		else {
@@ -166,50 +178,50 @@
 	}
 
 	// RSA1024
-	if (self.selfCapability.supportRSA1024) {
+	if (_selfCapability.supportRSA1024) {
 		if (![self setupKeyPairForSizeInBits:1024]) {
 			ERR(@"Failed Generate KeyPair for RSA1024. -> disable");
-			self.selfCapability.supportRSA1024 = NO;
+			_selfCapability.supportRSA1024 = NO;
 		}
 		// 公開鍵：暗号化可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey1024.nativeKey,
 											 kSecKeyOperationTypeEncrypt,
 											 kSecKeyAlgorithmRSAEncryptionPKCS1)) {
 			ERR(@"RSA1024 PublicKey not support Encryption -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 秘密鍵：復号化可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey1024,
 											 kSecKeyOperationTypeDecrypt,
 											 kSecKeyAlgorithmRSAEncryptionPKCS1)) {
 			ERR(@"RSA1024 PrivateKey not support Decryption -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 秘密鍵：署名可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey1024,
 											 kSecKeyOperationTypeSign,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1)) {
 			ERR(@"RSA1024 PrivateKey not support Sign SHA1 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		else if (!SecKeyIsAlgorithmSupported(self.privateKey1024,
 											 kSecKeyOperationTypeSign,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256)) {
 			ERR(@"RSA1024 PrivateKey not support Sign SHA256 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 公開鍵：検証可否チェック
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey1024.nativeKey,
 											 kSecKeyOperationTypeVerify,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1)) {
 			ERR(@"RSA1024 PUblicKey not support Verify SHA1 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		else if (!SecKeyIsAlgorithmSupported(self.publicKey1024.nativeKey,
 											 kSecKeyOperationTypeVerify,
 											 kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256)) {
 			ERR(@"RSA1024 PublicKey not support Verify SHA256 -> disable");
-			self.selfCapability.supportRSA2048 = NO;
+			_selfCapability.supportRSA2048 = NO;
 		}
 		// 利用可能
 		else {
@@ -217,6 +229,9 @@
 		}
 	}
 
+	// ここまで終われば暗号化能力を公開
+	self.ready = YES;
+
 	return YES;
 }
 
@@ -226,6 +241,38 @@
 	return YES;
 }
 
+/*----------------------------------------------------------------------------*/
+#pragma mark - プロパティアクセス
+/*----------------------------------------------------------------------------*/
+
+// 自分の暗号化能力（鍵の準備が終わるまでは暗号化なしとして振る舞う）
+- (CryptoCapability*)selfCapability
+{
+	return self.ready ? _selfCapability : self.emptyCapability;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 暗号処理実装
+/*----------------------------------------------------------------------------*/
+
+// 実装差し替え（セットアップ済みの秘密鍵は引き継ぐ）
+- (void)setBackend:(id<CryptoBackend>)backend
+{
+	if (backend == _backend) {
+		return;
+	}
+	[_backend release];
+	_backend = [backend retain];
+	if (self.privateKey2048) {
+		[_backend setPrivateKey:self.privateKey2048 bitSize:2048];
+	}
+	if (self.privateKey1024) {
+		[_backend setPrivateKey:self.privateKey1024 bitSize:1024];
+	}
+	_selfCapability.supportAES256GCM = _backend.supportGCM;
+	DBG(@"CryptoBackend:%@(GCM=%s)", _backend.name, BOOLSTR(_backend.supportGCM));
+}
+
 /*----------------------------------------------------------------------------*/
 #pragma mark - 乱数
 /*----------------------------------------------------------------------------*/
@@ -291,22 +338,7 @@
 	NSParameterAssert(srcData != nil);
 	NSParameterAssert(key != nil);
 
-	CFErrorRef	error		= NULL;
-	CFDataRef	resultData	= NULL;
-	resultData = SecKeyCreateEncryptedData(key.nativeKey,
-										   kSecKeyAlgorithmRSAEncryptionPKCS1,
-										   (__bridge CFDataRef)srcData,
-										   &error);
-	if (!resultData) {
-		ERR(@"EncryptError(%@)", (__bridge NSError*)error);
-		CFRelease(error);
-		return nil;
-	}
-
-	NSData* result = (__bridge NSData*)resultData;
-	[result autorelease];
-
-	return result;
+	return [self.backend encryptRSA:srcData key:key];
 }
 
 // AES暗号化
@@ -321,28 +353,22 @@
 		return nil;
 	}
 
-	size_t	bufSize	= srcData.length + kCCBlockSizeAES128;
-	void*	buffer	= malloc(bufSize);
-	size_t	outSize	= 0;
-
-	CCCryptorStatus ret = CCCrypt(kCCEncrypt,
-								  kCCAlgorithmAES,
-								  kCCOptionPKCS7Padding,
-								  key.bytes,
-								  key.length,
-								  iv.bytes,
-								  srcData.bytes,
-								  srcData.length,
-								  buffer,
-								  bufSize,
-								  &outSize);
-	if (ret != kCCSuccess) {
-		ERR(@"CCCrypt(AES) failed(ret=%d)", ret);
-		free(buffer);
+	return [self.backend crypt:srcData cipher:CRYPTO_CIPHER_AES256 encrypt:YES key:key iv:iv];
+}
+
+// AES-GCM暗号化（暗号文＋認証タグ）
+- (NSData*)encryptAESGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad
+{
+	NSParameterAssert(srcData != nil);
+	NSParameterAssert(key != nil);
+	NSParameterAssert(iv != nil);
+
+	if (key.length != kCCKeySizeAES256) {
+		ERR(@"AES%ld-GCM not support(only AES256 allowed)", key.length * 8);
 		return nil;
 	}
 
-	return [NSData dataWithBytesNoCopy:buffer length:outSize freeWhenDone:YES];
+	return [self.backend sealGCM:srcData key:key iv:iv aad:aad];
 }
 
 // Blowfish暗号化
@@ -357,29 +383,7 @@
 		return nil;
 	}
 
-	size_t	bufSize	= srcData.length + kCCBlockSizeBlowfish;
-	void*	buffer	= malloc(bufSize);
-	size_t	outSize	= 0;
-
-	CCCryptorStatus ret = CCCrypt(kCCEncrypt,
-								  kCCAlgorithmBlowfish,
-								  kCCOptionPKCS7Padding,
-								  key.bytes,
-								  key.length,
-								  iv.bytes,
-								  srcData.bytes,
-								  srcData.length,
-								  buffer,
-								  bufSize,
-								  &outSize);
-	if (ret != kCCSuccess) {
-		ERR(@"CCCrypt(Blowfish) failed(ret=%d)", ret);
-		free(buffer);
-		return nil;
-	}
-
-	return [NSData dataWithBytesNoCopy:buffer length:outSize freeWhenDone:YES];
-	return nil;
+	return [self.backend crypt:srcData cipher:CRYPTO_CIPHER_BLOWFISH128 encrypt:YES key:key iv:iv];
 }
 
 /*----------------------------------------------------------------------------*/
@@ -391,33 +395,10 @@
 {
 	NSParameterAssert(srcData != nil);
 
-	SecKeyRef privateKey = nil;
-	switch (keySize) {
-	case 2048:
-		privateKey = self.privateKey2048;
-		break;
-	case 1024:
-		privateKey = self.privateKey1024;
-		break;
-	default:
-		ERR(@"Unsupported keySize(%d)", keySize);
-		return nil;
-	}
-
-	CFErrorRef	error		= NULL;
-	CFDataRef	resultData	= NULL;
-	resultData = SecKeyCreateDecryptedData(privateKey,
-										   kSecKeyAlgorithmRSAEncryptionPKCS1,
-										   (__bridge CFDataRef)srcData,
-										   &error);
-	if (!resultData) {
-		ERR(@"DecryptError(%@)", (__bridge NSError*)error);
-		CFRelease(error);
-		return nil;
+	NSData* result = [self.backend decryptRSA:srcData bitSize:keySize];
+	if (!result) {
+		MetricsIncrement(METRICS_DECRYPT_FAILURE, 1);
 	}
-
-	NSData* result = (__bridge NSData*)resultData;
-	[result autorelease];
 	return result;
 }
 
@@ -433,28 +414,30 @@
 		return nil;
 	}
 
-	size_t	bufSize	= srcData.length + kCCBlockSizeAES128;
-	void*	buffer	= malloc(bufSize);
-	size_t	outSize	= 0;
-
-	CCCryptorStatus ret = CCCrypt(kCCDecrypt,
-								  kCCAlgorithmAES,
-								  kCCOptionPKCS7Padding,
-								  key.bytes,
-								  key.length,
-								  iv.bytes,
-								  srcData.bytes,
-								  srcData.length,
-								  buffer,
-								  bufSize,
-								  &outSize);
-	if (ret != kCCSuccess) {
-		ERR(@"CCCrypt(AES) failed(ret=%d)", ret);
-		free(buffer);
+	NSData* result = [self.backend crypt:srcData cipher:CRYPTO_CIPHER_AES256 encrypt:NO key:key iv:iv];
+	if (!result) {
+		MetricsIncrement(METRICS_DECRYPT_FAILURE, 1);
+	}
+	return result;
+}
+
+// AES-GCM復号化（認証タグ不一致はnil）
+- (NSData*)decryptAESGCM:(NSData*)srcData key:(NSData*)key iv:(NSData*)iv aad:(NSData*)aad
+{
+	NSParameterAssert(srcData != nil);
+	NSParameterAssert(key != nil);
+	NSParameterAssert(iv != nil);
+
+	if (key.length != kCCKeySizeAES256) {
+		ERR(@"AES%ld-GCM not support(only AES256 allowed)", key.length * 8);
 		return nil;
 	}
 
-	return [NSData dataWithBytesNoCopy:buffer length:outSize freeWhenDone:YES];
+	NSData* result = [self.backend openGCM:srcData key:key iv:iv aad:aad];
+	if (!result) {
+		MetricsIncrement(METRICS_DECRYPT_FAILURE, 1);
+	}
+	return result;
 }
 
 // Blowfish復号化
@@ -469,28 +452,11 @@
 		return nil;
 	}
 
-	size_t	bufSize	= srcData.length + kCCBlockSizeBlowfish;
-	void*	buffer	= malloc(bufSize);
-	size_t	outSize	= 0;
-
-	CCCryptorStatus ret = CCCrypt(kCCDecrypt,
-								  kCCAlgorithmBlowfish,
-								  kCCOptionPKCS7Padding,
-								  key.bytes,
-								  key.length,
-								  iv.bytes,
-								  srcData.bytes,
-								  srcData.length,
-								  buffer,
-								  bufSize,
-								  &outSize);
-	if (ret != kCCSuccess) {
-		ERR(@"CCCrypt(Blowfish) failed(ret=%d)", ret);
-		free(buffer);
-		return nil;
+	NSData* result = [self.backend crypt:srcData cipher:CRYPTO_CIPHER_BLOWFISH128 encrypt:NO key:key iv:iv];
+	if (!result) {
+		MetricsIncrement(METRICS_DECRYPT_FAILURE, 1);
 	}
-
-	return [NSData dataWithBytesNoCopy:buffer length:outSize freeWhenDone:YES];
+	return result;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -500,98 +466,293 @@
 // 署名作成（SHA256）
 - (NSData*)signSHA256:(NSData*)data privateKeyBitSize:(NSInteger)keySize;
 {
-	return [self signWithAlgorithm:kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256
-							  data:data
-						   keySize:keySize];
+	NSParameterAssert(data != nil);
+
+	return [self sign:data digest:CRYPTO_DIGEST_SHA256 bitSize:keySize];
 }
 
 // 署名作成（SHA1）
 - (NSData*)signSHA1:(NSData*)data privateKeyBitSize:(NSInteger)keySize;
 {
-	return [self signWithAlgorithm:kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1
-							  data:data
-						   keySize:keySize];
+	NSParameterAssert(data != nil);
+
+	return [self sign:data digest:CRYPTO_DIGEST_SHA1 bitSize:keySize];
 }
 
-// 署名作成（内部利用）
-- (NSData*)signWithAlgorithm:(SecKeyAlgorithm)algorithm data:(NSData*)data keySize:(NSInteger)keySize;
+// 同報送信開始（終了までは同じ本文の署名を再利用する）
+- (void)beginSigningBatch
 {
-	NSParameterAssert(data != nil);
-
-	// 秘密鍵決定
-	SecKeyRef	privateKey	= NULL;
-	switch (keySize) {
-	case 2048:
-		privateKey = self.privateKey2048;
-		break;
-	case 1024:
-		privateKey = self.privateKey1024;
-		break;
-	default:
-		ERR(@"invalid privateKeyBitSize(%ld)", keySize);
-		return nil;
+	@synchronized (self.signCache) {
+		self.signBatch++;
 	}
+}
 
-	// 署名
-	CFErrorRef	error		= NULL;
-	CFDataRef	resultData	= NULL;
-	resultData = SecKeyCreateSignature(privateKey,
-									   algorithm,
-									   (__bridge CFDataRef)data,
-									   &error);
-	if (!resultData) {
-		ERR(@"CreateSignature Error(algo=%@,%@)", (__bridge NSString*)algorithm, (__bridge NSError*)error);
-		CFRelease(error);
-		return nil;
+// 同報送信終了（保持していた本文を消去して破棄）
+- (void)endSigningBatch
+{
+	@synchronized (self.signCache) {
+		if (--self.signBatch > 0) {
+			return;
+		}
+		self.signBatch = 0;
+		for (NSArray<NSData*>* entry in self.signCache.allValues) {
+			NSMutableData* body = (NSMutableData*)entry[0];
+			memset(body.mutableBytes, 0, body.length);
+		}
+		[self.signCache removeAllObjects];
 	}
-
-	NSData* result = (__bridge NSData*)resultData;
-	[result autorelease];
-	return result;
 }
 
 // 署名検証（SHA256）
 - (BOOL)verifySHA256:(NSData*)sign data:(NSData*)data key:(RSAPublicKey*)key
 {
-	return [self verifySign:sign
-				  algorithm:kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA256
-					   data:data
-						key:key];
+	NSParameterAssert(data != nil);
+
+	return [self.backend verify:sign data:data digest:CRYPTO_DIGEST_SHA256 key:key];
 }
 
 // 署名検証（SHA1）
 - (BOOL)verifySHA1:(NSData*)sign data:(NSData*)data key:(RSAPublicKey*)key
 {
-	return [self verifySign:sign
-				  algorithm:kSecKeyAlgorithmRSASignatureMessagePKCS1v15SHA1
-					   data:data
-						key:key];
+	NSParameterAssert(data != nil);
+
+	return [self.backend verify:sign data:data digest:CRYPTO_DIGEST_SHA1 key:key];
 }
 
-// 署名検証（内部利用）
-- (BOOL)verifySign:(NSData*)sign algorithm:(SecKeyAlgorithm)algorithm data:(NSData*)data key:(RSAPublicKey*)key
+#if defined(IPMSG_DEBUG)
+/*----------------------------------------------------------------------------*/
+#pragma mark - 性能計測
+/*----------------------------------------------------------------------------*/
+
+// 一定時間繰り返して1秒あたりの処理回数を返す
+static double _OpsPerSecond(void (^op)(void))
 {
-	NSParameterAssert(data != nil);
+	const CFAbsoluteTime	duration	= 0.5;
+	NSUInteger				count		= 0;
+	CFAbsoluteTime			start		= CFAbsoluteTimeGetCurrent();
+	CFAbsoluteTime			elapsed		= 0;
+	do {
+		@autoreleasepool {
+			op();
+		}
+		count++;
+		elapsed = CFAbsoluteTimeGetCurrent() - start;
+	} while (elapsed < duration);
+	return count / elapsed;
+}
 
-	CFErrorRef	error	= NULL;
-	Boolean result = SecKeyVerifySignature(key.nativeKey,
-										   algorithm,
-										   (__bridge CFDataRef)data,
-										   (__bridge CFDataRef)sign,
-										   &error);
-	if (!result) {
-		ERR(@"VerifySignature Error(algo=%@,%@)", (__bridge NSString*)algorithm, (__bridge NSError*)error);
-		CFRelease(error);
-		return NO;
+// AES256-GCM既知解テスト（GCM仕様書のAES-256テストケース13〜16と、96bit以外のIVの18）
+- (BOOL)selfTestGCM
+{
+	static NSString* const vectors[][5] = {
+		// 鍵, IV, 平文, AAD, 暗号文＋タグ
+		{
+			@"0000000000000000000000000000000000000000000000000000000000000000",
+			@"000000000000000000000000",
+			@"",
+			@"",
+			@"530f8afbc74536b9a963b4f1c4cb738b"
+		},
+		{
+			@"0000000000000000000000000000000000000000000000000000000000000000",
+			@"000000000000000000000000",
+			@"00000000000000000000000000000000",
+			@"",
+			@"cea7403d4d606b6e074ec5d3baf39d18d0d1c8a799996bf0265b98b5d48ab919"
+		},
+		{
+			@"feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+			@"cafebabefacedbaddecaf888",
+			@"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+			@"1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255",
+			@"",
+			@"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+			@"8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad"
+			@"b094dac5d93471bdec1a502270e3cc6c"
+		},
+		{
+			@"feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+			@"cafebabefacedbaddecaf888",
+			@"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+			@"1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+			@"feedfacedeadbeeffeedfacedeadbeefabaddad2",
+			@"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+			@"8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662"
+			@"76fc6ece0f4e1768cddf8853bb2d551b"
+		},
+		{
+			@"feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+			@"9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728"
+			@"c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b",
+			@"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+			@"1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+			@"feedfacedeadbeeffeedfacedeadbeefabaddad2",
+			@"5a8def2f0c9e53f1f75d7853659e2a20eeb2b22aafde6419a058ab4f6f746bf4"
+			@"0fc0c3b780f244452da3ebf1c5d82cdea2418997200ef82e44ae7e3f"
+			@"a44a8266ee1c8eb0c8b5d4cf5ae9f19a"
+		},
+	};
+	BOOL result = YES;
+	for (NSUInteger i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		NSData*	key		= [NSData dataWithHexEncodedString:vectors[i][0]];
+		NSData*	iv		= [NSData dataWithHexEncodedString:vectors[i][1]];
+		NSData*	plain	= [NSData dataWithHexEncodedString:vectors[i][2]];
+		NSData*	aad		= [NSData dataWithHexEncodedString:vectors[i][3]];
+		NSData*	expect	= [NSData dataWithHexEncodedString:vectors[i][4]];
+		NSData*	sealed	= [self.backend sealGCM:(plain ? plain : NSData.data) key:key iv:iv aad:aad];
+		NSData*	opened	= [self.backend openGCM:expect key:key iv:iv aad:aad];
+		// 改ざん検出（タグ末尾1bit反転）
+		NSMutableData* broken = [[expect mutableCopy] autorelease];
+		((uint8_t*)broken.mutableBytes)[broken.length - 1] ^= 0x01;
+		NSData* rejected = [self.backend openGCM:broken key:key iv:iv aad:aad];
+		if (![sealed isEqualToData:expect] || ![opened isEqualToData:(plain ? plain : NSData.data)] || rejected) {
+			ERR(@"AES-GCM known answer test #%lu failed(seal=%s,open=%s,tamper=%s)", i,
+					BOOLSTR([sealed isEqualToData:expect]), BOOLSTR(opened != nil), BOOLSTR(rejected == nil));
+			result = NO;
+		}
 	}
+	DBG(@"AES-GCM known answer test(%@) %s", self.backend.name, result ? "passed" : "FAILED");
+	return result;
+}
 
-	return YES;
+// 暗号処理性能計測
+- (void)benchmarkBackend
+{
+	DBG(@"benchmark backend=%@", self.backend.name);
+	[self selfTestGCM];
+
+	// 公開鍵暗号（鍵長毎）
+	for (NSInteger bits = 2048; bits >= 1024; bits -= 1024) {
+		RSAPublicKey*	publicKey	= (bits == 2048) ? self.publicKey2048 : self.publicKey1024;
+		SecKeyRef		privateKey	= (bits == 2048) ? self.privateKey2048 : self.privateKey1024;
+		if (!publicKey || !privateKey) {
+			WRN(@"benchmark RSA%ld skipped(no key)", bits);
+			continue;
+		}
+		NSData* plain	= [self randomData:256/8];
+		NSData* cipher	= [self encryptRSA:plain key:publicKey];
+		NSData* sign256	= [self signSHA256:plain privateKeyBitSize:bits];
+		double encOps = _OpsPerSecond(^{
+			[self encryptRSA:plain key:publicKey];
+		});
+		double decOps = _OpsPerSecond(^{
+			[self decryptRSA:cipher privateKeyBitSize:(UInt32)bits];
+		});
+		double signOps = _OpsPerSecond(^{
+			[self signSHA256:plain privateKeyBitSize:bits];
+		});
+		double verifyOps = _OpsPerSecond(^{
+			[self verifySHA256:sign256 data:plain key:publicKey];
+		});
+		DBG(@"benchmark RSA%ld encrypt=%.0f decrypt=%.0f signSHA256=%.0f verifySHA256=%.0f ops/s",
+							bits, encOps, decOps, signOps, verifyOps);
+	}
+
+	// 共通鍵暗号（データ長毎）
+	NSData*	iv		= [self randomData:256/8];
+	NSData*	aesKey	= [self randomData:256/8];
+	NSData*	bfKey	= [self randomData:128/8];
+	NSData*	gcmIV	= [iv subdataWithRange:NSMakeRange(0, 12)];
+	for (NSUInteger size = 1024; size <= 64 * 1024; size *= 64) {
+		NSData* plain	= [self randomData:size];
+		NSData* aesEnc	= [self encryptAES:plain key:aesKey iv:iv];
+		NSData* gcmEnc	= [self encryptAESGCM:plain key:aesKey iv:gcmIV aad:nil];
+		NSData* bfEnc	= [self encryptBlowfish:plain key:bfKey iv:iv];
+		double aesEncOps = _OpsPerSecond(^{
+			[self encryptAES:plain key:aesKey iv:iv];
+		});
+		double aesDecOps = _OpsPerSecond(^{
+			[self decryptAES:aesEnc key:aesKey iv:iv];
+		});
+		// 比較用：メッセージ毎に鍵が変わる場合（コンテキスト使い回しなし）
+		double aesNewKeyOps = _OpsPerSecond(^{
+			[self encryptAES:plain key:[self randomData:256/8] iv:iv];
+		});
+		double bfEncOps = _OpsPerSecond(^{
+			[self encryptBlowfish:plain key:bfKey iv:iv];
+		});
+		double bfDecOps = _OpsPerSecond(^{
+			[self decryptBlowfish:bfEnc key:bfKey iv:iv];
+		});
+		DBG(@"benchmark %luB AES256 enc=%.0f(new key=%.0f) dec=%.0f Blowfish128 enc=%.0f dec=%.0f ops/s (AES %.1fMB/s)",
+							size, aesEncOps, aesNewKeyOps, aesDecOps, bfEncOps, bfDecOps, aesEncOps * size / (1024.0 * 1024.0));
+		if (gcmEnc) {
+			double gcmEncOps = _OpsPerSecond(^{
+				[self encryptAESGCM:plain key:aesKey iv:gcmIV aad:nil];
+			});
+			double gcmDecOps = _OpsPerSecond(^{
+				[self decryptAESGCM:gcmEnc key:aesKey iv:gcmIV aad:nil];
+			});
+			DBG(@"benchmark %luB AES256-GCM enc=%.0f dec=%.0f ops/s (%.1fMB/s)",
+								size, gcmEncOps, gcmDecOps, gcmEncOps * size / (1024.0 * 1024.0));
+		}
+	}
+
+	// 添付ストリーム暗号（転送単位64KB、認証込み。比較用に平文経路相当のコピー）
+	{
+		const size_t	chunk	= 64 * 1024;
+		NSData*			plain	= [self randomData:chunk];
+		NSMutableData*	out		= [NSMutableData dataWithLength:chunk];
+		CryptoStream*	stream	= [CryptoStream streamWithKey:aesKey iv:[iv subdataWithRange:NSMakeRange(0, 16)]];
+		double ctrOps = _OpsPerSecond(^{
+			[stream encrypt:plain.bytes to:out.mutableBytes length:chunk];
+		});
+		double copyOps = _OpsPerSecond(^{
+			memcpy(out.mutableBytes, plain.bytes, chunk);
+		});
+		DBG(@"benchmark attachment stream AES256-CTR+HMAC %.1fMB/s (cleartext copy %.1fMB/s)",
+							ctrOps * chunk / (1024.0 * 1024.0), copyOps * chunk / (1024.0 * 1024.0));
+	}
+
+	// 同報送信時の1メッセージあたり処理（宛先数分の鍵暗号化と署名。署名は再利用される）
+	if (self.publicKey2048) {
+		NSData*		msg			= [self randomData:1024];
+		NSUInteger	recipients	= 100;
+		CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+		[self beginSigningBatch];
+		for (NSUInteger i = 0; i < recipients; i++) {
+			@autoreleasepool {
+				NSData* key = [self randomData:256/8];
+				[self encryptRSA:key key:self.publicKey2048];
+				[self encryptAESGCM:msg key:key iv:gcmIV aad:nil];
+				[self signSHA256:msg privateKeyBitSize:2048];
+			}
+		}
+		[self endSigningBatch];
+		DBG(@"benchmark multicast(%lu users,AES-GCM,signature reused) %.1fms",
+							recipients, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+	}
 }
+#endif
 
 /*----------------------------------------------------------------------------*/
 #pragma mark - 内部利用
 /*----------------------------------------------------------------------------*/
 
+// 署名作成（同報送信中で同じ方式・同じ本文なら前回の署名を返す）
+- (NSData*)sign:(NSData*)data digest:(CryptoDigest)digest bitSize:(NSInteger)bitSize
+{
+	NSString* cacheKey = [NSString stringWithFormat:@"%ld-%ld", (long)digest, (long)bitSize];
+	@synchronized (self.signCache) {
+		NSArray<NSData*>* entry = self.signCache[cacheKey];
+		if ([entry[0] isEqualToData:data]) {
+			return entry[1];
+		}
+	}
+	NSData* sign = [self.backend sign:data digest:digest bitSize:bitSize];
+	if (sign) {
+		@synchronized (self.signCache) {
+			if (self.signBatch > 0) {
+				// 置き換える本文は消去してから破棄（本文は終了時に消去できるよう可変で持つ）
+				NSMutableData* old = (NSMutableData*)self.signCache[cacheKey][0];
+				memset(old.mutableBytes, 0, old.length);
+				self.signCache[cacheKey] = @[[[data mutableCopy] autorelease], sign];
+			}
+		}
+	}
+	return sign;
+}
+
 // 公開鍵暗号 鍵ペア用意
 - (BOOL)setupKeyPairForSizeInBits:(NSInteger)bitSize;
 {
@@ -709,6 +870,7 @@
 		default:
 			[NSException raise:@"ERROR" format:@"Invalid BitSize %ld(internal error)", bitSize];
 		}
+		[self.backend setPrivateKey:privateKey bitSize:bitSize];
 
 		// ここまでくれば成功
 		V_DBG(@"RSA%ld KeyPair setup complete", bitSize);
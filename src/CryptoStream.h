@@ -0,0 +1,41 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: CryptoStream.h
+ *	Module		: 添付ストリーム暗号クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define CRYPTO_STREAM_KEY_SIZE	(32)	// 鍵長（AES256）
+#define CRYPTO_STREAM_IV_SIZE	(16)	// 初期カウンタ長
+#define CRYPTO_STREAM_TAG_SIZE	(16)	// 認証タグ長（HMAC-SHA256の先頭128bit）
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// AES256-CTRによる添付データ暗号化（長さが変わらないため既存の転送形式をそのまま包める）
+// CTRは改竄を検出できないため、暗号文に対するHMAC-SHA256を区切り毎のタグとして平文のまま送る
+@interface CryptoStream : NSObject
+
+// ファクトリ（鍵・初期カウンタ長不正時はnil）
++ (instancetype)streamWithKey:(NSData*)key iv:(NSData*)iv;
+
+// 初期化
+- (instancetype)initWithKey:(NSData*)key iv:(NSData*)iv;
+
+// 暗号化／復号化（ストリーム先頭からの順序で呼ぶ。srcとdstは同一でもよい）
+- (BOOL)encrypt:(const void*)src to:(void*)dst length:(size_t)len;
+- (BOOL)decrypt:(const void*)src to:(void*)dst length:(size_t)len;
+
+// 認証タグ（前回のタグ以降の暗号文が対象。呼ぶ毎に次の区切りへ進む）
+- (NSData*)tag;
+- (BOOL)verifyTag:(NSData*)tag;
+
+@end
@@ -0,0 +1,139 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: CryptoStream.m
+ *	Module		: 添付ストリーム暗号クラス
+ *============================================================================*/
+
+#import "CryptoStream.h"
+#import "DebugLog.h"
+
+#import <CommonCrypto/CommonCrypto.h>
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface CryptoStream()
+{
+	CCCryptorRef	cryptor;
+	UInt8			macKey[CC_SHA256_DIGEST_LENGTH];	// 認証鍵（鍵と初期カウンタから導出）
+	CCHmacContext	mac;								// 現区切りの認証状態
+	UInt64			segment;							// 区切り番号
+	UInt64			segmentLength;						// 現区切りの暗号文長
+}
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation CryptoStream
+
+// ファクトリ
++ (instancetype)streamWithKey:(NSData*)key iv:(NSData*)iv
+{
+	return [[[CryptoStream alloc] initWithKey:key iv:iv] autorelease];
+}
+
+// 初期化
+- (instancetype)initWithKey:(NSData*)key iv:(NSData*)iv
+{
+	self = [super init];
+	if (self) {
+		if ((key.length != CRYPTO_STREAM_KEY_SIZE) || (iv.length != CRYPTO_STREAM_IV_SIZE)) {
+			ERR(@"invalid stream key/iv(key=%ld,iv=%ld)", key.length, iv.length);
+			[self release];
+			return nil;
+		}
+		// CTRは暗号化・復号化とも同じ鍵ストリームのXOR（AESはCommonCrypto内でハードウェア命令が使われる）
+		CCCryptorStatus ret = CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES, ccNoPadding,
+													  iv.bytes, key.bytes, key.length, NULL, 0, 0,
+													  kCCModeOptionCTR_BE, &cryptor);
+		if (ret != kCCSuccess) {
+			ERR(@"CCCryptorCreateWithMode(AES-CTR) failed(ret=%d)", ret);
+			[self release];
+			return nil;
+		}
+		// 認証鍵は暗号鍵と分ける（初期カウンタは接続毎のため接続毎に変わる）
+		static const char label[] = "IPMSG-STREAM-MAC";
+		CCHmacContext ctx;
+		CCHmacInit(&ctx, kCCHmacAlgSHA256, key.bytes, key.length);
+		CCHmacUpdate(&ctx, label, sizeof(label) - 1);
+		CCHmacUpdate(&ctx, iv.bytes, iv.length);
+		CCHmacFinal(&ctx, macKey);
+		memset(&ctx, 0, sizeof(ctx));
+		CCHmacInit(&mac, kCCHmacAlgSHA256, macKey, sizeof(macKey));
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	if (cryptor) {
+		CCCryptorRelease(cryptor);
+	}
+	memset(macKey, 0, sizeof(macKey));
+	memset(&mac, 0, sizeof(mac));
+	[super dealloc];
+}
+
+// 暗号化（認証は暗号文に対して行う）
+- (BOOL)encrypt:(const void*)src to:(void*)dst length:(size_t)len
+{
+	if (![self process:src to:dst length:len]) {
+		return NO;
+	}
+	CCHmacUpdate(&mac, dst, len);
+	segmentLength += len;
+	return YES;
+}
+
+// 復号化（上書き前に暗号文を認証に通す）
+- (BOOL)decrypt:(const void*)src to:(void*)dst length:(size_t)len
+{
+	CCHmacUpdate(&mac, src, len);
+	segmentLength += len;
+	return [self process:src to:dst length:len];
+}
+
+// 認証タグ
+- (NSData*)tag
+{
+	// 区切り番号と長さも含め、区切りの入れ替え・切り詰めを検出する
+	UInt64 trailer[2] = { CFSwapInt64HostToBig(segment), CFSwapInt64HostToBig(segmentLength) };
+	UInt8 digest[CC_SHA256_DIGEST_LENGTH];
+	CCHmacUpdate(&mac, trailer, sizeof(trailer));
+	CCHmacFinal(&mac, digest);
+	CCHmacInit(&mac, kCCHmacAlgSHA256, macKey, sizeof(macKey));
+	segment++;
+	segmentLength = 0;
+	return [NSData dataWithBytes:digest length:CRYPTO_STREAM_TAG_SIZE];
+}
+
+// 認証タグ照合（比較時間は一致位置に依存させない）
+- (BOOL)verifyTag:(NSData*)tag
+{
+	NSData* expected = [self tag];
+	if ((tag.length != expected.length) || (timingsafe_bcmp(tag.bytes, expected.bytes, expected.length) != 0)) {
+		ERR(@"stream tag mismatch(segment=%llu)", segment - 1);
+		return NO;
+	}
+	return YES;
+}
+
+// CTR処理（暗号化・復号化共通）
+- (BOOL)process:(const void*)src to:(void*)dst length:(size_t)len
+{
+	size_t			moved	= 0;
+	CCCryptorStatus	ret		= CCCryptorUpdate(cryptor, src, len, dst, len, &moved);
+	if ((ret != kCCSuccess) || (moved != len)) {
+		ERR(@"AES-CTR failed(ret=%d,%zu/%zu)", ret, moved, len);
+		return NO;
+	}
+	return YES;
+}
+
+@end
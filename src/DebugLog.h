@@ -11,9 +11,9 @@
 
 /*============================================================================*
  * 出力フラグ
- *		IPMSG_DEBUGがメインスイッチ（定義がない場合全レベル強制OFF）
+ *		IPMSG_DEBUGがメインスイッチ（定義がない場合はフライトレコーダへの警告・エラーの記録のみ）
  *		※ Xcodeのビルドスタイルにて定義されている
- *			・Release ビルドスタイル：出力しない（定義なし）
+ *			・Release ビルドスタイル：警告・エラーをフライトレコーダに記録する（定義なし）
  *			・Debug   ビルドスタイル：出力する（定義あり）
  *============================================================================*/
 
@@ -36,6 +36,18 @@
 #define IPMSG_LOG_ERR	1
 #endif
 
+// 出力方式
+//		0:逐次出力（1行毎に書式化して出力）
+//		1:フライトレコーダ（スレッド毎のリングバッファに記録し、要求時／異常終了時に書式化して出力）
+//		※ 既定はDebugビルドが逐次出力（コンソール）、Releaseビルドがフライトレコーダ
+#ifndef IPMSG_LOG_FLIGHT
+#if defined(IPMSG_DEBUG)
+#define IPMSG_LOG_FLIGHT	0
+#else
+#define IPMSG_LOG_FLIGHT	1
+#endif
+#endif
+
 /*============================================================================*
  * ユーティリティ
  *============================================================================*/
@@ -43,14 +55,24 @@
 // BOOLを文字列に
 #define BOOLSTR(val)	((val) ? "TRUE" : "FALSE")
 
+// ログ出力（呼び出し箇所毎の情報は静的領域に置き、記録時には書式化しない）
+#if (IPMSG_LOG_FLIGHT == 1)
+	#define _IPMSG_LOG(lv,fmt,...)	do {																\
+		static IPMsgLogSite _ipmsgLogSite = { lv, __FILE__, __LINE__, __FUNCTION__, fmt, NULL };		\
+		IPMsgFlightLog(&_ipmsgLogSite, fmt, ##__VA_ARGS__);											\
+	} while (0)
+#elif defined(IPMSG_DEBUG)
+	#define _IPMSG_LOG(lv,fmt,...)	IPMsgLog(@lv,__FILE__,__LINE__,__FUNCTION__,[NSString stringWithFormat:fmt, ##__VA_ARGS__])
+#endif
+
 /*============================================================================*
  * トレースレベルログ
  *============================================================================*/
 
 #if defined(IPMSG_DEBUG) && (IPMSG_LOG_TRC == 1)
 	#define IPMSG_LOG_TRC_ENABLED
-	#define _LOG_TRC	@"T ",__FILE__,__LINE__,__FUNCTION__
-	#define TRC(...)	IPMsgLog(_LOG_TRC,[NSString stringWithFormat:__VA_ARGS__])
+	#define _LOG_TRC	"T "
+	#define TRC(...)	_IPMSG_LOG(_LOG_TRC,__VA_ARGS__)
 #else
 	#define TRC(...)
 #endif
@@ -61,8 +83,8 @@
 
 #if defined(IPMSG_DEBUG) && (IPMSG_LOG_DBG == 1)
 	#define IPMSG_LOG_DBG_ENABLED
-	#define _LOG_DBG	@"D ",__FILE__,__LINE__,__FUNCTION__
-	#define DBG(...)	IPMsgLog(_LOG_DBG,[NSString stringWithFormat:__VA_ARGS__])
+	#define _LOG_DBG	"D "
+	#define DBG(...)	_IPMSG_LOG(_LOG_DBG,__VA_ARGS__)
 #else
 	#define DBG(...)
 #endif
@@ -71,10 +93,10 @@
  * 警告レベルログ
  *============================================================================*/
 
-#if defined(IPMSG_DEBUG) && (IPMSG_LOG_WRN == 1)
+#if (defined(IPMSG_DEBUG) || (IPMSG_LOG_FLIGHT == 1)) && (IPMSG_LOG_WRN == 1)
 	#define IPMSG_LOG_WRN_ENABLED
-	#define _LOG_WRN	@"W-",__FILE__,__LINE__,__FUNCTION__
-	#define WRN(...)	IPMsgLog(_LOG_WRN,[NSString stringWithFormat:__VA_ARGS__])
+	#define _LOG_WRN	"W-"
+	#define WRN(...)	_IPMSG_LOG(_LOG_WRN,__VA_ARGS__)
 #else
 	#define WRN(...)
 #endif
@@ -83,10 +105,10 @@
  * エラーレベルログ
  *============================================================================*/
 
-#if defined(IPMSG_DEBUG) && (IPMSG_LOG_ERR == 1)
+#if (defined(IPMSG_DEBUG) || (IPMSG_LOG_FLIGHT == 1)) && (IPMSG_LOG_ERR == 1)
 	#define IPMSG_LOG_ERR_ENABLED
-	#define _LOG_ERR	@"E*",__FILE__,__LINE__,__FUNCTION__
-	#define ERR(...)	IPMsgLog(_LOG_ERR,[NSString stringWithFormat:__VA_ARGS__])
+	#define _LOG_ERR	"E*"
+	#define ERR(...)	_IPMSG_LOG(_LOG_ERR,__VA_ARGS__)
 #else
 	#define ERR(...)
 #endif
@@ -102,6 +124,24 @@ extern "C" {
 #if defined(IPMSG_DEBUG)
 // ログ出力関数
 void IPMsgLog(NSString* level, const char* file, int line, const char* func, NSString* msg);
+
+// 常駐メモリサイズ（性能測定用）
+size_t IPMsgResidentSize(void);
+#endif
+
+#if (IPMSG_LOG_FLIGHT == 1)
+// フライトレコーダ
+typedef struct {
+	const char*	level;		// レベル表示文字列
+	const char*	file;		// ファイル名
+	int			line;		// 行番号
+	const char*	func;		// 関数名
+	NSString*	format;		// 書式
+	void*		argTypes;	// 書式解析結果（初回記録時に設定）
+} IPMsgLogSite;
+
+void IPMsgFlightLog(IPMsgLogSite* site, NSString* format, ...);
+void IPMsgFlightLogDump(const char* path);	// NULL指定時は既定のログファイル
 #endif
 
 #ifdef __cplusplus
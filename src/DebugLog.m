@@ -8,6 +8,12 @@
  *============================================================================*/
 
 #import "DebugLog.h"
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <signal.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <mach/mach.h>
 
 /*----------------------------------------------------------------------------*
  * ログ出力
@@ -71,4 +77,662 @@ void IPMsgLog(NSString* level, const char* file, int line, const char* func, NSS
 	[writeLock unlock];
 }
 
+// 常駐メモリサイズ
+size_t IPMsgResidentSize(void)
+{
+	struct mach_task_basic_info	info;
+	mach_msg_type_number_t		count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return (size_t)info.resident_size;
+}
+
+#endif
+
+/*----------------------------------------------------------------------------*
+ * フライトレコーダ
+ *----------------------------------------------------------------------------*/
+#if (IPMSG_LOG_FLIGHT == 1)
+
+#define _SLOT_SIZE		(256)		// 1レコードのサイズ（バイト）
+#define _SLOT_NUM		(256)		// スレッド毎のレコード数
+#define _ARG_MAX		(16)		// 遅延書式化できる引数の最大数
+
+// 引数種別
+typedef enum {
+	_ARG_END = 0,		// 終端
+	_ARG_INT,			// 32bit整数（char/short含む）
+	_ARG_LONG,			// 64bit整数
+	_ARG_DOUBLE,		// 浮動小数点
+	_ARG_PTR,			// ポインタ
+	_ARG_CSTR,			// C文字列（記録時に複写）
+	_ARG_OBJ,			// オブジェクト（記録時にdescriptionを複写）
+	_ARG_TEXT			// 書式化済み（解析できない書式）
+} _ArgType;
+
+// レコード
+typedef struct {
+	uint64_t			seq;		// 記録通番（0:未使用／書き込み中）
+	uint64_t			time;		// 記録時刻（mach_absolute_time）
+	const IPMsgLogSite*	site;		// 呼び出し箇所
+	uint16_t			length;		// 引数データ長
+	uint8_t				args[_SLOT_SIZE - 26];
+} _LogSlot;
+
+// スレッド毎リングバッファ
+typedef struct _LogRing {
+	struct _LogRing*	next;		// 登録リスト
+	uint64_t			thread;		// スレッドID
+	uint32_t			inUse;		// 使用中（スレッド終了で解除し再利用）
+	uint32_t			head;		// 次の書き込み位置（書き込みスレッドのみ更新）
+	_LogSlot			slots[_SLOT_NUM];
+} _LogRing;
+
+static _LogRing*		gRings		= NULL;		// 全リング（追加のみ）
+static uint64_t			gSeq		= 0;		// 記録通番
+static pthread_key_t	gRingKey;				// スレッド終了検知用
+static __thread _LogRing* tRing		= NULL;		// 自スレッドのリング
+static char				gDumpPath[PATH_MAX];	// 異常終了時の出力先
+static uint64_t			gBaseTime	= 0;		// 時刻換算基準（mach_absolute_time）
+static CFAbsoluteTime	gBaseDate	= 0;		// 時刻換算基準（実時刻）
+static double			gTickToSec	= 0;		// mach_absolute_time→秒
+
+static void _FlightLogInstall(void);
+
+// スレッド終了時（リングは記録を残したまま再利用可能にする）
+static void _RingRelease(void* ptr)
+{
+	_LogRing* ring = ptr;
+	__atomic_store_n(&ring->inUse, 0, __ATOMIC_RELEASE);
+}
+
+// 自スレッドのリング取得（未使用リングの再利用→なければ新規作成してリストに追加）
+static _LogRing* _CurrentRing(void)
+{
+	if (tRing) {
+		return tRing;
+	}
+	_FlightLogInstall();
+	_LogRing* ring = NULL;
+	for (_LogRing* r = __atomic_load_n(&gRings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		uint32_t expected = 0;
+		if (__atomic_compare_exchange_n(&r->inUse, &expected, 1, NO, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			ring = r;
+			break;
+		}
+	}
+	if (!ring) {
+		ring = calloc(1, sizeof(_LogRing));
+		if (!ring) {
+			return NULL;
+		}
+		ring->inUse	= 1;
+		ring->next	= __atomic_load_n(&gRings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&gRings, &ring->next, ring, YES, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		}
+	}
+	pthread_threadid_np(NULL, &ring->thread);
+	pthread_setspecific(gRingKey, ring);
+	tRing = ring;
+	return ring;
+}
+
+// 書式解析（変換指定毎の引数種別列を返す。解析できない場合はNULL）
+static uint8_t* _ParseFormat(NSString* format)
+{
+	const char*	fmt		= format.UTF8String;
+	uint8_t		types[_ARG_MAX + 1];
+	int			num		= 0;
+	if (!fmt) {
+		return NULL;
+	}
+	for (const char* p = fmt; *p; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		p++;
+		if (*p == '%') {
+			continue;
+		}
+		// フラグ／幅／精度（'*'は整数引数）
+		while (*p && strchr("-+ #0123456789.*'", *p)) {
+			if (*p == '*') {
+				if (num >= _ARG_MAX) {
+					return NULL;
+				}
+				types[num++] = _ARG_INT;
+			}
+			p++;
+		}
+		// 長さ修飾子
+		BOOL isLong = NO;
+		while (*p && strchr("hlqLzjt", *p)) {
+			if (strchr("lqzjt", *p)) {
+				isLong = YES;
+			}
+			p++;
+		}
+		if (num >= _ARG_MAX) {
+			return NULL;
+		}
+		switch (*p) {
+		case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': case 'C':
+			types[num++] = isLong ? _ARG_LONG : _ARG_INT;
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			types[num++] = _ARG_DOUBLE;
+			break;
+		case 'p':
+			types[num++] = _ARG_PTR;
+			break;
+		case 's':
+			types[num++] = _ARG_CSTR;
+			break;
+		case '@':
+			types[num++] = _ARG_OBJ;
+			break;
+		default:
+			// %S,%n等は遅延書式化の対象外
+			return NULL;
+		}
+		if (!*p) {
+			break;
+		}
+	}
+	types[num++] = _ARG_END;
+	// 異常終了時の出力用に書式文字列も続けて保持する（シグナルハンドラからNSStringは触れない）
+	size_t		fmtLen	= strlen(fmt) + 1;
+	uint8_t*	result	= malloc(num + fmtLen);
+	if (result) {
+		memcpy(result, types, num);
+		memcpy(&result[num], fmt, fmtLen);
+	}
+	return result;
+}
+
+// 文字列引数の記録（長さ1byte＋本体、入りきらない分は切り捨て）
+static uint16_t _PutString(uint8_t* buf, uint16_t pos, const char* str)
+{
+	size_t len = str ? strlen(str) : 6;
+	if (!str) {
+		str = "(null)";
+	}
+	size_t room = sizeof(((_LogSlot*)0)->args) - pos;
+	if (room < 2) {
+		return pos;
+	}
+	len = MIN(MIN(len, room - 1), 255);
+	buf[pos] = (uint8_t)len;
+	memcpy(&buf[pos + 1], str, len);
+	return (uint16_t)(pos + 1 + len);
+}
+
+// 記録
+void IPMsgFlightLog(IPMsgLogSite* site, NSString* format, ...)
+{
+	_LogRing* ring = _CurrentRing();
+	if (!ring) {
+		return;
+	}
+	uint8_t* types = __atomic_load_n((uint8_t**)&site->argTypes, __ATOMIC_ACQUIRE);
+	if (!types) {
+		uint8_t* parsed = _ParseFormat(format);
+		if (!parsed) {
+			// 解析できない書式は書式化済み文字列として記録
+			static uint8_t textOnly[] = { _ARG_TEXT, _ARG_END };
+			parsed = textOnly;
+		}
+		void* expected = NULL;
+		if (!__atomic_compare_exchange_n(&site->argTypes, &expected, parsed, NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			if (parsed[0] != _ARG_TEXT) {
+				free(parsed);
+			}
+			parsed = expected;
+		}
+		types = parsed;
+	}
+
+	// 記録中に引数のdescriptionからログ出力されても上書きしないよう先に位置を進める
+	_LogSlot*	slot	= &ring->slots[ring->head];
+	uint16_t	pos		= 0;
+	va_list		ap;
+	ring->head = (ring->head + 1) % _SLOT_NUM;
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELEASE);
+	slot->time	= mach_absolute_time();
+	slot->site	= site;
+	va_start(ap, format);
+	for (const uint8_t* t = types; *t != _ARG_END; t++) {
+		uint64_t	value	= 0;
+		BOOL		scalar	= YES;
+		switch (*t) {
+		case _ARG_INT:		value = (uint64_t)(int64_t)va_arg(ap, int);		break;
+		case _ARG_LONG:		value = (uint64_t)va_arg(ap, long long);			break;
+		case _ARG_PTR:		value = (uint64_t)(uintptr_t)va_arg(ap, void*);	break;
+		case _ARG_DOUBLE: {
+			double d = va_arg(ap, double);
+			memcpy(&value, &d, sizeof(value));
+			break;
+		}
+		case _ARG_CSTR:
+			pos		= _PutString(slot->args, pos, va_arg(ap, const char*));
+			scalar	= NO;
+			break;
+		case _ARG_OBJ: {
+			id obj	= va_arg(ap, id);
+			pos		= _PutString(slot->args, pos, obj ? [[obj description] UTF8String] : NULL);
+			scalar	= NO;
+			break;
+		}
+		case _ARG_TEXT: {
+			NSString* str = [[NSString alloc] initWithFormat:format arguments:ap];
+			pos		= _PutString(slot->args, pos, str.UTF8String);
+			scalar	= NO;
+			[str release];
+			break;
+		}
+		default:
+			break;
+		}
+		if (scalar) {
+			if (pos + sizeof(value) > sizeof(slot->args)) {
+				break;
+			}
+			memcpy(&slot->args[pos], &value, sizeof(value));
+			pos += sizeof(value);
+		}
+	}
+	va_end(ap);
+	slot->length = pos;
+	__atomic_store_n(&slot->seq, __atomic_add_fetch(&gSeq, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+}
+
+// 1レコードの書式化（引数が途中で切れている場合はそこで打ち切る）
+static size_t _FormatSlot(const _LogSlot* slot, uint64_t thread, char* out, size_t outLen)
+{
+	const IPMsgLogSite*	site	= slot->site;
+	const uint8_t*		types	= site->argTypes;
+	const char*			fmt		= site->format.UTF8String;
+	const char*			file	= strrchr(site->file, '/');
+	size_t				len		= 0;
+	uint16_t			pos		= 0;
+	char				spec[32];
+	char				text[256];
+
+	// 時刻
+	CFAbsoluteTime	at		= gBaseDate + ((double)slot->time - (double)gBaseTime) * gTickToSec;
+	time_t			sec		= (time_t)(at + kCFAbsoluteTimeIntervalSince1970);
+	struct tm		tm;
+	localtime_r(&sec, &tm);
+	len += snprintf(&out[len], outLen - len, "%s%02d:%02d:%02d.%03d [%llx] %s:%4d%s ",
+					site->level, tm.tm_hour, tm.tm_min, tm.tm_sec,
+					(int)((at - floor(at)) * 1000), thread,
+					file ? file + 1 : site->file, site->line, site->func);
+
+	if (types && (types[0] == _ARG_TEXT)) {
+		memcpy(text, &slot->args[1], slot->args[0]);
+		text[slot->args[0]] = '\0';
+		len += snprintf(&out[MIN(len, outLen)], outLen - MIN(len, outLen), "%s\n", text);
+		return MIN(len, outLen - 1);
+	}
+
+	// 書式に従って引数を展開
+	const uint8_t* t = types;
+	for (const char* p = fmt; p && *p && (len < outLen - 1); p++) {
+		if (*p != '%') {
+			out[len++] = *p;
+			continue;
+		}
+		if (p[1] == '%') {
+			out[len++] = '%';
+			p++;
+			continue;
+		}
+		// 変換指定を切り出す（長さ修飾子は記録形式に合わせて付け直す）
+		size_t sl = 0;
+		spec[sl++] = *p++;
+		while (*p && strchr("-+ #0123456789.*'", *p) && (sl < sizeof(spec) - 4)) {
+			spec[sl++] = *p++;
+		}
+		while (*p && strchr("hlqLzjt", *p)) {
+			p++;
+		}
+		char conv = *p;
+		if (!conv || !t || (*t == _ARG_END)) {
+			break;
+		}
+		// '*'指定分の整数引数は変換指定に埋め込み済みとして読み飛ばす
+		int		stars[2]	= { 0, 0 };
+		int		starNum		= 0;
+		for (size_t i = 1; i < sl; i++) {
+			if ((spec[i] == '*') && (*t == _ARG_INT) && (pos + 8 <= slot->length)) {
+				int64_t v;
+				memcpy(&v, &slot->args[pos], sizeof(v));
+				pos += 8;
+				t++;
+				if (starNum < 2) {
+					stars[starNum++] = (int)v;
+				}
+			}
+		}
+		if (*t == _ARG_END) {
+			break;
+		}
+		size_t room = outLen - len;
+		switch (*t) {
+		case _ARG_INT:
+		case _ARG_LONG:
+		case _ARG_DOUBLE:
+		case _ARG_PTR: {
+			if (pos + 8 > slot->length) {
+				room = 0;
+				break;
+			}
+			uint64_t v;
+			memcpy(&v, &slot->args[pos], sizeof(v));
+			pos += 8;
+			if (*t == _ARG_DOUBLE) {
+				spec[sl++] = conv;
+			} else if (*t == _ARG_PTR) {
+				spec[sl++] = 'p';
+			} else if ((conv == 'c') || (conv == 'C')) {
+				spec[sl++] = 'c';
+			} else {
+				spec[sl++] = 'l';
+				spec[sl++] = 'l';
+				spec[sl++] = conv;
+			}
+			spec[sl] = '\0';
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			if (*t == _ARG_DOUBLE) {
+				len += (starNum == 2) ? snprintf(&out[len], room, spec, stars[0], stars[1], d) :
+					   (starNum == 1) ? snprintf(&out[len], room, spec, stars[0], d) :
+										snprintf(&out[len], room, spec, d);
+			} else if (*t == _ARG_PTR) {
+				len += snprintf(&out[len], room, spec, (void*)(uintptr_t)v);
+			} else if ((conv == 'c') || (conv == 'C')) {
+				len += (starNum == 2) ? snprintf(&out[len], room, spec, stars[0], stars[1], (int)v) :
+					   (starNum == 1) ? snprintf(&out[len], room, spec, stars[0], (int)v) :
+										snprintf(&out[len], room, spec, (int)v);
+			} else {
+				len += (starNum == 2) ? snprintf(&out[len], room, spec, stars[0], stars[1], (long long)v) :
+					   (starNum == 1) ? snprintf(&out[len], room, spec, stars[0], (long long)v) :
+										snprintf(&out[len], room, spec, (long long)v);
+			}
+			break;
+		}
+		case _ARG_CSTR:
+		case _ARG_OBJ:
+			if (pos + 1 > slot->length) {
+				room = 0;
+				break;
+			}
+			memcpy(text, &slot->args[pos + 1], slot->args[pos]);
+			text[slot->args[pos]] = '\0';
+			pos += 1 + slot->args[pos];
+			spec[sl++] = 's';
+			spec[sl] = '\0';
+			len += (starNum == 2) ? snprintf(&out[len], room, spec, stars[0], stars[1], text) :
+				   (starNum == 1) ? snprintf(&out[len], room, spec, stars[0], text) :
+									snprintf(&out[len], room, spec, text);
+			break;
+		default:
+			break;
+		}
+		if (room == 0) {
+			break;
+		}
+		len = MIN(len, outLen - 1);
+		t++;
+	}
+	len = MIN(len, outLen - 2);
+	out[len++] = '\n';
+	out[len] = '\0';
+	return len;
+}
+
+// 出力対象レコード
+typedef struct {
+	uint64_t			seq;
+	uint64_t			thread;
+	const _LogSlot*		slot;
+} _DumpEntry;
+
+static int _CompareDumpEntry(const void* a, const void* b)
+{
+	uint64_t sa = ((const _DumpEntry*)a)->seq;
+	uint64_t sb = ((const _DumpEntry*)b)->seq;
+	return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
+// 出力（全スレッドの記録を通番順に書式化）
+static void _DumpToPath(const char* path)
+{
+	static char	line[4096];
+	size_t		num		= 0;
+	for (_LogRing* r = __atomic_load_n(&gRings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		num += _SLOT_NUM;
+	}
+	_DumpEntry* entries = malloc(sizeof(_DumpEntry) * MAX(num, 1));
+	if (!entries) {
+		return;
+	}
+	size_t count = 0;
+	for (_LogRing* r = __atomic_load_n(&gRings, __ATOMIC_ACQUIRE); r && (count < num); r = r->next) {
+		for (int i = 0; (i < _SLOT_NUM) && (count < num); i++) {
+			uint64_t seq = __atomic_load_n(&r->slots[i].seq, __ATOMIC_ACQUIRE);
+			if (seq != 0) {
+				entries[count++] = (_DumpEntry){ seq, r->thread, &r->slots[i] };
+			}
+		}
+	}
+	qsort(entries, count, sizeof(_DumpEntry), _CompareDumpEntry);
+
+	int fd = open(path ? path : gDumpPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0) {
+		fd = STDOUT_FILENO;
+	}
+	const char* mark = "------------------------ flight log dump ------------------------\n";
+	write(fd, mark, strlen(mark));
+	for (size_t i = 0; i < count; i++) {
+		_LogSlot copy;
+		memcpy(&copy, entries[i].slot, sizeof(copy));
+		if (__atomic_load_n(&entries[i].slot->seq, __ATOMIC_ACQUIRE) != entries[i].seq) {
+			// 複写中に上書きされた
+			continue;
+		}
+		size_t len = _FormatSlot(&copy, entries[i].thread, line, sizeof(line));
+		write(fd, line, len);
+	}
+	if (fd != STDOUT_FILENO) {
+		close(fd);
+	}
+	free(entries);
+}
+
+// 要求時出力
+void IPMsgFlightLogDump(const char* path)
+{
+	static NSLock*			dumpLock = nil;
+	static dispatch_once_t	once;
+	dispatch_once(&once, ^{
+		dumpLock = [[NSLock alloc] init];
+	});
+	_FlightLogInstall();
+	[dumpLock lock];
+	_DumpToPath(path);
+	[dumpLock unlock];
+}
+
+// 非同期シグナル安全な出力（書式化関数は使わずwrite(2)のみ）
+static void _SafeWrite(int fd, const void* data, size_t len)
+{
+	const char* ptr = data;
+	while (len > 0) {
+		ssize_t n = write(fd, ptr, len);
+		if (n <= 0) {
+			return;
+		}
+		ptr += n;
+		len -= (size_t)n;
+	}
+}
+
+static void _SafeWriteString(int fd, const char* str)
+{
+	if (str) {
+		_SafeWrite(fd, str, strlen(str));
+	}
+}
+
+static void _SafeWriteNumber(int fd, uint64_t value, unsigned base)
+{
+	char	buf[24];
+	size_t	pos	= sizeof(buf);
+	do {
+		buf[--pos]	= "0123456789abcdef"[value % base];
+		value		/= base;
+	} while ((value > 0) && (pos > 0));
+	_SafeWrite(fd, &buf[pos], sizeof(buf) - pos);
+}
+
+// 異常終了時出力（リングバッファの内容をスレッド毎に古い順で書き出す。書式は展開せず、引数は
+// 文字列はそのまま・数値は16進で並べる。スレッド間の前後は通番で判断する）
+static void _DumpFromSignal(void)
+{
+	int fd = open(gDumpPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0) {
+		fd = STDERR_FILENO;
+	}
+	_SafeWriteString(fd, "------------------------ flight log dump (crash) ------------------------\n");
+	for (_LogRing* r = __atomic_load_n(&gRings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		for (uint32_t n = 0; n < _SLOT_NUM; n++) {
+			const _LogSlot*	slot	= &r->slots[(head + n) % _SLOT_NUM];
+			uint64_t		seq		= __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (seq == 0) {
+				continue;
+			}
+			const IPMsgLogSite*	site	= slot->site;
+			const uint8_t*		types	= __atomic_load_n((uint8_t**)&site->argTypes, __ATOMIC_ACQUIRE);
+			const char*			file	= strrchr(site->file, '/');
+			_SafeWriteString(fd, site->level);
+			_SafeWriteString(fd, "#");
+			_SafeWriteNumber(fd, seq, 10);
+			_SafeWriteString(fd, " [");
+			_SafeWriteNumber(fd, r->thread, 16);
+			_SafeWriteString(fd, "] ");
+			_SafeWriteString(fd, file ? file + 1 : site->file);
+			_SafeWriteString(fd, ":");
+			_SafeWriteNumber(fd, (uint64_t)site->line, 10);
+			_SafeWriteString(fd, site->func);
+			if (!types) {
+				_SafeWriteString(fd, "\n");
+				continue;
+			}
+			const uint8_t* t = types;
+			if (*t != _ARG_TEXT) {
+				// 書式文字列（引数種別列の後ろに保持）
+				const uint8_t* end = types;
+				while (*end != _ARG_END) {
+					end++;
+				}
+				_SafeWriteString(fd, " \"");
+				_SafeWriteString(fd, (const char*)(end + 1));
+				_SafeWriteString(fd, "\"");
+			}
+			uint16_t pos = 0;
+			for (; (*t != _ARG_END) && (pos < slot->length); t++) {
+				_SafeWriteString(fd, " ");
+				if ((*t == _ARG_CSTR) || (*t == _ARG_OBJ) || (*t == _ARG_TEXT)) {
+					uint8_t len = slot->args[pos];
+					if (pos + 1 + len > slot->length) {
+						break;
+					}
+					_SafeWrite(fd, &slot->args[pos + 1], len);
+					pos += 1 + len;
+				} else {
+					uint64_t v;
+					if (pos + sizeof(v) > slot->length) {
+						break;
+					}
+					memcpy(&v, &slot->args[pos], sizeof(v));
+					_SafeWriteString(fd, "0x");
+					_SafeWriteNumber(fd, v, 16);
+					pos += sizeof(v);
+				}
+			}
+			_SafeWriteString(fd, "\n");
+		}
+	}
+	if (fd != STDERR_FILENO) {
+		close(fd);
+	}
+}
+
+// 異常終了時出力（出力後は既定の処理で終了させる）
+static void _CrashSignalHandler(int sig)
+{
+	_DumpFromSignal();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static NSUncaughtExceptionHandler* gPrevExceptionHandler = NULL;
+
+static void _UncaughtExceptionHandler(NSException* exception)
+{
+	_DumpToPath(NULL);
+	if (gPrevExceptionHandler) {
+		gPrevExceptionHandler(exception);
+	}
+}
+
+// 初期化（出力先決定・異常終了フック・SIGUSR1での要求時出力）
+static void _FlightLogInstallOnce(void);
+
+static void _FlightLogInstall(void)
+{
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		_FlightLogInstallOnce();
+	});
+}
+
+static void _FlightLogInstallOnce(void)
+{
+	mach_timebase_info_data_t tb;
+	mach_timebase_info(&tb);
+	gTickToSec	= (double)tb.numer / (double)tb.denom / 1000000000.0;
+	gBaseTime	= mach_absolute_time();
+	gBaseDate	= CFAbsoluteTimeGetCurrent();
+	pthread_key_create(&gRingKey, _RingRelease);
+
+#if defined(IPMSG_DEBUG)
+	NSString*	dir	= [[[NSBundle mainBundle] bundlePath] stringByDeletingLastPathComponent];
+	NSString*	log	= [dir stringByAppendingPathComponent:@"DebugLog.txt"];
+#else
+	// Releaseビルドはアプリ配置先に書き込めないためユーザのログフォルダに出力
+	NSString*	dir	= [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Logs"];
+	NSString*	log	= [dir stringByAppendingPathComponent:@"IPMessenger-FlightLog.txt"];
+#endif
+	strlcpy(gDumpPath, log.fileSystemRepresentation, sizeof(gDumpPath));
+
+	int sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+	for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+		signal(sigs[i], _CrashSignalHandler);
+	}
+	gPrevExceptionHandler = NSGetUncaughtExceptionHandler();
+	NSSetUncaughtExceptionHandler(_UncaughtExceptionHandler);
+
+	signal(SIGUSR1, SIG_IGN);
+	dispatch_source_t src = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0,
+												   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+	dispatch_source_set_event_handler(src, ^{
+		IPMsgFlightLogDump(NULL);
+	});
+	dispatch_resume(src);
+}
+
 #endif
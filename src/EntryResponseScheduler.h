@@ -0,0 +1,66 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: EntryResponseScheduler.h
+ *	Module		: エントリ応答送信スケジューラクラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+@class UserInfo;
+@class EntryResponseScheduler;
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 応答種別
+typedef NS_OPTIONS(NSUInteger, EntryResponseKind)
+{
+	ENTRY_RESPONSE_ANSENTRY	= 1 << 0,		// ANSENTRY応答
+	ENTRY_RESPONSE_GETINFO	= 1 << 1		// バージョン情報問い合わせ
+};
+
+/*============================================================================*
+ * プロトコル定義
+ *============================================================================*/
+
+@protocol EntryResponseSchedulerDelegate <NSObject>
+
+// 応答送信（スケジューラのキューから呼ばれる）
+- (void)entryScheduler:(EntryResponseScheduler*)scheduler
+		  sendResponse:(EntryResponseKind)kind
+					to:(UserInfo*)user;
+
+@end
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+@interface EntryResponseScheduler : NSObject
+
+@property(weak)		id<EntryResponseSchedulerDelegate>	delegate;			// 送信処理
+@property(assign)	double								packetsPerSecond;	// 送信レート上限（パケット／秒）
+@property(assign)	NSUInteger							burst;				// 瞬間送信上限（パケット）
+@property(readonly)	NSUInteger							pendingCount;		// 送信待ち相手数
+
+// 標準の応答分散幅（既知ユーザ数とサブネットから決定）
++ (NSTimeInterval)spreadForUserCount:(NSUInteger)userNum sameSubnet:(BOOL)sameSubnet;
+
+// 応答予約（同一相手の送信待ちがあれば統合する）
+- (void)scheduleResponse:(EntryResponseKind)kind
+					  to:(UserInfo*)user
+				  within:(NSTimeInterval)spread;
+
+// 送信待ち破棄
+- (void)cancelResponsesTo:(UserInfo*)user;
+- (void)cancelAllResponses;
+
+#if defined(IPMSG_DEBUG)
+// ENTRY集中時の送信シミュレーション（結果はデバッグログに出力）
++ (void)simulateStormWithNodes:(NSUInteger)nodes;
+#endif
+
+@end
@@ -0,0 +1,384 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: EntryResponseScheduler.m
+ *	Module		: エントリ応答送信スケジューラクラス
+ *============================================================================*/
+
+#import "EntryResponseScheduler.h"
+#import "UserInfo.h"
+#import "DebugLog.h"
+
+#import <netinet/in.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+static const NSTimeInterval	_TICK_INTERVAL	= 0.05;		// 送信判定間隔（秒）
+static const NSTimeInterval	_RATE_WINDOW	= 1.0;		// 受信レート計測間隔（秒）
+static const NSTimeInterval	_SPREAD_MAX		= 30.0;		// 応答分散幅の上限（秒）
+static const double			_DEFAULT_RATE	= 200.0;	// 標準送信レート（パケット／秒）
+static const NSUInteger		_DEFAULT_BURST	= 20;		// 標準瞬間送信上限（パケット）
+
+/*============================================================================*
+ * 内部クラス
+ *============================================================================*/
+
+// 送信待ち応答
+@interface EntryResponse : NSObject
+
+@property(retain)	UserInfo*			user;		// 送信相手
+@property(assign)	EntryResponseKind	kind;		// 応答種別
+@property(assign)	NSTimeInterval		due;		// 送信予定時刻
+
+@end
+
+@implementation EntryResponse
+
+- (void)dealloc
+{
+	[_user release];
+	[super dealloc];
+}
+
+@end
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface EntryResponseScheduler()
+{
+	dispatch_queue_t	queue;
+	dispatch_source_t	timer;
+}
+
+@property(retain)	NSMapTable<UserInfo*, EntryResponse*>*	pending;		// 送信待ち（相手毎に1件）
+@property(assign)	double									tokens;			// 送信可能パケット数
+@property(assign)	NSTimeInterval							lastRefill;		// 最終補充時刻
+@property(assign)	NSUInteger								arrivals;		// 計測中の予約数
+@property(assign)	NSTimeInterval							windowStart;	// 計測開始時刻
+@property(assign)	double									arrivalRate;	// 予約レート（平滑化済み）
+
+- (void)scheduleResponse:(EntryResponseKind)kind
+					  to:(UserInfo*)user
+				  within:(NSTimeInterval)spread
+					  at:(NSTimeInterval)now;
+- (NSArray<EntryResponse*>*)dequeueResponsesAt:(NSTimeInterval)now;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation EntryResponseScheduler
+
+/*----------------------------------------------------------------------------*
+ * クラスメソッド
+ *----------------------------------------------------------------------------*/
+
+// 標準の応答分散幅
++ (NSTimeInterval)spreadForUserCount:(NSUInteger)userNum sameSubnet:(BOOL)sameSubnet
+{
+	if ((userNum < 50) || sameSubnet) {
+		// ユーザ数50人以下またはアドレス上位24bitが同じ場合 0 〜 1023 ms
+		return 1.023;
+	} else if (userNum < 300) {
+		// ユーザ数が300人以下なら 0 〜 2047 ms
+		return 2.047;
+	}
+	// それ以上は 0 〜 4095 ms
+	return 4.095;
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		queue				= dispatch_queue_create("jp.ishwt.ipmsg.entryresponse", DISPATCH_QUEUE_SERIAL);
+		timer				= NULL;
+		_pending			= [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory
+												  valueOptions:NSPointerFunctionsStrongMemory
+													  capacity:64];
+		_packetsPerSecond	= _DEFAULT_RATE;
+		_burst				= _DEFAULT_BURST;
+		_tokens				= _DEFAULT_BURST;
+		_lastRefill			= -1;
+		_windowStart		= -1;
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	if (timer) {
+		dispatch_source_cancel(timer);
+		dispatch_release(timer);
+	}
+	dispatch_release(queue);
+	[_pending release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * プロパティアクセス
+ *----------------------------------------------------------------------------*/
+
+// 送信待ち相手数
+- (NSUInteger)pendingCount
+{
+	@synchronized (self) {
+		return self.pending.count;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 応答予約
+ *----------------------------------------------------------------------------*/
+
+// 応答予約
+- (void)scheduleResponse:(EntryResponseKind)kind
+					  to:(UserInfo*)user
+				  within:(NSTimeInterval)spread
+{
+	if (!user || (kind == 0)) {
+		return;
+	}
+	@synchronized (self) {
+		[self scheduleResponse:kind to:user within:spread at:NSProcessInfo.processInfo.systemUptime];
+		if (!timer) {
+			// 送信待ちがある間だけタイマを動かす
+			timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+			uint64_t interval = (uint64_t)(_TICK_INTERVAL * NSEC_PER_SEC);
+			dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 5);
+			dispatch_source_set_event_handler(timer, ^{
+				[self fire];
+			});
+			dispatch_resume(timer);
+		}
+	}
+}
+
+// 送信待ち破棄
+- (void)cancelResponsesTo:(UserInfo*)user
+{
+	if (!user) {
+		return;
+	}
+	@synchronized (self) {
+		[self.pending removeObjectForKey:user];
+	}
+}
+
+// 全送信待ち破棄
+- (void)cancelAllResponses
+{
+	@synchronized (self) {
+		[self.pending removeAllObjects];
+		if (timer) {
+			dispatch_source_cancel(timer);
+			dispatch_release(timer);
+			timer = NULL;
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部処理
+ *----------------------------------------------------------------------------*/
+
+// 応答予約（時刻指定）
+- (void)scheduleResponse:(EntryResponseKind)kind
+					  to:(UserInfo*)user
+				  within:(NSTimeInterval)spread
+					  at:(NSTimeInterval)now
+{
+	// 予約レート計測
+	if (self.windowStart < 0) {
+		self.windowStart = now;
+	}
+	self.arrivals++;
+	if (now - self.windowStart >= _RATE_WINDOW) {
+		double rate			= (double)self.arrivals / (now - self.windowStart);
+		self.arrivalRate	= (self.arrivalRate + rate) / 2.0;
+		self.arrivals		= 0;
+		self.windowStart	= now;
+	}
+
+	EntryResponse* res = [self.pending objectForKey:user];
+	if (res) {
+		// 同一相手の送信待ちに統合（重複応答は送らない）
+		res.kind	|= kind;
+		res.user	= user;
+		TRC(@"merged(%@,kind=%lu)", user, res.kind);
+		return;
+	}
+
+	// 予約が集中している場合は送信レートで捌ける幅まで分散させる
+	NSTimeInterval adaptive = ((double)self.pending.count + self.arrivalRate) / self.packetsPerSecond;
+	spread = MIN(MAX(spread, adaptive), _SPREAD_MAX);
+
+	res = [[EntryResponse alloc] init];
+	res.user	= user;
+	res.kind	= kind;
+	res.due		= now + spread * ((double)arc4random_uniform(1024) / 1024.0);
+	[self.pending setObject:res forKey:user];
+	[res release];
+	TRC(@"scheduled(%@,kind=%lu,after %.0fms,pending=%lu)", user, kind, (res.due - now) * 1000.0, self.pending.count);
+}
+
+// 送信対象取り出し（トークンバケットで送信量を制限）
+- (NSArray<EntryResponse*>*)dequeueResponsesAt:(NSTimeInterval)now
+{
+	if (self.lastRefill < 0) {
+		self.lastRefill = now;
+	}
+	self.tokens		= MIN((double)self.burst, self.tokens + (now - self.lastRefill) * self.packetsPerSecond);
+	self.lastRefill	= now;
+
+	NSMutableArray<EntryResponse*>* due = [NSMutableArray array];
+	for (EntryResponse* res in self.pending.objectEnumerator) {
+		if (res.due <= now) {
+			[due addObject:res];
+		}
+	}
+	[due sortUsingComparator:^NSComparisonResult(EntryResponse* r1, EntryResponse* r2) {
+		return (r1.due < r2.due) ? NSOrderedAscending : ((r1.due > r2.due) ? NSOrderedDescending : NSOrderedSame);
+	}];
+
+	NSMutableArray<EntryResponse*>* list = [NSMutableArray arrayWithCapacity:due.count];
+	for (EntryResponse* res in due) {
+		NSUInteger cost = ((res.kind & ENTRY_RESPONSE_ANSENTRY) ? 1 : 0) + ((res.kind & ENTRY_RESPONSE_GETINFO) ? 1 : 0);
+		if (self.tokens < cost) {
+			break;
+		}
+		self.tokens -= cost;
+		[list addObject:res];
+		[self.pending removeObjectForKey:res.user];
+	}
+	return list;
+}
+
+// タイマ処理
+- (void)fire
+{
+	@autoreleasepool {
+		NSArray<EntryResponse*>* list;
+		@synchronized (self) {
+			list = [self dequeueResponsesAt:NSProcessInfo.processInfo.systemUptime];
+			if ((self.pending.count == 0) && timer) {
+				dispatch_source_cancel(timer);
+				dispatch_release(timer);
+				timer = NULL;
+			}
+		}
+		for (EntryResponse* res in list) {
+			[self.delegate entryScheduler:self sendResponse:res.kind to:res.user];
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * シミュレーション
+ *----------------------------------------------------------------------------*/
+
+#if defined(IPMSG_DEBUG)
+
+// ENTRY集中時の送信シミュレーション
+//	・各ノードは1秒以内に起動し、0.5秒間隔で3回BR_ENTRYを送る想定
+//	・従来方式（受信毎にANSENTRYを遅延送信＋GETINFOを即時送信）と秒毎の送信数を比較
++ (void)simulateStormWithNodes:(NSUInteger)nodes
+{
+	@autoreleasepool {
+		const NSUInteger	repeat		= 3;
+		const NSUInteger	buckets		= (NSUInteger)_SPREAD_MAX + 10;
+		NSUInteger*			legacy		= calloc(buckets, sizeof(NSUInteger));
+		NSUInteger*			scheduled	= calloc(buckets, sizeof(NSUInteger));
+		NSMutableArray*		events		= [NSMutableArray arrayWithCapacity:nodes * repeat];
+		if (!legacy || !scheduled) {
+			free(legacy);
+			free(scheduled);
+			return;
+		}
+		for (NSUInteger i = 0; i < nodes; i++) {
+			struct sockaddr_in addr;
+			addr.sin_family			= AF_INET;
+			addr.sin_addr.s_addr	= htonl((UInt32)(0x0A000000 + i));
+			addr.sin_port			= htons(2425);
+			UserInfo*		user	= [UserInfo userWithHostName:[NSString stringWithFormat:@"node%lu", i]
+													logOnName:@"sim"
+													  address:&addr];
+			NSTimeInterval	boot	= (double)arc4random_uniform(1000) / 1000.0;
+			for (NSUInteger r = 0; r < repeat; r++) {
+				[events addObject:@[@(boot + r * 0.5), user]];
+			}
+		}
+		[events sortUsingComparator:^NSComparisonResult(NSArray* e1, NSArray* e2) {
+			return [e1[0] compare:e2[0]];
+		}];
+
+		// 従来方式
+		NSUInteger known = 0;
+		for (NSArray* ev in events) {
+			NSTimeInterval	t		= [ev[0] doubleValue];
+			NSTimeInterval	spread	= [self spreadForUserCount:MIN(known++, nodes) sameSubnet:NO];
+			NSTimeInterval	ans		= t + spread * ((double)arc4random_uniform(1024) / 1024.0);
+			legacy[MIN((NSUInteger)t, buckets - 1)]++;
+			legacy[MIN((NSUInteger)ans, buckets - 1)]++;
+		}
+
+		// スケジューラ方式
+		EntryResponseScheduler* sch = [[EntryResponseScheduler alloc] init];
+		NSUInteger		index	= 0;
+		NSUInteger		sent	= 0;
+		NSUInteger		known2	= 0;
+		NSTimeInterval	last	= 0;
+		for (NSTimeInterval now = 0; now < buckets; now += _TICK_INTERVAL) {
+			while ((index < events.count) && ([events[index][0] doubleValue] <= now)) {
+				NSTimeInterval spread = [self spreadForUserCount:MIN(known2++, nodes) sameSubnet:NO];
+				[sch scheduleResponse:ENTRY_RESPONSE_ANSENTRY | ENTRY_RESPONSE_GETINFO
+								   to:events[index][1]
+							   within:spread
+								   at:now];
+				index++;
+			}
+			for (EntryResponse* res in [sch dequeueResponsesAt:now]) {
+				NSUInteger num = ((res.kind & ENTRY_RESPONSE_ANSENTRY) ? 1 : 0) + ((res.kind & ENTRY_RESPONSE_GETINFO) ? 1 : 0);
+				scheduled[(NSUInteger)now] += num;
+				sent += num;
+				last = now;
+			}
+			if ((index >= events.count) && (sch.pending.count == 0)) {
+				break;
+			}
+		}
+		[sch release];
+
+		NSUInteger legacyTotal	= 0;
+		NSUInteger legacyPeak	= 0;
+		NSUInteger schedPeak	= 0;
+		for (NSUInteger i = 0; i < buckets; i++) {
+			legacyTotal += legacy[i];
+			legacyPeak	= MAX(legacyPeak, legacy[i]);
+			schedPeak	= MAX(schedPeak, scheduled[i]);
+		}
+		DBG(@"EntryStorm(nodes=%lu,events=%lu)", nodes, events.count);
+		DBG(@"  legacy   : total=%lu packets, peak=%lu packets/s", legacyTotal, legacyPeak);
+		DBG(@"  scheduler: total=%lu packets, peak=%lu packets/s, drained in %.2fs", sent, schedPeak, last);
+		free(legacy);
+		free(scheduled);
+	}
+}
+
+#endif
+
+@end
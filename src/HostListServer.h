@@ -0,0 +1,50 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: HostListServer.h
+ *	Module		: ホストリスト配信クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import <netinet/in.h>
+
+@class UserInfo;
+@class HostListServer;
+
+/*============================================================================*
+ * プロトコル定義
+ *============================================================================*/
+
+@protocol HostListServerDelegate <NSObject>
+
+// ユーザのコマンド項目（ホストリストに載せる能力フラグ）
+- (UInt32)hostListServer:(HostListServer*)server commandForUser:(UserInfo*)user;
+
+@end
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// GETLISTに対するANSLIST本体をページ単位で作成・キャッシュする
+@interface HostListServer : NSObject
+
+@property(weak)		id<HostListServerDelegate>	delegate;		// コマンド項目作成
+@property(readonly)	size_t						pageLimit;		// 1ページの上限バイト数
+@property(readonly)	NSUInteger					numberOfHosts;	// 配信ユーザ数
+
+// 初期化
+- (instancetype)initWithPageLimit:(size_t)limit;
+
+// 配信相手管理（OKGETLISTを返した相手と既知ユーザのGETLISTにのみ、相手毎に一定期間内の上限数まで応答する）
+- (void)noteOfferTo:(struct sockaddr_in*)addr;
+- (BOOL)acceptRequestFrom:(struct sockaddr_in*)addr;
+
+// 指定位置からのページ（ANSLIST本体。ユーザ一覧が変わるまで同じデータを返す）
+- (NSData*)pageFrom:(NSUInteger)start utf8:(BOOL)utf8;
+
+// キャッシュ破棄
+- (void)invalidate;
+
+@end
@@ -0,0 +1,312 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: HostListServer.m
+ *	Module		: ホストリスト配信クラス
+ *============================================================================*/
+
+#import "HostListServer.h"
+#import "UserManager.h"
+#import "UserInfo.h"
+#import "NSString+IPMessenger.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// ホストリスト区切り（MessageCenter.mの定義と同値）
+#define _SEPARATOR		'\a'
+#define _DUMMY			"\b"
+
+static const NSTimeInterval	_OFFER_TTL	= 60.0;		// OKGETLIST送信後にGETLISTを受け付ける時間（秒）
+static const NSUInteger		_OFFER_MAX	= 1024;		// 受付待ち相手数上限
+static const NSTimeInterval	_ANSWER_WINDOW	= 10.0;	// 応答数を数える期間（秒）
+static const NSUInteger		_ANSWER_MAX		= 16;	// 期間内の相手毎応答数上限（送信元詐称による増幅の抑止）
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface HostListServer()
+{
+	NSMutableArray<NSData*>*					records[2];		// ユーザ毎編集済み項目（[0]SJIS/[1]UTF-8）
+	NSMutableDictionary<NSNumber*, NSData*>*	pages[2];		// 開始位置毎編集済みページ
+}
+
+@property(assign)	size_t											pageLimit;
+@property(assign)	BOOL											dirty;		// 一覧再取得要
+@property(retain)	NSArray<UserInfo*>*								hosts;		// 配信ユーザ一覧
+@property(retain)	NSMutableSet<NSNumber*>*						addresses;	// 配信ユーザのアドレス
+@property(retain)	NSMutableDictionary<NSNumber*, NSDate*>*		offers;		// OKGETLIST送信先
+@property(retain)	NSMutableDictionary<NSNumber*, NSDate*>*		answerFrom;	// 相手毎応答数計測開始時刻
+@property(retain)	NSMutableDictionary<NSNumber*, NSNumber*>*		answerNum;	// 相手毎応答数
+
+- (void)userListChanged:(NSNotification*)aNotification;
+- (void)refreshIfNeeded;
+- (BOOL)consumeAnswerFor:(NSNumber*)key;
+- (NSData*)recordForUser:(UserInfo*)user utf8:(BOOL)utf8;
+
+@end
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 項目追加（空はダミー項目、区切り文字は空白に置き換える）
+static void _AppendField(NSMutableData* data, NSString* str, BOOL utf8)
+{
+	if (str.length == 0) {
+		[data appendBytes:_DUMMY length:1];
+	} else {
+		NSUInteger	pos	= data.length;
+		[str appendToData:data usingUTF8:utf8 nullTerminate:NO];
+		char*		ptr	= data.mutableBytes;
+		for (NSUInteger i = pos; i < data.length; i++) {
+			if ((ptr[i] == _SEPARATOR) || (ptr[i] == '\0')) {
+				ptr[i] = ' ';
+			}
+		}
+	}
+	char sep = _SEPARATOR;
+	[data appendBytes:&sep length:1];
+}
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation HostListServer
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithPageLimit:(size_t)limit
+{
+	self = [super init];
+	if (self) {
+		_pageLimit	= limit;
+		_dirty		= YES;
+		_offers		= [[NSMutableDictionary alloc] init];
+		_answerFrom	= [[NSMutableDictionary alloc] init];
+		_answerNum	= [[NSMutableDictionary alloc] init];
+		[NSNotificationCenter.defaultCenter addObserver:self
+											   selector:@selector(userListChanged:)
+												   name:kIPMsgUserListChangedNotification
+												 object:nil];
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[NSNotificationCenter.defaultCenter removeObserver:self];
+	for (int i = 0; i < 2; i++) {
+		[records[i] release];
+		[pages[i] release];
+	}
+	[_hosts release];
+	[_addresses release];
+	[_offers release];
+	[_answerFrom release];
+	[_answerNum release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 配信相手管理
+ *----------------------------------------------------------------------------*/
+
+// OKGETLIST送信記録
+- (void)noteOfferTo:(struct sockaddr_in*)addr
+{
+	@synchronized (self) {
+		if (self.offers.count >= _OFFER_MAX) {
+			// 期限切れを整理
+			NSMutableArray<NSNumber*>* expired = [NSMutableArray array];
+			[self.offers enumerateKeysAndObjectsUsingBlock:^(NSNumber* key, NSDate* date, BOOL* stop) {
+				if (-date.timeIntervalSinceNow > _OFFER_TTL) {
+					[expired addObject:key];
+				}
+			}];
+			[self.offers removeObjectsForKeys:expired];
+			if (self.offers.count >= _OFFER_MAX) {
+				WRN(@"hostlist offers full(%lu)", self.offers.count);
+				return;
+			}
+		}
+		self.offers[@(addr->sin_addr.s_addr)] = [NSDate date];
+	}
+}
+
+// GETLIST受付判定
+- (BOOL)acceptRequestFrom:(struct sockaddr_in*)addr
+{
+	NSNumber* key = @(addr->sin_addr.s_addr);
+	@synchronized (self) {
+		NSDate* date = self.offers[key];
+		if (!date || (-date.timeIntervalSinceNow > _OFFER_TTL)) {
+			[self refreshIfNeeded];
+			if (![self.addresses containsObject:key]) {
+				return NO;
+			}
+		}
+		return [self consumeAnswerFor:key];
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * ページ作成
+ *----------------------------------------------------------------------------*/
+
+// 配信ユーザ数
+- (NSUInteger)numberOfHosts
+{
+	@synchronized (self) {
+		[self refreshIfNeeded];
+		return self.hosts.count;
+	}
+}
+
+// 指定位置からのページ
+- (NSData*)pageFrom:(NSUInteger)start utf8:(BOOL)utf8
+{
+	int enc = utf8 ? 1 : 0;
+	@synchronized (self) {
+		[self refreshIfNeeded];
+		// 一覧より後ろの位置は末尾（空ページ）として同じキャッシュを使う
+		start = MIN(start, self.hosts.count);
+		NSData* page = pages[enc][@(start)];
+		if (page) {
+			return [[page retain] autorelease];
+		}
+		if (!records[enc]) {
+			// 項目の編集は一覧の更新後初回のみ
+			records[enc] = [[NSMutableArray alloc] initWithCapacity:self.hosts.count];
+			for (UserInfo* user in self.hosts) {
+				[records[enc] addObject:[self recordForUser:user utf8:utf8]];
+			}
+		}
+		NSArray<NSData*>*	list	= records[enc];
+		NSUInteger			total	= list.count;
+		NSMutableData*		body	= [NSMutableData dataWithCapacity:self.pageLimit];
+		NSUInteger			index	= start;
+		// 先頭部（継続位置・件数）と終端の分を空けておく
+		size_t				limit	= (self.pageLimit > 32) ? (self.pageLimit - 32) : 0;
+		while (index < total) {
+			NSData* record = list[index];
+			if ((body.length + record.length > limit) && (body.length > 0)) {
+				break;
+			}
+			[body appendData:record];
+			index++;
+		}
+		NSUInteger		count	= index - start;
+		NSUInteger		next	= (index < total) ? index : 0;
+		NSMutableData*	data	= [NSMutableData dataWithCapacity:body.length + 32];
+		char			head[32];
+		int				len		= snprintf(head, sizeof(head), "%5lu%c%5lu%c", next, _SEPARATOR, count, _SEPARATOR);
+		[data appendBytes:head length:(NSUInteger)len];
+		[data appendData:body];
+		[data appendBytes:"\0" length:1];
+		page = [[data copy] autorelease];
+		pages[enc][@(start)] = page;
+		DBG(@"hostlist page built(start=%lu,count=%lu,next=%lu,%luBytes,utf8=%s)",
+			start, count, next, page.length, BOOLSTR(utf8));
+		return page;
+	}
+}
+
+// キャッシュ破棄
+- (void)invalidate
+{
+	@synchronized (self) {
+		self.dirty = YES;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// ユーザ一覧変更（次回要求時に作り直す）
+- (void)userListChanged:(NSNotification*)aNotification
+{
+	[self invalidate];
+}
+
+// 一覧再取得（ロック中に呼ぶ）
+- (void)refreshIfNeeded
+{
+	if (!self.dirty) {
+		return;
+	}
+	self.dirty	= NO;
+	self.hosts	= UserManager.sharedManager.users;
+	NSMutableSet<NSNumber*>* addrs = [NSMutableSet setWithCapacity:self.hosts.count];
+	for (UserInfo* user in self.hosts) {
+		[addrs addObject:@(user.address.sin_addr.s_addr)];
+	}
+	self.addresses = addrs;
+	for (int i = 0; i < 2; i++) {
+		[records[i] release];
+		records[i]	= nil;
+		[pages[i] release];
+		pages[i]	= [[NSMutableDictionary alloc] init];
+	}
+}
+
+// 応答数計上（ロック中に呼ぶ。上限を超えたらNO）
+- (BOOL)consumeAnswerFor:(NSNumber*)key
+{
+	NSDate* from = self.answerFrom[key];
+	if (!from || (-from.timeIntervalSinceNow > _ANSWER_WINDOW)) {
+		if (self.answerFrom.count >= _OFFER_MAX) {
+			// 期間切れを整理
+			NSMutableArray<NSNumber*>* expired = [NSMutableArray array];
+			[self.answerFrom enumerateKeysAndObjectsUsingBlock:^(NSNumber* addr, NSDate* date, BOOL* stop) {
+				if (-date.timeIntervalSinceNow > _ANSWER_WINDOW) {
+					[expired addObject:addr];
+				}
+			}];
+			[self.answerFrom removeObjectsForKeys:expired];
+			[self.answerNum removeObjectsForKeys:expired];
+			if (self.answerFrom.count >= _OFFER_MAX) {
+				WRN(@"hostlist answers full(%lu)", self.answerFrom.count);
+				return NO;
+			}
+		}
+		self.answerFrom[key]	= [NSDate date];
+		self.answerNum[key]		= @(0);
+	}
+	NSUInteger num = self.answerNum[key].unsignedIntegerValue;
+	if (num >= _ANSWER_MAX) {
+		DBG(@"hostlist answer limit(%lu in %.0fs)", num, _ANSWER_WINDOW);
+		return NO;
+	}
+	self.answerNum[key] = @(num + 1);
+	return YES;
+}
+
+// ユーザ項目編集（ログオン名・ホスト名・コマンド・アドレス・ポート・ユーザ名・グループ名）
+- (NSData*)recordForUser:(UserInfo*)user utf8:(BOOL)utf8
+{
+	NSMutableData*		data	= [NSMutableData dataWithCapacity:128];
+	UInt32				command	= [self.delegate hostListServer:self commandForUser:user];
+	struct sockaddr_in	addr	= user.address;
+	_AppendField(data, user.logOnName, utf8);
+	_AppendField(data, user.hostName, utf8);
+	_AppendField(data, [NSString stringWithFormat:@"%u", command], utf8);
+	_AppendField(data, user.ipAddress, utf8);
+	// ポートはネットワークバイトオーダのまま（受信側の解析処理と同じ）
+	_AppendField(data, [NSString stringWithFormat:@"%u", addr.sin_port], utf8);
+	_AppendField(data, user.userName, utf8);
+	_AppendField(data, user.groupName, utf8);
+	return data;
+}
+
+@end
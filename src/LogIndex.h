@@ -0,0 +1,65 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: LogIndex.h
+ *	Module		: 検索用ログ索引クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+@class UserInfo;
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// ログ種別フラグ
+typedef NS_OPTIONS(NSUInteger, LogIndexFlags)
+{
+	LOGINDEX_FLAG_RECEIVE	= 1 << 0,		// 受信メッセージ
+	LOGINDEX_FLAG_BROADCAST	= 1 << 1,		// 一斉通報
+	LOGINDEX_FLAG_MULTICAST	= 1 << 2,		// マルチキャスト
+	LOGINDEX_FLAG_ABSENCE	= 1 << 3,		// 不在応答
+	LOGINDEX_FLAG_LOCKED	= 1 << 4,		// 錠前付き
+	LOGINDEX_FLAG_SEALED	= 1 << 5,		// 封書
+	LOGINDEX_FLAG_ATTACHED	= 1 << 6		// 添付あり
+};
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 検索結果
+@interface LogIndexEntry : NSObject
+
+@property(readonly)	NSDate*				date;			// メッセージ日時
+@property(readonly)	LogIndexFlags		flags;			// 種別
+@property(readonly)	NSArray<NSString*>*	logOnNames;		// 送受信相手ログオン名
+@property(readonly)	NSString*			summary;		// 送受信相手概要
+@property(readonly)	NSString*			message;		// メッセージ本文
+
+@end
+
+// ログ索引
+@interface LogIndex : NSObject
+
+@property(readonly)	NSString*	path;				// 索引ディレクトリパス
+
+// 初期化
+- (instancetype)initWithPath:(NSString*)path;
+
+// 記録
+- (void)appendLogWithUsers:(NSArray<UserInfo*>*)users
+				   message:(NSString*)msg
+					 flags:(LogIndexFlags)flags
+					  date:(NSDate*)date;
+
+// 検索（新しい順）
+- (NSArray<LogIndexEntry*>*)searchLogOnName:(NSString*)logOnName
+									keyword:(NSString*)keyword
+									   from:(NSDate*)from
+										 to:(NSDate*)to
+									  limit:(NSUInteger)limit;
+
+@end
@@ -0,0 +1,922 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: LogIndex.m
+ *	Module		: 検索用ログ索引クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import "LogIndex.h"
+#import "UserInfo.h"
+#import "DebugLog.h"
+
+#import <sys/types.h>
+#import <sys/stat.h>
+#import <sys/mman.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _SEGMENT_MAX_SIZE	(32 * 1024 * 1024)	// セグメント最大サイズ
+#define _RECORD_MAGIC		0x524C5049U			// "IPLR"
+#define _INDEX_MAGIC		0x494C5049U			// "IPLI"
+#define _INDEX_VERSION		2						// 2:英数字を3-gramで索引
+#define _HASH_INIT			2166136261U			// FNV-1a 初期値
+#define _HASH_PRIME			16777619U			// FNV-1a 乗数
+
+static NSString* _SEGMENT_EXT	= @"log";
+static NSString* _INDEX_EXT		= @"idx";
+
+// セグメント内レコードヘッダ（後続に相手ログオン名、相手概要、本文がUTF-8で続く）
+typedef struct {
+	uint32_t	magic;			// レコード識別子
+	uint32_t	length;			// レコード長（ヘッダ含む）
+	int64_t		time;			// 記録時刻（索引用）
+	int64_t		date;			// メッセージ日時
+	uint32_t	flags;			// 種別フラグ
+	uint32_t	userLength;		// 相手ログオン名（改行区切り）長
+	uint32_t	summaryLength;	// 相手概要長
+	uint32_t	messageLength;	// 本文長
+} _RecordHeader;
+
+// 索引ファイルヘッダ（後続にレコード表、語句表、ポスティングが続く）
+typedef struct {
+	uint32_t	magic;			// 索引識別子
+	uint32_t	version;		// 索引形式バージョン
+	uint32_t	recordCount;	// レコード数
+	uint32_t	termCount;		// 語句数
+} _IndexHeader;
+
+// レコード表エントリ
+typedef struct {
+	uint64_t	offset;			// セグメント内位置
+	int64_t		time;			// 記録時刻
+} _IndexRecord;
+
+// 語句表エントリ（hash昇順）
+typedef struct {
+	uint32_t	hash;			// 語句ハッシュ
+	uint32_t	count;			// ポスティング数
+	uint64_t	start;			// ポスティング開始位置
+} _IndexTerm;
+
+// ポスティング参照
+typedef struct {
+	const uint32_t*	list;
+	NSUInteger		count;
+} _Posting;
+
+/*============================================================================*
+ * 語句分解
+ *============================================================================*/
+
+static inline uint32_t _HashUpdate(uint32_t hash, unichar c)
+{
+	hash = (hash ^ (c & 0xFF)) * _HASH_PRIME;
+	hash = (hash ^ (c >> 8)) * _HASH_PRIME;
+	return hash;
+}
+
+// CJK文字判定（分かち書きされないため2-gramで索引する）
+static inline BOOL _IsCJK(unichar c)
+{
+	return (((c >= 0x3040) && (c <= 0x30FF)) ||		// ひらがな／カタカナ
+			((c >= 0x3400) && (c <= 0x9FFF)) ||		// CJK統合漢字
+			((c >= 0xAC00) && (c <= 0xD7AF)) ||		// ハングル
+			((c >= 0xF900) && (c <= 0xFAFF)));		// CJK互換漢字
+}
+
+// 文字列を索引語句ハッシュに分解（英数字は単語内の3-gram、CJKは2-gram。部分一致で引けるようにする）
+// 3文字未満の英数字語は語句にならない（検索時は時刻範囲内の照合で絞る）
+static void _Tokenize(NSString* str, NSMutableIndexSet* terms)
+{
+	NSString*	norm	= str.precomposedStringWithCompatibilityMapping.lowercaseString;
+	NSUInteger	len		= norm.length;
+	if (len == 0) {
+		return;
+	}
+	unichar* buf = malloc(sizeof(unichar) * len);
+	if (!buf) {
+		ERR(@"malloc error(%lu)", len);
+		return;
+	}
+	[norm getCharacters:buf range:NSMakeRange(0, len)];
+	NSCharacterSet*	alnum	= NSCharacterSet.alphanumericCharacterSet;
+	NSUInteger		wordLen	= 0;
+	for (NSUInteger i = 0; i < len; i++) {
+		unichar c = buf[i];
+		if (_IsCJK(c)) {
+			if ((i + 1 < len) && _IsCJK(buf[i + 1])) {
+				[terms addIndex:_HashUpdate(_HashUpdate(_HASH_INIT, c), buf[i + 1])];
+			}
+			wordLen = 0;
+		} else if ([alnum characterIsMember:c]) {
+			wordLen++;
+			if (wordLen >= 3) {
+				// CJK 2-gramと区別するため先頭に制御文字を付加
+				uint32_t hash = _HashUpdate(_HASH_INIT, 0x02);
+				hash = _HashUpdate(hash, buf[i - 2]);
+				hash = _HashUpdate(hash, buf[i - 1]);
+				[terms addIndex:_HashUpdate(hash, c)];
+			}
+		} else {
+			wordLen = 0;
+		}
+	}
+	free(buf);
+}
+
+// ログオン名の索引語句ハッシュ（本文の語句と区別するため先頭に制御文字を付加）
+static uint32_t _UserTerm(NSString* logOnName)
+{
+	uint32_t	hash	= _HashUpdate(_HASH_INIT, 0x01);
+	NSUInteger	len		= logOnName.length;
+	for (NSUInteger i = 0; i < len; i++) {
+		hash = _HashUpdate(hash, [logOnName characterAtIndex:i]);
+	}
+	return hash;
+}
+
+/*============================================================================*
+ * 索引探索
+ *============================================================================*/
+
+// 指定時刻以上の最初のレコード位置
+static NSUInteger _LowerBound(const _IndexRecord* records, NSUInteger count, int64_t time)
+{
+	NSUInteger lo = 0;
+	NSUInteger hi = count;
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (records[mid].time < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// 指定時刻より後の最初のレコード位置
+static NSUInteger _UpperBound(const _IndexRecord* records, NSUInteger count, int64_t time)
+{
+	NSUInteger lo = 0;
+	NSUInteger hi = count;
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (records[mid].time <= time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+// ポスティング内のレコード番号存在チェック
+static BOOL _PostingContains(const _Posting* posting, uint32_t recNo)
+{
+	NSUInteger lo = 0;
+	NSUInteger hi = posting->count;
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (posting->list[mid] < recNo) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return ((lo < posting->count) && (posting->list[lo] == recNo));
+}
+
+static int _PostingCompare(const void* a, const void* b)
+{
+	NSUInteger ca = ((const _Posting*)a)->count;
+	NSUInteger cb = ((const _Posting*)b)->count;
+	return (ca < cb) ? -1 : ((ca > cb) ? 1 : 0);
+}
+
+// 索引ファイルの形式チェック
+static BOOL _IndexIsCurrent(NSString* path)
+{
+	_IndexHeader	head;
+	int				ifd	= open(path.fileSystemRepresentation, O_RDONLY);
+	if (ifd < 0) {
+		return NO;
+	}
+	BOOL ret = ((read(ifd, &head, sizeof(head)) == sizeof(head)) &&
+				(head.magic == _INDEX_MAGIC) && (head.version == _INDEX_VERSION));
+	close(ifd);
+	return ret;
+}
+
+/*============================================================================*
+ * 検索結果クラス
+ *============================================================================*/
+
+@interface LogIndexEntry()
+
+@property(retain)	NSDate*				date;
+@property(assign)	LogIndexFlags		flags;
+@property(retain)	NSArray<NSString*>*	logOnNames;
+@property(copy)		NSString*			summary;
+@property(copy)		NSString*			message;
+@property(assign)	int64_t				time;
+@property(assign)	uint32_t			length;
+
++ (instancetype)entryWithBytes:(const void*)bytes length:(size_t)length;
+- (NSIndexSet*)terms;
+
+@end
+
+@implementation LogIndexEntry
+
+// レコードから生成
++ (instancetype)entryWithBytes:(const void*)bytes length:(size_t)length
+{
+	if (length < sizeof(_RecordHeader)) {
+		return nil;
+	}
+	// レコードは詰めて格納しているためヘッダは複写して参照
+	_RecordHeader head;
+	memcpy(&head, bytes, sizeof(head));
+	if ((head.magic != _RECORD_MAGIC) || (head.length > length) ||
+		(sizeof(head) + (size_t)head.userLength + head.summaryLength + head.messageLength != head.length)) {
+		return nil;
+	}
+	const char*		ptr		= (const char*)bytes + sizeof(head);
+	NSString*		users	= [[NSString alloc] initWithBytes:ptr length:head.userLength encoding:NSUTF8StringEncoding];
+	ptr += head.userLength;
+	NSString*		summary	= [[NSString alloc] initWithBytes:ptr length:head.summaryLength encoding:NSUTF8StringEncoding];
+	ptr += head.summaryLength;
+	NSString*		message	= [[NSString alloc] initWithBytes:ptr length:head.messageLength encoding:NSUTF8StringEncoding];
+	LogIndexEntry*	entry	= [[[LogIndexEntry alloc] init] autorelease];
+	entry.time			= head.time;
+	entry.length		= head.length;
+	entry.date			= [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)head.date];
+	entry.flags			= head.flags;
+	entry.logOnNames	= (users.length > 0) ? [users componentsSeparatedByString:@"\n"] : @[];
+	entry.summary		= summary;
+	entry.message		= message;
+	[users release];
+	[summary release];
+	[message release];
+	return entry;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_date release];
+	[_logOnNames release];
+	[_summary release];
+	[_message release];
+	[super dealloc];
+}
+
+// 索引語句
+- (NSIndexSet*)terms
+{
+	NSMutableIndexSet* terms = [NSMutableIndexSet indexSet];
+	for (NSString* logOnName in self.logOnNames) {
+		[terms addIndex:_UserTerm(logOnName)];
+	}
+	_Tokenize(self.summary, terms);
+	_Tokenize(self.message, terms);
+	return terms;
+}
+
+// オブジェクト概要
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"LogIndexEntry[%@,Users:%@]", self.date,
+									[self.logOnNames componentsJoinedByString:@","]];
+}
+
+@end
+
+/*============================================================================*
+ * セグメントクラス
+ *============================================================================*/
+
+@interface LogIndexSegment : NSObject
+{
+	// 確定済みセグメント（mmap参照）
+	const char*				logMap;
+	size_t					logMapLength;
+	const char*				indexMap;
+	size_t					indexMapLength;
+	// 書き込み中セグメント（メモリ上索引）
+	int						fd;
+	NSMutableData*			records;
+	NSMutableDictionary<NSNumber*, NSMutableData*>*	postings;
+}
+
+@property(readonly)	NSInteger	number;			// セグメント番号
+@property(readonly)	NSString*	logPath;		// セグメントファイルパス
+@property(readonly)	NSString*	indexPath;		// 索引ファイルパス
+@property(readonly)	BOOL		sealed;			// 確定済みか
+@property(readonly)	off_t		size;			// セグメントサイズ
+@property(readonly)	int64_t		lastTime;		// 最終記録時刻
+
+- (instancetype)initWithDirectory:(NSString*)dir number:(NSInteger)number sealed:(BOOL)sealed;
+- (BOOL)appendRecord:(NSData*)record time:(int64_t)time terms:(NSIndexSet*)terms;
+- (BOOL)seal;
+- (NSUInteger)recordCount;
+- (const _IndexRecord*)recordTable;
+- (BOOL)posting:(_Posting*)posting forHash:(uint32_t)hash;
+- (LogIndexEntry*)entryAtRecord:(NSUInteger)recNo;
+
+@end
+
+@implementation LogIndexSegment
+
+// 初期化
+- (instancetype)initWithDirectory:(NSString*)dir number:(NSInteger)number sealed:(BOOL)sealed
+{
+	self = [super init];
+	if (self) {
+		NSString* base = [dir stringByAppendingPathComponent:[NSString stringWithFormat:@"%08ld", number]];
+		_number		= number;
+		_logPath	= [[base stringByAppendingPathExtension:_SEGMENT_EXT] copy];
+		_indexPath	= [[base stringByAppendingPathExtension:_INDEX_EXT] copy];
+		_sealed		= sealed;
+		fd			= -1;
+		if (!sealed && ![self openForAppend]) {
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	if (logMap) {
+		munmap((void*)logMap, logMapLength);
+	}
+	if (indexMap) {
+		munmap((void*)indexMap, indexMapLength);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	[records release];
+	[postings release];
+	[_logPath release];
+	[_indexPath release];
+	[super dealloc];
+}
+
+// 書き込み用オープン（既存レコードからメモリ上索引を再構築）
+- (BOOL)openForAppend
+{
+	fd = open(self.logPath.fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		ERR(@"segment open error(%@,%s)", self.logPath, strerror(errno));
+		return NO;
+	}
+	records		= [[NSMutableData alloc] init];
+	postings	= [[NSMutableDictionary alloc] init];
+
+	NSData* data = [NSData dataWithContentsOfFile:self.logPath options:NSDataReadingMappedIfSafe error:nil];
+	size_t	pos  = 0;
+	while (pos + sizeof(_RecordHeader) <= data.length) {
+		const char*		ptr		= (const char*)data.bytes + pos;
+		LogIndexEntry*	entry	= [LogIndexEntry entryWithBytes:ptr length:data.length - pos];
+		if (!entry) {
+			break;
+		}
+		_IndexRecord rec = { pos, entry.time };
+		[self addRecord:&rec terms:entry.terms];
+		_lastTime	= entry.time;
+		pos			+= entry.length;
+	}
+	if (pos < data.length) {
+		// 書き込み途中で終了した末尾レコードを破棄
+		WRN(@"segment truncated(%@,%zu->%zu)", self.logPath, (size_t)data.length, pos);
+		if (ftruncate(fd, (off_t)pos) != 0) {
+			ERR(@"segment truncate error(%@,%s)", self.logPath, strerror(errno));
+		}
+	}
+	_size = (off_t)pos;
+	DBG(@"segment opened(%@,records=%lu,terms=%lu)", self.logPath, self.recordCount, postings.count);
+	return YES;
+}
+
+// メモリ上索引への追加
+- (void)addRecord:(const _IndexRecord*)rec terms:(NSIndexSet*)terms
+{
+	uint32_t recNo = (uint32_t)self.recordCount;
+	[records appendBytes:rec length:sizeof(_IndexRecord)];
+	for (NSUInteger hash = terms.firstIndex; hash != NSNotFound; hash = [terms indexGreaterThanIndex:hash]) {
+		NSNumber*		key		= @(hash);
+		NSMutableData*	list	= postings[key];
+		if (!list) {
+			list = [NSMutableData dataWithCapacity:sizeof(uint32_t) * 4];
+			postings[key] = list;
+		}
+		[list appendBytes:&recNo length:sizeof(recNo)];
+	}
+}
+
+// レコード追記
+- (BOOL)appendRecord:(NSData*)record time:(int64_t)time terms:(NSIndexSet*)terms
+{
+	if (self.sealed || (fd < 0)) {
+		ERR(@"segment not writable(%@)", self.logPath);
+		return NO;
+	}
+	ssize_t written = pwrite(fd, record.bytes, record.length, self.size);
+	if (written != (ssize_t)record.length) {
+		ERR(@"segment write error(%@,%s)", self.logPath, strerror(errno));
+		ftruncate(fd, self.size);
+		return NO;
+	}
+	_IndexRecord rec = { (uint64_t)self.size, time };
+	[self addRecord:&rec terms:terms];
+	_size		+= record.length;
+	_lastTime	= time;
+	return YES;
+}
+
+// セグメント確定（索引ファイル出力）
+- (BOOL)seal
+{
+	if (self.sealed) {
+		return YES;
+	}
+	NSArray<NSNumber*>*	keys	= [postings.allKeys sortedArrayUsingSelector:@selector(compare:)];
+	_IndexHeader		head	= { _INDEX_MAGIC, _INDEX_VERSION, (uint32_t)self.recordCount, (uint32_t)keys.count };
+	NSMutableData*		data	= [NSMutableData dataWithCapacity:sizeof(head) + records.length + sizeof(_IndexTerm) * keys.count];
+	[data appendBytes:&head length:sizeof(head)];
+	[data appendData:records];
+	uint64_t start = 0;
+	for (NSNumber* key in keys) {
+		uint32_t	count	= (uint32_t)(postings[key].length / sizeof(uint32_t));
+		_IndexTerm	term	= { key.unsignedIntValue, count, start };
+		[data appendBytes:&term length:sizeof(term)];
+		start += count;
+	}
+	for (NSNumber* key in keys) {
+		[data appendData:postings[key]];
+	}
+	if (![data writeToFile:self.indexPath atomically:YES]) {
+		ERR(@"index write error(%@)", self.indexPath);
+		return NO;
+	}
+	close(fd);
+	fd = -1;
+	[records release];
+	records = nil;
+	[postings release];
+	postings = nil;
+	_sealed = YES;
+	DBG(@"segment sealed(%@,records=%u,terms=%lu)", self.logPath, head.recordCount, keys.count);
+	return YES;
+}
+
+// 確定済みセグメントのマッピング（検索は書き込みロック外で並行して行うため排他する）
+- (BOOL)map
+{
+	@synchronized (self) {
+		return [self mapLocked];
+	}
+}
+
+// 確定済みセグメントのマッピング（ロック中に呼ぶ）
+- (BOOL)mapLocked
+{
+	if (indexMap) {
+		return YES;
+	}
+	struct stat	st;
+	int			lfd	= open(self.logPath.fileSystemRepresentation, O_RDONLY);
+	int			ifd	= open(self.indexPath.fileSystemRepresentation, O_RDONLY);
+	BOOL		ret	= NO;
+	if ((lfd >= 0) && (ifd >= 0)) {
+		if ((fstat(lfd, &st) == 0) && (st.st_size > 0)) {
+			logMapLength	= (size_t)st.st_size;
+			logMap			= mmap(NULL, logMapLength, PROT_READ, MAP_PRIVATE, lfd, 0);
+		}
+		if ((fstat(ifd, &st) == 0) && (st.st_size >= (off_t)sizeof(_IndexHeader))) {
+			indexMapLength	= (size_t)st.st_size;
+			indexMap		= mmap(NULL, indexMapLength, PROT_READ, MAP_PRIVATE, ifd, 0);
+		}
+		if (logMap == MAP_FAILED) {
+			logMap = NULL;
+		}
+		if (indexMap == MAP_FAILED) {
+			indexMap = NULL;
+		}
+		if (logMap && indexMap) {
+			const _IndexHeader* head = (const _IndexHeader*)indexMap;
+			ret = ((head->magic == _INDEX_MAGIC) && (head->version == _INDEX_VERSION) &&
+				   (sizeof(_IndexHeader) + sizeof(_IndexRecord) * (size_t)head->recordCount +
+					sizeof(_IndexTerm) * (size_t)head->termCount <= indexMapLength));
+		}
+	}
+	if (lfd >= 0) {
+		close(lfd);
+	}
+	if (ifd >= 0) {
+		close(ifd);
+	}
+	if (!ret) {
+		ERR(@"segment map error(%@)", self.logPath);
+		if (logMap) {
+			munmap((void*)logMap, logMapLength);
+			logMap = NULL;
+		}
+		if (indexMap) {
+			munmap((void*)indexMap, indexMapLength);
+			indexMap = NULL;
+		}
+	}
+	return ret;
+}
+
+// レコード数
+- (NSUInteger)recordCount
+{
+	if (!self.sealed) {
+		return records.length / sizeof(_IndexRecord);
+	}
+	return [self map] ? ((const _IndexHeader*)indexMap)->recordCount : 0;
+}
+
+// レコード表
+- (const _IndexRecord*)recordTable
+{
+	if (!self.sealed) {
+		return records.bytes;
+	}
+	return [self map] ? (const _IndexRecord*)(indexMap + sizeof(_IndexHeader)) : NULL;
+}
+
+// 語句のポスティング取得
+- (BOOL)posting:(_Posting*)posting forHash:(uint32_t)hash
+{
+	if (!self.sealed) {
+		NSData* list = postings[@(hash)];
+		posting->list	= list.bytes;
+		posting->count	= list.length / sizeof(uint32_t);
+		return (list != nil);
+	}
+	if (![self map]) {
+		return NO;
+	}
+	const _IndexHeader*	head	= (const _IndexHeader*)indexMap;
+	const _IndexTerm*	terms	= (const _IndexTerm*)(indexMap + sizeof(_IndexHeader) + sizeof(_IndexRecord) * head->recordCount);
+	const uint32_t*		lists	= (const uint32_t*)(terms + head->termCount);
+	NSUInteger			lo		= 0;
+	NSUInteger			hi		= head->termCount;
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (terms[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo >= head->termCount) || (terms[lo].hash != hash)) {
+		return NO;
+	}
+	if ((const char*)(lists + terms[lo].start + terms[lo].count) > indexMap + indexMapLength) {
+		ERR(@"index corrupted(%@)", self.indexPath);
+		return NO;
+	}
+	posting->list	= lists + terms[lo].start;
+	posting->count	= terms[lo].count;
+	return YES;
+}
+
+// レコード読み込み
+- (LogIndexEntry*)entryAtRecord:(NSUInteger)recNo
+{
+	const _IndexRecord* rec = self.recordTable + recNo;
+	if (self.sealed) {
+		if (rec->offset >= logMapLength) {
+			return nil;
+		}
+		return [LogIndexEntry entryWithBytes:logMap + rec->offset length:logMapLength - (size_t)rec->offset];
+	}
+	_RecordHeader head;
+	if (pread(fd, &head, sizeof(head), (off_t)rec->offset) != sizeof(head)) {
+		ERR(@"segment read error(%@,%s)", self.logPath, strerror(errno));
+		return nil;
+	}
+	NSMutableData* data = [NSMutableData dataWithLength:head.length];
+	if (!data || (pread(fd, data.mutableBytes, head.length, (off_t)rec->offset) != (ssize_t)head.length)) {
+		ERR(@"segment read error(%@,%s)", self.logPath, strerror(errno));
+		return nil;
+	}
+	return [LogIndexEntry entryWithBytes:data.bytes length:data.length];
+}
+
+@end
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface LogIndex()
+
+@property(retain)	NSMutableArray<LogIndexSegment*>*	segments;
+@property(retain)	LogIndexSegment*					active;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation LogIndex
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithPath:(NSString*)path
+{
+	self = [super init];
+	if (self) {
+		NSFileManager* fm = NSFileManager.defaultManager;
+		if (![fm createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:nil]) {
+			ERR(@"index directory create error(%@)", path);
+			[self release];
+			return nil;
+		}
+		_path		= [path copy];
+		_segments	= [[NSMutableArray alloc] init];
+
+		// 既存セグメント読み込み
+		NSMutableArray<NSNumber*>* numbers = [NSMutableArray array];
+		for (NSString* name in [fm contentsOfDirectoryAtPath:path error:nil]) {
+			if ([name.pathExtension isEqualToString:_SEGMENT_EXT]) {
+				[numbers addObject:@(name.stringByDeletingPathExtension.integerValue)];
+			}
+		}
+		[numbers sortUsingSelector:@selector(compare:)];
+		for (NSNumber* num in numbers) {
+			NSString*			idx		= [[path stringByAppendingPathComponent:[NSString stringWithFormat:@"%08ld", num.integerValue]]
+																		stringByAppendingPathExtension:_INDEX_EXT];
+			BOOL				sealed	= [fm fileExistsAtPath:idx];
+			if (sealed && !_IndexIsCurrent(idx)) {
+				// 旧形式の索引はレコードから作り直す
+				DBG(@"index format outdated(%@) -> rebuild", idx);
+				[fm removeItemAtPath:idx error:nil];
+				sealed = NO;
+			}
+			LogIndexSegment*	seg		= [[LogIndexSegment alloc] initWithDirectory:path number:num.integerValue sealed:sealed];
+			if (!seg) {
+				continue;
+			}
+			if (!sealed && ![num isEqual:numbers.lastObject]) {
+				// 索引未出力のまま残った途中セグメント
+				[seg seal];
+			}
+			[_segments addObject:seg];
+			[seg release];
+		}
+		LogIndexSegment* last = _segments.lastObject;
+		if (last && !last.sealed) {
+			_active = [last retain];
+		}
+		DBG(@"LogIndex opened(%@,segments=%lu)", path, _segments.count);
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_path release];
+	[_segments release];
+	[_active release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 記録
+ *----------------------------------------------------------------------------*/
+
+// ログ記録
+- (void)appendLogWithUsers:(NSArray<UserInfo*>*)users
+				   message:(NSString*)msg
+					 flags:(LogIndexFlags)flags
+					  date:(NSDate*)date
+{
+	NSMutableArray<NSString*>*	logOnNames	= [NSMutableArray arrayWithCapacity:users.count];
+	NSMutableArray<NSString*>*	summaries	= [NSMutableArray arrayWithCapacity:users.count];
+	for (UserInfo* user in users) {
+		[logOnNames addObject:user.logOnName];
+		[summaries addObject:user.summaryString];
+	}
+	NSData*	userData	= [[logOnNames componentsJoinedByString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+	NSData*	summaryData	= [[summaries componentsJoinedByString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+	NSData*	messageData	= [(msg ? msg : @"") dataUsingEncoding:NSUTF8StringEncoding];
+
+	// 索引語句
+	NSMutableIndexSet* terms = [NSMutableIndexSet indexSet];
+	for (NSString* logOnName in logOnNames) {
+		[terms addIndex:_UserTerm(logOnName)];
+	}
+	for (NSString* summary in summaries) {
+		_Tokenize(summary, terms);
+	}
+	_Tokenize(msg, terms);
+
+	_RecordHeader head;
+	head.magic			= _RECORD_MAGIC;
+	head.length			= (uint32_t)(sizeof(head) + userData.length + summaryData.length + messageData.length);
+	head.date			= (int64_t)(date ? date : [NSDate date]).timeIntervalSince1970;
+	head.flags			= (uint32_t)flags;
+	head.userLength		= (uint32_t)userData.length;
+	head.summaryLength	= (uint32_t)summaryData.length;
+	head.messageLength	= (uint32_t)messageData.length;
+
+	@synchronized (self) {
+		if (!self.active) {
+			NSInteger			num	= self.segments.lastObject.number + 1;
+			LogIndexSegment*	seg	= [[LogIndexSegment alloc] initWithDirectory:self.path number:num sealed:NO];
+			if (!seg) {
+				return;
+			}
+			[self.segments addObject:seg];
+			self.active = seg;
+			[seg release];
+		}
+		// 索引の時刻は単調増加とする（時刻範囲を二分探索するため）
+		int64_t lastTime = self.active.lastTime;
+		if (self.segments.count > 1) {
+			LogIndexSegment* prev = self.segments[self.segments.count - 2];
+			lastTime = MAX(lastTime, prev.lastTime);
+		}
+		head.time = MAX((int64_t)NSDate.date.timeIntervalSince1970, lastTime);
+
+		NSMutableData* record = [NSMutableData dataWithCapacity:head.length];
+		[record appendBytes:&head length:sizeof(head)];
+		[record appendData:userData];
+		[record appendData:summaryData];
+		[record appendData:messageData];
+		if (![self.active appendRecord:record time:head.time terms:terms]) {
+			return;
+		}
+		if (self.active.size >= _SEGMENT_MAX_SIZE) {
+			if ([self.active seal]) {
+				self.active = nil;
+			}
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 検索
+ *----------------------------------------------------------------------------*/
+
+// ログ検索
+- (NSArray<LogIndexEntry*>*)searchLogOnName:(NSString*)logOnName
+									keyword:(NSString*)keyword
+									   from:(NSDate*)from
+										 to:(NSDate*)to
+									  limit:(NSUInteger)limit
+{
+	NSMutableArray<LogIndexEntry*>*	result	= [NSMutableArray array];
+	NSArray<NSString*>*				words	= nil;
+	NSMutableIndexSet*				terms	= [NSMutableIndexSet indexSet];
+	int64_t							tFrom	= from ? (int64_t)from.timeIntervalSince1970 : INT64_MIN;
+	int64_t							tTo		= to ? (int64_t)to.timeIntervalSince1970 : INT64_MAX;
+	if (limit == 0) {
+		limit = NSUIntegerMax;
+	}
+	if (logOnName.length > 0) {
+		[terms addIndex:_UserTerm(logOnName)];
+	}
+	if (keyword.length > 0) {
+		// 空白区切りはAND条件
+		NSCharacterSet*	spaces	= NSCharacterSet.whitespaceAndNewlineCharacterSet;
+		NSPredicate*	nonNull	= [NSPredicate predicateWithFormat:@"length > 0"];
+		words = [[keyword componentsSeparatedByCharactersInSet:spaces] filteredArrayUsingPredicate:nonNull];
+		_Tokenize(keyword, terms);
+	}
+
+	// 確定済みセグメントは変更されないため書き込みロック外で検索する（書き込み中セグメントのみロック）
+	NSDate*						start	= [NSDate date];
+	NSArray<LogIndexSegment*>*	segs	= nil;
+	LogIndexSegment*			active	= nil;
+	@synchronized (self) {
+		segs	= [[self.segments copy] autorelease];
+		active	= [[self.active retain] autorelease];
+	}
+	for (LogIndexSegment* seg in segs.reverseObjectEnumerator) {
+		BOOL more;
+		if (seg == active) {
+			@synchronized (self) {
+				more = [self searchSegment:seg terms:terms logOnName:logOnName words:words
+									  from:tFrom to:tTo limit:limit result:result];
+			}
+		} else {
+			more = [self searchSegment:seg terms:terms logOnName:logOnName words:words
+								  from:tFrom to:tTo limit:limit result:result];
+		}
+		if (!more) {
+			break;
+		}
+	}
+	DBG(@"search done(%lu hits,%.3fms)", result.count, -start.timeIntervalSinceNow * 1000.0);
+	return result;
+}
+
+// セグメント内検索（上限到達時NO）
+- (BOOL)searchSegment:(LogIndexSegment*)seg
+				terms:(NSIndexSet*)terms
+			logOnName:(NSString*)logOnName
+				words:(NSArray<NSString*>*)words
+				 from:(int64_t)from
+				   to:(int64_t)to
+				limit:(NSUInteger)limit
+			   result:(NSMutableArray<LogIndexEntry*>*)result
+{
+	const _IndexRecord*	recs	= seg.recordTable;
+	NSUInteger			count	= seg.recordCount;
+	if (!recs || (count == 0)) {
+		return YES;
+	}
+	NSUInteger lo = _LowerBound(recs, count, from);
+	NSUInteger hi = _UpperBound(recs, count, to);
+	if (lo >= hi) {
+		return YES;
+	}
+
+	// 語句毎のポスティングを件数の少ない順に並べる
+	NSUInteger	num			= 0;
+	_Posting*	postings	= malloc(sizeof(_Posting) * MAX(terms.count, 1));
+	if (!postings) {
+		ERR(@"malloc error(%lu)", terms.count);
+		return NO;
+	}
+	for (NSUInteger hash = terms.firstIndex; hash != NSNotFound; hash = [terms indexGreaterThanIndex:hash]) {
+		if (![seg posting:&postings[num] forHash:(uint32_t)hash]) {
+			// 含まれない語句がある
+			free(postings);
+			return YES;
+		}
+		num++;
+	}
+	qsort(postings, num, sizeof(_Posting), _PostingCompare);
+
+	// 候補レコードを新しい順に照合
+	NSUInteger	cand	= (num > 0) ? postings[0].count : (hi - lo);
+	BOOL		ret		= YES;
+	while (cand-- > 0) {
+		uint32_t recNo = (num > 0) ? postings[0].list[cand] : (uint32_t)(lo + cand);
+		if (recNo >= hi) {
+			continue;
+		}
+		if (recNo < lo) {
+			break;
+		}
+		BOOL hit = YES;
+		for (NSUInteger i = 1; hit && (i < num); i++) {
+			hit = _PostingContains(&postings[i], recNo);
+		}
+		if (!hit) {
+			continue;
+		}
+		LogIndexEntry* entry = [seg entryAtRecord:recNo];
+		if (!entry) {
+			continue;
+		}
+		// ハッシュ衝突やn-gramの偽陽性を除外
+		if ((logOnName.length > 0) && ![entry.logOnNames containsObject:logOnName]) {
+			continue;
+		}
+		for (NSString* word in words) {
+			NSStringCompareOptions opt = NSCaseInsensitiveSearch | NSWidthInsensitiveSearch;
+			if (([entry.message rangeOfString:word options:opt].location == NSNotFound) &&
+				([entry.summary rangeOfString:word options:opt].location == NSNotFound)) {
+				hit = NO;
+				break;
+			}
+		}
+		if (!hit) {
+			continue;
+		}
+		[result addObject:entry];
+		if (result.count >= limit) {
+			ret = NO;
+			break;
+		}
+	}
+	free(postings);
+	return ret;
+}
+
+@end
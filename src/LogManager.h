@@ -11,6 +11,7 @@
 @class RecvMessage;
 @class SendMessage;
 @class UserInfo;
+@class LogIndex;
 
 /*============================================================================*
  * クラス定義
@@ -18,7 +19,8 @@
 
 @interface LogManager : NSObject
 
-@property(copy)	NSString*	filePath;		// ログファイルパス
+@property(copy)		NSString*	filePath;		// ログファイルパス
+@property(readonly)	LogIndex*	logIndex;		// 検索用索引（未使用時nil）
 
 // ファクトリ
 + (LogManager*)standardLog;
@@ -8,6 +8,7 @@
 
 #import <Foundation/Foundation.h>
 #import "LogManager.h"
+#import "LogIndex.h"
 #import "UserInfo.h"
 #import "Config.h"
 #import "RecvMessage.h"
@@ -28,6 +29,7 @@ static NSString* _HEAD_END		= @"-------------------------------------\n";
 @property(copy)		NSString*			typeSealed;
 @property(copy)		NSString*			typeAttached;
 @property(retain)	NSDateFormatter*	dateFormat;
+@property(retain)	LogIndex*			logIndex;
 
 - (void)writeLog:(NSString*)msg;
 
@@ -104,9 +106,29 @@ static NSString* _HEAD_END		= @"-------------------------------------\n";
 	[_typeSealed release];
 	[_typeAttached release];
 	[_dateFormat release];
+	[_logIndex release];
 	[super dealloc];
 }
 
+/*============================================================================*
+ * 検索用索引
+ *============================================================================*/
+
+// 検索用索引（設定有効時に初回アクセスで作成）
+- (LogIndex*)logIndex
+{
+	if (!Config.sharedConfig.logIndexEnabled) {
+		return nil;
+	}
+	@synchronized (self) {
+		if (!_logIndex) {
+			NSString* path = [self.filePath stringByAppendingPathExtension:@"index"];
+			_logIndex = [[LogIndex alloc] initWithPath:path];
+		}
+		return _logIndex;
+	}
+}
+
 /*============================================================================*
  * ログ出力
  *============================================================================*/
@@ -152,6 +174,31 @@ static NSString* _HEAD_END		= @"-------------------------------------\n";
 
 	// ログ出力
 	[self writeLog:msg];
+
+	// 索引出力
+	LogIndex* index = self.logIndex;
+	if (index) {
+		LogIndexFlags flags = LOGINDEX_FLAG_RECEIVE;
+		if (info.broadcast) {
+			flags |= LOGINDEX_FLAG_BROADCAST;
+		}
+		if (info.absence) {
+			flags |= LOGINDEX_FLAG_ABSENCE;
+		}
+		if (info.multicast) {
+			flags |= LOGINDEX_FLAG_MULTICAST;
+		}
+		if (info.locked) {
+			flags |= LOGINDEX_FLAG_LOCKED;
+		} else if (info.sealed) {
+			flags |= LOGINDEX_FLAG_SEALED;
+		}
+		if (info.attachments.count > 0) {
+			flags |= LOGINDEX_FLAG_ATTACHED;
+		}
+		NSString* body = (range.length > 0) ? [info.message substringWithRange:range] : info.message;
+		[index appendLogWithUsers:@[info.fromUser] message:body flags:flags date:info.receiveDate];
+	}
 }
 
 // 送信ログ出力
@@ -185,6 +232,24 @@ static NSString* _HEAD_END		= @"-------------------------------------\n";
 
 	// ログ出力
 	[self writeLog:msg];
+
+	// 索引出力
+	LogIndex* index = self.logIndex;
+	if (index) {
+		LogIndexFlags flags = 0;
+		if (to.count > 1) {
+			flags |= LOGINDEX_FLAG_MULTICAST;
+		}
+		if (info.locked) {
+			flags |= LOGINDEX_FLAG_LOCKED;
+		} else if (info.sealed) {
+			flags |= LOGINDEX_FLAG_SEALED;
+		}
+		if (info.attachments.count > 0) {
+			flags |= LOGINDEX_FLAG_ATTACHED;
+		}
+		[index appendLogWithUsers:to message:info.message flags:flags date:nil];
+	}
 }
 
 // メッセージ出力（内部用）
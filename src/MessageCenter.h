@@ -91,6 +91,7 @@ typedef NS_ENUM(NSInteger, DownloaderResult)
 
 
 // メッセージ送信（ブロードキャスト）
+- (void)refreshBroadcastTargets;
 - (void)broadcastEntry;
 - (void)broadcastAbsence;
 - (void)broadcastExit;
@@ -100,6 +101,9 @@ typedef NS_ENUM(NSInteger, DownloaderResult)
 - (void)sendOpenSealMessage:(RecvMessage*)info;
 - (void)sendReleaseAttachmentMessage:(RecvMessage*)info;
 
+// バージョン情報取得
+- (void)requestVersionInfoForUsers:(NSArray<UserInfo*>*)users;
+
 // 添付ファイル管理
 - (NSArray<SendAttachment*>*)sentAttachments;
 - (void)removeAttachment:(SendAttachment*)attach;
@@ -112,4 +116,9 @@ typedef NS_ENUM(NSInteger, DownloaderResult)
 							  delegate:(id<DownloaderDelegate>)listener;
 - (void)stopDownload:(id<DownloaderContext>)downloader;
 
+#if defined(IPMSG_DEBUG)
+// パケット編集性能計測（結果はデバッグログに出力。PeerSimulatorのrunBenchmarksから実行）
+- (void)benchmarkPacketBuilding;
+#endif
+
 @end
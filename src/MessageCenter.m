@@ -22,9 +22,20 @@
 #import "RecvAttachment.h"
 #import "RecvFile.h"
 #import "RecvClipboard.h"
+#import "RecvMessageBody.h"
 #import "SendAttachment.h"
+#import "AttachmentManifest.h"
+#import "SendFileCache.h"
+#import "StripePlanner.h"
+#import "BandwidthShaper.h"
+#import "EntryResponseScheduler.h"
+#import "BroadcastEngine.h"
+#import "HostListServer.h"
+#import "RuntimeMetrics.h"
+#import "VersionCache.h"
 #import "CryptoCapability.h"
 #import "CryptoManager.h"
+#import "CryptoStream.h"
 #import "RSAPublicKey.h"
 #import "NSString+IPMessenger.h"
 #import "NSData+IPMessenger.h"
@@ -35,6 +46,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/sysctl.h>
+#include <sys/stat.h>
 
 #define _MESSAGE_DEBUG  (1)
 #define _MESSAGE_TRACE  (0)
@@ -311,6 +324,32 @@
 
 /* QUOTE END } */
 
+/*============================================================================*
+ * 独自拡張定義
+ *============================================================================*/
+
+// 長文メッセージ本文のTCP受け渡しに対応（エントリ系コマンドのオプション）
+#define IPMSG_CAPLARGEMSGOPT	IPMSG_FLAG_RESV1
+// 添付の暗号化転送に対応（エントリ系コマンドのオプション）
+#define IPMSG_CAPENCSTREAMOPT	IPMSG_FLAG_RESV2
+// 添付の暗号化転送要求（GETFILEDATA/GETDIRFILESのオプション。要求末尾に初期カウンタを付加）
+// 応答はデータ末尾（ディレクトリは各ファイルのデータ後と末尾）に認証タグを付加
+#define IPMSG_ENCSTREAMOPT		IPMSG_FLAG_RESV2
+// 添付の範囲指定取得に対応（エントリ系コマンドのオプション。予約領域RESV3）
+#define IPMSG_CAPRANGEOPT		0x80000000UL
+// 添付の範囲指定取得要求（GETFILEDATAのオプション。オフセットの後に取得長を付加）
+#define IPMSG_RANGEOPT			IPMSG_FLAG_RESV1
+// 拡張ファイル属性：転送暗号鍵（16進文字列。暗号化された拡張部でのみ送る）
+#define IPMSG_FILE_STREAMKEY	0x0000FE01UL
+// 拡張ファイル属性：フォルダ配下のファイルサイズ合計・ファイル数（フォルダ添付のみ。受信側の進捗表示用）
+#define IPMSG_FILE_DIRSIZE		0x0000FE02UL
+#define IPMSG_FILE_DIRFILES		0x0000FE03UL
+// 添付種別：メッセージ本文（UTF-8）
+#define IPMSG_FILE_MSGBODY		0x00000030UL
+// 暗号化能力：AES256-GCM（本文末尾に16バイトの認証タグ、IVはIPMSG_PACKETNO_IVの先頭12バイト）
+#define IPMSG_AES_256_GCM		0x00200000UL
+#define _GCM_IV_SIZE			(12)
+
 /*============================================================================*
  * Notification 通知キー
  *============================================================================*/
@@ -325,11 +364,55 @@ NSString* const kIPMsgAttachmentListChangedNotification = @"IPMsgAttachmentListC
 static const NSTimeInterval RETRY_INTERVAL	= 2.0;
 static const NSInteger		RETRY_MAX		= 3;
 static const NSTimeInterval _ATTACH_TIMEOUT = (24 * 60 * 60);
+static const NSTimeInterval	_RANGE_RELEASE_DELAY	= 60.0;	// 全範囲送信後に送信対象から外すまでの猶予（受信失敗範囲の再要求用）
 static const NSInteger		_ANY_PACKET_NO	= NSNotFound;
 static const NSInteger		_ANY_FILE_ID	= NSNotFound;
+static const long			_CLIPBOARD_PREFETCH_MAX	= 4;	// 埋め込みクリップボード同時ダウンロード数
+static const NSUInteger		_MSGBODY_PREVIEW_LEN	= 256;	// 本文TCP受け渡し時にUDPで送る先頭部分の文字数
 
 #define MESSAGE_SEPARATOR	":"
 #define MAX_UDPBUF			32768
+#define _DOWNLOAD_BUF_SIZE	(64 * 1024)	// 添付受信単位（復号・書き込みをまとめて行う）
+#define _STRIPE_THRESHOLD	(64ULL * 1024 * 1024)	// 複数接続で分割受信するファイルサイズ
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 起動時間計測（プロセス起動からの経過時間をデバッグログに出力）
+static void _StartupMilestone(NSString* name)
+{
+#if defined(IPMSG_DEBUG)
+	static CFAbsoluteTime	launchAt = 0;
+	static dispatch_once_t	once;
+	dispatch_once(&once, ^{
+		struct kinfo_proc	info;
+		size_t				len		= sizeof(info);
+		int					mib[4]	= { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+		if (sysctl(mib, 4, &info, &len, NULL, 0) == 0) {
+			struct timeval tv = info.kp_proc.p_starttime;
+			launchAt = (tv.tv_sec - kCFAbsoluteTimeIntervalSince1970) + tv.tv_usec / 1000000.0;
+		} else {
+			launchAt = CFAbsoluteTimeGetCurrent();
+		}
+	});
+	DBG(@"Startup:%@(+%.3fs from launch)", name, CFAbsoluteTimeGetCurrent() - launchAt);
+#endif
+}
+
+// 添付オプションから転送暗号鍵を除く（平文で送る場合・非対応の相手に送る場合）
+static NSString* _StripStreamKeys(NSString* option)
+{
+	NSString* keyAttr = [NSString stringWithFormat:@"%lX=", IPMSG_FILE_STREAMKEY];
+	if (![option containsString:keyAttr]) {
+		return option;
+	}
+	NSString* pattern = [NSString stringWithFormat:@"%@[0-9A-Fa-f]*:?", keyAttr];
+	return [option stringByReplacingOccurrencesOfString:pattern
+											 withString:@""
+												options:NSRegularExpressionSearch
+												  range:NSMakeRange(0, option.length)];
+}
 
 /*============================================================================*
  * 内部クラス
@@ -344,6 +427,7 @@ static const NSInteger		_ANY_FILE_ID	= NSNotFound;
 @property(weak)		id<DownloaderDelegate>		delegate;
 @property(assign)	int							tcpSocket;
 @property(assign)	BOOL						stop;
+@property(retain)	CryptoStream*				cipher;		// 受信データ復号（暗号化転送時）
 
 @end
 
@@ -366,6 +450,7 @@ static const NSInteger		_ANY_FILE_ID	= NSNotFound;
 	[_attachments release];
 	[_fromUser release];
 	[_savePath release];
+	[_cipher release];
 	if (_tcpSocket != -1) {
 		close(_tcpSocket);
 	}
@@ -382,7 +467,7 @@ typedef NSDictionary<NSFileAttributeKey, id>		_FileAttrDic;
 typedef NSMutableDictionary<NSString*,RetryInfo*>	_SendList;
 typedef NSMutableArray<SendAttachment*>				_AttachList;
 
-@interface MessageCenter()
+@interface MessageCenter() <EntryResponseSchedulerDelegate, HostListServerDelegate>
 
 // 共通
 @property(assign)	UInt16			portNo;				// ポート番号
@@ -392,6 +477,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 @property(retain)	NSLock*			udpServerLock;		// UDPサーバ待ち合わせ用ロック
 @property(assign)	BOOL			udpServerStop;		// UDPサーバ停止フラグ
 @property(retain)	_SendList*		sendList;			// 応答待ちメッセージ一覧（再送用）
+@property(assign)	BOOL			cryptoPending;		// 暗号化準備中（暗号化対応の相手へのメッセージは保留）
+@property(retain)	EntryResponseScheduler*	entryScheduler;	// ENTRY応答送信スケジューラ
+@property(retain)	BroadcastEngine*		broadcaster;	// ブロードキャスト送信先
+@property(retain)	HostListServer*			hostListServer;	// ホストリスト配信
 
 // 添付ファイル送受信関連
 @property(retain)	_AttachList*	attachList;			// 送信添付ファイル一覧
@@ -404,11 +493,33 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 @property(assign)	UInt32			selfSpec;			// 自分の対応機能
 @property(copy)		NSString*		selfVersion;		// 自分のバージョン情報
 
+// 送信パケット雛形（自分の情報が変わるまで使い回す）
+@property(retain)	NSMutableData*	packetBuffer;		// パケット編集バッファ（ロックも兼ねる）
+@property(retain)	NSData*			headerTemplate;		// ヘッダ部雛形（":ログオン名:ホスト名:"）
+@property(retain)	NSData*			entryTemplate;		// エントリ系パケット本体
+
 // 送信添付ファイル情報追加/削除
 - (void)addAttachment:(SendAttachment*)attach;
+- (void)setTrashTimerForAttachment:(SendAttachment*)attach;
 
 // 添付ファイル送信ユーザ削除
 - (void)removeAttachmentUser:(UserInfo*)user packetNo:(NSInteger)pNo fileID:(NSInteger)fid;
+- (void)releaseRangeAttachment:(SendAttachment*)attach forUser:(UserInfo*)user;
+
+// 転送暗号鍵渡し済み記録
+- (void)noteStreamKeyIssuedTo:(UserInfo*)user packetNo:(NSInteger)pNo;
+
+// 送信パケット雛形
+- (void)invalidatePacketTemplates;
+- (size_t)buildPacketWithNo:(UInt32)pNo command:(UInt32)cmd data:(NSData*)data total:(size_t*)total;
+- (size_t)buildPacketInBuffer:(NSMutableData*)buffer no:(UInt32)pNo command:(UInt32)cmd data:(NSData*)data total:(size_t*)total;
+
+// 暗号化準備完了
+- (void)cryptoStartupFinished:(BOOL)result;
+- (void)sendHeldMessages;
+
+// 自分自身の送信判定
+- (BOOL)isSelfUser:(UserInfo*)user address:(struct sockaddr_in)addr;
 
 // その他
 - (void)fireAttachListChangeNotice;
@@ -504,6 +615,11 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		_udpServerLock	= [[NSLock alloc] init];
 		_udpServerStop	= FALSE;
 		_sendList		= [[_SendList alloc] init];
+		_entryScheduler	= [[EntryResponseScheduler alloc] init];
+		_entryScheduler.delegate = self;
+		_broadcaster	= [[BroadcastEngine alloc] init];
+		_hostListServer	= [[HostListServer alloc] initWithPageLimit:MAX_UDPBUF - 1024];
+		_hostListServer.delegate = self;
 		_tcpSocket		= -1;
 		_tcpServerLock	= [[NSLock alloc] init];
 		_tcpServerStop	= FALSE;
@@ -511,6 +627,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		_selfLogOnName	= [NSUserName() copy];
 		_selfSpec		= IPMSG_CAPUTF8OPT;
 		_selfVersion	= [[NSString alloc] initWithFormat:NSLocalizedString(@"Version.Msg.string", nil), verStr];
+		_packetBuffer	= [[NSMutableData alloc] initWithLength:MAX_UDPBUF];
 	}
 
 	return self;
@@ -531,8 +648,14 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	[_tcpServerLock release];
 	[_attachList release];
 	[_sendList release];
+	[_broadcaster release];
+	[_hostListServer release];
+	[_entryScheduler release];
 	[_selfLogOnName release];
 	[_selfVersion release];
+	[_packetBuffer release];
+	[_headerTemplate release];
+	[_entryTemplate release];
 	[super dealloc];
 }
 
@@ -549,23 +672,19 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		self.portNo = IPMSG_DEFAULT_PORT;
 	}
 
-	// 暗号化
-	if (![CryptoManager.sharedManager startup]) {
-		ERR(@"Startup:CryptManager startup error");
-		//TODO:エラーダイアログ表示してアプリ終了？
-	} else {
-		DBG(@"Startup:CryptMangaer startup finished.");
-		CryptoManager* cm = CryptoManager.sharedManager;
-		if (cm.selfCapability.supportEncryption) {
-			self.selfSpec |= IPMSG_ENCRYPTOPT;
-			if (cm.selfCapability.supportFingerPrint) {
-				// 公開鍵指紋設定
-				NSData* fingerPrint = [cm publicKeyFingerPrintForRSA2048Modulus:cm.publicKey2048.modulus];
-				self.selfLogOnName = [NSString stringWithFormat:@"%@-<%@>", NSUserName(), fingerPrint.hexEncodedString];
-			}
-			self.selfSpec |= IPMSG_ENCEXTMSGOPT;
-		}
-	}
+	// 動作統計出力
+	[RuntimeMetrics.sharedMetrics startExporter];
+
+	// 暗号化（鍵生成・鍵チェーン検索は時間がかかるので待たずに起動し、準備でき次第再通知）
+	CFAbsoluteTime cryptoStart = CFAbsoluteTimeGetCurrent();
+	self.cryptoPending = YES;
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		BOOL result = [CryptoManager.sharedManager startup];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			DBG(@"Startup:CryptManager setup took %.3fs", CFAbsoluteTimeGetCurrent() - cryptoStart);
+			[self cryptoStartupFinished:result];
+		});
+	});
 
 	// メッセージ受信サーバ
 	if ([self.udpServerLock tryLock]) {
@@ -629,6 +748,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		sockopt = MAX_UDPBUF;
 		setsockopt(_udpSocket, SOL_SOCKET, SO_SNDBUF, &sockopt, sizeof(sockopt));
 		setsockopt(_udpSocket, SOL_SOCKET, SO_RCVBUF, &sockopt, sizeof(sockopt));
+		// 受信宛先アドレス取得（ブロードキャスト／マルチキャストの受信数計測用）
+		sockopt = 1;
+		setsockopt(_udpSocket, IPPROTO_IP, IP_RECVDSTADDR, &sockopt, sizeof(sockopt));
+
+		// ブロードキャスト送信先・マルチキャストグループ参加（ポート確定後）
+		[self.broadcaster refreshWithPort:self.portNo socket:self.udpSocket];
 
 		// 受信スレッド起動
 		DBG(@"Startup:Message:invoke ServerThread");
@@ -706,13 +831,69 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 
 		self.selfSpec |= IPMSG_FILEATTACHOPT;
 		self.selfSpec |= IPMSG_CLIPBOARDOPT;
+		self.selfSpec |= IPMSG_CAPLARGEMSGOPT;
+		self.selfSpec |= IPMSG_CAPRANGEOPT;
 	} else {
 		WRN(@"Startup:Attachment:ServerThread already working.");
 	}
 
+	_StartupMilestone(@"server ready");
+
 	return YES;
 }
 
+// 暗号化準備完了時処理（メインスレッド）
+- (void)cryptoStartupFinished:(BOOL)result
+{
+	self.cryptoPending = NO;
+	if (!result) {
+		ERR(@"Startup:CryptManager startup error");
+		//TODO:エラーダイアログ表示してアプリ終了？
+		[self sendHeldMessages];
+		return;
+	}
+	_StartupMilestone(@"crypto ready");
+	CryptoManager* cm = CryptoManager.sharedManager;
+	if (!cm.selfCapability.supportEncryption) {
+		DBG(@"Startup:encryption not available");
+		[self sendHeldMessages];
+		return;
+	}
+	if (cm.selfCapability.supportFingerPrint) {
+		// 公開鍵指紋付きのログオン名は別ユーザとして扱われるので、旧名での登録を取り消しておく
+		[self broadcastExit];
+		NSData* fingerPrint = [cm publicKeyFingerPrintForRSA2048Modulus:cm.publicKey2048.modulus];
+		self.selfLogOnName = [NSString stringWithFormat:@"%@-<%@>", NSUserName(), fingerPrint.hexEncodedString];
+	}
+	self.selfSpec |= IPMSG_ENCRYPTOPT;
+	self.selfSpec |= IPMSG_ENCEXTMSGOPT;
+	self.selfSpec |= IPMSG_CAPENCSTREAMOPT;
+	// 暗号化対応として再通知（雛形はbroadcastEntryで作り直される）
+	[self broadcastEntry];
+	_StartupMilestone(@"re-announced with encryption");
+	[self sendHeldMessages];
+}
+
+// 暗号化準備中に保留したメッセージの送信（暗号化対応の相手宛の応答待ちメッセージ）
+- (void)sendHeldMessages
+{
+	for (RetryInfo* info in self.sendList.allValues) {
+		if (!info.toUser.supportsEncrypt) {
+			continue;
+		}
+		if (!info.toUser.publicKey) {
+			[self sendGetPubKeyTo:info.toUser];
+		} else {
+			DBG(@"Send held message(PacketNo=%ld,%@)", info.packetNo, info.toUser);
+			[self sendTo:info.toUser
+				packetNo:info.packetNo
+				 command:info.command
+				 message:info.message
+				  option:info.option];
+		}
+	}
+}
+
 // サーバ停止
 - (BOOL)shutdownServer
 {
@@ -732,6 +913,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		self.tcpSocket = -1;
 	}
 
+	// 送信待ちENTRY応答
+	[self.entryScheduler cancelAllResponses];
+
 	// メッセージ受信サーバ
 	if ([self.udpServerLock tryLock]) {
 		DBG(@"Shutdown:Messages:Server not exist");
@@ -747,6 +931,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		self.udpSocket = -1;
 	}
 
+	// 動作統計出力
+	[RuntimeMetrics.sharedMetrics stopExporter];
+
 	return YES;
 }
 
@@ -760,7 +947,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			struct timeval		tv;
 			char				buff[MAX_UDPBUF];	// 受信バッファ
 			struct sockaddr_in	fromAddr;
-			socklen_t			fromAddrLen = sizeof(fromAddr);
+			struct iovec		iov;
+			struct msghdr		msg;
+			union {
+				struct cmsghdr	hdr;
+				char			buf[CMSG_SPACE(sizeof(struct in_addr))];
+			} control;
 
 			while (!self.udpServerStop) {
 				FD_ZERO(&fdSet);
@@ -776,12 +968,37 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 					// タイムアウト
 					continue;
 				}
-				// 受信
-				ssize_t len = recvfrom(self.udpSocket, buff, MAX_UDPBUF, 0, (struct sockaddr*)&fromAddr, &fromAddrLen);
+				// 受信（宛先アドレスも取得）
+				iov.iov_base		= buff;
+				iov.iov_len			= MAX_UDPBUF;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_name		= &fromAddr;
+				msg.msg_namelen		= sizeof(fromAddr);
+				msg.msg_iov			= &iov;
+				msg.msg_iovlen		= 1;
+				msg.msg_control		= control.buf;
+				msg.msg_controllen	= sizeof(control.buf);
+				ssize_t len = recvmsg(self.udpSocket, &msg, 0);
 				if (len == -1) {
-					ERR(@"Server:MessageRecvThread:recvfrom error(sock=%d,errno=%d)", self.udpSocket, errno);
+					ERR(@"Server:MessageRecvThread:recvmsg error(sock=%d,errno=%d)", self.udpSocket, errno);
 					continue;
 				}
+				for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+					if ((cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_RECVDSTADDR)) {
+						struct in_addr dst;
+						memcpy(&dst, CMSG_DATA(cmsg), sizeof(dst));
+						switch ([self.broadcaster transportForDestination:dst]) {
+						case BROADCAST_TRANSPORT_BROADCAST:
+							MetricsIncrement(METRICS_BROADCAST_RECEIVED, 1);
+							break;
+						case BROADCAST_TRANSPORT_MULTICAST:
+							MetricsIncrement(METRICS_MULTICAST_RECEIVED, 1);
+							break;
+						default:
+							break;
+						}
+					}
+				}
 				// メッセージ処理
 				@try {
 					[self processReceiveMessageBuffer:buff length:len from:fromAddr];
@@ -855,6 +1072,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			return;
 		}
 		DBG(@"Server:AttachmentConnectionThread:start(sock=%d).", sock);
+		MetricsGaugeAdd(METRICS_TCP_CONNECTIONS, 1);
 
 		struct sockaddr_in	addr;
 		addr.sin_addr.s_addr	= htonl(ipAddr);
@@ -903,6 +1121,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 
 		close(sock);
+		MetricsGaugeAdd(METRICS_TCP_CONNECTIONS, -1);
 		DBG(@"Server:AttachmentConnectionThread:finish.(sock=%d)", sock);
 	}
 }
@@ -912,36 +1131,28 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 #pragma mark - メッセージ送信（ブロードキャスト）
 /*----------------------------------------------------------------------------*/
 
-// ブロードキャスト送信処理
+// ブロードキャスト送信処理（NIC毎・個別指定・ダイアルアップユーザ宛に1回の編集で送信）
 - (void)sendBroadcast:(UInt32)cmd data:(NSData*)data
 {
-	// ブロードキャスト（ローカル）アドレスへ送信
-	struct sockaddr_in	bcast;
-	memset(&bcast, 0, sizeof(bcast));
-	bcast.sin_family		= AF_INET;
-	bcast.sin_port			= htons(self.portNo);
-	bcast.sin_addr.s_addr	= htonl(INADDR_BROADCAST);
-	[self sendTo:&bcast packetNo:-1 command:cmd data:data];
+	[self sendTo:NULL packetNo:-1 command:cmd data:data];
+}
 
-	// 個別ブロードキャストへ送信
-	Config* cfg = Config.sharedConfig;
-	for (NSString* address in cfg.broadcastAddresses) {
-		bcast.sin_addr.s_addr = inet_addr(address.UTF8String);
-		if (bcast.sin_addr.s_addr != INADDR_NONE) {
-			[self sendTo:&bcast packetNo:-1 command:cmd data:data];
-		}
-	}
-	for (UserInfo* user in UserManager.sharedManager.users) {
-		if (user.dialupConnect) {
-			bcast.sin_addr.s_addr = user.address.sin_addr.s_addr;
-			[self sendTo:&bcast packetNo:-1 command:cmd data:data];
-		}
-	}
+// ブロードキャスト送信先の再構築
+- (void)refreshBroadcastTargets
+{
+	[self.broadcaster refreshWithPort:self.portNo socket:self.udpSocket];
 }
 
 // BR_ENTRYのブロードキャスト
 - (void)broadcastEntry
 {
+	static dispatch_once_t firstEntry;
+	dispatch_once(&firstEntry, ^{
+		_StartupMilestone(@"first BR_ENTRY");
+	});
+	// 起動時・ネットワーク変更時に呼ばれるので雛形と送信先を作り直す
+	[self invalidatePacketTemplates];
+	[self refreshBroadcastTargets];
 	[self sendBroadcast:IPMSG_NOOPERATION data:nil];
 	[self sendBroadcast:IPMSG_BR_ENTRY|self.selfSpec
 				   data:[self makeEntryMessageData]];
@@ -951,6 +1162,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 // BR_ABSENCEのブロードキャスト
 - (void)broadcastAbsence
 {
+	// ユーザ名・グループ名・不在・ホスト名の変更時に呼ばれるので雛形を作り直す
+	[self invalidatePacketTemplates];
 	[self sendBroadcast:IPMSG_BR_ABSENCE|self.selfSpec
 				   data:[self makeEntryMessageData]];
 	DBG(@"broadcast absence");
@@ -983,8 +1196,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 	}
 
-	// 添付ファイルメッセージ編集
-	NSString* option = nil;
+	// 添付ファイルメッセージ編集（暗号化転送対応時は添付毎に転送暗号鍵を付ける）
+	NSString*		option		= nil;
+	CryptoManager*	cm			= CryptoManager.sharedManager;
+	BOOL			streamKeys	= ((self.selfSpec & IPMSG_CAPENCSTREAMOPT) != 0);
 	if (msg.attachments.count > 0) {
 		NSFileManager*		fm		= NSFileManager.defaultManager;
 		NSInteger			count	= 0;
@@ -1008,25 +1223,20 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				[buffer appendString:ext];
 				[buffer appendString:@":"];
 			}
+			NSUInteger	dirFiles;
+			UInt64		dirSize;
+			if ([attach.manifest getFileCount:&dirFiles totalSize:&dirSize]) {
+				[buffer appendFormat:@"%lX=%llX:%lX=%lX:", IPMSG_FILE_DIRSIZE, dirSize, IPMSG_FILE_DIRFILES, dirFiles];
+			}
+			attach.streamKey = streamKeys ? [cm randomData:CRYPTO_STREAM_KEY_SIZE] : nil;
+			if (attach.streamKey) {
+				[buffer appendFormat:@"%lX=%@:", IPMSG_FILE_STREAMKEY, attach.streamKey.hexEncodedString];
+			}
 			[buffer appendString:@"\a"];
-			TRC(@"Attachment(%@)", buffer);
+			TRC(@"Attachment(%@)", _StripStreamKeys(buffer));
 			attach.packetNo	= msg.packetNo;
 			attach.fileID	= count;
-			// 破棄タイマの設定
-			__weak typeof(self)		weakSelf	= self;
-			__weak SendAttachment*	weakAttach	= attach;
-			attach.trashTimer = [NSTimer scheduledTimerWithTimeInterval:_ATTACH_TIMEOUT
-																  repeats:NO
-																	block:^(NSTimer* _Nonnull timer) {
-				DBG(@"Attachment Timeout(PacketNo=%ld,FileID=%ld,%.1fs passed.) -> Remove",
-													weakAttach.packetNo, weakAttach.fileID, _ATTACH_TIMEOUT);
-				@synchronized(weakSelf.attachList) {
-					// 添付ファイル削除
-					DBG(@"AttachFile remove(PacketNo=%ld,FileID=%ld)", weakAttach.packetNo, weakAttach.fileID);
-					[weakSelf.attachList removeObject:weakAttach];
-				}
-				[weakSelf fireAttachListChangeNotice];
-			}];
+			[self setTrashTimerForAttachment:attach];
 			[self addAttachment:attach];
 			count++;
 		}
@@ -1036,12 +1246,57 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 	}
 
-	// 各ユーザに送信
+	// 長文メッセージ本文はTCP受け渡し用の添付として登録（対応ユーザにのみ使用）
+	SendAttachment*	bodyAttach	= nil;
+	NSString*		bodyOption	= nil;
+	NSString*		preview		= nil;
+	NSUInteger		threshold	= Config.sharedConfig.largeMessageThreshold;
+	if ((threshold > 0) && ([msg.message lengthOfBytesUsingEncoding:NSUTF8StringEncoding] > threshold)) {
+		NSData* body = [msg.message dataUsingEncoding:NSUTF8StringEncoding];
+		bodyAttach = [SendAttachment attachmentWithData:body name:@"message.txt"];
+		bodyAttach.packetNo		= msg.packetNo;
+		bodyAttach.fileID		= (NSInteger)msg.attachments.count;
+		bodyAttach.streamKey	= streamKeys ? [cm randomData:CRYPTO_STREAM_KEY_SIZE] : nil;
+		NSString* keyAttr = @"";
+		if (bodyAttach.streamKey) {
+			keyAttr = [NSString stringWithFormat:@"%lX=%@:", IPMSG_FILE_STREAMKEY, bodyAttach.streamKey.hexEncodedString];
+		}
+		bodyOption = [NSString stringWithFormat:@"%@%ld:%@:%zX:%X:%X:%@\a",
+												(option ? option : @""),
+												bodyAttach.fileID,
+												bodyAttach.name,
+												body.length,
+												(unsigned)NSDate.date.timeIntervalSince1970,
+												(unsigned)IPMSG_FILE_MSGBODY,
+												keyAttr];
+		// 先頭部分（合成文字の途中で切らない）をUDPで送り、全文はTCPで取得させる
+		// （バイト長で判定しているので文字数が先頭部分の長さに満たないこともある）
+		NSRange range = [msg.message rangeOfComposedCharacterSequencesForRange:NSMakeRange(0, MIN(_MSGBODY_PREVIEW_LEN, msg.message.length))];
+		preview = [msg.message substringWithRange:range];
+		[self setTrashTimerForAttachment:bodyAttach];
+		[self addAttachment:bodyAttach];
+		DBG(@"MessageBody via TCP(PacketNo=%ld,%lu bytes,threshold=%lu)", msg.packetNo, body.length, threshold);
+	}
+
+	// 各ユーザに送信（同じ本文への署名は送信中のみ使い回す）
+	[cm beginSigningBatch];
 	for (UserInfo* user in toUsers) {
 		NSInteger	pNo 			= -1;
-		BOOL		supportsAttach	= (command & IPMSG_FILEATTACHOPT) && (user.supportsAttachment);
+		// 暗号化して送る相手には本文を暗号化転送できる場合のみTCPで渡す（平文で全文を渡さない）
+		BOOL		encBody			= (bodyAttach.streamKey && user.supportsEncryptedStream &&
+									   user.supportsEncExtMsg && ((self.selfSpec & IPMSG_ENCEXTMSGOPT) != 0));
+		BOOL		largeBody		= (bodyAttach && user.supportsLargeMessage && user.supportsAttachment &&
+									   (!user.supportsEncrypt || encBody));
+		UInt32		userCommand		= largeBody ? (command | IPMSG_FILEATTACHOPT) : command;
+		NSString*	userMessage		= largeBody ? preview : msg.message;
+		NSString*	userOption		= largeBody ? bodyOption : option;
+		BOOL		supportsAttach	= (userCommand & IPMSG_FILEATTACHOPT) && (user.supportsAttachment);
 		// 送信
-		if (user.supportsEncrypt && !user.publicKey) {
+		if (user.supportsEncrypt && self.cryptoPending) {
+			// 暗号化準備中は平文に落とさず保留（準備完了時に応答待ち一覧から送信する）
+			_MSG_DBG(@"Hold SENDMSG to %@(crypto not ready)", user);
+			pNo = msg.packetNo;
+		} else if (user.supportsEncrypt && !user.publicKey) {
 			// 暗号化対応で公開鍵を未受信なのでまずは鍵要求
 			_MSG_DBG(@"Send GETPUBKEY to %@(no key)", user);
 			[self sendGetPubKeyTo:user];
@@ -1051,16 +1306,16 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			// 暗号化非対応または鍵受信済みなので送信
 			pNo = [self sendTo:user
 					  packetNo:msg.packetNo
-					   command:command
-					   message:msg.message
-						option:supportsAttach ? option : nil];
+					   command:userCommand
+					   message:userMessage
+						option:supportsAttach ? userOption : nil];
 		}
 		if (pNo >= 0) {
 			if (supportsAttach) {
-				// 添付付きで送った場合には送り先に追加
+				// 添付付きで送った場合には送り先に追加（本文添付は本文をTCPで渡す相手のみ）
 				@synchronized (self.attachList) {
 					for (SendAttachment* attach in self.attachList) {
-						if (attach.packetNo == pNo) {
+						if ((attach.packetNo == pNo) && (largeBody || (attach != bodyAttach))) {
 							[attach addUser:user];
 						}
 					}
@@ -1069,11 +1324,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			}
 			// 応答待ちメッセージ一覧に追加
 			RetryInfo* retry = [RetryInfo infoWithPacketNo:pNo
-												   command:command
+												   command:userCommand
 														to:user
-												   message:msg.message
-													option:option];
+												   message:userMessage
+													option:userOption];
 			self.sendList[retry.identifyKey] = retry;
+			MetricsGaugeSet(METRICS_SEND_LIST_SIZE, (SInt64)self.sendList.count);
 			// リトライタイマ発行
 			[NSTimer scheduledTimerWithTimeInterval:RETRY_INTERVAL
 											 target:self
@@ -1082,6 +1338,13 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 											repeats:YES];
 		}
 	}
+	[cm endSigningBatch];
+
+	// 本文をTCPで渡す相手がいなければ本文添付は不要
+	if (bodyAttach && (bodyAttach.remainUsers.count == 0)) {
+		[bodyAttach.trashTimer invalidate];
+		[self removeAttachment:bodyAttach];
+	}
 }
 
 // 応答タイムアウト時処理
@@ -1090,6 +1353,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	NSString*	retryKey	= timer.userInfo;
 	RetryInfo*	retryInfo	= self.sendList[retryKey];
 	if (retryInfo) {
+		if (self.cryptoPending && retryInfo.toUser.supportsEncrypt) {
+			// 暗号化準備中の保留メッセージ（再送回数に数えない）
+			return;
+		}
 		if (retryInfo.retryCount >= RETRY_MAX) {
 			// いったんタイマ解除
 			[timer invalidate];
@@ -1109,6 +1376,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 									fileID:_ANY_FILE_ID];
 				// 応答待ちメッセージ一覧からメッセージのエントリを削除
 				[self.sendList removeObjectForKey:retryKey];
+				MetricsGaugeSet(METRICS_SEND_LIST_SIZE, (SInt64)self.sendList.count);
 				return;
 			}
 			// リトライ階数をリセットして再試行
@@ -1134,6 +1402,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 		// リトライ回数インクリメント
 		retryInfo.retryCount++;
+		MetricsIncrement(METRICS_SEND_RETRY, 1);
 	} else {
 		// タイマ解除
 		[timer invalidate];
@@ -1174,6 +1443,23 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		  option:nil];
 }
 
+/*----------------------------------------------------------------------------*/
+#pragma mark - バージョン情報取得
+/*----------------------------------------------------------------------------*/
+
+// バージョン情報の問い合わせ（キャッシュ有効／問い合わせ中のユーザは対象外）
+- (void)requestVersionInfoForUsers:(NSArray<UserInfo*>*)users
+{
+	VersionCache* cache = VersionCache.sharedCache;
+	for (UserInfo* user in users) {
+		if (![cache beginProbeForUser:user]) {
+			continue;
+		}
+		_MSG_DBG(@"Schedule GETINFO(%@)", user);
+		[self.entryScheduler scheduleResponse:ENTRY_RESPONSE_GETINFO to:user within:0];
+	}
+}
+
 /*----------------------------------------------------------------------------*/
 #pragma mark - 添付ファイル管理
 /*----------------------------------------------------------------------------*/
@@ -1201,6 +1487,25 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 }
 
+// 送信添付ファイル破棄タイマ設定
+- (void)setTrashTimerForAttachment:(SendAttachment*)attach
+{
+	__weak typeof(self)		weakSelf	= self;
+	__weak SendAttachment*	weakAttach	= attach;
+	attach.trashTimer = [NSTimer scheduledTimerWithTimeInterval:_ATTACH_TIMEOUT
+														  repeats:NO
+															block:^(NSTimer* _Nonnull timer) {
+		DBG(@"Attachment Timeout(PacketNo=%ld,FileID=%ld,%.1fs passed.) -> Remove",
+											weakAttach.packetNo, weakAttach.fileID, _ATTACH_TIMEOUT);
+		@synchronized(weakSelf.attachList) {
+			// 添付ファイル削除
+			DBG(@"AttachFile remove(PacketNo=%ld,FileID=%ld)", weakAttach.packetNo, weakAttach.fileID);
+			[weakSelf.attachList removeObject:weakAttach];
+		}
+		[weakSelf fireAttachListChangeNotice];
+	}];
+}
+
 // 送信添付ファイル情報削除
 - (void)removeAttachment:(SendAttachment*)attach
 {
@@ -1246,9 +1551,38 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 }
 
+// 範囲送信完了ユーザ削除（猶予中に範囲送信がなければ削除する）
+- (void)releaseRangeAttachment:(SendAttachment*)attach forUser:(UserInfo*)user
+{
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_RANGE_RELEASE_DELAY * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+		NSTimeInterval idle = [attach rangeIdleIntervalForUser:user];
+		if (idle < _RANGE_RELEASE_DELAY) {
+			// 再要求された範囲を送信済み（その送信完了時に改めて予約されている）
+			TRC(@"range release postponed(%@,%@,idle=%.1fs)", user, attach, idle);
+			return;
+		}
+		[self removeAttachmentUser:user packetNo:attach.packetNo fileID:attach.fileID];
+	});
+}
+
+// 転送暗号鍵渡し済み記録
+- (void)noteStreamKeyIssuedTo:(UserInfo*)user packetNo:(NSInteger)pNo
+{
+	@synchronized (self.attachList) {
+		for (SendAttachment* attach in self.attachList) {
+			if ((attach.packetNo == pNo) && attach.streamKey) {
+				[attach addStreamKeyUser:user];
+			}
+		}
+	}
+}
+
 // 添付管理情報変更通知発行
 - (void)fireAttachListChangeNotice
 {
+	@synchronized (self.attachList) {
+		MetricsGaugeSet(METRICS_ATTACH_LIST_SIZE, (SInt64)self.attachList.count);
+	}
 	NSNotificationCenter* nc = NSNotificationCenter.defaultCenter;
 	[nc postNotificationName:kIPMsgAttachmentListChangedNotification object:nil];
 }
@@ -1292,7 +1626,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 #pragma mark - メッセージ送信処理（内部利用）
 /*----------------------------------------------------------------------------*/
 
-// データ送信実処理
+// データ送信実処理（toAddrがNULLの場合はブロードキャスト）
 - (NSInteger)sendTo:(struct sockaddr_in*)toAddr packetNo:(NSInteger)pNo command:(UInt32)cmd data:(NSData*)data
 {
 	Config*	config = Config.sharedConfig;
@@ -1311,31 +1645,41 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		pNo = MessageCenter.nextPacketNo;
 	}
 
-	// メッセージヘッダ部編集
-	NSString*	headerStr	= [NSString stringWithFormat:@"%d:%d:%@:%@:%d:",
-								IPMSG_VERSION, (UInt32)pNo, self.selfLogOnName, AppControlGetHostName(), cmd];
-	NSData*		headerData	= [headerStr dataUsingUTF8:NO nullTerminate:NO];
-
-	// 送信データ作成
-	NSData* sendData = nil;
-	if (data.length > 0) {
-		NSMutableData*	sendMutableData	= [NSMutableData dataWithCapacity:headerData.length + data.length];
-		[sendMutableData appendData:headerData];
-		[sendMutableData appendData:data];
-		sendData = sendMutableData;
-	} else {
-		sendData = headerData;
+	// パケット編集・送信（編集バッファは共用のためロック中に行う）
+	@synchronized (self.packetBuffer) {
+		size_t	total	= 0;
+		size_t	len		= [self buildPacketWithNo:(UInt32)pNo command:cmd data:data total:&total];
+		if (total > len) {
+			// パケットサイズあふれ（切り詰めて送信）
+			WRN(@"packet truncated(PacketNo=%ld,%zu->%zu bytes)", pNo, total, len);
+		}
+		if (toAddr) {
+			sendto(self.udpSocket, self.packetBuffer.bytes, len, 0, (struct sockaddr*)toAddr, sizeof(struct sockaddr_in));
+		} else {
+			[self.broadcaster sendPacket:self.packetBuffer.bytes length:len socket:self.udpSocket];
+		}
 	}
-
-	// パケットサイズあふれ調整
-	size_t len = sendData.length;
-	if (len > MAX_UDPBUF) {
-		len = MAX_UDPBUF;
+	MetricsCountPacket(NO, cmd);
+	// 添付送信中は応答待ちの相手がいる制御パケットを優先させる（ブロードキャストは対象外）
+	switch (GET_MODE(cmd)) {
+	case IPMSG_SENDMSG:
+		// 自分の送信メッセージも受信確認が遅れると再送になるため対象
+		if (toAddr && (cmd & IPMSG_SENDCHECKOPT)) {
+			[BandwidthShaper.sharedShaper noteControlTraffic];
+		}
+		break;
+	case IPMSG_RECVMSG:
+	case IPMSG_ANSENTRY:
+	case IPMSG_ANSLIST:
+	case IPMSG_ANSLIST_DICT:
+		if (toAddr) {
+			[BandwidthShaper.sharedShaper noteControlTraffic];
+		}
+		break;
+	default:
+		break;
 	}
 
-	// 送信
-	sendto(self.udpSocket, sendData.bytes, len, 0, (struct sockaddr*)toAddr, sizeof(struct sockaddr_in));
-
 	return pNo;
 }
 
@@ -1348,6 +1692,11 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			cmd |= IPMSG_UTF8OPT;
 		}
 		if ((GET_MODE(cmd) == IPMSG_SENDMSG) && toUser.supportsEncrypt) {
+			if (self.cryptoPending) {
+				// 暗号化準備中は送らない（平文に落とさない）
+				WRN(@"SENDMSG to %@ not sent(crypto not ready)", toUser);
+				return -1;
+			}
 			if (!toUser.publicKey) {
 				// 公開鍵がある状態で呼び出されるはず（暗号化対応の相手に原則平文のメッセージを送ることはしない）
 				ERR(@"RSA PublicKey not exist(%@,internal error)", toUser);
@@ -1360,6 +1709,13 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				UInt32	spec		= 0;
 				BOOL	encExtMsg	= (toUser.supportsEncExtMsg && ((self.selfSpec & IPMSG_ENCEXTMSGOPT) != 0));
 				BOOL	useBase64	= cap.supportEncodeBase64;
+				if (!encExtMsg || !toUser.supportsEncryptedStream) {
+					// 転送暗号鍵は暗号化される拡張部でのみ渡す
+					opt = _StripStreamKeys(opt);
+				} else if (opt) {
+					// 鍵を渡した相手からの平文要求は以降拒否する
+					[self noteStreamKeyIssuedTo:toUser packetNo:pNo];
+				}
 				if (useBase64) {
 					_MSG_DBG(@"  -> Binary Encode with Base64");
 					spec |= IPMSG_ENCODE_BASE64;
@@ -1408,7 +1764,19 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				// 本文暗号化
 				NSData* sessionKey		= nil;
 				NSData* encryptedData	= nil;
-				if (cap.supportAES256) {
+				if (cap.supportAES256GCM) {
+					sessionKey		= [cm randomData:256/8];
+					encryptedData	= [cm encryptAESGCM:srcData
+													key:sessionKey
+													 iv:[ivData subdataWithRange:NSMakeRange(0, _GCM_IV_SIZE)]
+													aad:nil];
+					if (!encryptedData) {
+						ERR(@"AES256-GCM encryption error");
+						return -1;
+					}
+					_MSG_DBG(@"  -> Encrypt with AES256-GCM succeeded(%ldbytes->%ldbytes)", srcData.length, encryptedData.length);
+					spec |= IPMSG_AES_256_GCM;
+				} else if (cap.supportAES256) {
 					sessionKey		= [cm randomData:256/8];
 					encryptedData	= [cm encryptAES:srcData key:sessionKey iv:ivData];
 					if (!encryptedData) {
@@ -1496,16 +1864,11 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				_MSG_DBG(@"  ---- FinishEncrpt ----");
 			}
 		} else {
-			NSData* msgData = [msg dataUsingUTF8:useUTF8 nullTerminate:YES];
-			if (opt) {
-				NSData*			optData			= [opt dataUsingUTF8:useUTF8 nullTerminate:YES];
-				NSMutableData*	sendMutableData	= [NSMutableData dataWithCapacity:msgData.length + optData.length];
-				[sendMutableData appendData:msgData];
-				[sendMutableData appendData:optData];
-				sendData = sendMutableData;
-			} else {
-				sendData = msgData;
-			}
+			// 本文とオプションを1つのバッファに直接変換（転送暗号鍵は平文では送らない）
+			NSMutableData* sendMutableData = [NSMutableData data];
+			[msg appendToData:sendMutableData usingUTF8:useUTF8 nullTerminate:YES];
+			[_StripStreamKeys(opt) appendToData:sendMutableData usingUTF8:useUTF8 nullTerminate:YES];
+			sendData = sendMutableData;
 		}
 	}
 
@@ -1526,6 +1889,17 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 }
 
 - (NSData*)makeEntryMessageData
+{
+	@synchronized (self.packetBuffer) {
+		if (!self.entryTemplate) {
+			self.entryTemplate = [self buildEntryMessageData];
+		}
+		return [[self.entryTemplate retain] autorelease];
+	}
+}
+
+// エントリ系パケット本体編集
+- (NSData*)buildEntryMessageData
 {
 	Config*			config	= Config.sharedConfig;
 	NSMutableData*	data	= [NSMutableData dataWithCapacity:256];
@@ -1543,9 +1917,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 
 	// ニックネーム
-	[data appendData:[user dataUsingUTF8:NO nullTerminate:NO]];
+	[user appendToData:data usingUTF8:NO nullTerminate:NO];
 	if (absence.length > 0) {
-		[data appendData:[absence dataUsingUTF8:NO nullTerminate:NO]];
+		[absence appendToData:data usingUTF8:NO nullTerminate:NO];
 	}
 
 	// グループ化拡張セパレータ
@@ -1554,7 +1928,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// グループ名
 	NSString* group = config.groupName;
 	if (group.length > 0) {
-		[data appendData:[group dataUsingUTF8:NO nullTerminate:NO]];
+		[group appendToData:data usingUTF8:NO nullTerminate:NO];
 	}
 
 	// UTF-8拡張セパレータ
@@ -1568,16 +1942,214 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	if (group.length > 0) {
 		[utf8Str appendFormat:@"GN:%@\n", group];
 	}
-	[data appendData:[utf8Str dataUsingUTF8:YES nullTerminate:NO]];
+	[utf8Str appendToData:data usingUTF8:YES nullTerminate:NO];
 	[data appendBytes:"\0" length:1];
 
-	return data;
+	return [[data copy] autorelease];
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 送信パケット雛形
+/*----------------------------------------------------------------------------*/
+
+// バッファ追記（上限で切り詰め）
+static inline void _PacketAppend(char* buf, size_t* len, size_t max, const void* bytes, size_t n)
+{
+	n = MIN(n, max - *len);
+	memcpy(&buf[*len], bytes, n);
+	*len += n;
+}
+
+// 10進数値追記
+static inline void _PacketAppendNumber(char* buf, size_t* len, size_t max, UInt32 val)
+{
+	char	digits[10];
+	size_t	n = sizeof(digits);
+	do {
+		digits[--n]	= (char)('0' + (val % 10));
+		val			/= 10;
+	} while (val > 0);
+	_PacketAppend(buf, len, max, &digits[n], sizeof(digits) - n);
+}
+
+// 雛形破棄（自分の情報が変化した場合）
+- (void)invalidatePacketTemplates
+{
+	@synchronized (self.packetBuffer) {
+		self.headerTemplate	= nil;
+		self.entryTemplate	= nil;
+	}
+}
+
+// パケット編集（packetBufferのロック中に呼ぶこと。編集長を返し、切り詰め前の長さをtotalに返す）
+- (size_t)buildPacketWithNo:(UInt32)pNo command:(UInt32)cmd data:(NSData*)data total:(size_t*)total
+{
+	return [self buildPacketInBuffer:self.packetBuffer no:pNo command:cmd data:data total:total];
+}
+
+// パケット編集（編集先指定。雛形の参照のみpacketBufferのロック中に行う）
+- (size_t)buildPacketInBuffer:(NSMutableData*)buffer no:(UInt32)pNo command:(UInt32)cmd data:(NSData*)data total:(size_t*)total
+{
+	NSData* header;
+	@synchronized (self.packetBuffer) {
+		if (!self.headerTemplate) {
+			NSString* str = [NSString stringWithFormat:@":%@:%@:", self.selfLogOnName, AppControlGetHostName()];
+			self.headerTemplate = [str dataUsingUTF8:NO nullTerminate:NO];
+		}
+		header = [[self.headerTemplate retain] autorelease];
+	}
+	char*	buf		= buffer.mutableBytes;
+	size_t	max		= buffer.length;
+	size_t	len		= 0;
+
+	// "バージョン:パケット番号:ログオン名:ホスト名:コマンド:"＋本体
+	_PacketAppendNumber(buf, &len, max, IPMSG_VERSION);
+	_PacketAppend(buf, &len, max, ":", 1);
+	_PacketAppendNumber(buf, &len, max, pNo);
+	_PacketAppend(buf, &len, max, header.bytes, header.length);
+	_PacketAppendNumber(buf, &len, max, cmd);
+	_PacketAppend(buf, &len, max, ":", 1);
+	size_t headerLen = len;
+	_PacketAppend(buf, &len, max, data.bytes, data.length);
+
+	*total = headerLen + data.length;
+	return len;
+}
+
+#if defined(IPMSG_DEBUG)
+// パケット編集ベンチマーク（従来方式との比較結果はデバッグログに出力）
+- (void)benchmarkPacketBuilding
+{
+	const NSInteger	loops	= 100000;
+	NSData*			msgData	= [@"benchmark message" dataUsingUTF8:NO nullTerminate:YES];
+	for (NSInteger entry = 0; entry < 2; entry++) {
+		UInt32 cmd = entry ? (IPMSG_BR_ENTRY|self.selfSpec) : (IPMSG_SENDMSG|IPMSG_SENDCHECKOPT);
+		// 従来方式（ヘッダ書式化・変換・連結、エントリ本体も毎回編集）
+		NSData*			legacyData	= nil;
+		CFAbsoluteTime	start		= CFAbsoluteTimeGetCurrent();
+		for (NSInteger i = 0; i < loops; i++) {
+			@autoreleasepool {
+				NSData*		data		= entry ? [self buildEntryMessageData] : msgData;
+				NSString*	headerStr	= [NSString stringWithFormat:@"%d:%d:%@:%@:%u:",
+											IPMSG_VERSION, (UInt32)i, self.selfLogOnName, AppControlGetHostName(), cmd];
+				NSData*		headerData	= [headerStr dataUsingUTF8:NO nullTerminate:NO];
+				NSMutableData* sendData	= [NSMutableData dataWithCapacity:headerData.length + data.length];
+				[sendData appendData:headerData];
+				[sendData appendData:data];
+				if (i == loops - 1) {
+					legacyData = [sendData retain];
+				}
+			}
+		}
+		CFAbsoluteTime legacy = CFAbsoluteTimeGetCurrent() - start;
+		// 雛形方式（送信処理を止めないよう編集先は専用バッファ）
+		NSMutableData*	buffer	= [NSMutableData dataWithLength:MAX_UDPBUF];
+		size_t			len		= 0;
+		start = CFAbsoluteTimeGetCurrent();
+		for (NSInteger i = 0; i < loops; i++) {
+			@autoreleasepool {
+				NSData*	data	= entry ? [self makeEntryMessageData] : msgData;
+				size_t	total	= 0;
+				len = [self buildPacketInBuffer:buffer no:(UInt32)i command:cmd data:data total:&total];
+			}
+		}
+		NSData* templateData = [NSData dataWithBytes:buffer.bytes length:len];
+		CFAbsoluteTime current = CFAbsoluteTimeGetCurrent() - start;
+		if (![templateData isEqualToData:legacyData]) {
+			WRN(@"benchmark(entry=%s) result differs(legacy=%@,template=%@)", BOOLSTR(entry), legacyData, templateData);
+		}
+		[legacyData release];
+		DBG(@"benchmark(entry=%s,%lu bytes) legacy=%.0fpkt/s template=%.0fpkt/s",
+							BOOLSTR(entry), templateData.length, loops / legacy, loops / current);
+	}
+}
+#endif
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - ENTRY応答送信（EntryResponseSchedulerDelegate）
+/*----------------------------------------------------------------------------*/
+
+// スケジューラからの応答送信
+- (void)entryScheduler:(EntryResponseScheduler*)scheduler
+		  sendResponse:(EntryResponseKind)kind
+					to:(UserInfo*)user
+{
+	if (kind & ENTRY_RESPONSE_ANSENTRY) {
+		Config*		cfg			= Config.sharedConfig;
+		NSString*	userName	= cfg.userName;
+		NSString*	groupName	= cfg.groupName;
+		if (userName.length <= 0) {
+			userName = NSUserName();
+		}
+		if (groupName.length <= 0) {
+			groupName = nil;
+		}
+		_MSG_DBG(@"Send ANS_ENTRY(%@)", user);
+		[self sendTo:user
+			packetNo:-1
+			 command:IPMSG_ANSENTRY|self.selfSpec
+			 message:userName
+			  option:groupName];
+	}
+	if (kind & ENTRY_RESPONSE_GETINFO) {
+		_MSG_DBG(@"Send IPMSG_GETINFO(%@)", user);
+		struct sockaddr_in addr = user.address;
+		[self sendTo:&addr packetNo:-1 command:IPMSG_GETINFO data:nil];
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - ホストリスト配信（HostListServerDelegate）
+/*----------------------------------------------------------------------------*/
+
+// ホストリストのコマンド項目（ENTRY受信時に解析した能力フラグを戻す）
+- (UInt32)hostListServer:(HostListServer*)server commandForUser:(UserInfo*)user
+{
+	UInt32 command = IPMSG_BR_ENTRY;
+	if (user.inAbsence) {
+		command |= IPMSG_ABSENCEOPT;
+	}
+	if (user.dialupConnect) {
+		command |= IPMSG_DIALUPOPT;
+	}
+	if (user.supportsAttachment) {
+		command |= IPMSG_FILEATTACHOPT;
+	}
+	if (user.supportsLargeMessage) {
+		command |= IPMSG_CAPLARGEMSGOPT;
+	}
+	if (user.supportsEncryptedStream) {
+		command |= IPMSG_CAPENCSTREAMOPT;
+	}
+	if (user.supportsRangeRequest) {
+		command |= IPMSG_CAPRANGEOPT;
+	}
+	if (user.supportsEncrypt) {
+		command |= IPMSG_ENCRYPTOPT;
+	}
+	if (user.supportsEncExtMsg) {
+		command |= IPMSG_ENCEXTMSGOPT;
+	}
+	if (user.supportsUTF8) {
+		command |= IPMSG_CAPUTF8OPT;
+	}
+	return command;
 }
 
 /*----------------------------------------------------------------------------*/
 #pragma mark - メッセージ受信処理（内部利用）
 /*----------------------------------------------------------------------------*/
 
+// 自分自身の送信判定（複数NICでは送出NIC毎のアドレスから届くため、自マシンの全アドレスと
+// ログオン名・ホスト名で判定する。同一マシン上の別ユーザは対象外）
+- (BOOL)isSelfUser:(UserInfo*)user address:(struct sockaddr_in)addr
+{
+	if (![self.broadcaster isLocalAddress:addr.sin_addr] && (ntohl(addr.sin_addr.s_addr) != AppControlGetIPAddress())) {
+		return NO;
+	}
+	return ([user.logOnName isEqualToString:self.selfLogOnName] && [user.hostName isEqualToString:AppControlGetHostName()]);
+}
+
 // 受信後実処理
 - (void)processReceiveMessageBuffer:(char*)buff
 							 length:(ssize_t)len
@@ -1614,10 +2186,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// バージョン番号チェック
 	if (!(tok = strtok_r(buff, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(version get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	if (strtol(tok, NULL, 10) != IPMSG_VERSION) {
 		ERR(@"msg:version invalid(%ld)", strtol(tok, NULL, 10));
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	TRC(@"\tversion       =%d(OK)", IPMSG_VERSION);
@@ -1625,6 +2199,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// パケット番号
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(version get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	packetNo = strtol(tok, NULL, 10);
@@ -1633,6 +2208,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// ログイン名退避
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(logOn get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	char* logOnUserPtr = tok;
@@ -1640,6 +2216,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// ホスト名退避
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(host get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	char* hostNamePtr = tok;
@@ -1647,10 +2224,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// コマンド番号
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(command get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	command = (UInt32)strtoul(tok, NULL, 10);
 	TRC(@"\tcommand       =0x%08X", command);
+	MetricsCountPacket(YES, command);
 
 	BOOL useUTF8 = ((command & IPMSG_UTF8OPT) != 0);
 	TRC(@"\t (UTF8OPT     =%d)", useUTF8);
@@ -1664,6 +2243,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	TRC(@"\thostName      =%@", hostName);
 
 	// 追加部
+	const char* appendixPtr = ptr;
 	if (ptr) {
 		appendix = [NSString stringWithCString:ptr utf8Encoded:useUTF8];
 	}
@@ -1741,8 +2321,18 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			ERR(@"        > Cancel (has FingerPrint although enryption not support)");
 			break;
 		}
+		UserInfo* knownUser = nil;
 		if (!isUnknownUser) {
 			// 既知のユーザからのENTRY系パケット受信時はユーザ情報を更新
+			// 同一ユーザは作り直さずに更新する。ただし指紋なしで公開鍵取得済みの場合は
+			// 相手の鍵が変わっている可能性があるため従来通り作り直して再取得させる
+			BOOL sameHost	= ([fromUser.hostName isEqualToString:hostName] &&
+							   (fromUser.address.sin_port == fromAddr.sin_port));
+			BOOL keepKey	= (fromUser.fingerPrint || !fromUser.publicKey);
+			if (sameHost && keepKey) {
+				// 表示中のインスタンスは受信スレッドで書き換えず、作業用に受けた内容をメインスレッドで反映する
+				knownUser = fromUser;
+			}
 			fromUser = [UserInfo userWithHostName:hostName
 										logOnName:logOnUser
 										  address:&fromAddr];
@@ -1752,6 +2342,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		fromUser.inAbsence			= (BOOL)((command & IPMSG_ABSENCEOPT) != 0);
 		fromUser.dialupConnect		= (BOOL)((command & IPMSG_DIALUPOPT) != 0);
 		fromUser.supportsAttachment	= (BOOL)((command & IPMSG_FILEATTACHOPT) != 0);
+		fromUser.supportsLargeMessage	= (BOOL)((command & IPMSG_CAPLARGEMSGOPT) != 0);
+		fromUser.supportsEncryptedStream	= (BOOL)((command & IPMSG_CAPENCSTREAMOPT) != 0);
+		fromUser.supportsRangeRequest		= (BOOL)((command & IPMSG_CAPRANGEOPT) != 0);
 		fromUser.supportsEncrypt	= (BOOL)((command & IPMSG_ENCRYPTOPT) != 0);
 		fromUser.supportsEncExtMsg	= (BOOL)((command & IPMSG_ENCEXTMSGOPT) != 0);
 		fromUser.supportsUTF8		= (BOOL)((command & IPMSG_CAPUTF8OPT) != 0);
@@ -1763,50 +2356,37 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				 command:IPMSG_BR_EXIT|self.selfSpec
 					data:[self makeEntryMessageData]];
 		} else {
+			EntryResponseKind	kind	= 0;
+			NSTimeInterval		spread	= 0;
 			if (GET_MODE(command) == IPMSG_BR_ENTRY) {
 				_MSG_DBG(@"        > IPMSG_BR_ENTRY");
 				UInt32 ipAddress = AppControlGetIPAddress();
-				if (ntohl(fromAddr.sin_addr.s_addr) != ipAddress) {
+				if (![self isSelfUser:fromUser address:fromAddr]) {
 					// 応答を送信（自分自身以外）
-					int64_t		delta	= 500 * NSEC_PER_MSEC;
-					NSUInteger	userNum	= UserManager.sharedManager.users.count;
-					if ((userNum < 50) || ((ipAddress ^ htonl(fromAddr.sin_addr.s_addr) << 8) == 0)) {
-						// ユーザ数50人以下またはアドレス上位24bitが同じ場合 0 〜 1023 ms
-						delta = (1023 & arc4random_uniform(INT32_MAX)) * NSEC_PER_MSEC;
-					} else if (userNum < 300) {
-						// ユーザ数が300人以下なら 0 〜 2047 ms
-						delta = (2047 & arc4random_uniform(INT32_MAX)) * NSEC_PER_MSEC;
-					} else {
-						// それ以上は 0 〜 4095 ms
-						delta = (4095 & arc4random_uniform(INT32_MAX)) * NSEC_PER_MSEC;
-					}
-					_MSG_DBG(@"        > Send ANS_ENTRY(after %lldms)", (delta / NSEC_PER_MSEC));
-					dispatch_time_t		when 	= dispatch_time(DISPATCH_TIME_NOW, delta);
-					dispatch_queue_t	queue	= dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-					dispatch_after(when, queue, ^{
-						Config*		cfg			= Config.sharedConfig;
-						NSString*	userName	= cfg.userName;
-						NSString*	groupName	= cfg.groupName;
-						if (userName.length <= 0) {
-							userName = NSUserName();
-						}
-						if (groupName.length <= 0) {
-							groupName = nil;
-						}
-						[self sendTo:fromUser
-							packetNo:-1
-							 command:IPMSG_ANSENTRY|self.selfSpec
-							 message:userName
-							  option:groupName];
-					});
+					NSUInteger	userNum		= UserManager.sharedManager.users.count;
+					BOOL		sameSubnet	= ((ipAddress ^ htonl(fromAddr.sin_addr.s_addr) << 8) == 0);
+					kind	|= ENTRY_RESPONSE_ANSENTRY;
+					spread	= [EntryResponseScheduler spreadForUserCount:userNum sameSubnet:sameSubnet];
 				}
 			}
+			// バージョン情報はキャッシュから補完（問い合わせは表示時に必要分のみ）
+			fromUser.version = [VersionCache.sharedCache versionForUser:fromUser];
+			if (knownUser) {
+				// 一覧変更通知（メインスレッドで処理される）より先に反映されるよう先に積む
+				UserInfo* entry = fromUser;
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[knownUser updateEntryFromUser:entry];
+				});
+				fromUser = knownUser;
+			}
 			// ユーザ一覧に追加
 			_MSG_DBG(@"        > Append User(%@)", fromUser);
 			[UserManager.sharedManager appendUser:fromUser];
-			// バージョン情報問い合わせ
-			_MSG_DBG(@"        > Send IPMSG_GETINFO");
-			[self sendTo:&fromAddr packetNo:-1 command:IPMSG_GETINFO data:nil];
+			// ANSENTRY応答（同一相手の重複はまとめて間引く）
+			if (kind != 0) {
+				_MSG_DBG(@"        > Schedule ANS_ENTRY(within %.0fms)", spread * 1000.0);
+				[self.entryScheduler scheduleResponse:kind to:fromUser within:spread];
+			}
 		}
 		break;
 	case IPMSG_BR_EXIT:
@@ -1814,6 +2394,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		_MSG_DBG(@"        > Remove User(%@)", fromUser.summaryString);
 		// ユーザ一覧から削除
 		[UserManager.sharedManager removeUser:fromUser];
+		// 送信待ちENTRY応答を破棄
+		[self.entryScheduler cancelResponsesTo:fromUser];
 		// 送信添付ファイル管理から削除
 		[self removeAttachmentUser:fromUser
 						  packetNo:_ANY_PACKET_NO
@@ -1929,7 +2511,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			}
 			_MSG_DBG(@"    -> EncryptedMsg  :%ldbytes", encMsg.length);
 			NSData* messageData = NULL;
-			if (capa & IPMSG_AES_256) {
+			if (capa & IPMSG_AES_256_GCM) {
+				messageData = [cm decryptAESGCM:encMsg
+											key:sessionKey
+											 iv:[ivData subdataWithRange:NSMakeRange(0, _GCM_IV_SIZE)]
+											aad:nil];
+			} else if (capa & IPMSG_AES_256) {
 				messageData = [cm decryptAES:encMsg key:sessionKey iv:ivData];
 			} else if (capa & IPMSG_BLOWFISH_128) {
 				messageData = [cm decryptBlowfish:encMsg key:sessionKey iv:ivData];
@@ -1981,7 +2568,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			}
 
 			// 暗号化レベル判定
-			if ((capa & IPMSG_RSA_2048) && (capa & IPMSG_AES_256)) {
+			if ((capa & IPMSG_RSA_2048) && (capa & (IPMSG_AES_256|IPMSG_AES_256_GCM))) {
 				if (capa & IPMSG_SIGN_SHA256) {
 					secureLevel = 4;
 				} else if (capa & IPMSG_SIGN_SHA1) {
@@ -2022,6 +2609,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		// 応答待ちメッセージ一覧から受信したメッセージのエントリを削除
 		NSString* key = [RetryInfo identifyKeyForPacketNo:appendix.integerValue to:fromUser];
 		[self.sendList removeObjectForKey:key];
+		MetricsGaugeSet(METRICS_SEND_LIST_SIZE, (SInt64)self.sendList.count);
 		break;
 	case IPMSG_READMSG:		// 封書開封通知パケット
 		_MSG_DBG(@"command=IPMSG_READMSG");
@@ -2066,9 +2654,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	case IPMSG_SENDINFO:	// バージョン情報
 		_MSG_DBG(@"command=IPMSG_SENDINFO");
 		_MSG_DBG(@"        > Version Info(%@=%@)", fromUser.summaryString, appendix);
-		// バージョン情報をユーザ情報に設定
-		fromUser.version = appendix;
-		[UserManager.sharedManager appendUser:fromUser];
+		// バージョン情報をキャッシュとユーザ情報に設定（変化がなければ一覧更新しない）
+		[VersionCache.sharedCache setVersion:appendix forUser:fromUser];
+		if (isUnknownUser || ![fromUser.version isEqualToString:appendix]) {
+			fromUser.version = appendix;
+			[UserManager.sharedManager appendUser:fromUser];
+		}
 		break;
 	/*-------- 不在関連 ---------*/
 	case IPMSG_GETABSENCEINFO:
@@ -2154,9 +2745,24 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		break;
 	/*-------- ホストリスト関連 ---------*/
 	case IPMSG_BR_ISGETLIST:
-		// NOP
-		_MSG_DBG(@"command=IPMSG_BR_ISGETLIST");
-		_MSG_DBG(@"        > nop");
+	case IPMSG_BR_ISGETLIST2:
+		_MSG_DBG(@"command=IPMSG_BR_ISGETLIST|IPMSG_BR_ISGETLIST2");
+		if (!config.hostListServer) {
+			_MSG_DBG(@"        > nop(not hostlist server)");
+			break;
+		}
+		if ([self isSelfUser:fromUser address:fromAddr]) {
+			_MSG_DBG(@"        > nop(self)");
+			break;
+		}
+		if ([config matchRefuseCondition:fromUser]) {
+			_MSG_DBG(@"        > nop(Refuse condition matched[%@])", fromUser.summaryString);
+			break;
+		}
+		// ホストリスト配信可能を応答（以降のGETLISTを受け付ける）
+		_MSG_DBG(@"        > Send IPMSG_OKGETLIST");
+		[self.hostListServer noteOfferTo:&fromAddr];
+		[self sendTo:&fromAddr packetNo:-1 command:IPMSG_OKGETLIST|self.selfSpec data:nil];
 		break;
 	case IPMSG_OKGETLIST:
 		// NOP
@@ -2164,18 +2770,29 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		_MSG_DBG(@"        > nop");
 		break;
 	case IPMSG_GETLIST:
-		// NOP
 		_MSG_DBG(@"command=IPMSG_GETLIST");
-		_MSG_DBG(@"        > nop");
-		break;
-	case IPMSG_BR_ISGETLIST2:
-		// NOP
-		_MSG_DBG(@"command=IPMSG_BR_ISGETLIST2");
-		_MSG_DBG(@"        > nop");
+		if (!config.hostListServer) {
+			_MSG_DBG(@"        > nop(not hostlist server)");
+			break;
+		}
+		if (![self.hostListServer acceptRequestFrom:&fromAddr]) {
+			// 要求より大きい応答を返すため、OKGETLIST送信先・既知ユーザ以外や応答数上限超過時には応答しない
+			WRN(@"GETLIST refused(%s)", inet_ntoa(fromAddr.sin_addr));
+			break;
+		}
+		{
+			NSInteger	start	= appendix ? MAX(appendix.integerValue, 0) : 0;
+			NSData*		page	= [self.hostListServer pageFrom:(NSUInteger)start utf8:useUTF8];
+			_MSG_DBG(@"        > Send IPMSG_ANSLIST(start=%ld,%luBytes)", start, page.length);
+			[self sendTo:&fromAddr
+				packetNo:-1
+				 command:IPMSG_ANSLIST|(useUTF8 ? IPMSG_UTF8OPT : 0)
+					data:page];
+		}
 		break;
 	case IPMSG_ANSLIST:
 		_MSG_DBG(@"command=IPMSG_ANSLIST");
-		NSInteger hostListContinueCount = [self processReceivedHostList:appendix];
+		NSInteger hostListContinueCount = [self processReceivedHostList:appendixPtr utf8Encoded:useUTF8];
 		if (hostListContinueCount > 0) {
 			_MSG_DBG(@"        > Send IPMSG_GETLIST(%ld)", hostListContinueCount);
 			// 継続のGETLIST送信
@@ -2206,7 +2823,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	NSArray<NSString*>* attachList = [attachMessage componentsSeparatedByString:@":\a"];
 	if (attachList.count > 0) {
 		for (NSString* attachStr in attachList) {
-			TRC(@"attach string(%@)", attachStr);
+			TRC(@"attach string(%@)", _StripStreamKeys(attachStr));
 			if (attachStr.length <= 0) {
 				TRC(@"attach empty1 -> continue");
 				continue;
@@ -2214,7 +2831,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			if ([attachStr characterAtIndex:0] == ':') {
 				// 区切りが":\a:"だった場合、先頭の:を削る
 				attachStr = [attachStr substringFromIndex:1];
-				TRC(@"attach striped(%@)", attachStr);
+				TRC(@"attach striped(%@)", _StripStreamKeys(attachStr));
 				if (attachStr.length <= 0) {
 					TRC(@"attach empty2 -> continue");
 					continue;
@@ -2230,6 +2847,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 					[files addObject:(RecvFile*)attach];
 				} else if ([attach isKindOfClass:RecvClipboard.class]) {
 					[clips addObject:(RecvClipboard*)attach];
+				} else if ([attach isKindOfClass:RecvMessageBody.class]) {
+					recvMsg.messageBody = (RecvMessageBody*)attach;
 				} else {
 					// err
 				}
@@ -2249,18 +2868,15 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 - (void)processReceivedMessage:(RecvMessage*)recvMsg
 {
 	@autoreleasepool {
+		if (recvMsg.messageBody) {
+			// 長文本文はTCPで取得して差し替え（取得できなければ先頭部分のみ表示）
+			[self fetchMessageBody:recvMsg];
+		}
 		if (recvMsg.clipboards.count > 0) {
-			// 埋め込みクリップボードをダウンロード
-			AttachDLContextImpl* dl = [[AttachDLContextImpl alloc] init];
-
-			dl.attachments	= recvMsg.clipboards;
-			dl.packetNo		= recvMsg.packetNo;
-			dl.fromUser		= recvMsg.fromUser;
-			dl.tcpSocket	= -1;
-			dl.stop			= NO;
-
-			// あえて同期で呼び出し（ダウンロードしきってメッセージ表示するため）
-			[self performSelector:@selector(downloadThread:) withObject:dl];
+			// 埋め込みクリップボードは表示と並行してダウンロード（表示側は読み込み完了通知で差し替え）
+			recvMsg.clipboardDownload = [self prefetchClipboards:recvMsg.clipboards
+															  of:recvMsg.packetNo
+															from:recvMsg.fromUser];
 		}
 		// 受信処理（非同期）
 		dispatch_async(dispatch_get_main_queue(), ^{
@@ -2269,77 +2885,203 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 }
 
-// 受信ホストリスト解析処理
-- (NSInteger)processReceivedHostList:(NSString*)hostListMessage
+// 長文メッセージ本文取得（受信スレッドから同期で呼ばれる）
+- (void)fetchMessageBody:(RecvMessage*)recvMsg
 {
-	NSInteger continueCount = 0;
-	if (hostListMessage.length > 0) {
-		NSArray<NSString*>*	lists = [hostListMessage componentsSeparatedByString:@"\a"];
-		if (lists.count > 2) {
-			NSInteger totalCount = lists[1].integerValue;
-			if (totalCount > 0) {
-				continueCount = lists[0].integerValue;
-				if (lists.count < (totalCount * 7 + 2)) {
-					WRN(@"hostlist:invalid data(items=%ld,totalCount=%ld,%@)", lists.count, totalCount, self);
-					totalCount = (lists.count - 2) / 7;
-				}
-				Config* config = Config.sharedConfig;
-				for (NSInteger i = 0; i < totalCount; i++) {
-					NSArray<NSString*>*	itemArray		= [lists subarrayWithRange:NSMakeRange(i * 7 + 2, 7)];
-					NSString*			itemLogOnName	= itemArray[0];
-					NSString*			itemHostName	= itemArray[1];
-					UInt32				itemCommand		= (UInt32)[itemArray[2] integerValue];
-					NSString*			itemAddrStr		= itemArray[3];
-					UInt32				itemAddrNum		= (UInt32)inet_addr([itemAddrStr UTF8String]);
-					UInt16				itemPort		= (UInt16)[itemArray[4] integerValue];
-					NSString*			itemUserName	= itemArray[5];
-					NSString*			itemGroupName	= itemArray[6];
-
-					struct sockaddr_in itemAddr;
-					itemAddr.sin_family			= AF_INET;
-					itemAddr.sin_addr.s_addr	= itemAddrNum;
-					itemAddr.sin_port			= itemPort;
-
-					if ([itemUserName isEqualToString:@"\b"]) {
-						itemUserName = nil;
-					}
-					if ([itemGroupName isEqualToString:@"\b"]) {
-						itemGroupName = nil;
-					}
+	RecvMessageBody* body = recvMsg.messageBody;
+	if (body.size > IPMSG_MESSAGE_BODY_MAX_SIZE) {
+		WRN(@"message body too large(%zd bytes) -> skip", body.size);
+		return;
+	}
 
-					UserInfo* newUser = [UserInfo userWithHostName:itemHostName
-														 logOnName:itemLogOnName
-														   address:&itemAddr];
-					if (newUser) {
-						newUser.userName			= itemUserName;
-						newUser.groupName			= itemGroupName;
-						newUser.inAbsence			= (BOOL)((itemCommand & IPMSG_ABSENCEOPT) != 0);
-						newUser.dialupConnect		= (BOOL)((itemCommand & IPMSG_DIALUPOPT) != 0);
-						newUser.supportsAttachment	= (BOOL)((itemCommand & IPMSG_FILEATTACHOPT) != 0);
-						newUser.supportsEncrypt		= (BOOL)((itemCommand & IPMSG_ENCRYPTOPT) != 0);
-						newUser.supportsEncExtMsg	= (BOOL)((itemCommand & IPMSG_ENCEXTMSGOPT) != 0);
-						newUser.supportsUTF8		= (BOOL)((itemCommand & IPMSG_CAPUTF8OPT) != 0);
-						if (![config matchRefuseCondition:newUser]) {
-							_MSG_DBG(@"        > Append User([%ld/%ld] %@)", i + 1, totalCount, newUser.summaryString);
-							[UserManager.sharedManager appendUser:newUser];
-						}
-					}
-				}
-			}
-		}
+	AttachDLContextImpl* dl = [[AttachDLContextImpl alloc] init];
+
+	dl.attachments	= @[body];
+	dl.packetNo		= recvMsg.packetNo;
+	dl.fromUser		= recvMsg.fromUser;
+	dl.tcpSocket	= -1;
+	dl.stop			= NO;
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	// downloadThread:側でautoreleaseされる
+	[self downloadThread:dl];
+	if (body.message) {
+		recvMsg.message = body.message;
+		DBG(@"message body fetched(pNo=%ld,%zd bytes,%.1fms)",
+							recvMsg.packetNo, body.size, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+	} else {
+		WRN(@"message body fetch failed(pNo=%ld,%zd bytes) -> preview only", recvMsg.packetNo, body.size);
 	}
-	return continueCount;
 }
 
-/*----------------------------------------------------------------------------*/
-#pragma mark - 添付ファイル送信処理（内部利用）
-/*----------------------------------------------------------------------------*/
-
-// リクエスト受信後実処理
-- (void)processAttachmentRequestBuffer:(char*)buff
-								length:(ssize_t)len
-								  from:(struct sockaddr_in)fromAddr
-								socket:(int)sock
+// 埋め込みクリップボード先読み（同時ダウンロード数を制限してバックグラウンドで受信・デコード）
+- (id<DownloaderContext>)prefetchClipboards:(NSArray<RecvClipboard*>*)clips
+										 of:(NSInteger)packetNo
+									   from:(UserInfo*)fromUser
+{
+	static dispatch_semaphore_t	limit = NULL;
+	static dispatch_once_t		once;
+	dispatch_once(&once, ^{
+		limit = dispatch_semaphore_create(_CLIPBOARD_PREFETCH_MAX);
+	});
+
+	// サイズ上限を超えるものはダウンロードしない
+	NSMutableArray<RecvClipboard*>* targets = [NSMutableArray<RecvClipboard*> arrayWithCapacity:clips.count];
+	for (RecvClipboard* clip in clips) {
+		if (clip.size > IPMSG_CLIPBOARD_MAX_SIZE) {
+			WRN(@"clipboard too large(%@,%zd bytes) -> skip", clip.name, clip.size);
+			[clip complete];
+			continue;
+		}
+		[targets addObject:clip];
+	}
+	if (targets.count == 0) {
+		return nil;
+	}
+
+	AttachDLContextImpl* dl = [[AttachDLContextImpl alloc] init];
+
+	dl.attachments	= targets;
+	dl.packetNo		= packetNo;
+	dl.fromUser		= fromUser;
+	dl.tcpSocket	= -1;
+	dl.stop			= NO;
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		dispatch_semaphore_wait(limit, DISPATCH_TIME_FOREVER);
+		if (!dl.stop) {
+			// downloadThread:側でautoreleaseされる
+			[self downloadThread:[dl retain]];
+		}
+		dispatch_semaphore_signal(limit);
+		// 中断・エラーで受信できなかったものも完了扱いにする（表示側はプレースホルダを差し替える）
+		for (RecvClipboard* clip in targets) {
+			[clip complete];
+		}
+	});
+
+	return [dl autorelease];
+}
+
+// ホストリスト項目切り出し（項目長を返し、次項目位置に進める）
+static const char* _HostListNextField(const char** cursor, size_t* len)
+{
+	const char* start = *cursor;
+	if (!start) {
+		return NULL;
+	}
+	const char* sep = strchr(start, HOSTLIST_SEPARATOR);
+	if (sep) {
+		*len	= (size_t)(sep - start);
+		*cursor	= sep + 1;
+	} else {
+		*len	= strlen(start);
+		*cursor	= NULL;
+	}
+	return start;
+}
+
+// ホストリスト文字列項目変換（ダミー項目はnil）
+static NSString* _HostListString(const char* field, size_t len, BOOL utf8)
+{
+	if ((len == 1) && (field[0] == HOSTLIST_DUMMY[0])) {
+		return nil;
+	}
+	return [NSString stringWithBytes:field length:len utf8Encoded:utf8];
+}
+
+// 受信ホストリスト解析処理（受信バッファを先頭から逐次解析し、一括でユーザ追加）
+- (NSInteger)processReceivedHostList:(const char*)hostList utf8Encoded:(BOOL)utf8
+{
+	enum { _LOGON, _HOST, _COMMAND, _ADDRESS, _PORT, _USER, _GROUP, _FIELD_NUM };
+
+	if (!hostList || (hostList[0] == '\0')) {
+		return 0;
+	}
+	const char*	cursor	= hostList;
+	size_t		len;
+	const char*	field	= _HostListNextField(&cursor, &len);
+	NSInteger	continueCount	= strtol(field, NULL, 10);
+	field = _HostListNextField(&cursor, &len);
+	if (!field || !cursor) {
+		return 0;
+	}
+	NSInteger totalCount = strtol(field, NULL, 10);
+	if (totalCount <= 0) {
+		return 0;
+	}
+
+	Config*						config		= Config.sharedConfig;
+	NSMutableArray<UserInfo*>*	newUsers	= [NSMutableArray arrayWithCapacity:totalCount];
+	NSInteger					i;
+	for (i = 0; i < totalCount; i++) {
+		const char*	items[_FIELD_NUM];
+		size_t		itemLens[_FIELD_NUM];
+		NSInteger	num;
+		for (num = 0; num < _FIELD_NUM; num++) {
+			items[num] = _HostListNextField(&cursor, &itemLens[num]);
+			if (!items[num]) {
+				break;
+			}
+		}
+		if (num < _FIELD_NUM) {
+			WRN(@"hostlist:invalid data(items=%ld/%ld,totalCount=%ld,%@)", i, num, totalCount, self);
+			break;
+		}
+
+		char addrStr[INET_ADDRSTRLEN];
+		if (itemLens[_ADDRESS] >= sizeof(addrStr)) {
+			WRN(@"hostlist:invalid address(len=%zu)", itemLens[_ADDRESS]);
+			continue;
+		}
+		memcpy(addrStr, items[_ADDRESS], itemLens[_ADDRESS]);
+		addrStr[itemLens[_ADDRESS]] = '\0';
+
+		UInt32 itemCommand = (UInt32)strtoul(items[_COMMAND], NULL, 10);
+
+		struct sockaddr_in itemAddr;
+		itemAddr.sin_family			= AF_INET;
+		itemAddr.sin_addr.s_addr	= (UInt32)inet_addr(addrStr);
+		itemAddr.sin_port			= (UInt16)strtol(items[_PORT], NULL, 10);
+
+		NSString* itemLogOnName	= [NSString stringWithBytes:items[_LOGON] length:itemLens[_LOGON] utf8Encoded:utf8];
+		NSString* itemHostName	= [NSString stringWithBytes:items[_HOST] length:itemLens[_HOST] utf8Encoded:utf8];
+		UserInfo* newUser = [UserInfo userWithHostName:itemHostName
+											 logOnName:itemLogOnName
+											   address:&itemAddr];
+		if (newUser) {
+			newUser.userName			= _HostListString(items[_USER], itemLens[_USER], utf8);
+			newUser.groupName			= _HostListString(items[_GROUP], itemLens[_GROUP], utf8);
+			newUser.inAbsence			= (BOOL)((itemCommand & IPMSG_ABSENCEOPT) != 0);
+			newUser.dialupConnect		= (BOOL)((itemCommand & IPMSG_DIALUPOPT) != 0);
+			newUser.supportsAttachment	= (BOOL)((itemCommand & IPMSG_FILEATTACHOPT) != 0);
+			newUser.supportsLargeMessage	= (BOOL)((itemCommand & IPMSG_CAPLARGEMSGOPT) != 0);
+			newUser.supportsEncryptedStream	= (BOOL)((itemCommand & IPMSG_CAPENCSTREAMOPT) != 0);
+			newUser.supportsRangeRequest	= (BOOL)((itemCommand & IPMSG_CAPRANGEOPT) != 0);
+			newUser.supportsEncrypt		= (BOOL)((itemCommand & IPMSG_ENCRYPTOPT) != 0);
+			newUser.supportsEncExtMsg	= (BOOL)((itemCommand & IPMSG_ENCEXTMSGOPT) != 0);
+			newUser.supportsUTF8		= (BOOL)((itemCommand & IPMSG_CAPUTF8OPT) != 0);
+			if (![config matchRefuseCondition:newUser]) {
+				_MSG_TRC(@"        > Append User([%ld/%ld] %@)", i + 1, totalCount, newUser.summaryString);
+				[newUsers addObject:newUser];
+			}
+		}
+	}
+	_MSG_DBG(@"        > Append %ld Users(total=%ld,continue=%ld)", newUsers.count, totalCount, continueCount);
+	[UserManager.sharedManager appendUsers:newUsers];
+
+	return continueCount;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 添付ファイル送信処理（内部利用）
+/*----------------------------------------------------------------------------*/
+
+// リクエスト受信後実処理
+- (void)processAttachmentRequestBuffer:(char*)buff
+								length:(ssize_t)len
+								  from:(struct sockaddr_in)fromAddr
+								socket:(int)sock
 {
 	// リクエスト解析
 	buff[len] = '\0';
@@ -2359,10 +3101,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// バージョン番号チェック
 	if (!(tok = strtok_r(buff, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(version get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	if (strtol(tok, NULL, 10) != IPMSG_VERSION) {
 		ERR(@"msg:version invalid(%ld)", strtol(tok, NULL, 10));
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	TRC(@"\tversion       =%d(OK)", IPMSG_VERSION);
@@ -2370,6 +3114,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// パケット番号
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(version get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	packetNo = strtol(tok, NULL, 10);
@@ -2378,6 +3123,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// ログイン名
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(logOn get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	logOnUserCStr = tok;
@@ -2385,6 +3131,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// ホスト名
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(host get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	hostNameCStr = tok;
@@ -2392,6 +3139,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// コマンド番号
 	if (!(tok = strtok_r(NULL, MESSAGE_SEPARATOR, &ptr))) {
 		ERR(@"msg:illegal format(command get error,\"%s\")", buff);
+		MetricsIncrement(METRICS_PARSE_ERROR, 1);
 		return;
 	}
 	command = (UInt32)strtoul(tok, NULL, 10);
@@ -2439,17 +3187,30 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 
 	// オフセット（フォルダの場合は来ない。本当はファイルとフォルダ分けて処理すべき）
-	unsigned attachOffset = 0;
+	unsigned long long attachOffset = 0;
 	if (GET_MODE(command) == IPMSG_GETFILEDATA) {
 		if (requestParts[2].length > 0) {
 			scanner = [NSScanner scannerWithString:requestParts[2]];
-			if (![scanner scanHexInt:&attachOffset]) {
+			if (![scanner scanHexLongLong:&attachOffset]) {
 				ERR(@"offset parse error(%@)", requestParts[2]);
 				return;
 			}
 		}
 	}
 
+	// 取得長（範囲指定取得時のみ。以降の項目は1つずつ後ろにずれる）
+	BOOL				rangeRequest	= ((GET_MODE(command) == IPMSG_GETFILEDATA) && (command & IPMSG_RANGEOPT));
+	unsigned long long	attachLength	= 0;
+	NSUInteger			ivIndex			= 3;
+	if (rangeRequest) {
+		scanner = [NSScanner scannerWithString:(requestParts.count > 3) ? requestParts[3] : @""];
+		if (![scanner scanHexLongLong:&attachLength] || (attachLength == 0)) {
+			ERR(@"range length parse error(%@)", appendix);
+			return;
+		}
+		ivIndex++;
+	}
+
 	// 送信添付ファイル情報検索
 	SendAttachment*	attach = nil;
 	@synchronized (self.attachList) {
@@ -2471,6 +3232,52 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		return;
 	}
 
+	// 暗号化転送要求（鍵は添付毎、初期カウンタは要求毎に受信側が指定）
+	CryptoStream* cipher = nil;
+	if (command & IPMSG_ENCSTREAMOPT) {
+		NSData* iv = nil;
+		if (requestParts.count > ivIndex) {
+			iv = [NSData dataWithHexEncodedString:requestParts[ivIndex]];
+		}
+		if (attach.streamKey && iv) {
+			cipher = [CryptoStream streamWithKey:attach.streamKey iv:iv];
+		}
+		if (!cipher) {
+			// 平文では応答しない
+			ERR(@"encrypted stream request invalid(%@,key=%s)", appendix, BOOLSTR(attach.streamKey != nil));
+			return;
+		}
+		DBG(@"attachment stream encrypted(%@)", attach);
+	} else if ([attach isStreamKeyIssuedTo:user]) {
+		// 鍵を渡した相手には平文で応答しない（暗号化指定を外した要求の拒否）
+		ERR(@"plaintext request refused(key issued,%@,%@)", user, attach);
+		return;
+	}
+
+	// 帯域制御開始
+	BandwidthShaper*	shaper		= BandwidthShaper.sharedShaper;
+	BandwidthTransfer*	transfer	= [shaper beginTransferTo:fromAddr socket:sock];
+	transfer.cipher = cipher;
+
+	// メモリ上データ（メッセージ本文）送信
+	if (attach.data) {
+		if (GET_MODE(command) != IPMSG_GETFILEDATA) {
+			ERR(@"invalid command for data([0x%08lX],%@)", GET_MODE(command), attach);
+		} else if (rangeRequest) {
+			// 範囲指定取得は通常ファイルのみ（メモリ上データは分割取得されない）
+			ERR(@"range request for data refused(%@)", attach);
+		} else if ([self sendMemoryData:attach.data offset:(size_t)attachOffset to:sock transfer:transfer] && [transfer sendTag:sock]) {
+			[self removeAttachmentUser:user
+							  packetNo:attachPacketNo
+								fileID:attachFileID];
+			DBG(@"Data Request processing complete.");
+		} else {
+			ERR(@"sendData error(%@)", attach);
+		}
+		[shaper endTransfer:transfer];
+		return;
+	}
+
 	NSFileManager*	fm		= NSFileManager.defaultManager;
 	_FileAttrDic*	attrs	= [fm attributesOfItemAtPath:attach.path error:NULL];
 	NSString*		type	= attrs[NSFileType];
@@ -2482,13 +3289,44 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			ERR(@"type is not file(%@)", attach.path);
 			break;
 		}
-		if ([self sendFileData:attach.path to:sock]) {
-			[self removeAttachmentUser:user
-							  packetNo:attachPacketNo
-								fileID:attachFileID];
-			DBG(@"File Request processing complete.");
+		if ((attachOffset == 0) && !rangeRequest) {
+			// ファイル全体
+			if ([self sendFileData:attach.path to:sock transfer:transfer] && [transfer sendTag:sock]) {
+				[self removeAttachmentUser:user
+								  packetNo:attachPacketNo
+									fileID:attachFileID];
+				DBG(@"File Request processing complete.");
+			} else {
+				ERR(@"sendFile error(%@)", attach.path);
+			}
 		} else {
-			ERR(@"sendFile error(%@)", attach.path);
+			// 途中から（範囲指定時は指定長のみ）
+			UInt64 fileSize = [self fileSizeForAttrs:attrs];
+			if (attachOffset > fileSize) {
+				ERR(@"offset over filesize(%@,%llu/%llu)", attach.path, attachOffset, fileSize);
+				break;
+			}
+			UInt64 length = fileSize - attachOffset;
+			if (rangeRequest) {
+				if (attachLength > length) {
+					ERR(@"range over filesize(%@,%llu+%llu/%llu)", attach.path, attachOffset, attachLength, fileSize);
+					break;
+				}
+				length = attachLength;
+			}
+			if ([self sendFileData:attach.path offset:attachOffset length:length to:sock transfer:transfer] && [transfer sendTag:sock]) {
+				if (!rangeRequest) {
+					[self removeAttachmentUser:user
+									  packetNo:attachPacketNo
+										fileID:attachFileID];
+				} else if ([attach addSentRange:NSMakeRange((NSUInteger)attachOffset, (NSUInteger)length) ofLength:fileSize forUser:user]) {
+					// 範囲指定時は全範囲を送り終えても、受信側で失敗した範囲の再要求に備えてしばらく残す
+					[self releaseRangeAttachment:attach forUser:user];
+				}
+				DBG(@"File Request processing complete(offset=%llu,length=%llu).", attachOffset, length);
+			} else {
+				ERR(@"sendFile error(%@,offset=%llu,length=%llu)", attach.path, attachOffset, length);
+			}
 		}
 		break;
 	case IPMSG_GETDIRFILES:	// ディレクトリ
@@ -2496,7 +3334,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			ERR(@"type is not directory(%@)", attach.path);
 			break;
 		}
-		if ([self sendDirectory:attach.path attrs:attrs to:sock useUTF8:useUTF8]) {
+		if ([self sendDirectory:attach.path manifest:attach.manifest attrs:attrs to:sock useUTF8:useUTF8 transfer:transfer] && [transfer sendTag:sock]) {
 			[self removeAttachmentUser:user
 							  packetNo:attachPacketNo
 								fileID:attachFileID];
@@ -2510,10 +3348,74 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		break;
 	}
 
+	// 帯域制御終了
+	[shaper endTransfer:transfer];
+}
+
+// ディレクトリ送信（作成済みの一覧があれば配下の属性取得を省く）
+- (BOOL)sendDirectory:(NSString*)path
+			 manifest:(AttachmentManifest*)manifest
+				attrs:(_FileAttrDic*)attrs
+				   to:(int)sock
+			  useUTF8:(BOOL)utf8
+			 transfer:(BandwidthTransfer*)transfer
+{
+	NSArray<ManifestEntry*>* entries = manifest.entries;
+	if (!entries) {
+		return [self sendDirectory:path attrs:attrs to:sock useUTF8:utf8 transfer:transfer];
+	}
+
+	DBG(@"start dir by manifest(%@,%lu entries)", path, entries.count);
+	for (ManifestEntry* entry in entries) {
+		@autoreleasepool {
+			// 属性は一覧作成時のもの（更新は変更通知で一覧ごと破棄される。通知前の更新は送信時のサイズ確認で検出）
+			_FileAttrDic* entryAttrs = entry.attrs;
+			switch (entry.type) {
+			case MANIFEST_ENTRY_FILE:
+				if (![self sendFileHeader:entry.path attrs:entryAttrs hidden:entry.hidden to:sock useUTF8:utf8 transfer:transfer]) {
+					ERR(@"header send error(%@)", entry.path);
+					return NO;
+				}
+				// ヘッダで通知したサイズと異なる場合は受信側と整合しないため中断する
+				if (![self sendFileData:entry.path size:[self fileSizeForAttrs:entryAttrs] to:sock transfer:transfer]) {
+					ERR(@"file send error(%@)", entry.path);
+					[manifest invalidate];
+					return NO;
+				}
+				// 暗号化転送時はファイル毎に認証タグを送る
+				if (![transfer sendTag:sock]) {
+					return NO;
+				}
+				break;
+			case MANIFEST_ENTRY_DIRECTORY:
+				if (![self sendFileHeader:entry.path attrs:entryAttrs hidden:entry.hidden to:sock useUTF8:utf8 transfer:transfer]) {
+					ERR(@"header send error(%@)", entry.path);
+					return NO;
+				}
+				break;
+			case MANIFEST_ENTRY_RET_PARENT:
+				{
+					const char* dat = "000B:.:0:3:";	// IPMSG_FILE_RETPARENT = 0x3
+					if (![transfer send:sock bytes:dat length:strlen(dat)]) {
+						ERR(@"to parent header send error(%s,%@)", dat, path);
+						return NO;
+					}
+				}
+				break;
+			}
+		}
+	}
+	DBG(@"complete dir by manifest(%@)", path);
+
+	return YES;
 }
 
-// ディレクトリ送信
-- (BOOL)sendDirectory:(NSString*)path attrs:(_FileAttrDic*)attrs to:(int)sock useUTF8:(BOOL)utf8
+// ディレクトリ送信（配下を走査しながら送信）
+- (BOOL)sendDirectory:(NSString*)path
+				attrs:(_FileAttrDic*)attrs
+				   to:(int)sock
+			  useUTF8:(BOOL)utf8
+			 transfer:(BandwidthTransfer*)transfer
 {
 	TRC(@"start dir(%@)", path);
 
@@ -2523,7 +3425,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 
 	// ヘッダ送信
-	if (![self sendFileHeader:path attrs:attrs to:sock useUTF8:utf8]) {
+	if (![self sendFileHeader:path attrs:attrs to:sock useUTF8:utf8 transfer:transfer]) {
 		ERR(@"header send error(%@)", path);
 		return NO;
 	}
@@ -2538,12 +3440,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		// 子ファイル
 		if ([type isEqualToString:NSFileTypeRegular]) {
 			// ヘッダ送信
-			if (![self sendFileHeader:child attrs:childAttrs to:sock useUTF8:utf8]) {
+			if (![self sendFileHeader:child attrs:childAttrs to:sock useUTF8:utf8 transfer:transfer]) {
 				ERR(@"header send error(%@)", child);
 				return NO;
 			}
-			// ファイルデータ送信
-			if (![self sendFileData:child to:sock]) {
+			// ファイルデータ送信（暗号化転送時はファイル毎に認証タグを送る）
+			if (![self sendFileData:child to:sock transfer:transfer] || ![transfer sendTag:sock]) {
 				ERR(@"file send error(%@)", child);
 				return NO;
 			}
@@ -2551,7 +3453,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		// 子ディレクトリ
 		else if ([type isEqualToString:NSFileTypeDirectory]) {
 			// ディレクトリ送信（再帰呼び出し）
-			if (![self sendDirectory:child attrs:childAttrs to:sock useUTF8:utf8]) {
+			if (![self sendDirectory:child attrs:childAttrs to:sock useUTF8:utf8 transfer:transfer]) {
 				ERR(@"subdir send error(%@)", child);
 				return NO;
 			}
@@ -2563,9 +3465,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 	}
 
-	// 親ディレクトリ復帰ヘッダ送信
+	// 親ディレクトリ復帰ヘッダ送信（ヘッダも暗号化対象のため転送経由）
 	const char* dat = "000B:.:0:3:";	// IPMSG_FILE_RETPARENT = 0x3
-	if (send(sock, dat, strlen(dat), 0) < 0) {
+	if (![transfer send:sock bytes:dat length:strlen(dat)]) {
 		ERR(@"to parent header send error(%s,%@)", dat, path);
 		return NO;
 	}
@@ -2576,17 +3478,31 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 }
 
 // ファイル階層ヘッダ送信処理
-- (BOOL)sendFileHeader:(NSString*)path attrs:(_FileAttrDic*)attrs to:(int)sock useUTF8:(BOOL)utf8
+- (BOOL)sendFileHeader:(NSString*)path
+				 attrs:(_FileAttrDic*)attrs
+					to:(int)sock
+			   useUTF8:(BOOL)utf8
+			  transfer:(BandwidthTransfer*)transfer
 {
 	if (!attrs) {
 		NSFileManager* fm = NSFileManager.defaultManager;
 		attrs = [fm attributesOfItemAtPath:path error:nil];
 	}
+	return [self sendFileHeader:path attrs:attrs hidden:[AttachmentManifest isHiddenPath:path] to:sock useUTF8:utf8 transfer:transfer];
+}
 
+// ファイル階層ヘッダ送信処理（属性取得済み）
+- (BOOL)sendFileHeader:(NSString*)path
+				 attrs:(_FileAttrDic*)attrs
+				hidden:(BOOL)hidden
+					to:(int)sock
+			   useUTF8:(BOOL)utf8
+			  transfer:(BandwidthTransfer*)transfer
+{
 	NSString*	nameOrg		= path.lastPathComponent.precomposedStringWithCanonicalMapping;
 	NSString*	fileName	= [nameOrg stringByReplacingOccurrencesOfString:@":" withString:@"::"];
 	size_t		fileSize	= [self fileSizeForAttrs:attrs];
-	unsigned	fileAttr	= [self makeFileAttributeForPath:path attrs:attrs];
+	unsigned	fileAttr	= [self makeFileAttributeForPath:path attrs:attrs hidden:hidden];
 	NSString*	extAttr		= [self makeFileExtendAttributeForAttrs:attrs];
 
 	// ヘッダ編集
@@ -2596,7 +3512,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	NSData*		dat	= [dh2 dataUsingUTF8:utf8 nullTerminate:NO];
 
 	// ファイルヘッダ送信
-	if (send(sock, dat.bytes, dat.length, 0) < 0) {
+	if (![transfer send:sock bytes:dat.bytes length:dat.length]) {
 		ERR(@"header send error(%@)", dh2);
 		return NO;
 	}
@@ -2605,15 +3521,31 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 }
 
 // ファイルデータ送信処理
-- (BOOL)sendFileData:(NSString*)path to:(int)sock
+- (BOOL)sendFileData:(NSString*)path to:(int)sock transfer:(BandwidthTransfer*)transfer
 {
+	// 共有マップ経由で送信（同一ファイルを同時にダウンロードする接続間でページを共用）
+	SendFileCache* cache = [SendFileCache acquireCacheForPath:path];
+	if (cache) {
+		BOOL ret = [cache sendTo:sock transfer:transfer];
+		[SendFileCache relinquishCache:cache];
+		return ret;
+	}
+
+	// マップできない場合は逐次読み込みで送信
 	// ファイルオープン
 	NSFileHandle* fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
 	if (!fileHandle) {
 		ERR(@"sendFileData:Open Error(%@)", path);
 		return NO;
 	}
+	BOOL ret = [self sendFileHandle:fileHandle path:path to:sock transfer:transfer];
+	[fileHandle closeFile];
+	return ret;
+}
 
+// ファイルデータ逐次読み込み送信処理（開いたファイルの現在位置から末尾まで。クローズは呼び出し側）
+- (BOOL)sendFileHandle:(NSFileHandle*)fileHandle path:(NSString*)path to:(int)sock transfer:(BandwidthTransfer*)transfer
+{
 	size_t totalSize = 0;
 	// 送信単位サイズ（将来ユーザ調整可能に？)
 	size_t size = 8192;
@@ -2624,7 +3556,6 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		NSData*	data = [fileHandle readDataOfLength:size];
 		if (!data) {
 			ERR(@"sendFileData:Read Error(data is nil,path=%@)", path);
-			[fileHandle closeFile];
 			return NO;
 		}
 		// 送信完了チェック
@@ -2633,9 +3564,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			break;
 		}
 		// データ送信
-		if (send(sock, data.bytes, data.length, 0) < 0) {
+		if (![transfer send:sock bytes:data.bytes length:data.length]) {
 			ERR(@"sendFileData:Send Error(path=%@)", path);
-			[fileHandle closeFile];
 			return NO;
 		}
 		totalSize += data.length;
@@ -2646,8 +3576,108 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 	}
 
+	return YES;
+}
+
+// ファイルデータ範囲送信処理
+- (BOOL)sendFileData:(NSString*)path offset:(UInt64)offset length:(UInt64)length to:(int)sock transfer:(BandwidthTransfer*)transfer
+{
+	if (length == 0) {
+		return YES;
+	}
+	SendFileCache* cache = [SendFileCache acquireCacheForPath:path];
+	if (cache) {
+		BOOL ret = NO;
+		if ((offset > cache.length) || (length > cache.length - offset)) {
+			ERR(@"sendFileData:range over(%@,%llu+%llu/%zu)", path, offset, length, cache.length);
+		} else {
+			ret = [cache sendFrom:(size_t)offset length:(size_t)length to:sock transfer:transfer];
+		}
+		[SendFileCache relinquishCache:cache];
+		return ret;
+	}
+
+	// マップできない場合は逐次読み込みで送信
+	NSFileHandle* fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
+	if (!fileHandle) {
+		ERR(@"sendFileData:Open Error(%@)", path);
+		return NO;
+	}
+	BOOL ret = YES;
+	@try {
+		[fileHandle seekToFileOffset:offset];
+		while (length > 0) {
+			NSData* data = [fileHandle readDataOfLength:(NSUInteger)MIN(length, 65536ULL)];
+			if (data.length == 0) {
+				ERR(@"sendFileData:file shrunk(%@,remain=%llu)", path, length);
+				ret = NO;
+				break;
+			}
+			if (![transfer send:sock bytes:data.bytes length:data.length]) {
+				ERR(@"sendFileData:Send Error(path=%@)", path);
+				ret = NO;
+				break;
+			}
+			length -= data.length;
+		}
+	}
+	@catch (NSException* exception) {
+		ERR(@"sendFileData:Read Error([%@],path=%@)", exception.name, path);
+		ret = NO;
+	}
 	[fileHandle closeFile];
+	return ret;
+}
 
+// ファイルデータ送信処理（サイズ確認付き。ヘッダ送信後に更新されたファイルは送らない）
+- (BOOL)sendFileData:(NSString*)path size:(size_t)size to:(int)sock transfer:(BandwidthTransfer*)transfer
+{
+	if (size == 0) {
+		// 空ファイル（共有マップは使えない。ヘッダ通りデータなし）
+		return YES;
+	}
+	SendFileCache* cache = [SendFileCache acquireCacheForPath:path];
+	if (!cache) {
+		// マップできない場合は開いたファイルのサイズを確認してそのまま逐次読み込みで送信
+		NSFileHandle* fileHandle = [NSFileHandle fileHandleForReadingAtPath:path];
+		if (!fileHandle) {
+			ERR(@"sendFileData:Open Error(%@)", path);
+			return NO;
+		}
+		struct stat st;
+		if ((fstat(fileHandle.fileDescriptor, &st) != 0) || ((UInt64)st.st_size != size)) {
+			ERR(@"sendFileData:size changed(%@,%zu->%lld)", path, size, (long long)st.st_size);
+			[fileHandle closeFile];
+			return NO;
+		}
+		BOOL ret = [self sendFileHandle:fileHandle path:path to:sock transfer:transfer];
+		[fileHandle closeFile];
+		return ret;
+	}
+	BOOL ret = NO;
+	if (cache.length != size) {
+		ERR(@"sendFileData:size changed(%@,%zu->%zu)", path, size, cache.length);
+	} else {
+		ret = [cache sendTo:sock transfer:transfer];
+	}
+	[SendFileCache relinquishCache:cache];
+	return ret;
+}
+
+// メモリ上データ送信
+- (BOOL)sendMemoryData:(NSData*)data offset:(size_t)offset to:(int)sock transfer:(BandwidthTransfer*)transfer
+{
+	const char*	bytes	= data.bytes;
+	size_t		length	= data.length;
+	if (offset > length) {
+		ERR(@"sendMemoryData:offset invalid(%zu/%zu)", offset, length);
+		return NO;
+	}
+	if (![transfer send:sock bytes:&bytes[offset] length:length - offset]) {
+		ERR(@"sendMemoryData:Send Error(%zu/%zu)", offset, length);
+		return NO;
+	}
+	TRC(@"SendDataComplete(size=%zu)", length);
 	return YES;
 }
 
@@ -2664,6 +3694,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 
 // ファイル属性編集
 - (UInt32)makeFileAttributeForPath:(NSString*)path attrs:(_FileAttrDic*)attrs
+{
+	return [self makeFileAttributeForPath:path attrs:attrs hidden:[AttachmentManifest isHiddenPath:path]];
+}
+
+// ファイル属性編集（非表示判定済み）
+- (UInt32)makeFileAttributeForPath:(NSString*)path attrs:(_FileAttrDic*)attrs hidden:(BOOL)hidden
 {
 	UInt32 fileAttr = 0;
 
@@ -2689,13 +3725,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	}
 
 	// 非表示ファイル
-	id value;
-	NSURL* fileURL = [NSURL fileURLWithPath:path];
-	if ([fileURL getResourceValue:&value forKey:NSURLIsHiddenKey error:nil]) {
-		if ([value boolValue]) {
-			// 非表示ファイル
-			fileAttr |= IPMSG_FILE_HIDDENOPT;
-		}
+	if (hidden) {
+		fileAttr |= IPMSG_FILE_HIDDENOPT;
 	}
 
 	return fileAttr;
@@ -2758,8 +3789,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		[dl autorelease];
 		
 		DownloaderResult	result	= DL_SUCCESS;
+		CFAbsoluteTime		startAt	= CFAbsoluteTimeGetCurrent();
 
 		DBG(@"start download thread.");
+		MetricsGaugeAdd(METRICS_DOWNLOADS, 1);
 
 		// ステータス管理開始
 		dl.totalCount		= dl.attachments.count;
@@ -2769,7 +3802,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		dl.totalSize		= 0;
 		dl.downloadedSize	= 0;
 		for (RecvAttachment* attach in dl.attachments) {
-			dl.totalSize += attach.size;
+			// フォルダは配下の合計が通知されていれば最初から含める
+			dl.totalSize += attach.size + attach.contentSize;
 		}
 		[dl.delegate downloadWillStart];
 		// 添付毎ダウンロードループ
@@ -2783,6 +3817,21 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 
 			[dl.delegate downloadIndexOfTargetChanged];
 
+			// 大きなファイルは範囲に分けて複数接続で受信（相手が範囲指定取得に対応している場合）
+			if ((attach.type == ATTACH_TYPE_REGULAR_FILE) && [attach isKindOfClass:RecvFile.class] &&
+				dl.fromUser.supportsRangeRequest && (attach.size >= _STRIPE_THRESHOLD) &&
+				(Config.sharedConfig.downloadStreams > 1)) {
+				result = [self download:dl stripedFile:(RecvFile*)attach];
+				if (result != DL_SUCCESS) {
+					ERR(@"download striped file error.(%@)", attach.name);
+					continue;
+				}
+				((RecvFile*)attach).downloaded = YES;
+				dl.downloadedFiles++;
+				[dl.delegate downloadNumberOfFileChanged];
+				continue;
+			}
+
 			// ソケット準備
 			if (dl.tcpSocket != -1) {
 				close(dl.tcpSocket);
@@ -2823,19 +3872,25 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			if (dl.fromUser.supportsUTF8) {
 				command |= IPMSG_UTF8OPT;
 			}
-			NSString* str = [NSString stringWithFormat:@"%d:%ld:%@:%@:%d:%lx:%lx:%x:",
-															IPMSG_VERSION,
-															MessageCenter.nextPacketNo,
-															self.selfLogOnName,
-															AppControlGetHostName(),
-															command,
-															dl.packetNo,
-															attach.fileID,
-															0U];
-			NSData* data = [str dataUsingUTF8:NO nullTerminate:YES];
+			// 転送暗号鍵を受け取っていれば暗号化転送を要求（初期カウンタは接続毎に作る）
+			NSData* streamIV = nil;
+			dl.cipher = nil;
+			if (attach.streamKey && dl.fromUser.supportsEncryptedStream) {
+				streamIV	= [CryptoManager.sharedManager randomData:CRYPTO_STREAM_IV_SIZE];
+				dl.cipher	= [CryptoStream streamWithKey:attach.streamKey iv:streamIV];
+				if (dl.cipher) {
+					command |= IPMSG_ENCSTREAMOPT;
+				}
+			}
+			NSData* data = [self attachRequestWithCommand:command
+												 packetNo:dl.packetNo
+												   fileID:attach.fileID
+												   offset:0
+												   length:0
+													   iv:(dl.cipher ? streamIV : nil)];
 			// リクエスト送信
 			if (send(dl.tcpSocket, data.bytes, data.length, 0) < 0) {
-				ERR(@"file:attach request send error.(%@)", str);
+				ERR(@"file:attach request send error.(%s)", (const char*)data.bytes);
 				close(dl.tcpSocket);
 				dl.tcpSocket = -1;
 				result = DL_COMMUNICATION_ERROR;
@@ -2879,6 +3934,15 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 				dl.downloadedFiles++;
 				[dl.delegate downloadNumberOfFileChanged];
 				break;
+			case ATTACH_TYPE_MESSAGE_BODY:
+				result = [self download:dl file:attach];
+				if (result != DL_SUCCESS) {
+					ERR(@"download message body error.(%@)", attach.name);
+					close(dl.tcpSocket);
+					dl.tcpSocket = -1;
+					break;
+				}
+				break;
 			default:
 				ERR(@"unsupported file type(%ld,%@)", attach.type, attach.name);
 				break;
@@ -2891,6 +3955,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		if (dl.stop) {
 			result = DL_STOP;
 		}
+		MetricsGaugeAdd(METRICS_DOWNLOADS, -1);
+		if (result == DL_SUCCESS) {
+			MetricsObserve(METRICS_DOWNLOAD_DURATION, CFAbsoluteTimeGetCurrent() - startAt);
+		}
 		[dl.delegate downloadDidFinished:result];
 		DBG(@"stop download thread.");
 	}
@@ -2902,7 +3970,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
  *----------------------------------------------------------------------------*/
 - (DownloaderResult)download:(AttachDLContextImpl*)dl file:(RecvAttachment*)attach
 {
-	char				buf[8192];	// バッファサイズを変更可能に？
+	char				buf[_DOWNLOAD_BUF_SIZE];
 	unsigned long long	remain;
 	size_t				size;
 	DownloaderResult	ret;
@@ -2953,9 +4021,223 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	// ファイルクローズ
 	[attach closeHandle];
 
+	// 認証タグ照合（暗号化転送時。改竄されていれば受信したファイルを残さない）
+	ret = [self download:dl socket:dl.tcpSocket verifyTag:dl.cipher];
+	if (ret != DL_SUCCESS) {
+		if (file) {
+			[[NSFileManager defaultManager] removeItemAtPath:file.path error:NULL];
+		}
+		return ret;
+	}
+
 	return DL_SUCCESS;
 }
 
+/*----------------------------------------------------------------------------*
+ * ファイル分割ダウンロード処理
+ *----------------------------------------------------------------------------*/
+- (DownloaderResult)download:(AttachDLContextImpl*)dl stripedFile:(RecvFile*)file
+{
+	dl.currentFileName = file.name;
+	[dl.delegate downloadFileChanged];
+	file.path = [dl.savePath stringByAppendingPathComponent:file.name];
+
+	// ファイルオープン／領域確保（各範囲は位置指定で書き込む）
+	if (![file openHandle]) {
+		ERR(@"file:open/create file error(%@)", file.name);
+		return DL_FILE_OPEN_ERROR;
+	}
+	if (![file preallocate]) {
+		[file closeHandle];
+		[NSFileManager.defaultManager removeItemAtPath:file.path error:NULL];
+		return DL_FILE_OPEN_ERROR;
+	}
+
+	StripePlanner*		planner		= [[[StripePlanner alloc] initWithLength:file.size
+															   maxStreams:Config.sharedConfig.downloadStreams] autorelease];
+	dispatch_group_t	group		= dispatch_group_create();
+	dispatch_queue_t	queue		= dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	CFAbsoluteTime		startAt		= CFAbsoluteTimeGetCurrent();
+	__block	DownloaderResult	lastError	= DL_SUCCESS;
+	DBG(@"file:start striped download(%@,%zu bytes,chunk=%llu,max=%lu streams)",
+		file.name, file.size, planner.chunkSize, planner.maxStreams);
+
+	// 目標並列数まで接続を増やしながら全範囲の完了を待つ
+	while (!planner.finished && !planner.failed) {
+		if (dl.stop) {
+			[planner cancel];
+			break;
+		}
+		while ([planner acquireStream]) {
+			dispatch_group_async(group, queue, ^{
+				@autoreleasepool {
+					UInt64 offset;
+					UInt64 length;
+					while ([planner nextRange:&offset length:&length]) {
+						DownloaderResult ret = [self download:dl stripe:file offset:offset length:length planner:planner];
+						if (ret != DL_SUCCESS) {
+							@synchronized (planner) {
+								lastError = ret;
+							}
+						}
+					}
+				}
+			});
+		}
+		dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 200 * NSEC_PER_MSEC));
+	}
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+
+	// ファイルクローズ
+	[file closeHandle];
+
+	if (!planner.finished) {
+		DownloaderResult result = dl.stop ? DL_STOP : ((lastError != DL_SUCCESS) ? lastError : DL_INTERNAL_ERROR);
+		WRN(@"file:striped download error(%ld,%@)", (long)result, file.name);
+		// 書きかけのファイルを削除
+		[NSFileManager.defaultManager removeItemAtPath:file.path error:NULL];
+		return result;
+	}
+
+	CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - startAt;
+	DBG(@"file:striped download complete(%@,%.1fMB/s,streams=%lu[peak %lu])",
+		file.name, (elapsed > 0) ? (file.size / elapsed / (1024.0 * 1024.0)) : 0.0,
+		planner.targetStreams, planner.peakStreams);
+	return DL_SUCCESS;
+}
+
+// 範囲ダウンロード（1範囲を1接続で取得する）
+- (DownloaderResult)download:(AttachDLContextImpl*)dl
+					  stripe:(RecvFile*)file
+					  offset:(UInt64)offset
+					  length:(UInt64)length
+					 planner:(StripePlanner*)planner
+{
+	char				buf[_DOWNLOAD_BUF_SIZE];
+	UInt64				received	= 0;
+	DownloaderResult	ret			= DL_SUCCESS;
+
+	// 接続
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock == -1) {
+		ERR(@"stripe:socket open error");
+		[planner failRange:offset length:length received:0];
+		return DL_SOCKET_ERROR;
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family			= AF_INET;
+	addr.sin_port			= htons(self.portNo);
+	addr.sin_addr.s_addr	= dl.fromUser.address.sin_addr.s_addr;
+	if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		ERR(@"stripe:connect error");
+		close(sock);
+		[planner failRange:offset length:length received:0];
+		return DL_CONNECT_ERROR;
+	}
+
+	// リクエスト送信（暗号化転送時は接続毎に初期カウンタを作る）
+	UInt32			command	= IPMSG_GETFILEDATA | IPMSG_RANGEOPT;
+	CryptoStream*	cipher	= nil;
+	NSData*			iv		= nil;
+	if (dl.fromUser.supportsUTF8) {
+		command |= IPMSG_UTF8OPT;
+	}
+	if (file.streamKey && dl.fromUser.supportsEncryptedStream) {
+		iv		= [CryptoManager.sharedManager randomData:CRYPTO_STREAM_IV_SIZE];
+		cipher	= [CryptoStream streamWithKey:file.streamKey iv:iv];
+		if (cipher) {
+			command |= IPMSG_ENCSTREAMOPT;
+		}
+	}
+	NSData* data = [self attachRequestWithCommand:command
+										 packetNo:dl.packetNo
+										   fileID:file.fileID
+										   offset:offset
+										   length:length
+											   iv:(cipher ? iv : nil)];
+	if (send(sock, data.bytes, data.length, 0) < 0) {
+		ERR(@"stripe:request send error(offset=%llu,length=%llu)", offset, length);
+		close(sock);
+		[planner failRange:offset length:length received:0];
+		return DL_COMMUNICATION_ERROR;
+	}
+
+	// 受信・位置指定書き込み
+	while ((received < length) && !planner.failed) {
+		size_t size = (size_t)MIN((UInt64)sizeof(buf), length - received);
+		ret = [self download:dl socket:sock cipher:cipher toBuffer:buf maxLength:size];
+		if (ret != DL_SUCCESS) {
+			WRN(@"stripe:receive error(%ld,offset=%llu,received=%llu)", (long)ret, offset, received);
+			break;
+		}
+		if (![file writeData:buf length:size atOffset:offset + received]) {
+			ret = DL_FILE_OPEN_ERROR;
+			break;
+		}
+		received += size;
+		[planner addReceivedBytes:size];
+		@synchronized (dl) {
+			dl.downloadedSize += size;
+		}
+		[dl.delegate downloadDownloadedSizeChanged];
+	}
+	if ((ret == DL_SUCCESS) && (received == length)) {
+		// 認証タグ照合（不一致は範囲全体を取り直す）
+		ret = [self download:dl socket:sock verifyTag:cipher];
+		if (ret != DL_SUCCESS) {
+			WRN(@"stripe:tag error(%ld,offset=%llu,length=%llu)", (long)ret, offset, length);
+			received = 0;
+			@synchronized (dl) {
+				dl.downloadedSize -= (size_t)length;
+			}
+		}
+	}
+	close(sock);
+
+	if ((ret == DL_SUCCESS) && (received == length)) {
+		[planner completeRange:offset length:length];
+		return DL_SUCCESS;
+	}
+	if (ret == DL_SUCCESS) {
+		// 中止された
+		ret = DL_STOP;
+	}
+	@synchronized (dl) {
+		dl.downloadedSize -= (size_t)received;
+	}
+	[dl.delegate downloadDownloadedSizeChanged];
+	[planner failRange:offset length:length received:received];
+	return ret;
+}
+
+// 添付要求編集（範囲指定取得時は取得長、暗号化転送時は初期カウンタを付加）
+- (NSData*)attachRequestWithCommand:(UInt32)command
+						   packetNo:(NSInteger)packetNo
+							 fileID:(NSInteger)fileID
+							 offset:(UInt64)offset
+							 length:(UInt64)length
+								 iv:(NSData*)iv
+{
+	NSMutableString* str = [NSMutableString stringWithFormat:@"%d:%ld:%@:%@:%u:%lx:%lx:%llx:",
+															IPMSG_VERSION,
+															MessageCenter.nextPacketNo,
+															self.selfLogOnName,
+															AppControlGetHostName(),
+															command,
+															packetNo,
+															fileID,
+															offset];
+	if (command & IPMSG_RANGEOPT) {
+		[str appendFormat:@"%llx:", length];
+	}
+	if (iv) {
+		[str appendFormat:@"%@:", iv.hexEncodedString];
+	}
+	return [str dataUsingUTF8:NO nullTerminate:YES];
+}
+
 /*----------------------------------------------------------------------------*
  * ディレクトリダウンロード処理
  *----------------------------------------------------------------------------*/
@@ -2968,7 +4250,8 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	RecvAttachment*		attach;
 	RecvFile*			file;
 	size_t				remain;
-	DBG(@"dir:start download directory(%@)", [dir name]);
+	UInt64				received	= 0;	// 配下ファイルの受信予定サイズ累計
+	DBG(@"dir:start download directory(%@,files=%lu,size=%llu)", [dir name], dir.contentFiles, dir.contentSize);
 
 	/*------------------------------------------------------------------------*
 	 * 各ファイル受信ループ
@@ -3061,8 +4344,12 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		// ファイル受信
 		remain = file.size;
 		if (remain > 0) {
-			dl.totalSize += remain;
-			[dl.delegate downloadTotalSizeChanged];
+			// 事前に通知された合計を超えた分のみ加算（通知がなければ全量）
+			received += remain;
+			if (received > dir.contentSize) {
+				dl.totalSize += (size_t)MIN((UInt64)remain, received - dir.contentSize);
+				[dl.delegate downloadTotalSizeChanged];
+			}
 			while (remain > 0) {
 				size_t size = MIN(sizeof(buf), remain);
 				result = [self download:dl toBuffer:buf maxLength:size];
@@ -3089,6 +4376,14 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 			result = DL_SIZE_NOT_ENOUGH;
 			break;
 		}
+		if (file.type == ATTACH_TYPE_REGULAR_FILE) {
+			// 認証タグ照合（暗号化転送時。改竄されたファイルは残さない）
+			result = [self download:dl socket:dl.tcpSocket verifyTag:dl.cipher];
+			if (result != DL_SUCCESS) {
+				[[NSFileManager defaultManager] removeItemAtPath:file.path error:NULL];
+				break;
+			}
+		}
 
 		switch (file.type) {
 		case ATTACH_TYPE_REGULAR_FILE:
@@ -3111,6 +4406,11 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 	}
 
+	// 末尾の認証タグ照合（最後のファイル以降のヘッダが対象）
+	if ((result == DL_SUCCESS) && !dl.stop) {
+		result = [self download:dl socket:dl.tcpSocket verifyTag:dl.cipher];
+	}
+
 	// エラー判定
 	if (dl.stop) {
 		// 停止された場合
@@ -3130,6 +4430,16 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 
 // ソケット受信
 - (DownloaderResult)download:(AttachDLContextImpl*)dl toBuffer:(void*)ptr maxLength:(size_t)len
+{
+	return [self download:dl socket:dl.tcpSocket cipher:dl.cipher toBuffer:ptr maxLength:len];
+}
+
+// ソケット受信（接続指定。分割受信時は接続毎に並行して呼ばれる）
+- (DownloaderResult)download:(AttachDLContextImpl*)dl
+					  socket:(int)sock
+					  cipher:(CryptoStream*)cipher
+					toBuffer:(void*)ptr
+				   maxLength:(size_t)len
 {
 	int		timeout		= 0;
 	size_t	recvSize	= 0;
@@ -3140,15 +4450,15 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 		fd_set fdSet;
 		FD_ZERO(&fdSet);
-		FD_SET(dl.tcpSocket, &fdSet);
+		FD_SET(sock, &fdSet);
 		struct timeval	tv;
 		tv.tv_sec	= 0;
 		tv.tv_usec	= 500000;
 		// ソケット監視
-		int ret = select(dl.tcpSocket + 1, &fdSet, NULL, NULL, &tv);
+		int ret = select(sock + 1, &fdSet, NULL, NULL, &tv);
 		if (ret == 0) {
 			// 受信なし
-			DBG(@"timeout(sock=%d,count=%d)", dl.tcpSocket, timeout);
+			DBG(@"timeout(sock=%d,count=%d)", sock, timeout);
 			continue;
 		}
 		if (ret < 0) {
@@ -3158,23 +4468,48 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		}
 		// 正常受信
 		timeout = -1;
-		ssize_t size = recv(dl.tcpSocket, &(((char*)ptr)[recvSize]), len - recvSize, 0);
+		ssize_t size = recv(sock, &(((char*)ptr)[recvSize]), len - recvSize, 0);
 		if (size < 0) {
 			ERR(@"socket error(recv=%ld,maybe disconnected.)", size);
 			return DL_DISCONNECTED;
 		}
+		if (cipher && (size > 0)) {
+			// 暗号化転送は受信順にその場で復号
+			if (![cipher decrypt:&(((char*)ptr)[recvSize]) to:&(((char*)ptr)[recvSize]) length:(size_t)size]) {
+				return DL_INVALID_DATA;
+			}
+		}
 		recvSize += size;
+		MetricsIncrement(METRICS_ATTACH_BYTES_RECEIVED, (UInt64)size);
 		if (recvSize < len) {
 			continue;
 		}
 		return DL_SUCCESS;
 	}
 
-	WRN(@"receive timeout(%dsec,sock=%d)", timeout/2, dl.tcpSocket);
+	WRN(@"receive timeout(%dsec,sock=%d)", timeout/2, sock);
 
 	return DL_TIMEOUT;
 }
 
+// 認証タグ受信・照合（暗号化転送でなければ何もしない）
+- (DownloaderResult)download:(AttachDLContextImpl*)dl socket:(int)sock verifyTag:(CryptoStream*)cipher
+{
+	if (!cipher) {
+		return DL_SUCCESS;
+	}
+	char				tag[CRYPTO_STREAM_TAG_SIZE];
+	DownloaderResult	ret = [self download:dl socket:sock cipher:nil toBuffer:tag maxLength:sizeof(tag)];
+	if (ret != DL_SUCCESS) {
+		ERR(@"stream tag receive error(%ld)", (long)ret);
+		return ret;
+	}
+	if (![cipher verifyTag:[NSData dataWithBytes:tag length:sizeof(tag)]]) {
+		return DL_INVALID_DATA;
+	}
+	return DL_SUCCESS;
+}
+
 // 受信バッファ解析初期化共通処理
 - (RecvAttachment*)parseAttachmentBuffer:(NSString*)buf needReadModTime:(BOOL)flag
 {
@@ -3264,6 +4599,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		attach = [[[RecvClipboard alloc] init] autorelease];
 		attach.type = ATTACH_TYPE_CLIPBOARD;
 		break;
+	case IPMSG_FILE_MSGBODY:
+		attach = [[[RecvMessageBody alloc] init] autorelease];
+		attach.type = ATTACH_TYPE_MESSAGE_BODY;
+		break;
 	default:
 		ERR(@"unknown attachment type(%ld,%@)", GET_MODE(attribute), fileName);
 		return nil;
@@ -3308,6 +4647,29 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 		ERR(@"extend attribute invalid(%@)", str);
 		return;
 	}
+	if (key == IPMSG_FILE_STREAMKEY) {
+		// 転送暗号鍵（値は数値ではなく16進文字列）
+		NSData* streamKey = [NSData dataWithHexEncodedString:kv[1]];
+		if (streamKey.length != CRYPTO_STREAM_KEY_SIZE) {
+			ERR(@"extAttr:STREAMKEY invalid length(%ld)", streamKey.length);
+			return;
+		}
+		attach.streamKey = streamKey;
+		TRC(@"extAttr:STREAMKEY    = (%ldbytes)", streamKey.length);
+		return;
+	}
+	if (key == IPMSG_FILE_DIRSIZE) {
+		// フォルダ配下のファイルサイズ合計（64bit値）
+		unsigned long long size;
+		scanner = [NSScanner scannerWithString:kv[1]];
+		if (![scanner scanHexLongLong:&size]) {
+			ERR(@"extend attribute invalid(%@)", str);
+			return;
+		}
+		attach.contentSize = size;
+		TRC(@"extAttr:DIRSIZE      = %llu", attach.contentSize);
+		return;
+	}
 	scanner	= [NSScanner scannerWithString:kv[1]];
 	if (![scanner scanHexInt:&val]) {
 		ERR(@"extend attribute invalid(%@)", str);
@@ -3382,6 +4744,10 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	case IPMSG_FILE_ALIASFNAME:
 		WRN(@"extAttr:ALIASFNAME   unsupported(%d[0x%X])", val, val);
 		break;
+	case IPMSG_FILE_DIRFILES:
+		attach.contentFiles = val;
+		TRC(@"extAttr:DIRFILES     = %d", val);
+		break;
 	default:
 		WRN(@"extAttr:unknownType(key=0x%08X,val=%d[0x%X])", key, val, val);
 		break;
@@ -3403,6 +4769,9 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	if (cap.supportAES256) {
 		cmd |= IPMSG_AES_256;
 	}
+	if (cap.supportAES256GCM) {
+		cmd |= IPMSG_AES_256_GCM;
+	}
 	if (cap.supportRSA1024) {
 		cmd |= IPMSG_RSA_1024;
 	}
@@ -3444,6 +4813,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	CryptoCapability* cap = [[[CryptoCapability alloc] init] autorelease];
 	cap.supportBlowfish128	= ((val & IPMSG_BLOWFISH_128) != 0);
 	cap.supportAES256		= ((val & IPMSG_AES_256) != 0);
+	cap.supportAES256GCM	= ((val & IPMSG_AES_256_GCM) != 0);
 	cap.supportRSA1024		= ((val & IPMSG_RSA_1024) != 0);
 	cap.supportRSA2048		= ((val & IPMSG_RSA_2048) != 0);
 	cap.supportPacketNoIV	= ((val & IPMSG_PACKETNO_IV) != 0);
@@ -3454,6 +4824,7 @@ typedef NSMutableArray<SendAttachment*>				_AttachList;
 	_MSG_DBG(@" FingerPrint=%s", BOOLSTR(cap.supportFingerPrint));
 	_MSG_DBG(@" Blowfish128=%s", BOOLSTR(cap.supportBlowfish128));
 	_MSG_DBG(@" AES256     =%s", BOOLSTR(cap.supportAES256));
+	_MSG_DBG(@" AES256GCM  =%s", BOOLSTR(cap.supportAES256GCM));
 	_MSG_DBG(@" RSA1024    =%s", BOOLSTR(cap.supportRSA1024));
 	_MSG_DBG(@" RSA2048    =%s", BOOLSTR(cap.supportRSA2048));
 	_MSG_DBG(@" PacketNoIV =%s", BOOLSTR(cap.supportPacketNoIV));
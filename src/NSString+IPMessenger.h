@@ -13,9 +13,22 @@
 // 送受信文字列変換（C文字列→NSString)
 + (instancetype)stringWithCString:(const char*)nullTerminatedCString utf8Encoded:(BOOL)utf8;
 + (instancetype)stringWithData:(NSData *)data utf8Encoded:(BOOL)utf8;
++ (instancetype)stringWithBytes:(const void*)bytes length:(NSUInteger)len utf8Encoded:(BOOL)utf8;
 
 // 送受信データ変換（NSString→NSData)
 - (NSData*)dataUsingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull;
 - (NSData*)dataUsingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull maxLength:(NSUInteger)maxLength;
 
+// 送受信データ変換（呼び出し元バッファへ直接変換。戻り値は書き込みバイト数（NULL終端含む））
+- (NSUInteger)getBytes:(void*)buffer maxLength:(NSUInteger)maxLength usingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull;
+- (NSUInteger)appendToData:(NSMutableData*)data usingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull;
+
+// 検索用正規化（大文字小文字・全角半角・ひらがなカタカナを同一視した文字列）
+- (NSString*)searchKeyString;
+
+#if defined(IPMSG_DEBUG)
+// 変換性能測定（従来実装との比較結果はデバッグログに出力。PeerSimulatorのrunBenchmarksから実行）
++ (void)benchmarkTranscoding;
+#endif
+
 @end
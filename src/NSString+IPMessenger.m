@@ -13,6 +13,9 @@
  * 定数定義
  *============================================================================*/
 
+#define _CHUNK_CHARS	(256)		// 1回の変換単位（UTF-16文字数）
+
+#if defined(IPMSG_DEBUG)
 // SJISリードバイト判定テーブル（2byte文字上位バイトは 0x81〜0x9F,0xE0〜0xFC）
 static const BOOL _SjisLead[] = {
 	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,	NO,		// 0x0x
@@ -32,6 +35,27 @@ static const BOOL _SjisLead[] = {
 	YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,	// 0xEx
 	YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,YES,NO,	NO,	NO,		// 0xFx
 };
+#endif
+
+/*============================================================================*
+ * 内部関数
+ *============================================================================*/
+
+// ASCII文字のみか判定（64bit単位で4文字ずつまとめて判定）
+static inline BOOL _IsASCII(const unichar* chars, NSUInteger len)
+{
+	uint64_t	bits	= 0;
+	NSUInteger	i		= 0;
+	for (; i + 4 <= len; i += 4) {
+		uint64_t word;
+		memcpy(&word, &chars[i], sizeof(word));
+		bits |= word;
+	}
+	for (; i < len; i++) {
+		bits |= chars[i];
+	}
+	return ((bits & 0xFF80FF80FF80FF80ULL) == 0);
+}
 
 /*============================================================================*
  * クラス実装
@@ -56,6 +80,12 @@ static const BOOL _SjisLead[] = {
 	return [[[NSString alloc] initWithData:data encoding:enc] autorelease];
 }
 
++ (instancetype)stringWithBytes:(const void*)bytes length:(NSUInteger)len utf8Encoded:(BOOL)utf8
+{
+	NSStringEncoding enc = utf8 ? NSUTF8StringEncoding : [NSString localeDependStringEncoding];
+	return [[[NSString alloc] initWithBytes:bytes length:len encoding:enc] autorelease];
+}
+
 + (NSStringEncoding)localeDependStringEncoding
 {
 	static NSStringEncoding enc = NSUIntegerMax;
@@ -99,57 +129,200 @@ static const BOOL _SjisLead[] = {
 		ERR(@"illlegal Parameter(containNull although maxLength is 0");
 		return nil;
 	}
+	NSStringEncoding	enc		= useUTF8 ? NSUTF8StringEncoding : [NSString localeDependStringEncoding];
+	NSUInteger			bound	= [self maximumLengthOfBytesUsingEncoding:enc] + (containNull ? 1 : 0);
+	NSUInteger			bufLen	= MIN(bound, maxLength);
+	NSMutableData*		data	= [NSMutableData dataWithLength:bufLen];
+	data.length = [self getBytes:data.mutableBytes
+					   maxLength:bufLen
+					   usingUTF8:useUTF8
+				   nullTerminate:containNull];
+	return data;
+}
+
+// 呼び出し元バッファへ直接変換する（文字境界で切り詰め）
+- (NSUInteger)getBytes:(void*)buffer maxLength:(NSUInteger)maxLength usingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull
+{
+	if (containNull && (maxLength == 0)) {
+		ERR(@"illlegal Parameter(containNull although maxLength is 0");
+		return 0;
+	}
+	NSStringEncoding	nsEnc	= useUTF8 ? NSUTF8StringEncoding : [NSString localeDependStringEncoding];
+	CFStringEncoding	enc		= CFStringConvertNSStringEncodingToEncoding(nsEnc);
+	UInt8*				bytes	= buffer;
+	NSUInteger			cap		= MIN(maxLength - (containNull ? 1 : 0), (NSUInteger)LONG_MAX);
+	NSUInteger			len		= self.length;
+	NSUInteger			idx		= 0;
+	NSUInteger			out		= 0;
+	uint64_t			work[_CHUNK_CHARS / 4];
+	unichar*			chars	= (unichar*)work;
+	while ((idx < len) && (out < cap)) {
+		NSUInteger n = MIN(_CHUNK_CHARS, len - idx);
+		[self getCharacters:chars range:NSMakeRange(idx, n)];
+		if ((idx + n < len) && CFStringIsSurrogateHighCharacter(chars[n - 1])) {
+			// サロゲートペアは分断しない
+			n--;
+		}
+		if (_IsASCII(chars, n)) {
+			// ASCIIのみの区間はどの符号化でも1文字1バイト
+			NSUInteger copy = MIN(n, cap - out);
+			for (NSUInteger i = 0; i < copy; i++) {
+				bytes[out + i] = (UInt8)chars[i];
+			}
+			out	+= copy;
+			idx	+= copy;
+			continue;
+		}
+		if (!useUTF8) {
+			// SJISの場合、'¥'は'\'に変換しておかないと文字化けする
+			for (NSUInteger i = 0; i < n; i++) {
+				if (chars[i] == 0x00A5) {
+					chars[i] = '\\';
+				}
+			}
+		}
+		// 変換器は文字単位で出力するため、バッファに入りきらない文字（2byte文字の後半等）は書き込まれない
+		CFStringRef str = CFStringCreateWithCharactersNoCopy(kCFAllocatorDefault, chars, n, kCFAllocatorNull);
+		if (!str) {
+			ERR(@"CFString create error(%lu)", n);
+			break;
+		}
+		CFIndex used = 0;
+		CFIndex conv = CFStringGetBytes(str, CFRangeMake(0, n), enc, '?', false, &bytes[out], cap - out, &used);
+		CFRelease(str);
+		out	+= used;
+		idx	+= conv;
+		if ((NSUInteger)conv < n) {
+			// バッファ満杯
+			break;
+		}
+	}
+	if (containNull) {
+		bytes[out++] = '\0';
+	}
+	return out;
+}
+
+// データ末尾に変換結果を追加する
+- (NSUInteger)appendToData:(NSMutableData*)data usingUTF8:(BOOL)useUTF8 nullTerminate:(BOOL)containNull
+{
+	NSStringEncoding	enc		= useUTF8 ? NSUTF8StringEncoding : [NSString localeDependStringEncoding];
+	NSUInteger			base	= data.length;
+	NSUInteger			bound	= [self maximumLengthOfBytesUsingEncoding:enc] + (containNull ? 1 : 0);
+	data.length = base + bound;
+	NSUInteger used = [self getBytes:(UInt8*)data.mutableBytes + base
+						   maxLength:bound
+						   usingUTF8:useUTF8
+					   nullTerminate:containNull];
+	data.length = base + used;
+	return used;
+}
+
+/*----------------------------------------------------------------------------*/
+#pragma mark - 検索
+/*----------------------------------------------------------------------------*/
+
+// 検索用正規化（比較は正規化済み文字列同士を単純比較で行う）
+- (NSString*)searchKeyString
+{
+	// 互換分解・合成で半角カナ（濁点分離含む）や全角英数を統一
+	NSString* str = self.precomposedStringWithCompatibilityMapping;
+	str = [str stringByFoldingWithOptions:(NSCaseInsensitiveSearch | NSWidthInsensitiveSearch) locale:nil];
+	// ひらがなはカタカナに寄せる
+	NSString* kana = [str stringByApplyingTransform:NSStringTransformHiraganaToKatakana reverse:NO];
+	return kana ? kana : str;
+}
+
+#if defined(IPMSG_DEBUG)
+/*----------------------------------------------------------------------------*/
+#pragma mark - 性能測定
+/*----------------------------------------------------------------------------*/
 
+// 従来実装（比較用）
+static NSData* _LegacyData(NSString* src, BOOL useUTF8, BOOL containNull, NSUInteger maxLength)
+{
 	NSData* data = nil;
 	if (useUTF8) {
-		data = [self dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+		data = [src dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
 	} else {
-		// SJISの場合、'¥'は'\'に変換しておかないと文字化けする
-		NSString* str = [self stringByReplacingOccurrencesOfString:@"¥" withString:@"\\"];
+		NSString* str = [src stringByReplacingOccurrencesOfString:@"¥" withString:@"\\"];
 		data = [str dataUsingEncoding:[NSString localeDependStringEncoding] allowLossyConversion:YES];
 	}
 	if (data.length > maxLength - (containNull ? 1 : 0)) {
-		// 切り詰め
-		NSMutableData*	work	= [data mutableCopy];
+		NSMutableData*	work	= [[data mutableCopy] autorelease];
 		UInt8* 			bytes	= (UInt8*)work.mutableBytes;
 		NSUInteger		pos		= maxLength - 1;
-		// 最後の文字境界を探す
 		if (useUTF8) {
-			// UTF8のの文字境界は、上位1ビットが0(ASCII)か、上位2ビットが1（リードバイト）
-			//	→ 上位2bitが10bのものはトレイルバイト
 			while (((bytes[pos] & 0xC0) == 0x80) && (pos > 0)) {
 				pos--;
 			}
 		} else {
-			// SJISの文字境界は仕組み上前からなめる以外に判定できない
 			UInt8*	ptr		= bytes;
 			UInt8*	tail	= &bytes[pos];
 			BOOL	isLead	= NO;
 			for (; ptr < tail; ptr++) {
-				if (isLead) {
-					isLead = NO;
-				} else {
-					isLead = _SjisLead[*ptr];
-				}
+				isLead = isLead ? NO : _SjisLead[*ptr];
 			}
 			if (isLead) {
-				// 末尾が2byte文字の上位バイトなら1byte切り詰める
 				pos--;
 			}
 		}
-		// 文字境界にNULL終端設定
 		bytes[pos] = '\0';
 		data = [NSData dataWithBytes:bytes length:pos + (containNull ? 1 : 0)];
-	} else {
-		// サイズ内
-		if (containNull) {
-			// NULL終端追加
-			NSMutableData* work = [data mutableCopy];
-			[work increaseLengthBy:1];
-			data = work;
-		}
+	} else if (containNull) {
+		NSMutableData* work = [[data mutableCopy] autorelease];
+		[work increaseLengthBy:1];
+		data = work;
 	}
 	return data;
 }
 
+// 変換性能測定（英文／和文／混在の各コーパスで従来実装と比較）
++ (void)benchmarkTranscoding
+{
+	NSString* en	= @"The quick brown fox jumps over the lazy dog. 0123456789 ";
+	NSString* ja	= @"吾輩は猫である。名前はまだ無い。どこで生れたかとんと見当がつかぬ。";
+	NSString* mix	= @"Meeting at 15:00 会議室Ａ（3F）で打ち合わせ、資料は¥share¥docs にあります。";
+	NSDictionary<NSString*,NSString*>* corpora = @{
+		@"english"	: [@"" stringByPaddingToLength:en.length * 64 withString:en startingAtIndex:0],
+		@"japanese"	: [@"" stringByPaddingToLength:ja.length * 64 withString:ja startingAtIndex:0],
+		@"mixed"	: [@"" stringByPaddingToLength:mix.length * 64 withString:mix startingAtIndex:0],
+	};
+	const NSUInteger	loop		= 2000;
+	const NSUInteger	limits[]	= { NSUIntegerMax, 1023, 64 };
+	for (NSString* name in corpora) {
+		NSString* str = corpora[name];
+		for (int u = 0; u < 2; u++) {
+			BOOL useUTF8 = (u != 0);
+			for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+				NSUInteger	maxLen	= limits[l];
+				NSData*		oldData	= _LegacyData(str, useUTF8, YES, maxLen);
+				NSData*		newData	= [str dataUsingUTF8:useUTF8 nullTerminate:YES maxLength:maxLen];
+				if (![oldData isEqualToData:newData]) {
+					// GBK/Big5/UHCでは従来実装の切り詰めがSJIS判定のため差異が出ることがある
+					WRN(@"benchmark(%@,utf8=%s,max=%ld) result differs(old=%lu,new=%lu)",
+						name, BOOLSTR(useUTF8), (long)maxLen, oldData.length, newData.length);
+				}
+				CFAbsoluteTime t0 = CFAbsoluteTimeGetCurrent();
+				for (NSUInteger i = 0; i < loop; i++) {
+					@autoreleasepool {
+						_LegacyData(str, useUTF8, YES, maxLen);
+					}
+				}
+				CFAbsoluteTime t1 = CFAbsoluteTimeGetCurrent();
+				for (NSUInteger i = 0; i < loop; i++) {
+					@autoreleasepool {
+						[str dataUsingUTF8:useUTF8 nullTerminate:YES maxLength:maxLen];
+					}
+				}
+				CFAbsoluteTime t2 = CFAbsoluteTimeGetCurrent();
+				DBG(@"benchmark(%@,utf8=%s,max=%ld) legacy=%.1fus new=%.1fus",
+					name, BOOLSTR(useUTF8), (long)maxLen,
+					(t1 - t0) * 1000000.0 / loop, (t2 - t1) * 1000000.0 / loop);
+			}
+		}
+	}
+}
+#endif
+
 @end
@@ -0,0 +1,56 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: PeerSimulator.h
+ *	Module		: 仮想ユーザ負荷試験クラス（デバッグ用）
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+#if defined(IPMSG_DEBUG)
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 試験シナリオ
+typedef NS_ENUM(NSInteger, PeerSimScenario)
+{
+	PEERSIM_BOOT_STORM = 0,		// 全仮想ユーザが一斉にBR_ENTRY（ANSENTRY応答までの時間）
+	PEERSIM_MULTICAST_SEND,		// 全仮想ユーザ宛にメッセージ送信（到着までの時間）
+	PEERSIM_MASS_DOWNLOAD,		// 全仮想ユーザが同一添付ファイルを同時ダウンロード（完了までの時間）
+	PEERSIM_STRIPED_DOWNLOAD	// 大きな添付ファイルを並列数を変えて範囲指定ダウンロード（並列数毎の速度）
+};
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// ループバック上に仮想ユーザを立ててMessageCenterに負荷をかける
+@interface PeerSimulator : NSObject
+
+@property(readonly)	NSUInteger		peerCount;		// 仮想ユーザ数
+@property(assign)	NSTimeInterval	timeout;		// シナリオ毎の応答待ち上限
+@property(readonly)	NSUInteger		failures;		// 合格基準を満たさなかったシナリオ数
+
+// ファクトリ
++ (instancetype)simulatorWithPeerCount:(NSUInteger)count;
+
+// 全シナリオ実行（バックグラウンドで実行し、結果と合否はデバッグログに出力。起動引数 -PeerSimulatorPeers N で起動時に実行）
+// 先に各モジュールの単体性能測定（runBenchmarks）も行う
++ (void)runSuiteWithPeerCount:(NSUInteger)count;
+
+// 単体性能測定（文字コード変換・パケット編集・暗号処理・ユーザ情報メモリ量。結果はデバッグログに出力）
++ (void)runBenchmarks;
+
+// 仮想ユーザ起動／停止（停止時はBR_EXITを送る）
+- (BOOL)start;
+- (void)stop;
+
+// シナリオ実行（メインスレッド以外から呼ぶこと。合否を含む結果レポートを返す）
+- (NSString*)runScenario:(PeerSimScenario)scenario;
+
+@end
+
+#endif
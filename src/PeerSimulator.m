@@ -0,0 +1,812 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: PeerSimulator.m
+ *	Module		: 仮想ユーザ負荷試験クラス（デバッグ用）
+ *============================================================================*/
+
+#import "PeerSimulator.h"
+
+#if defined(IPMSG_DEBUG)
+
+#import "MessageCenter.h"
+#import "UserManager.h"
+#import "UserInfo.h"
+#import "SendMessage.h"
+#import "SendAttachment.h"
+#import "Config.h"
+#import "StripePlanner.h"
+#import "CryptoManager.h"
+#import "NSString+IPMessenger.h"
+#import "DebugLog.h"
+
+#import <sys/socket.h>
+#import <sys/event.h>
+#import <sys/resource.h>
+#import <netinet/in.h>
+#import <arpa/inet.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// プロトコル定義（MessageCenter.mの定義と同値）
+#define _IPMSG_VERSION			1
+#define _IPMSG_BR_ENTRY			0x00000001UL
+#define _IPMSG_BR_EXIT			0x00000002UL
+#define _IPMSG_ANSENTRY			0x00000003UL
+#define _IPMSG_SENDMSG			0x00000020UL
+#define _IPMSG_RECVMSG			0x00000021UL
+#define _IPMSG_GETFILEDATA		0x00000060UL
+#define _IPMSG_SENDCHECKOPT		0x00000100UL
+#define _IPMSG_FILEATTACHOPT	0x00200000UL
+#define _IPMSG_UTF8OPT			0x00800000UL
+#define _IPMSG_CAPUTF8OPT		0x01000000UL
+#define _IPMSG_RANGEOPT			0x20000000UL
+#define _GET_MODE(command)		(command & 0x000000ffUL)
+
+#define _LOGON_PREFIX			@"peersim-"				// 仮想ユーザのログオン名接頭辞
+#define _GROUP_NAME				"PeerSimulator"			// 仮想ユーザのグループ名
+#define _DEFAULT_TIMEOUT		(60.0)					// 応答待ち上限（標準）
+#define _DOWNLOAD_PARALLEL		(64)					// 同時ダウンロード数
+#define _DOWNLOAD_FILE_SIZE		(4 * 1024 * 1024)		// ダウンロード試験ファイルサイズ
+#define _RECV_BUF_SIZE			(65536)					// 受信バッファ
+#define _STRIPED_FILE_SIZE		(256 * 1024 * 1024)		// 分割ダウンロード試験ファイルサイズ
+#define _STRIPED_FILE_BLOCK		(4 * 1024 * 1024)		// 分割ダウンロード試験ファイル作成単位
+
+// シナリオ毎の合格基準（負値は判定しない。タイムアウトは常に不合格）
+typedef struct {
+	double	p99;			// 応答時間p99上限（ミリ秒）
+	double	loss;			// 損失率上限（％）
+	double	throughput;		// スループット下限（MB/秒。分割ダウンロードは自動調整時の速度）
+} _ScenarioLimit;
+
+static const _ScenarioLimit _ScenarioLimits[] = {
+	{  2000.0,	1.0,	-1.0 },		// PEERSIM_BOOT_STORM（ループバックでも一斉送信はUDP取りこぼしがある）
+	{  3000.0,	0.0,	-1.0 },		// PEERSIM_MULTICAST_SEND（再送があるため損失なし）
+	{ 30000.0,	0.0,	20.0 },		// PEERSIM_MASS_DOWNLOAD
+	{    -1.0,	-1.0,	50.0 },		// PEERSIM_STRIPED_DOWNLOAD
+};
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface PeerSimulator()
+{
+	int*			socks;		// 仮想ユーザ毎UDPソケット
+	UInt16*			ports;		// 仮想ユーザ毎ポート番号
+	CFAbsoluteTime*	doneAt;		// 仮想ユーザ毎完了時刻（0:未完了）
+	BOOL*			failed;		// 仮想ユーザ毎失敗フラグ
+}
+
+@property(assign)	int						kq;				// 受信待ちkqueue
+@property(assign)	BOOL					running;		// 受信スレッド動作中
+@property(retain)	NSThread*				recvThread;		// 受信スレッド
+@property(assign)	PeerSimScenario			scenario;		// 実行中シナリオ
+@property(assign)	NSInteger				packetNo;		// 待ち合わせ対象パケット番号
+@property(assign)	CFAbsoluteTime			startAt;		// シナリオ開始時刻
+@property(assign)	NSUInteger				doneCount;		// 完了（失敗含む）数
+@property(assign)	UInt64					bytesReceived;	// ダウンロード総量
+@property(assign)	dispatch_semaphore_t	downloadLimit;	// 同時ダウンロード数制限
+@property(readwrite)	NSUInteger			failures;		// 合格基準を満たさなかったシナリオ数
+
+- (NSString*)logOnNameAt:(NSUInteger)index;
+- (void)sendFrom:(NSUInteger)index command:(UInt32)cmd data:(NSData*)data;
+- (void)receiveThread:(id)arg;
+- (void)processPacket:(char*)buf length:(size_t)len peer:(NSUInteger)index;
+- (void)downloadAt:(NSUInteger)index file:(NSString*)fileID size:(size_t)size;
+- (NSString*)runStripedDownload;
+- (NSString*)stripedDownloadAt:(NSUInteger)index fileID:(NSInteger)fileID size:(UInt64)size streams:(NSUInteger)streams rate:(double*)rate finished:(BOOL*)finished;
+- (NSString*)judge:(PeerSimScenario)scenario p99:(double)p99 loss:(double)loss throughput:(double)throughput completed:(BOOL)completed;
+- (BOOL)downloadAt:(NSUInteger)index fileID:(NSInteger)fileID offset:(UInt64)offset length:(UInt64)length planner:(StripePlanner*)planner;
+- (void)markDone:(NSUInteger)index failed:(BOOL)fail;
+- (BOOL)waitForCompletion;
+- (NSArray<UserInfo*>*)simulatedUsers;
+
+@end
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 昇順比較（qsort用）
+static int _CompareDouble(const void* a, const void* b)
+{
+	double d1 = *(const double*)a;
+	double d2 = *(const double*)b;
+	return (d1 < d2) ? -1 : ((d1 > d2) ? 1 : 0);
+}
+
+// CPU使用時間（ユーザ＋システム）
+static NSTimeInterval _CPUTime(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// 次の":"までを切り出す（見つからなければNULL）
+static char* _NextField(char** cursor)
+{
+	char* start = *cursor;
+	char* sep	= start ? strchr(start, ':') : NULL;
+	if (!sep) {
+		return NULL;
+	}
+	*sep	= '\0';
+	*cursor	= sep + 1;
+	return start;
+}
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation PeerSimulator
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)simulatorWithPeerCount:(NSUInteger)count
+{
+	return [[[PeerSimulator alloc] initWithPeerCount:count] autorelease];
+}
+
+// 全シナリオ実行
++ (void)runSuiteWithPeerCount:(NSUInteger)count
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		@autoreleasepool {
+			[PeerSimulator runBenchmarks];
+			PeerSimulator* sim = [PeerSimulator simulatorWithPeerCount:count];
+			if (![sim start]) {
+				ERR(@"PeerSimulator start failed(%lu peers)", count);
+				return;
+			}
+			NSMutableString* report = [NSMutableString string];
+			for (PeerSimScenario s = PEERSIM_BOOT_STORM; s <= PEERSIM_STRIPED_DOWNLOAD; s++) {
+				[report appendString:[sim runScenario:s]];
+				[report appendString:@"\n"];
+			}
+			[sim stop];
+			if (sim.failures > 0) {
+				ERR(@"PeerSimulator suite FAILED(%lu peers,%lu scenarios)\n%@", count, sim.failures, report);
+			} else {
+				DBG(@"PeerSimulator suite passed(%lu peers)\n%@", count, report);
+			}
+		}
+	});
+}
+
+// 単体性能測定
++ (void)runBenchmarks
+{
+	@autoreleasepool {
+		[NSString benchmarkTranscoding];
+	}
+	@autoreleasepool {
+		[MessageCenter.sharedCenter benchmarkPacketBuilding];
+	}
+	@autoreleasepool {
+		[CryptoManager.sharedManager benchmarkBackend];
+	}
+	@autoreleasepool {
+		[UserInfo benchmarkFootprint];
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithPeerCount:(NSUInteger)count
+{
+	self = [super init];
+	if (self) {
+		_peerCount		= count;
+		_timeout		= _DEFAULT_TIMEOUT;
+		_kq				= -1;
+		_downloadLimit	= dispatch_semaphore_create(_DOWNLOAD_PARALLEL);
+		socks			= malloc(sizeof(int) * count);
+		ports			= calloc(count, sizeof(UInt16));
+		doneAt			= calloc(count, sizeof(CFAbsoluteTime));
+		failed			= calloc(count, sizeof(BOOL));
+		if (!socks || !ports || !doneAt || !failed) {
+			ERR(@"malloc error(%lu)", count);
+			[self release];
+			return nil;
+		}
+		for (NSUInteger i = 0; i < count; i++) {
+			socks[i] = -1;
+		}
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[self stop];
+	free(socks);
+	free(ports);
+	free(doneAt);
+	free(failed);
+	[_recvThread release];
+	if (_downloadLimit) {
+		dispatch_release(_downloadLimit);
+	}
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 起動／停止
+ *----------------------------------------------------------------------------*/
+
+// 仮想ユーザ起動
+- (BOOL)start
+{
+	if (self.running) {
+		return YES;
+	}
+
+	// ソケット数上限を引き上げ
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rlim_t need = (rlim_t)self.peerCount + 256;
+		if (rl.rlim_cur < need) {
+			rl.rlim_cur = MIN(need, MIN(rl.rlim_max, (rlim_t)OPEN_MAX));
+			if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+				WRN(@"setrlimit error(%s)", strerror(errno));
+			}
+		}
+	}
+
+	self.kq = kqueue();
+	if (self.kq < 0) {
+		ERR(@"kqueue error(%s)", strerror(errno));
+		return NO;
+	}
+	for (NSUInteger i = 0; i < self.peerCount; i++) {
+		int sock = socket(AF_INET, SOCK_DGRAM, 0);
+		if (sock < 0) {
+			ERR(@"socket error(#%lu,%s)", i, strerror(errno));
+			[self stop];
+			return NO;
+		}
+		struct sockaddr_in addr;
+		socklen_t addrLen = sizeof(addr);
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family			= AF_INET;
+		addr.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+		addr.sin_port			= 0;
+		if ((bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+			(getsockname(sock, (struct sockaddr*)&addr, &addrLen) != 0)) {
+			ERR(@"bind error(#%lu,%s)", i, strerror(errno));
+			close(sock);
+			[self stop];
+			return NO;
+		}
+		socks[i] = sock;
+		ports[i] = ntohs(addr.sin_port);
+		struct kevent ev;
+		EV_SET(&ev, sock, EVFILT_READ, EV_ADD, 0, 0, (void*)(uintptr_t)i);
+		kevent(self.kq, &ev, 1, NULL, 0, NULL);
+	}
+
+	self.running	= YES;
+	self.recvThread	= [[[NSThread alloc] initWithTarget:self selector:@selector(receiveThread:) object:nil] autorelease];
+	[self.recvThread start];
+	DBG(@"PeerSimulator started(%lu peers on loopback)", self.peerCount);
+	return YES;
+}
+
+// 仮想ユーザ停止
+- (void)stop
+{
+	if (self.running) {
+		// 一覧から消えるようにBR_EXIT
+		for (NSUInteger i = 0; i < self.peerCount; i++) {
+			[self sendFrom:i command:_IPMSG_BR_EXIT data:nil];
+		}
+		self.running = NO;
+		while (self.recvThread && !self.recvThread.isFinished) {
+			[NSThread sleepForTimeInterval:0.05];
+		}
+	}
+	for (NSUInteger i = 0; (i < self.peerCount) && socks; i++) {
+		if (socks[i] >= 0) {
+			close(socks[i]);
+			socks[i] = -1;
+		}
+	}
+	if (self.kq >= 0) {
+		close(self.kq);
+		self.kq = -1;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * シナリオ実行
+ *----------------------------------------------------------------------------*/
+
+- (NSString*)runScenario:(PeerSimScenario)scenario
+{
+	NSString*	name		= @[@"BootStorm", @"MulticastSend", @"MassDownload", @"StripedDownload"][scenario];
+	NSString*	filePath	= nil;
+
+	// 状態初期化
+	@synchronized (self) {
+		memset(doneAt, 0, sizeof(CFAbsoluteTime) * self.peerCount);
+		memset(failed, 0, sizeof(BOOL) * self.peerCount);
+		self.scenario		= scenario;
+		self.packetNo		= -1;
+		self.doneCount		= 0;
+		self.bytesReceived	= 0;
+	}
+	size_t			rssBefore	= IPMsgResidentSize();
+	NSTimeInterval	cpuBefore	= _CPUTime();
+	self.startAt = CFAbsoluteTimeGetCurrent();
+
+	switch (scenario) {
+	case PEERSIM_BOOT_STORM:
+		// 全仮想ユーザから一斉にBR_ENTRY
+		for (NSUInteger i = 0; i < self.peerCount; i++) {
+			NSMutableData* data = [NSMutableData data];
+			NSData* nick = [[NSString stringWithFormat:@"Sim%05lu", i] dataUsingEncoding:NSUTF8StringEncoding];
+			[data appendData:nick];
+			[data appendBytes:"\0" _GROUP_NAME "\0" length:sizeof(_GROUP_NAME) + 1];
+			[self sendFrom:i command:_IPMSG_BR_ENTRY|_IPMSG_CAPUTF8OPT|_IPMSG_FILEATTACHOPT data:data];
+		}
+		break;
+	case PEERSIM_MULTICAST_SEND:
+	case PEERSIM_MASS_DOWNLOAD:
+		{
+			NSArray<UserInfo*>* users = self.simulatedUsers;
+			if (users.count < self.peerCount) {
+				WRN(@"PeerSimulator %@:only %lu/%lu peers known", name, users.count, self.peerCount);
+			}
+			SendMessage* msg = [[[SendMessage alloc] init] autorelease];
+			msg.packetNo	= MessageCenter.nextPacketNo;
+			msg.message		= [NSString stringWithFormat:@"PeerSimulator %@", name];
+			if (scenario == PEERSIM_MASS_DOWNLOAD) {
+				// 試験用ファイル作成
+				filePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"ipmsg-peersim.bin"];
+				NSMutableData* body = [NSMutableData dataWithLength:_DOWNLOAD_FILE_SIZE];
+				arc4random_buf(body.mutableBytes, body.length);
+				if (![body writeToFile:filePath atomically:YES]) {
+					ERR(@"test file create error(%@)", filePath);
+					self.failures++;
+					return [NSString stringWithFormat:@"%@: test file create error => FAIL", name];
+				}
+				SendAttachment* attach = [SendAttachment attachmentWithPath:filePath];
+				if (attach) {
+					msg.attachments = @[attach];
+				}
+			}
+			self.packetNo = msg.packetNo;
+			self.startAt = CFAbsoluteTimeGetCurrent();
+			dispatch_sync(dispatch_get_main_queue(), ^{
+				[MessageCenter.sharedCenter sendMessage:msg to:users];
+			});
+		}
+		break;
+	case PEERSIM_STRIPED_DOWNLOAD:
+		// 並列数毎の速度を別形式で集計
+		return [self runStripedDownload];
+	default:
+		return [NSString stringWithFormat:@"unknown scenario(%ld)", scenario];
+	}
+
+	BOOL			completed	= [self waitForCompletion];
+	CFAbsoluteTime	wall		= CFAbsoluteTimeGetCurrent() - self.startAt;
+	NSTimeInterval	cpu			= _CPUTime() - cpuBefore;
+	size_t			rssAfter	= IPMsgResidentSize();
+
+	// 集計
+	double*		lat		= malloc(sizeof(double) * MAX(self.peerCount, 1));
+	NSUInteger	num		= 0;
+	NSUInteger	lost	= 0;
+	@synchronized (self) {
+		for (NSUInteger i = 0; i < self.peerCount; i++) {
+			if ((doneAt[i] > 0) && !failed[i]) {
+				lat[num++] = (doneAt[i] - self.startAt) * 1000.0;
+			} else {
+				lost++;
+			}
+		}
+	}
+	qsort(lat, num, sizeof(double), _CompareDouble);
+	double (^pct)(double) = ^double(double p) {
+		return (num > 0) ? lat[MIN(num - 1, (NSUInteger)(num * p))] : 0;
+	};
+	NSMutableString* report = [NSMutableString stringWithFormat:
+								@"%@(peers=%lu%@): p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms loss=%lu(%.2f%%) "
+								@"cpu=%.2fs(%.0f%%) rss=%.1fMB(%+.1fMB)",
+								name, self.peerCount, completed ? @"" : @",timeout",
+								pct(0.5), pct(0.9), pct(0.99), pct(1.0),
+								lost, (self.peerCount > 0) ? (lost * 100.0 / self.peerCount) : 0.0,
+								cpu, (wall > 0) ? (cpu * 100.0 / wall) : 0.0,
+								rssAfter / (1024.0 * 1024.0), ((double)rssAfter - (double)rssBefore) / (1024.0 * 1024.0)];
+	double throughput = -1.0;
+	if (scenario == PEERSIM_MASS_DOWNLOAD) {
+		throughput = (wall > 0) ? (self.bytesReceived / wall / (1024.0 * 1024.0)) : 0.0;
+		[report appendFormat:@" throughput=%.1fMB/s", throughput];
+	}
+	[report appendString:[self judge:scenario
+								 p99:pct(0.99)
+								loss:(self.peerCount > 0) ? (lost * 100.0 / self.peerCount) : 0.0
+						  throughput:throughput
+						   completed:completed]];
+	free(lat);
+	if (filePath) {
+		[NSFileManager.defaultManager removeItemAtPath:filePath error:NULL];
+	}
+	DBG(@"PeerSimulator %@", report);
+	return report;
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// 仮想ユーザのログオン名
+- (NSString*)logOnNameAt:(NSUInteger)index
+{
+	return [NSString stringWithFormat:@"%@%05lu", _LOGON_PREFIX, index];
+}
+
+// 仮想ユーザからのパケット送信
+- (void)sendFrom:(NSUInteger)index command:(UInt32)cmd data:(NSData*)data
+{
+	if (socks[index] < 0) {
+		return;
+	}
+	NSString*		header	= [NSString stringWithFormat:@"%d:%ld:%@:peersim-host%05lu:%u:",
+														_IPMSG_VERSION, MessageCenter.nextPacketNo,
+														[self logOnNameAt:index], index, cmd | _IPMSG_UTF8OPT];
+	NSMutableData*	packet	= [NSMutableData dataWithData:[header dataUsingEncoding:NSUTF8StringEncoding]];
+	if (data) {
+		[packet appendData:data];
+	}
+	struct sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family		= AF_INET;
+	to.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	to.sin_port			= htons((UInt16)((Config.sharedConfig.portNo > 0) ? Config.sharedConfig.portNo : 2425));
+	sendto(socks[index], packet.bytes, packet.length, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+// 受信スレッド
+- (void)receiveThread:(id)arg
+{
+	char* buf = malloc(_RECV_BUF_SIZE + 1);
+	if (!buf) {
+		ERR(@"malloc error");
+		return;
+	}
+	struct timespec	wait = { 0, 100 * 1000 * 1000 };
+	struct kevent	events[64];
+	while (self.running) {
+		@autoreleasepool {
+			int n = kevent(self.kq, NULL, 0, events, 64, &wait);
+			for (int e = 0; e < n; e++) {
+				NSUInteger	index	= (NSUInteger)(uintptr_t)events[e].udata;
+				ssize_t		len		= recv(socks[index], buf, _RECV_BUF_SIZE, 0);
+				if (len > 0) {
+					buf[len] = '\0';
+					[self processPacket:buf length:(size_t)len peer:index];
+				}
+			}
+		}
+	}
+	free(buf);
+}
+
+// 仮想ユーザの受信処理
+- (void)processPacket:(char*)buf length:(size_t)len peer:(NSUInteger)index
+{
+	char*	cursor	= buf;
+	char*	ver		= _NextField(&cursor);
+	char*	pno		= _NextField(&cursor);
+	char*	logon	= _NextField(&cursor);
+	char*	host	= _NextField(&cursor);
+	char*	cmdStr	= _NextField(&cursor);
+	if (!ver || !pno || !logon || !host || !cmdStr) {
+		WRN(@"PeerSimulator:illegal packet(#%lu)", index);
+		return;
+	}
+	UInt32 cmd = (UInt32)strtoul(cmdStr, NULL, 10);
+	switch (_GET_MODE(cmd)) {
+	case _IPMSG_ANSENTRY:
+		if (self.scenario == PEERSIM_BOOT_STORM) {
+			[self markDone:index failed:NO];
+		}
+		break;
+	case _IPMSG_SENDMSG:
+		if (cmd & _IPMSG_SENDCHECKOPT) {
+			// 受信確認
+			NSData* ack = [[NSString stringWithFormat:@"%s", pno] dataUsingEncoding:NSUTF8StringEncoding];
+			[self sendFrom:index command:_IPMSG_RECVMSG data:ack];
+		}
+		if (strtol(pno, NULL, 10) != self.packetNo) {
+			break;
+		}
+		if (self.scenario == PEERSIM_MULTICAST_SEND) {
+			[self markDone:index failed:NO];
+		} else if ((self.scenario == PEERSIM_MASS_DOWNLOAD) && (cmd & _IPMSG_FILEATTACHOPT)) {
+			// 添付情報（本文\0ファイルID:ファイル名:サイズ:...）の先頭ファイルを取得
+			size_t		msgLen	= strlen(cursor);
+			const char*	option	= (cursor + msgLen < buf + len) ? cursor + msgLen + 1 : NULL;
+			NSArray*	fields	= option ? [@(option) componentsSeparatedByString:@":"] : nil;
+			if (fields.count < 3) {
+				[self markDone:index failed:YES];
+				break;
+			}
+			unsigned long long size = strtoull([fields[2] UTF8String], NULL, 16);
+			NSString* fileID = fields[0];
+			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+				[self downloadAt:index file:fileID size:(size_t)size];
+			});
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// 仮想ユーザのダウンロード
+- (void)downloadAt:(NSUInteger)index file:(NSString*)fileID size:(size_t)size
+{
+	dispatch_semaphore_wait(self.downloadLimit, DISPATCH_TIME_FOREVER);
+	BOOL fail	= YES;
+	int sock	= socket(AF_INET, SOCK_STREAM, 0);
+	if (sock >= 0) {
+		struct sockaddr_in to;
+		memset(&to, 0, sizeof(to));
+		to.sin_family		= AF_INET;
+		to.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+		to.sin_port			= htons((UInt16)((Config.sharedConfig.portNo > 0) ? Config.sharedConfig.portNo : 2425));
+		if (connect(sock, (struct sockaddr*)&to, sizeof(to)) == 0) {
+			NSString* req = [NSString stringWithFormat:@"%d:%ld:%@:peersim-host%05lu:%u:%lx:%lx:0:",
+														_IPMSG_VERSION, MessageCenter.nextPacketNo,
+														[self logOnNameAt:index], index,
+														(UInt32)(_IPMSG_GETFILEDATA | _IPMSG_UTF8OPT),
+														self.packetNo, (long)fileID.integerValue];
+			const char* reqStr = req.UTF8String;
+			if (send(sock, reqStr, strlen(reqStr) + 1, 0) >= 0) {
+				char	buf[_RECV_BUF_SIZE];
+				size_t	total = 0;
+				while (total < size) {
+					ssize_t n = recv(sock, buf, sizeof(buf), 0);
+					if (n <= 0) {
+						break;
+					}
+					total += (size_t)n;
+				}
+				@synchronized (self) {
+					self.bytesReceived += total;
+				}
+				fail = (total != size);
+			}
+		}
+		close(sock);
+	}
+	dispatch_semaphore_signal(self.downloadLimit);
+	[self markDone:index failed:fail];
+}
+
+// 分割ダウンロード試験（並列数1,2,4,8固定と自動調整で同じファイルを取得し速度を比べる）
+- (NSString*)runStripedDownload
+{
+	NSArray<NSNumber*>*	streams	= @[@1, @2, @4, @8, @0];	// 0:自動調整
+	NSArray<UserInfo*>*	users	= self.simulatedUsers;
+	if (users.count < streams.count) {
+		// 範囲を全て送ると送信側から外れるため、試行毎に別の仮想ユーザを使う
+		self.failures++;
+		return [NSString stringWithFormat:@"StripedDownload: need %lu peers(known=%lu) => FAIL", streams.count, users.count];
+	}
+	users = [users subarrayWithRange:NSMakeRange(0, streams.count)];
+
+	// 試験用ファイル作成
+	NSString* filePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"ipmsg-peersim-striped.bin"];
+	if (![NSFileManager.defaultManager createFileAtPath:filePath contents:nil attributes:nil]) {
+		ERR(@"test file create error(%@)", filePath);
+		self.failures++;
+		return @"StripedDownload: test file create error => FAIL";
+	}
+	NSFileHandle*	fh		= [NSFileHandle fileHandleForWritingAtPath:filePath];
+	NSMutableData*	block	= [NSMutableData dataWithLength:_STRIPED_FILE_BLOCK];
+	for (NSUInteger i = 0; i < _STRIPED_FILE_SIZE / _STRIPED_FILE_BLOCK; i++) {
+		arc4random_buf(block.mutableBytes, block.length);
+		[fh writeData:block];
+	}
+	[fh closeFile];
+
+	SendMessage*	msg		= [[[SendMessage alloc] init] autorelease];
+	SendAttachment*	attach	= [SendAttachment attachmentWithPath:filePath];
+	msg.packetNo	= MessageCenter.nextPacketNo;
+	msg.message		= @"PeerSimulator StripedDownload";
+	msg.attachments	= attach ? @[attach] : nil;
+	self.packetNo	= msg.packetNo;
+	dispatch_sync(dispatch_get_main_queue(), ^{
+		[MessageCenter.sharedCenter sendMessage:msg to:users];
+	});
+
+	NSMutableString*	report		= [NSMutableString stringWithFormat:@"StripedDownload(size=%dMB):", _STRIPED_FILE_SIZE / (1024 * 1024)];
+	double				autoRate	= 0;
+	BOOL				allDone		= YES;
+	for (NSUInteger i = 0; i < streams.count; i++) {
+		NSUInteger	index		= (NSUInteger)[users[i].logOnName substringFromIndex:_LOGON_PREFIX.length].integerValue;
+		double		rate		= 0;
+		BOOL		finished	= NO;
+		[report appendString:@" "];
+		[report appendString:[self stripedDownloadAt:index
+											  fileID:attach.fileID
+												size:_STRIPED_FILE_SIZE
+											 streams:streams[i].unsignedIntegerValue
+												rate:&rate
+											finished:&finished]];
+		if (streams[i].unsignedIntegerValue == 0) {
+			autoRate = rate;
+		}
+		allDone = allDone && finished;
+	}
+	[report appendString:[self judge:PEERSIM_STRIPED_DOWNLOAD p99:-1.0 loss:-1.0 throughput:autoRate completed:allDone]];
+	[NSFileManager.defaultManager removeItemAtPath:filePath error:NULL];
+	DBG(@"PeerSimulator %@", report);
+	return report;
+}
+
+// 分割ダウンロード1回分（streams=0は自動調整。受信データは書き込まず捨てる）
+- (NSString*)stripedDownloadAt:(NSUInteger)index fileID:(NSInteger)fileID size:(UInt64)size streams:(NSUInteger)streams rate:(double*)rate finished:(BOOL*)finished
+{
+	NSUInteger			max		= (streams > 0) ? streams : Config.sharedConfig.downloadStreams;
+	StripePlanner*		planner	= [[[StripePlanner alloc] initWithLength:size maxStreams:max] autorelease];
+	dispatch_group_t	group	= dispatch_group_create();
+	dispatch_queue_t	queue	= dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	CFAbsoluteTime		start	= CFAbsoluteTimeGetCurrent();
+	planner.adaptive = (streams == 0);
+
+	while (!planner.finished && !planner.failed) {
+		if (CFAbsoluteTimeGetCurrent() - start > self.timeout) {
+			[planner cancel];
+			break;
+		}
+		while ([planner acquireStream]) {
+			dispatch_group_async(group, queue, ^{
+				@autoreleasepool {
+					UInt64 offset;
+					UInt64 length;
+					while ([planner nextRange:&offset length:&length]) {
+						[self downloadAt:index fileID:fileID offset:offset length:length planner:planner];
+					}
+				}
+			});
+		}
+		dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, 200 * NSEC_PER_MSEC));
+	}
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+
+	CFAbsoluteTime	wall	= CFAbsoluteTimeGetCurrent() - start;
+	NSString*		label	= (streams > 0) ? [NSString stringWithFormat:@"streams=%lu", streams]
+										: [NSString stringWithFormat:@"auto(peak=%lu)", planner.peakStreams];
+	*rate		= (wall > 0) ? (planner.receivedBytes / wall / (1024.0 * 1024.0)) : 0.0;
+	*finished	= planner.finished;
+	return [NSString stringWithFormat:@"%@:%.1fMB/s%@", label, *rate, planner.finished ? @"" : @"(failed)"];
+}
+
+// 合否判定（不合格の場合は理由を列挙し、不合格数を加算する）
+- (NSString*)judge:(PeerSimScenario)scenario p99:(double)p99 loss:(double)loss throughput:(double)throughput completed:(BOOL)completed
+{
+	const _ScenarioLimit*	limit	= &_ScenarioLimits[scenario];
+	NSMutableArray*			reasons	= [NSMutableArray array];
+	if (!completed) {
+		[reasons addObject:@"not completed"];
+	}
+	if ((limit->p99 >= 0) && (p99 > limit->p99)) {
+		[reasons addObject:[NSString stringWithFormat:@"p99>%.0fms", limit->p99]];
+	}
+	if ((limit->loss >= 0) && (loss > limit->loss)) {
+		[reasons addObject:[NSString stringWithFormat:@"loss>%.1f%%", limit->loss]];
+	}
+	if ((limit->throughput >= 0) && (throughput < limit->throughput)) {
+		[reasons addObject:[NSString stringWithFormat:@"throughput<%.1fMB/s", limit->throughput]];
+	}
+	if (reasons.count > 0) {
+		@synchronized (self) {
+			self.failures++;
+		}
+		return [NSString stringWithFormat:@" => FAIL(%@)", [reasons componentsJoinedByString:@","]];
+	}
+	return @" => PASS";
+}
+
+// 仮想ユーザの範囲ダウンロード
+- (BOOL)downloadAt:(NSUInteger)index fileID:(NSInteger)fileID offset:(UInt64)offset length:(UInt64)length planner:(StripePlanner*)planner
+{
+	UInt64	total	= 0;
+	int		sock	= socket(AF_INET, SOCK_STREAM, 0);
+	if (sock >= 0) {
+		struct sockaddr_in to;
+		memset(&to, 0, sizeof(to));
+		to.sin_family		= AF_INET;
+		to.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+		to.sin_port			= htons((UInt16)((Config.sharedConfig.portNo > 0) ? Config.sharedConfig.portNo : 2425));
+		if (connect(sock, (struct sockaddr*)&to, sizeof(to)) == 0) {
+			NSString* req = [NSString stringWithFormat:@"%d:%ld:%@:peersim-host%05lu:%u:%lx:%lx:%llx:%llx:",
+														_IPMSG_VERSION, MessageCenter.nextPacketNo,
+														[self logOnNameAt:index], index,
+														(UInt32)(_IPMSG_GETFILEDATA | _IPMSG_UTF8OPT | _IPMSG_RANGEOPT),
+														self.packetNo, (long)fileID, offset, length];
+			const char* reqStr = req.UTF8String;
+			if (send(sock, reqStr, strlen(reqStr) + 1, 0) >= 0) {
+				char buf[_RECV_BUF_SIZE];
+				while ((total < length) && !planner.failed) {
+					ssize_t n = recv(sock, buf, (size_t)MIN((UInt64)sizeof(buf), length - total), 0);
+					if (n <= 0) {
+						break;
+					}
+					total += (UInt64)n;
+					[planner addReceivedBytes:(UInt64)n];
+				}
+			}
+		}
+		close(sock);
+	}
+	if (total == length) {
+		[planner completeRange:offset length:length];
+		return YES;
+	}
+	[planner failRange:offset length:length received:total];
+	return NO;
+}
+
+// 完了記録（最初の1回のみ）
+- (void)markDone:(NSUInteger)index failed:(BOOL)fail
+{
+	@synchronized (self) {
+		if (doneAt[index] > 0) {
+			return;
+		}
+		doneAt[index] = CFAbsoluteTimeGetCurrent();
+		failed[index] = fail;
+		self.doneCount++;
+	}
+}
+
+// 全仮想ユーザ完了待ち（タイムアウト時NO）
+- (BOOL)waitForCompletion
+{
+	CFAbsoluteTime limit = self.startAt + self.timeout;
+	while (CFAbsoluteTimeGetCurrent() < limit) {
+		if (self.doneCount >= self.peerCount) {
+			return YES;
+		}
+		[NSThread sleepForTimeInterval:0.05];
+	}
+	return NO;
+}
+
+// ユーザ一覧中の仮想ユーザ
+- (NSArray<UserInfo*>*)simulatedUsers
+{
+	NSMutableArray<UserInfo*>* users = [NSMutableArray<UserInfo*> array];
+	for (UserInfo* user in UserManager.sharedManager.users) {
+		if ([user.logOnName hasPrefix:_LOGON_PREFIX] && (user.address.sin_addr.s_addr == htonl(INADDR_LOOPBACK))) {
+			[users addObject:user];
+		}
+	}
+	return users;
+}
+
+@end
+
+#endif
@@ -216,6 +216,7 @@
 		NSInteger index = self.netBroadAddressTable.selectedRow;
 		if (index != -1) {
 			[Config.sharedConfig removeBroadcastAtIndex:index];
+			[MessageCenter.sharedCenter refreshBroadcastTargets];
 			[self.netBroadAddressTable reloadData];
 			[self.netBroadAddressTable deselectAll:self];
 		}
@@ -266,6 +267,7 @@
 			}
 			[config addBroadcastWithHost:string];
 		}
+		[MessageCenter.sharedCenter refreshBroadcastTargets];
 		self.bcastSheetErrorLabel.stringValue = @"";
 		[self.panel endSheet:self.bcastSheet returnCode:NSModalResponseOK];
 	}
@@ -46,9 +46,14 @@ typedef NSMutableArray<NSImage*>	_IconList;
 @property(retain)	NSDate*					dlStart;				// ダウンロード開始時刻
 @property(weak)		id<DownloaderContext>	download;				// ダウンロード情報
 @property(retain)	NSTimer*				dlSheetRefreshTimer;	// ダウンロードシート更新タイマ
-@property(assign)	NSInteger				dlSheetRefreshFlags;	// ダウンロードシート更新マスク
+@property(assign)	NSInteger				dlSheetRefreshFlags;	// ダウンロードシート更新マスク（受信スレッドからも更新するためロックして操作）
+@property(retain)	NSMapTable*				clipAttachments;		// 埋め込みクリップボード→表示中テキスト添付
+@property(retain)	id<NSObject>			clipLoadedObserver;		// 埋め込みクリップボード読み込み通知オブザーバ
 
 - (void)setAttachHeader;
+- (NSImage*)clipboardPlaceholder;
+- (void)clipboardLoaded:(RecvClipboard*)clip;
+- (void)addDownloadSheetRefreshFlags:(NSInteger)flags;
 
 @end
 
@@ -150,13 +155,27 @@ typedef NSMutableArray<NSImage*>	_IconList;
 			}
 		}
 
-		// 埋め込みクリップボード挿入
+		// 埋め込みクリップボード挿入（読み込み中のものはプレースホルダを表示し、完了通知で差し替え）
+		if (_recvMsg.clipboards.count > 0) {
+			__weak typeof(self) weakSelf = self;
+			_clipAttachments	= [[NSMapTable strongToStrongObjectsMapTable] retain];
+			_clipLoadedObserver	= [[NSNotificationCenter.defaultCenter addObserverForName:kIPMsgClipboardLoadedNotification
+																			   object:nil
+																				queue:nil
+																		   usingBlock:^(NSNotification* note) {
+																			   [weakSelf clipboardLoaded:note.object];
+																		   }] retain];
+		}
 		for (RecvClipboard* clip in _recvMsg.clipboards) {
-			NSTextAttachmentCell*	cell	= [[[NSTextAttachmentCell alloc] initImageCell:clip.image] autorelease];
+			NSImage*				image	= clip.completed ? clip.image : [self clipboardPlaceholder];
+			NSTextAttachmentCell*	cell	= [[[NSTextAttachmentCell alloc] initImageCell:image ? image : [NSImage imageNamed:NSImageNameCaution]] autorelease];
 			NSTextAttachment*		attach	= [[[NSTextAttachment alloc] init] autorelease];
 			attach.attachmentCell = cell;
 			NSAttributedString* str = [NSAttributedString attributedStringWithAttachment:attach];
 			[_messageArea.textStorage insertAttributedString:str atIndex:clip.clipboardPos];
+			if (!clip.completed) {
+				[_clipAttachments setObject:attach forKey:clip];
+			}
 		}
 	}
 
@@ -166,6 +185,11 @@ typedef NSMutableArray<NSImage*>	_IconList;
 // 解放処理
 - (void)dealloc
 {
+	if (_clipLoadedObserver) {
+		[NSNotificationCenter.defaultCenter removeObserver:_clipLoadedObserver];
+		[_clipLoadedObserver release];
+	}
+	[_clipAttachments release];
 	[_dlStart release];
 	[_download release];
 	[_icons release];
@@ -311,7 +335,9 @@ typedef NSMutableArray<NSImage*>	_IconList;
 					});
 				}];
 				// ダウンロード（スレッド）開始
-				self.dlSheetRefreshFlags = 0;
+				@synchronized (self) {
+					self.dlSheetRefreshFlags = 0;
+				}
 				self.dlStart = [NSDate date];
 				self.download = [MessageCenter.sharedCenter startDownload:targets
 																	   of:self.recvMsg.packetNo
@@ -558,6 +584,53 @@ typedef NSMutableArray<NSImage*>	_IconList;
 	[self.attachTable tableColumnWithIdentifier:@"Attachment"].headerCell.stringValue = title;
 }
 
+// 埋め込みクリップボード読み込み中プレースホルダ画像
+- (NSImage*)clipboardPlaceholder
+{
+	static NSImage*			placeholder = nil;
+	static dispatch_once_t	once;
+	dispatch_once(&once, ^{
+		placeholder = [[NSImage imageWithSize:NSMakeSize(64, 64)
+									  flipped:NO
+							   drawingHandler:^BOOL(NSRect rect) {
+			NSBezierPath* path = [NSBezierPath bezierPathWithRoundedRect:NSInsetRect(rect, 2, 2) xRadius:6 yRadius:6];
+			[[NSColor.lightGrayColor colorWithAlphaComponent:0.3] setFill];
+			[path fill];
+			[NSColor.lightGrayColor setStroke];
+			path.lineWidth = 1;
+			[path stroke];
+			return YES;
+		}] retain];
+	});
+	return placeholder;
+}
+
+// 埋め込みクリップボード読み込み完了時処理（プレースホルダを差し替え）
+- (void)clipboardLoaded:(RecvClipboard*)clip
+{
+	NSTextAttachment* attach = [self.clipAttachments objectForKey:clip];
+	if (!attach) {
+		// 他のメッセージの通知
+		return;
+	}
+	NSImage* image = clip.image;
+	if (!image) {
+		image = [NSImage imageNamed:NSImageNameCaution];
+	}
+	attach.attachmentCell = [[[NSTextAttachmentCell alloc] initImageCell:image] autorelease];
+	NSTextStorage* storage = self.messageArea.textStorage;
+	[storage enumerateAttribute:NSAttachmentAttributeName
+						inRange:NSMakeRange(0, storage.length)
+						options:0
+					 usingBlock:^(id value, NSRange range, BOOL* stop) {
+		if (value == attach) {
+			[storage edited:NSTextStorageEditedAttributes range:range changeInLength:0];
+			*stop = YES;
+		}
+	}];
+	[self.clipAttachments removeObjectForKey:clip];
+}
+
 // 添付一覧ダブルクリック時処理
 - (void)attachTableDoubleClicked:(id)sender
 {
@@ -572,26 +645,32 @@ typedef NSMutableArray<NSImage*>	_IconList;
 
 - (void)downloadSheetRefresh:(NSTimer*)timer
 {
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshTitle) {
+	// 更新マスクは取り出すと同時にクリアする（取り出し後の更新は次回反映）
+	NSInteger flags;
+	@synchronized (self) {
+		flags = self.dlSheetRefreshFlags;
+		self.dlSheetRefreshFlags = 0;
+	}
+	if (flags & _AttachSheetRefreshTitle) {
 		NSUInteger	num		= self.download.totalCount;
 		NSInteger	index	= self.download.downloadedCount + 1;
 		NSString*	format	= NSLocalizedString(@"RecvDlg.AttachSheet.Title", nil);
 		NSString*	title	= [NSString stringWithFormat:format, index, num];
 		self.attachSheetTitleLabel.stringValue = title;
 	}
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshFileName) {
+	if (flags & _AttachSheetRefreshFileName) {
 		self.attachSheetFileNameLabel.stringValue = self.download.currentFileName;
 	}
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshFileNum) {
+	if (flags & _AttachSheetRefreshFileNum) {
 		self.attachSheetFileNumLabel.objectValue = @(self.download.downloadedFiles);
 	}
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshDirNum) {
+	if (flags & _AttachSheetRefreshDirNum) {
 		self.attachSheetDirNumLabel.objectValue = @(self.download.downloadedDirs);
 	}
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshTotalSize) {
+	if (flags & _AttachSheetRefreshTotalSize) {
 		self.attachSheetProgress.maxValue = self.download.totalSize;
 	}
-	if (self.dlSheetRefreshFlags & _AttachSheetRefreshDownloadSize) {
+	if (flags & _AttachSheetRefreshDownloadSize) {
 		self.attachSheetProgress.doubleValue	= self.download.downloadedSize;
 		if (self.download.downloadedSize > 0) {
 			NSTimeInterval interval = -self.dlStart.timeIntervalSinceNow;
@@ -606,8 +685,8 @@ typedef NSMutableArray<NSImage*>	_IconList;
 			}
 		}
 	}
-	if ((self.dlSheetRefreshFlags & _AttachSheetRefreshTotalSize) ||
-		(self.dlSheetRefreshFlags & _AttachSheetRefreshDownloadSize)) {
+	if ((flags & _AttachSheetRefreshTotalSize) ||
+		(flags & _AttachSheetRefreshDownloadSize)) {
 		double	downSize	= self.download.downloadedSize;
 		double	totalSize	= self.download.totalSize;
 		if (downSize > 0) {
@@ -639,7 +718,14 @@ typedef NSMutableArray<NSImage*>	_IconList;
 		}
 		self.attachSheetSizeLabel.stringValue = str;
 	}
-	self.dlSheetRefreshFlags = 0;
+}
+
+// ダウンロードシート更新要求（受信スレッドから呼ばれる）
+- (void)addDownloadSheetRefreshFlags:(NSInteger)flags
+{
+	@synchronized (self) {
+		self.dlSheetRefreshFlags |= flags;
+	}
 }
 
 - (void)downloadWillStart
@@ -650,10 +736,10 @@ typedef NSMutableArray<NSImage*>	_IconList;
 		self.attachSheetFileNameLabel.stringValue	= @"";
 		self.attachSheetProgress.maxValue			= self.download.totalSize;
 		self.attachSheetProgress.doubleValue		= 0;
-		self.dlSheetRefreshFlags = _AttachSheetRefreshFileNum
-									| _AttachSheetRefreshDirNum
-									| _AttachSheetRefreshTotalSize
-									| _AttachSheetRefreshDownloadSize;
+		[self addDownloadSheetRefreshFlags:_AttachSheetRefreshFileNum
+											| _AttachSheetRefreshDirNum
+											| _AttachSheetRefreshTotalSize
+											| _AttachSheetRefreshDownloadSize];
 		[self downloadSheetRefresh:nil];
 	});
 }
@@ -664,10 +750,10 @@ typedef NSMutableArray<NSImage*>	_IconList;
 		self.attachSheetCancelButton.enabled		= NO;
 		self.attachSheetTitleLabel.stringValue		= NSLocalizedString(@"RecvDlg.AttachSheet.Finish", nil);
 		self.attachSheetFileNameLabel.stringValue	= @"";
-		self.dlSheetRefreshFlags = _AttachSheetRefreshFileNum
-									| _AttachSheetRefreshDirNum
-									| _AttachSheetRefreshTotalSize
-									| _AttachSheetRefreshDownloadSize;
+		[self addDownloadSheetRefreshFlags:_AttachSheetRefreshFileNum
+											| _AttachSheetRefreshDirNum
+											| _AttachSheetRefreshTotalSize
+											| _AttachSheetRefreshDownloadSize];
 		[self downloadSheetRefresh:nil];
 	});
 	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 500 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
@@ -718,32 +804,32 @@ typedef NSMutableArray<NSImage*>	_IconList;
 
 - (void)downloadFileChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshFileName;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshFileName];
 }
 
 - (void)downloadNumberOfFileChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshFileNum;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshFileNum];
 }
 
 - (void)downloadNumberOfDirectoryChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshDirNum;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshDirNum];
 }
 
 - (void)downloadIndexOfTargetChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshTitle;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshTitle];
 }
 
 - (void)downloadTotalSizeChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshTotalSize;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshTotalSize];
 }
 
 - (void)downloadDownloadedSizeChanged
 {
-	self.dlSheetRefreshFlags |= _AttachSheetRefreshDownloadSize;
+	[self addDownloadSheetRefreshFlags:_AttachSheetRefreshDownloadSize];
 }
 
 /*----------------------------------------------------------------------------*/
@@ -863,6 +949,10 @@ typedef NSMutableArray<NSImage*>	_IconList;
 // ウィンドウクローズ時処理
 - (void)windowWillClose:(NSNotification*)aNotification
 {
+	if (self.clipAttachments.count > 0) {
+		// 読み込み中の埋め込みクリップボードは中断
+		[MessageCenter.sharedCenter stopDownload:self.recvMsg.clipboardDownload];
+	}
 	if (self.recvMsg.attachments.count > 0) {
 		// 添付ファイルが残っている場合破棄通知
 		[MessageCenter.sharedCenter sendReleaseAttachmentMessage:self.recvMsg];
@@ -19,6 +19,7 @@ typedef NS_ENUM(NSInteger, AttachmentType)
 	ATTACH_TYPE_DIRECTORY,			// ディレクトリ
 	ATTACH_TYPE_RET_PARENT,			// 親ディレクトリ移動（ディレクトリダウンロード時）
 	ATTACH_TYPE_CLIPBOARD,			// 埋め込みクリップボード
+	ATTACH_TYPE_MESSAGE_BODY,		// メッセージ本文（長文のTCP受け渡し）
 	_ATTACH_TYPE_UNKNOWN			// その他
 };
 
@@ -40,6 +41,9 @@ typedef NS_ENUM(NSInteger, AttachmentType)
 @property(assign)	OSType			hfsFileType;		// HFSファイルタイプ
 @property(assign)	OSType			hfsCreator;			// HFSクリエータ
 @property(assign)	short			permission;			// POXISパーミッション
+@property(retain)	NSData*			streamKey;			// 転送暗号鍵（暗号化転送対応時のみ）
+@property(assign)	UInt64			contentSize;		// フォルダ配下のファイルサイズ合計（通知がない場合0）
+@property(assign)	NSUInteger		contentFiles;		// フォルダ配下のファイル数（通知がない場合0）
 
 - (BOOL)openHandle;
 - (BOOL)writeData:(void*)data length:(size_t)len;
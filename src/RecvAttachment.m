@@ -36,6 +36,7 @@
 	[_name release];
 	[_createTime release];
 	[_modifyTime release];
+	[_streamKey release];
 	[super dealloc];
 }
 
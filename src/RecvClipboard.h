@@ -9,17 +9,35 @@
 #import <Cocoa/Cocoa.h>
 #import "RecvAttachment.h"
 
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 受信可能な画像データサイズ上限（超過するものはダウンロードしない）
+#define IPMSG_CLIPBOARD_MAX_SIZE	(32 * 1024 * 1024)
+
+/*============================================================================*
+ * Notification 通知キー
+ *============================================================================*/
+
+/// 埋め込み画像読み込み完了通知（失敗時も通知。objectは対象RecvClipboard）
+extern NSString* const kIPMsgClipboardLoadedNotification;
+
 /*============================================================================*
  * クラス定義
  *============================================================================*/
 
 @interface RecvClipboard : RecvAttachment
 
-@property(readonly)	NSImage*	image;				// 埋め込み画像
+@property(readonly)	NSImage*	image;				// 埋め込み画像（読み込み前／失敗時はnil）
 @property(assign)	NSInteger	clipboardPos;		// 埋め込み位置
+@property(readonly)	BOOL		completed;			// 読み込み完了（失敗含む）
 
 - (BOOL)openHandle;
 - (BOOL)writeData:(void*)data length:(size_t)len;
 - (void)closeHandle;
 
+// 読み込み完了（未完了の場合は失敗として完了させ、メインスレッドに通知）
+- (void)complete;
+
 @end
@@ -14,6 +14,13 @@
 #import "NSString+IPMessenger.h"
 #import "DebugLog.h"
 
+/*============================================================================*
+ * Notification キー
+ *============================================================================*/
+
+// 埋め込み画像読み込み完了
+NSString* const kIPMsgClipboardLoadedNotification = @"IPMsgClipboardLoaded";
+
 /*============================================================================*
  * プライベートメソッド定義
  *============================================================================*/
@@ -22,6 +29,7 @@
 
 @property(retain)	NSImage*		image;
 @property(retain)	NSMutableData*	handle;
+@property(assign)	BOOL			completed;
 
 @end
 
@@ -50,6 +58,10 @@
 // 書き込み用に開く
 - (BOOL)openHandle
 {
+	if (self.size > IPMSG_CLIPBOARD_MAX_SIZE) {
+		ERR(@"Image too large(size=%zd,max=%d)", self.size, IPMSG_CLIPBOARD_MAX_SIZE);
+		return NO;
+	}
 	self.handle = [NSMutableData dataWithCapacity:self.size];
 	if (!self.handle) {
 		ERR(@"Buffer create error(size=%zd)", self.size);
@@ -76,11 +88,42 @@
 		ERR(@"Buffer handle not created.");
 		return;
 	}
-	self.image = [[[NSImage alloc] initWithData:self.handle] autorelease];
-	if (!self.image) {
+	if (self.handle.length != self.size) {
+		// 受信途中で中断
+		WRN(@"Image data incomplete(%lu/%zd,%@)", self.handle.length, self.size, self.name);
+		self.handle = nil;
+		return;
+	}
+	NSImage* image = [[[NSImage alloc] initWithData:self.handle] autorelease];
+	if (image) {
+		// 表示時（メインスレッド）ではなくここでデコードさせておく
+		for (NSImageRep* rep in image.representations) {
+			if ([rep isKindOfClass:NSBitmapImageRep.class]) {
+				[(NSBitmapImageRep*)rep bitmapData];
+			}
+		}
+	} else {
 		ERR(@"Image Convert error.(%@)", self.name);
 	}
-	self.handle = nil;
+	self.image	= image;
+	self.handle	= nil;
+	[self complete];
+}
+
+// 読み込み完了
+- (void)complete
+{
+	@synchronized(self) {
+		if (self.completed) {
+			return;
+		}
+		self.completed = YES;
+	}
+	TRC(@"clipboard completed(%@,image=%s)", self.name, BOOLSTR(self.image != nil));
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[NSNotificationCenter.defaultCenter postNotificationName:kIPMsgClipboardLoadedNotification
+														  object:self];
+	});
 }
 
 /*----------------------------------------------------------------------------*
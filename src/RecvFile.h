@@ -19,6 +19,8 @@
 
 - (BOOL)openHandle;
 - (BOOL)writeData:(void*)data length:(size_t)len;
+- (BOOL)preallocate;															// 全体サイズ分の領域確保（並列受信時。openHandle後に呼ぶ）
+- (BOOL)writeData:(const void*)data length:(size_t)len atOffset:(UInt64)offset;	// 位置指定書き込み（複数スレッドから同時に呼べる）
 - (void)closeHandle;
 
 @end
@@ -11,6 +11,8 @@
 //	#define IPMSG_LOG_TRC	0
 
 #import "RecvFile.h"
+#import <fcntl.h>
+#import <unistd.h>
 #import "NSString+IPMessenger.h"
 #import "DebugLog.h"
 
@@ -145,6 +147,54 @@
 	return NO;
 }
 
+// 全体サイズ分の領域確保
+- (BOOL)preallocate
+{
+	if (!self.handle) {
+		ERR(@"handle not opend.");
+		return NO;
+	}
+	int			fd		= self.handle.fileDescriptor;
+	fstore_t	store	= { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)self.size, 0 };
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+		// 連続領域が取れなければ断片化を許して確保
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+			WRN(@"preallocate error(%@,%s)", self.path, strerror(errno));
+		}
+	}
+	if (ftruncate(fd, (off_t)self.size) != 0) {
+		ERR(@"truncate error(%@,%s)", self.path, strerror(errno));
+		return NO;
+	}
+	return YES;
+}
+
+// 位置指定書き込み
+- (BOOL)writeData:(const void*)data length:(size_t)len atOffset:(UInt64)offset
+{
+	if (!self.handle) {
+		ERR(@"handle not opend.");
+		return NO;
+	}
+	int			fd	= self.handle.fileDescriptor;
+	const char*	ptr	= data;
+	while (len > 0) {
+		ssize_t ret = pwrite(fd, ptr, len, (off_t)offset);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERR(@"write error(%@,offset=%llu,%s)", self.path, offset, strerror(errno));
+			return NO;
+		}
+		ptr		+= ret;
+		len		-= (size_t)ret;
+		offset	+= (UInt64)ret;
+	}
+	return YES;
+}
+
 // ファイルクローズ
 - (void)closeHandle
 {
@@ -11,6 +11,8 @@
 @class UserInfo;
 @class RecvFile;
 @class RecvClipboard;
+@class RecvMessageBody;
+@protocol DownloaderContext;
 
 /*============================================================================*
  * クラス定義
@@ -31,6 +33,8 @@
 @property(assign)	BOOL						absence;		// 不在モード中
 @property(retain)	NSArray<RecvFile*>*			attachments;	// 添付ファイル
 @property(retain)	NSArray<RecvClipboard*>*	clipboards;		// 埋め込みクリップボード
+@property(retain)	id<DownloaderContext>		clipboardDownload;	// 埋め込みクリップボード受信状況
+@property(retain)	RecvMessageBody*			messageBody;	// TCP受け渡し本文
 @property(assign)	BOOL						needLog;		// ログ保存要否
 
 // その他
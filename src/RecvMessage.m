@@ -25,6 +25,8 @@
 	[_fromUser release];
 	[_attachments release];
 	[_clipboards release];
+	[_clipboardDownload release];
+	[_messageBody release];
 	[_message release];
 	[super dealloc];
 }
@@ -0,0 +1,31 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RecvMessageBody.h
+ *	Module		: 受信メッセージ本文（TCP受け渡し）オブジェクトクラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+#import "RecvAttachment.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 受信可能な本文サイズ上限
+#define IPMSG_MESSAGE_BODY_MAX_SIZE	(16 * 1024 * 1024)
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+@interface RecvMessageBody : RecvAttachment
+
+@property(readonly)	NSString*	message;			// 受信本文（受信完了前／失敗時はnil）
+
+- (BOOL)openHandle;
+- (BOOL)writeData:(void*)data length:(size_t)len;
+- (void)closeHandle;
+
+@end
@@ -0,0 +1,100 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RecvMessageBody.m
+ *	Module		: 受信メッセージ本文（TCP受け渡し）オブジェクトクラス
+ *============================================================================*/
+
+#import "RecvMessageBody.h"
+#import "NSString+IPMessenger.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * プライベートメソッド定義
+ *============================================================================*/
+
+@interface RecvMessageBody()
+
+@property(copy)		NSString*		message;
+@property(retain)	NSMutableData*	handle;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation RecvMessageBody
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 解放
+- (void)dealloc
+{
+	[_message release];
+	[_handle release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * ファイル入出力関連
+ *----------------------------------------------------------------------------*/
+
+// 書き込み用に開く
+- (BOOL)openHandle
+{
+	if (self.size > IPMSG_MESSAGE_BODY_MAX_SIZE) {
+		ERR(@"Message body too large(size=%zd,max=%d)", self.size, IPMSG_MESSAGE_BODY_MAX_SIZE);
+		return NO;
+	}
+	self.handle = [NSMutableData dataWithCapacity:self.size];
+	if (!self.handle) {
+		ERR(@"Buffer create error(size=%zd)", self.size);
+		return NO;
+	}
+	return YES;
+}
+
+// 書き込み
+- (BOOL)writeData:(void*)data length:(size_t)len
+{
+	if (!self.handle) {
+		ERR(@"Buffer handle not created.");
+		return NO;
+	}
+	[self.handle appendBytes:data length:len];
+	return YES;
+}
+
+// クローズ（本文はUTF-8で受け渡す）
+- (void)closeHandle
+{
+	if (!self.handle) {
+		ERR(@"Buffer handle not created.");
+		return;
+	}
+	if (self.handle.length == self.size) {
+		self.message = [NSString stringWithData:self.handle utf8Encoded:YES];
+		if (!self.message) {
+			ERR(@"Message body convert error(%zd bytes)", self.size);
+		}
+	} else {
+		WRN(@"Message body incomplete(%lu/%zd)", self.handle.length, self.size);
+	}
+	self.handle = nil;
+}
+
+/*----------------------------------------------------------------------------*
+ * その他
+ *----------------------------------------------------------------------------*/
+
+// オブジェクト概要
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"RecvMessageBody[FileID:%ld,Size:%zd]", self.fileID, self.size];
+}
+
+@end
@@ -0,0 +1,30 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RefuseMatcher.h
+ *	Module		: 通知拒否条件判定クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+@class UserInfo;
+@class RefuseInfo;
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 通知拒否条件一覧を判定対象毎の検索構造に変換したもの（構築後は不変）
+@interface RefuseMatcher : NSObject
+
+// ファクトリ
++ (instancetype)matcherWithRefuseList:(NSArray<RefuseInfo*>*)list;
+
+// 初期化
+- (instancetype)initWithRefuseList:(NSArray<RefuseInfo*>*)list;
+
+// 判定
+- (BOOL)match:(UserInfo*)user;
+
+@end
@@ -0,0 +1,339 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RefuseMatcher.m
+ *	Module		: 通知拒否条件判定クラス
+ *============================================================================*/
+
+#import "RefuseMatcher.h"
+#import "RefuseInfo.h"
+#import "UserInfo.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _TARGET_NUM		(IP_REFUSE_ADDRESS + 1)		// 判定対象数
+#define _STACK_CHARS	128							// 判定文字列のスタック展開上限
+
+// トライ木ノード（0番がルート）
+typedef struct {
+	unichar		ch;			// 遷移文字
+	BOOL		output;		// パターン終端（Aho-Corasickでは失敗遷移先の終端も含む）
+	uint32_t	child;		// 先頭子ノード（0:なし）
+	uint32_t	next;		// 次兄弟ノード（0:なし）
+	uint32_t	fail;		// 失敗遷移先（Aho-Corasick用）
+} _TrieNode;
+
+// 子ノード検索
+static inline uint32_t _TrieChild(const _TrieNode* nodes, uint32_t node, unichar c)
+{
+	for (uint32_t n = nodes[node].child; n != 0; n = nodes[n].next) {
+		if (nodes[n].ch == c) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+/*============================================================================*
+ * トライ木クラス
+ *============================================================================*/
+
+@interface RefuseTrie : NSObject
+
+@property(retain)	NSMutableData*	nodes;		// _TrieNode配列
+
+- (void)addPattern:(NSString*)pattern reverse:(BOOL)reverse;
+- (void)buildFailureLinks;
+- (BOOL)matchPrefix:(const unichar*)chars length:(NSUInteger)len;
+- (BOOL)matchSuffix:(const unichar*)chars length:(NSUInteger)len;
+- (BOOL)matchContain:(const unichar*)chars length:(NSUInteger)len;
+
+@end
+
+@implementation RefuseTrie
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		// ルートノード
+		_nodes = [[NSMutableData alloc] initWithLength:sizeof(_TrieNode)];
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_nodes release];
+	[super dealloc];
+}
+
+// パターン追加（reverse指定時は末尾から登録）
+- (void)addPattern:(NSString*)pattern reverse:(BOOL)reverse
+{
+	NSUInteger	len		= pattern.length;
+	uint32_t	node	= 0;
+	for (NSUInteger i = 0; i < len; i++) {
+		unichar		c		= [pattern characterAtIndex:(reverse ? (len - 1 - i) : i)];
+		_TrieNode*	nodes	= self.nodes.mutableBytes;
+		uint32_t	child	= _TrieChild(nodes, node, c);
+		if (child == 0) {
+			_TrieNode newNode = { c, NO, 0, nodes[node].child, 0 };
+			child = (uint32_t)(self.nodes.length / sizeof(_TrieNode));
+			nodes[node].child = child;
+			[self.nodes appendBytes:&newNode length:sizeof(newNode)];
+		}
+		node = child;
+	}
+	((_TrieNode*)self.nodes.mutableBytes)[node].output = YES;
+}
+
+// 失敗遷移構築（Aho-Corasick）
+- (void)buildFailureLinks
+{
+	_TrieNode*	nodes	= self.nodes.mutableBytes;
+	NSUInteger	count	= self.nodes.length / sizeof(_TrieNode);
+	uint32_t*	queue	= malloc(sizeof(uint32_t) * count);
+	NSUInteger	head	= 0;
+	NSUInteger	tail	= 0;
+	if (!queue) {
+		ERR(@"malloc error(%lu)", count);
+		return;
+	}
+	for (uint32_t c = nodes[0].child; c != 0; c = nodes[c].next) {
+		nodes[c].fail	= 0;
+		queue[tail++]	= c;
+	}
+	while (head < tail) {
+		uint32_t n = queue[head++];
+		for (uint32_t c = nodes[n].child; c != 0; c = nodes[c].next) {
+			uint32_t f = nodes[n].fail;
+			uint32_t t = _TrieChild(nodes, f, nodes[c].ch);
+			while ((t == 0) && (f != 0)) {
+				f = nodes[f].fail;
+				t = _TrieChild(nodes, f, nodes[c].ch);
+			}
+			nodes[c].fail	= t;
+			nodes[c].output	|= nodes[t].output;
+			queue[tail++]	= c;
+		}
+	}
+	free(queue);
+}
+
+// 前方一致
+- (BOOL)matchPrefix:(const unichar*)chars length:(NSUInteger)len
+{
+	const _TrieNode*	nodes	= self.nodes.bytes;
+	uint32_t			node	= 0;
+	if (nodes[0].output) {
+		return YES;
+	}
+	for (NSUInteger i = 0; i < len; i++) {
+		node = _TrieChild(nodes, node, chars[i]);
+		if (node == 0) {
+			return NO;
+		}
+		if (nodes[node].output) {
+			return YES;
+		}
+	}
+	return NO;
+}
+
+// 後方一致（逆順登録したトライ木を末尾から辿る）
+- (BOOL)matchSuffix:(const unichar*)chars length:(NSUInteger)len
+{
+	const _TrieNode*	nodes	= self.nodes.bytes;
+	uint32_t			node	= 0;
+	if (nodes[0].output) {
+		return YES;
+	}
+	for (NSUInteger i = len; i > 0; i--) {
+		node = _TrieChild(nodes, node, chars[i - 1]);
+		if (node == 0) {
+			return NO;
+		}
+		if (nodes[node].output) {
+			return YES;
+		}
+	}
+	return NO;
+}
+
+// 部分一致
+- (BOOL)matchContain:(const unichar*)chars length:(NSUInteger)len
+{
+	const _TrieNode*	nodes	= self.nodes.bytes;
+	uint32_t			state	= 0;
+	for (NSUInteger i = 0; i < len; i++) {
+		uint32_t next = _TrieChild(nodes, state, chars[i]);
+		while ((next == 0) && (state != 0)) {
+			state	= nodes[state].fail;
+			next	= _TrieChild(nodes, state, chars[i]);
+		}
+		state = next;
+		if (nodes[state].output) {
+			return YES;
+		}
+	}
+	return NO;
+}
+
+@end
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface RefuseMatcher()
+{
+	NSMutableSet<NSString*>*	exact[_TARGET_NUM];		// 一致
+	RefuseTrie*					prefix[_TARGET_NUM];	// 始まる
+	RefuseTrie*					suffix[_TARGET_NUM];	// 終わる
+	RefuseTrie*					contain[_TARGET_NUM];	// 含む
+}
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation RefuseMatcher
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)matcherWithRefuseList:(NSArray<RefuseInfo*>*)list
+{
+	return [[[RefuseMatcher alloc] initWithRefuseList:list] autorelease];
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithRefuseList:(NSArray<RefuseInfo*>*)list
+{
+	self = [super init];
+	if (self) {
+		for (RefuseInfo* info in list) {
+			NSInteger t = info.target;
+			if ((t < 0) || (t >= _TARGET_NUM) || !info.string) {
+				WRN(@"invalid refuse info(%@)", info);
+				continue;
+			}
+			switch (info.condition) {
+			case IP_REFUSE_MATCH:
+				if (!exact[t]) {
+					exact[t] = [[NSMutableSet alloc] init];
+				}
+				[exact[t] addObject:info.string];
+				break;
+			case IP_REFUSE_CONTAIN:
+				if (info.string.length == 0) {
+					// 空文字列は従来判定（rangeOfString:）でも一致しない
+					break;
+				}
+				if (!contain[t]) {
+					contain[t] = [[RefuseTrie alloc] init];
+				}
+				[contain[t] addPattern:info.string reverse:NO];
+				break;
+			case IP_REFUSE_START:
+				if (!prefix[t]) {
+					prefix[t] = [[RefuseTrie alloc] init];
+				}
+				[prefix[t] addPattern:info.string reverse:NO];
+				break;
+			case IP_REFUSE_END:
+				if (!suffix[t]) {
+					suffix[t] = [[RefuseTrie alloc] init];
+				}
+				[suffix[t] addPattern:info.string reverse:YES];
+				break;
+			default:
+				WRN(@"invalid refuse condition(%ld)", info.condition);
+				break;
+			}
+		}
+		for (NSInteger t = 0; t < _TARGET_NUM; t++) {
+			[contain[t] buildFailureLinks];
+		}
+		TRC(@"RefuseMatcher compiled(%lu rules)", list.count);
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	for (NSInteger t = 0; t < _TARGET_NUM; t++) {
+		[exact[t] release];
+		[prefix[t] release];
+		[suffix[t] release];
+		[contain[t] release];
+	}
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 判定
+ *----------------------------------------------------------------------------*/
+
+- (BOOL)match:(UserInfo*)user
+{
+	for (NSInteger t = 0; t < _TARGET_NUM; t++) {
+		if (!exact[t] && !prefix[t] && !suffix[t] && !contain[t]) {
+			continue;
+		}
+		NSString* targetStr = nil;
+		switch (t) {
+		case IP_REFUSE_USER:	targetStr = user.userName;		break;
+		case IP_REFUSE_GROUP:	targetStr = user.groupName;		break;
+		case IP_REFUSE_MACHINE:	targetStr = user.hostName;		break;
+		case IP_REFUSE_LOGON:	targetStr = user.logOnName;		break;
+		case IP_REFUSE_ADDRESS:	targetStr = user.ipAddress;		break;
+		default:												break;
+		}
+		if (!targetStr) {
+			continue;
+		}
+		if ([exact[t] containsObject:targetStr]) {
+			return YES;
+		}
+		if (!prefix[t] && !suffix[t] && !contain[t]) {
+			continue;
+		}
+		// 文字列を一度だけUTF-16展開して各トライ木で共用
+		NSUInteger	len		= targetStr.length;
+		unichar		stackBuf[_STACK_CHARS];
+		unichar*	chars	= (len <= _STACK_CHARS) ? stackBuf : malloc(sizeof(unichar) * len);
+		if (!chars) {
+			ERR(@"malloc error(%lu)", len);
+			continue;
+		}
+		[targetStr getCharacters:chars range:NSMakeRange(0, len)];
+		BOOL hit = ([prefix[t] matchPrefix:chars length:len] ||
+					[suffix[t] matchSuffix:chars length:len] ||
+					[contain[t] matchContain:chars length:len]);
+		if (chars != stackBuf) {
+			free(chars);
+		}
+		if (hit) {
+			return YES;
+		}
+	}
+	return NO;
+}
+
+@end
@@ -0,0 +1,79 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RuntimeMetrics.h
+ *	Module		: 動作統計収集／出力クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+// 累積カウンタ
+typedef NS_ENUM(NSInteger, MetricsCounter)
+{
+	METRICS_PARSE_ERROR = 0,		// 受信パケット解析エラー
+	METRICS_DECRYPT_FAILURE,		// 復号失敗
+	METRICS_SEND_RETRY,				// メッセージ再送
+	METRICS_ATTACH_BYTES_SENT,		// 添付送信バイト数
+	METRICS_ATTACH_BYTES_RECEIVED,	// 添付受信バイト数
+	METRICS_BROADCAST_SENT,			// 一括送信：ブロードキャスト
+	METRICS_MULTICAST_SENT,			// 一括送信：マルチキャスト
+	METRICS_DIRECTED_SENT,			// 一括送信：個別宛先（個別指定アドレス・ダイアルアップ）
+	METRICS_BROADCAST_RECEIVED,		// ブロードキャスト受信
+	METRICS_MULTICAST_RECEIVED,		// マルチキャスト受信
+	METRICS_COUNTER_MAX
+};
+
+// 現在値
+typedef NS_ENUM(NSInteger, MetricsGauge)
+{
+	METRICS_SEND_LIST_SIZE = 0,		// 応答待ちメッセージ数
+	METRICS_ATTACH_LIST_SIZE,		// 送信添付ファイル数
+	METRICS_USER_COUNT,				// ユーザ数
+	METRICS_TCP_CONNECTIONS,		// 添付送信接続数
+	METRICS_DOWNLOADS,				// ダウンロード中数
+	METRICS_GAUGE_MAX
+};
+
+// 所要時間分布
+typedef NS_ENUM(NSInteger, MetricsHistogram)
+{
+	METRICS_DOWNLOAD_DURATION = 0,	// ダウンロード所要時間
+	METRICS_UPLOAD_DURATION,		// 添付送信所要時間
+	METRICS_HISTOGRAM_MAX
+};
+
+/*============================================================================*
+ * 関数定義（ロックを取らないので任意のスレッドから呼んでよい）
+ *============================================================================*/
+
+void MetricsCountPacket(BOOL received, UInt32 command);
+void MetricsIncrement(MetricsCounter counter, UInt64 value);
+void MetricsGaugeSet(MetricsGauge gauge, SInt64 value);
+void MetricsGaugeAdd(MetricsGauge gauge, SInt64 delta);
+void MetricsObserve(MetricsHistogram histogram, NSTimeInterval seconds);
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 統計をローカルソケット（Unixドメイン）にテキスト形式で出力する
+@interface RuntimeMetrics : NSObject
+
+@property(readonly)	NSString*	socketPath;		// 出力ソケットパス
+
+// 共有インスタンス
++ (instancetype)sharedMetrics;
+
+// 出力ソケット開始／停止
+- (BOOL)startExporter;
+- (void)stopExporter;
+
+// 現在の統計（Prometheusテキスト形式）
+- (NSString*)exportText;
+
+@end
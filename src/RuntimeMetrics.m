@@ -0,0 +1,332 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: RuntimeMetrics.m
+ *	Module		: 動作統計収集／出力クラス
+ *============================================================================*/
+
+#import "RuntimeMetrics.h"
+#import "DebugLog.h"
+
+#import <stdatomic.h>
+#import <sys/socket.h>
+#import <sys/stat.h>
+#import <sys/un.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _SOCKET_NAME	@"ipmsg-metrics.sock"	// 出力ソケット名（一時ディレクトリ内）
+#define _COMMAND_MAX	(256)					// コマンド種別数（GET_MODE）
+
+// ヒストグラム区間上限（秒）
+static const double _Buckets[] = { 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300 };
+#define _BUCKET_COUNT	(sizeof(_Buckets) / sizeof(_Buckets[0]))
+
+// 出力名
+static const char* const _CounterNames[METRICS_COUNTER_MAX][2] = {
+	{ "ipmsg_parse_errors_total",			"Received packets rejected by the parser" },
+	{ "ipmsg_decrypt_failures_total",		"Decryption failures" },
+	{ "ipmsg_send_retries_total",			"Message resends after missing RECVMSG" },
+	{ "ipmsg_attach_sent_bytes_total",		"Attachment bytes sent" },
+	{ "ipmsg_attach_received_bytes_total",	"Attachment bytes received" },
+	{ "ipmsg_broadcast_sent_total",			"Discovery packets sent by broadcast" },
+	{ "ipmsg_multicast_sent_total",			"Discovery packets sent by multicast" },
+	{ "ipmsg_directed_sent_total",			"Discovery packets sent to individual addresses" },
+	{ "ipmsg_broadcast_received_total",		"Packets received by broadcast" },
+	{ "ipmsg_multicast_received_total",		"Packets received by multicast" },
+};
+static const char* const _GaugeNames[METRICS_GAUGE_MAX][2] = {
+	{ "ipmsg_send_list_size",				"Messages waiting for RECVMSG" },
+	{ "ipmsg_attach_list_size",				"Attachments offered to peers" },
+	{ "ipmsg_users",						"Known users" },
+	{ "ipmsg_tcp_connections",				"Active attachment upload connections" },
+	{ "ipmsg_downloads",					"Active attachment downloads" },
+};
+static const char* const _HistogramNames[METRICS_HISTOGRAM_MAX][2] = {
+	{ "ipmsg_download_duration_seconds",	"Attachment download duration" },
+	{ "ipmsg_upload_duration_seconds",		"Attachment upload duration" },
+};
+
+/*============================================================================*
+ * 統計領域（すべてatomic、relaxedで更新）
+ *============================================================================*/
+
+typedef struct {
+	_Atomic(UInt64)	buckets[_BUCKET_COUNT + 1];	// 区間毎件数（末尾は+Inf）
+	_Atomic(UInt64)	count;						// 件数
+	_Atomic(UInt64)	sumMicros;					// 合計（マイクロ秒）
+} _Histogram;
+
+static _Atomic(UInt64)	_Packets[2][_COMMAND_MAX];		// [0]送信/[1]受信
+static _Atomic(UInt64)	_Counters[METRICS_COUNTER_MAX];
+static _Atomic(SInt64)	_Gauges[METRICS_GAUGE_MAX];
+static _Histogram		_Histograms[METRICS_HISTOGRAM_MAX];
+
+/*============================================================================*
+ * 記録関数
+ *============================================================================*/
+
+void MetricsCountPacket(BOOL received, UInt32 command)
+{
+	atomic_fetch_add_explicit(&_Packets[received ? 1 : 0][command & 0xFF], 1, memory_order_relaxed);
+}
+
+void MetricsIncrement(MetricsCounter counter, UInt64 value)
+{
+	if ((counter >= 0) && (counter < METRICS_COUNTER_MAX)) {
+		atomic_fetch_add_explicit(&_Counters[counter], value, memory_order_relaxed);
+	}
+}
+
+void MetricsGaugeSet(MetricsGauge gauge, SInt64 value)
+{
+	if ((gauge >= 0) && (gauge < METRICS_GAUGE_MAX)) {
+		atomic_store_explicit(&_Gauges[gauge], value, memory_order_relaxed);
+	}
+}
+
+void MetricsGaugeAdd(MetricsGauge gauge, SInt64 delta)
+{
+	if ((gauge >= 0) && (gauge < METRICS_GAUGE_MAX)) {
+		atomic_fetch_add_explicit(&_Gauges[gauge], delta, memory_order_relaxed);
+	}
+}
+
+void MetricsObserve(MetricsHistogram histogram, NSTimeInterval seconds)
+{
+	if ((histogram < 0) || (histogram >= METRICS_HISTOGRAM_MAX)) {
+		return;
+	}
+	_Histogram*	h		= &_Histograms[histogram];
+	size_t		index	= 0;
+	while ((index < _BUCKET_COUNT) && (seconds > _Buckets[index])) {
+		index++;
+	}
+	atomic_fetch_add_explicit(&h->buckets[index], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sumMicros, (UInt64)(MAX(seconds, 0) * 1000000.0), memory_order_relaxed);
+}
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface RuntimeMetrics()
+{
+	dispatch_queue_t	queue;		// 出力処理キュー
+	dispatch_source_t	source;		// 接続待ちソース
+}
+
+@property(copy)		NSString*	socketPath;
+@property(assign)	int			listenSocket;	// 待ち受けソケット
+
+- (void)acceptConnection;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation RuntimeMetrics
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)sharedMetrics
+{
+	static RuntimeMetrics*	sharedMetrics = nil;
+	static dispatch_once_t	once;
+
+	dispatch_once(&once, ^{
+		sharedMetrics = [[RuntimeMetrics alloc] init];
+	});
+
+	return sharedMetrics;
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		_socketPath		= [[NSTemporaryDirectory() stringByAppendingPathComponent:_SOCKET_NAME] copy];
+		_listenSocket	= -1;
+		queue			= dispatch_queue_create("jp.ishwt.ipmsg.metrics", DISPATCH_QUEUE_SERIAL);
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[self stopExporter];
+	[_socketPath release];
+	dispatch_release(queue);
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 出力ソケット
+ *----------------------------------------------------------------------------*/
+
+// 出力開始
+- (BOOL)startExporter
+{
+	if (source) {
+		return YES;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlcpy(addr.sun_path, self.socketPath.fileSystemRepresentation, sizeof(addr.sun_path)) >= sizeof(addr.sun_path)) {
+		ERR(@"metrics socket path too long(%@)", self.socketPath);
+		return NO;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		ERR(@"metrics socket error(%s)", strerror(errno));
+		return NO;
+	}
+	// 前回起動時の残骸を削除
+	unlink(addr.sun_path);
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		ERR(@"metrics bind error(%@,%s)", self.socketPath, strerror(errno));
+		close(sock);
+		return NO;
+	}
+	chmod(addr.sun_path, S_IRUSR | S_IWUSR);
+	if (listen(sock, 4) != 0) {
+		ERR(@"metrics listen error(%s)", strerror(errno));
+		close(sock);
+		unlink(addr.sun_path);
+		return NO;
+	}
+	self.listenSocket = sock;
+
+	__weak typeof(self) weakSelf = self;
+	source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)sock, 0, queue);
+	dispatch_source_set_event_handler(source, ^{
+		[weakSelf acceptConnection];
+	});
+	dispatch_source_set_cancel_handler(source, ^{
+		close(sock);
+	});
+	dispatch_resume(source);
+	DBG(@"metrics exporter started(%@)", self.socketPath);
+	return YES;
+}
+
+// 出力停止
+- (void)stopExporter
+{
+	if (!source) {
+		return;
+	}
+	dispatch_source_cancel(source);
+	dispatch_release(source);
+	source				= NULL;
+	self.listenSocket	= -1;
+	unlink(self.socketPath.fileSystemRepresentation);
+	DBG(@"metrics exporter stopped");
+}
+
+/*----------------------------------------------------------------------------*
+ * 出力内容
+ *----------------------------------------------------------------------------*/
+
+- (NSString*)exportText
+{
+	NSMutableString* text = [NSMutableString stringWithCapacity:4096];
+
+	// パケット数（コマンド毎、0件は省略）
+	[text appendString:@"# HELP ipmsg_packets_total UDP packets by command\n"];
+	[text appendString:@"# TYPE ipmsg_packets_total counter\n"];
+	for (int dir = 0; dir < 2; dir++) {
+		for (int cmd = 0; cmd < _COMMAND_MAX; cmd++) {
+			UInt64 val = atomic_load_explicit(&_Packets[dir][cmd], memory_order_relaxed);
+			if (val > 0) {
+				[text appendFormat:@"ipmsg_packets_total{direction=\"%s\",command=\"0x%02x\"} %llu\n",
+									(dir ? "rx" : "tx"), cmd, val];
+			}
+		}
+	}
+
+	// カウンタ
+	for (int i = 0; i < METRICS_COUNTER_MAX; i++) {
+		[text appendFormat:@"# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+							_CounterNames[i][0], _CounterNames[i][1], _CounterNames[i][0],
+							_CounterNames[i][0], atomic_load_explicit(&_Counters[i], memory_order_relaxed)];
+	}
+
+	// ゲージ
+	for (int i = 0; i < METRICS_GAUGE_MAX; i++) {
+		[text appendFormat:@"# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+							_GaugeNames[i][0], _GaugeNames[i][1], _GaugeNames[i][0],
+							_GaugeNames[i][0], atomic_load_explicit(&_Gauges[i], memory_order_relaxed)];
+	}
+
+	// ヒストグラム（区間は累積件数で出力）
+	for (int i = 0; i < METRICS_HISTOGRAM_MAX; i++) {
+		_Histogram*	h		= &_Histograms[i];
+		const char*	name	= _HistogramNames[i][0];
+		UInt64		total	= 0;
+		[text appendFormat:@"# HELP %s %s\n# TYPE %s histogram\n", name, _HistogramNames[i][1], name];
+		for (size_t b = 0; b <= _BUCKET_COUNT; b++) {
+			total += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+			if (b < _BUCKET_COUNT) {
+				[text appendFormat:@"%s_bucket{le=\"%g\"} %llu\n", name, _Buckets[b], total];
+			} else {
+				[text appendFormat:@"%s_bucket{le=\"+Inf\"} %llu\n", name, total];
+			}
+		}
+		[text appendFormat:@"%s_sum %.6f\n%s_count %llu\n",
+							name, atomic_load_explicit(&h->sumMicros, memory_order_relaxed) / 1000000.0,
+							name, atomic_load_explicit(&h->count, memory_order_relaxed)];
+	}
+
+	return text;
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// 接続毎に現在の統計を書き出して切断
+- (void)acceptConnection
+{
+	int client = accept(self.listenSocket, NULL, NULL);
+	if (client < 0) {
+		WRN(@"metrics accept error(%s)", strerror(errno));
+		return;
+	}
+	int on = 1;
+	setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	@autoreleasepool {
+		NSData*		data	= [self.exportText dataUsingEncoding:NSUTF8StringEncoding];
+		const char*	ptr		= data.bytes;
+		size_t		remain	= data.length;
+		while (remain > 0) {
+			ssize_t n = write(client, ptr, remain);
+			if (n <= 0) {
+				if ((n < 0) && (errno == EINTR)) {
+					continue;
+				}
+				break;
+			}
+			ptr		+= n;
+			remain	-= (size_t)n;
+		}
+	}
+	close(client);
+}
+
+@end
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 
 @class UserInfo;
+@class AttachmentManifest;
 
 /*============================================================================*
  * クラス定義
@@ -18,19 +19,34 @@
 
 @property(assign)	NSInteger			packetNo;		// パケット番号
 @property(assign)	NSInteger			fileID;			// ファイルID
-@property(readonly)	NSString*			path;			// ファイルパス
+@property(readonly)	NSString*			path;			// ファイルパス（メモリ上データの場合nil）
+@property(readonly)	NSData*				data;			// メモリ上データ（メッセージ本文等）
 @property(readonly)	NSString*			name;			// ファイル名
 @property(readonly)	NSArray<UserInfo*>*	remainUsers;	// 未ダウンロードユーザ
 @property(retain)	NSTimer*			trashTimer;		// 破棄タイマ
+@property(retain)	NSData*				streamKey;		// 転送暗号鍵（暗号化転送しない場合nil）
+@property(readonly)	AttachmentManifest*	manifest;		// フォルダ内容一覧（フォルダの場合のみ）
 
 // ファクトリ
 + (instancetype)attachmentWithPath:(NSString*)path;
++ (instancetype)attachmentWithData:(NSData*)data name:(NSString*)name;
 
 // 初期化
 - (instancetype)initWithPath:(NSString*)path;
+- (instancetype)initWithData:(NSData*)data name:(NSString*)name;
 
 // 送信ユーザ管理
 - (NSInteger)addUser:(UserInfo*)user;
 - (NSInteger)removeUser:(UserInfo*)user;
 
+// 転送暗号鍵渡し済みユーザ管理（渡した相手には平文で応答しない）
+- (void)addStreamKeyUser:(UserInfo*)user;
+- (BOOL)isStreamKeyIssuedTo:(UserInfo*)user;
+
+// 範囲送信記録（ユーザへの送信済み範囲がファイル全体を覆ったらYES）
+- (BOOL)addSentRange:(NSRange)range ofLength:(UInt64)length forUser:(UserInfo*)user;
+
+// 最後の範囲送信からの経過時間（範囲送信なしの場合DBL_MAX）
+- (NSTimeInterval)rangeIdleIntervalForUser:(UserInfo*)user;
+
 @end
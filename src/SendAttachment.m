@@ -8,6 +8,7 @@
 
 #import "SendAttachment.h"
 #import "UserInfo.h"
+#import "AttachmentManifest.h"
 #import "DebugLog.h"
 
 typedef NSMutableArray<UserInfo*>	_UserList;
@@ -15,6 +16,9 @@ typedef NSMutableArray<UserInfo*>	_UserList;
 @interface SendAttachment()
 
 @property(retain)	_UserList*	userList;
+@property(retain)	NSMapTable<UserInfo*, NSMutableIndexSet*>*	sentRanges;		// ユーザ毎送信済み範囲（範囲指定取得時）
+@property(retain)	NSMutableSet<UserInfo*>*	keyUsers;		// 転送暗号鍵渡し済みユーザ
+@property(retain)	NSMapTable<UserInfo*, NSDate*>*	rangeDates;	// ユーザ毎最終範囲送信時刻
 
 @end
 
@@ -33,6 +37,11 @@ typedef NSMutableArray<UserInfo*>	_UserList;
 	return [[[SendAttachment alloc] initWithPath:path] autorelease];
 }
 
++ (instancetype)attachmentWithData:(NSData*)data name:(NSString*)name
+{
+	return [[[SendAttachment alloc] initWithData:data name:name] autorelease];
+}
+
 /*----------------------------------------------------------------------------*
  * 初期化／解放
  *----------------------------------------------------------------------------*/
@@ -90,6 +99,23 @@ typedef NSMutableArray<UserInfo*>	_UserList;
 		_path		= [path copy];
 		_name		= [path.lastPathComponent.precomposedStringWithCanonicalMapping copy];;
 		_userList	= [[_UserList alloc] init];
+		if ([type isEqualToString:NSFileTypeDirectory]) {
+			// 配下の一覧は添付時点から作成しておき、各ユーザへの送信で共用する
+			_manifest = [[AttachmentManifest alloc] initWithPath:path];
+		}
+	}
+	return self;
+}
+
+// 初期化（メモリ上データ送信用）
+- (instancetype)initWithData:(NSData*)data name:(NSString*)name
+{
+	self = [super init];
+	if (self) {
+		_fileID		= NSNotFound;
+		_data		= [data copy];
+		_name		= [name copy];
+		_userList	= [[_UserList alloc] init];
 	}
 	return self;
 }
@@ -103,8 +129,15 @@ typedef NSMutableArray<UserInfo*>	_UserList;
 	}
 	[_trashTimer release];
 	[_userList release];
+	[_sentRanges release];
+	[_keyUsers release];
+	[_rangeDates release];
 	[_path release];
+	[_data release];
 	[_name release];
+	[_streamKey release];
+	[_manifest stop];
+	[_manifest release];
 	[super dealloc];
 }
 
@@ -140,10 +173,63 @@ typedef NSMutableArray<UserInfo*>	_UserList;
 {
 	@synchronized (self.userList) {
 		[self.userList removeObject:user];
+		[self.sentRanges removeObjectForKey:user];
+		[self.rangeDates removeObjectForKey:user];
 		return self.userList.count;
 	}
 }
 
+// 転送暗号鍵渡し済みユーザ追加
+- (void)addStreamKeyUser:(UserInfo*)user
+{
+	if (!self.streamKey) {
+		return;
+	}
+	@synchronized (self.userList) {
+		if (!self.keyUsers) {
+			self.keyUsers = [NSMutableSet<UserInfo*> set];
+		}
+		[self.keyUsers addObject:user];
+	}
+}
+
+// 転送暗号鍵渡し済みチェック
+- (BOOL)isStreamKeyIssuedTo:(UserInfo*)user
+{
+	@synchronized (self.userList) {
+		return [self.keyUsers containsObject:user];
+	}
+}
+
+// 範囲送信記録
+- (BOOL)addSentRange:(NSRange)range ofLength:(UInt64)length forUser:(UserInfo*)user
+{
+	@synchronized (self.userList) {
+		if (!self.sentRanges) {
+			self.sentRanges = [NSMapTable strongToStrongObjectsMapTable];
+			self.rangeDates = [NSMapTable strongToStrongObjectsMapTable];
+		}
+		[self.rangeDates setObject:[NSDate date] forKey:user];
+		NSMutableIndexSet* ranges = [self.sentRanges objectForKey:user];
+		if (!ranges) {
+			ranges = [NSMutableIndexSet indexSet];
+			[self.sentRanges setObject:ranges forKey:user];
+		}
+		// 再要求された範囲は重ねて数えない（バイト位置の集合として持つ）
+		[ranges addIndexesInRange:range];
+		return (ranges.count >= length);
+	}
+}
+
+// 最後の範囲送信からの経過時間
+- (NSTimeInterval)rangeIdleIntervalForUser:(UserInfo*)user
+{
+	@synchronized (self.userList) {
+		NSDate* date = [self.rangeDates objectForKey:user];
+		return date ? -date.timeIntervalSinceNow : DBL_MAX;
+	}
+}
+
 /*----------------------------------------------------------------------------*
  * その他
  *----------------------------------------------------------------------------*/
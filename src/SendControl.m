@@ -19,6 +19,7 @@
 #import "RecvFile.h"
 #import "MessageCenter.h"
 #import "ReceiveControl.h"
+#import "NSString+IPMessenger.h"
 #import "DebugLog.h"
 
 /*============================================================================*
@@ -38,6 +39,44 @@ typedef NSMutableArray<UserInfo*>		_UserList;
 typedef NSMutableArray<SendAttachment*>	_AttachList;
 typedef NSMutableArray<NSImage*>		_IconList;
 
+// ユーザ一覧ソート条件（ソート前に識別子を項目に解決しておく）
+typedef struct {
+	UserInfoField	fields[_USERINFO_FIELD_MAX];
+	BOOL			ascending[_USERINFO_FIELD_MAX];
+	NSUInteger		count;
+} _SortSpec;
+
+// ユーザ一覧ソート要素（比較中にロックを取らないよう並び替えキーを先に取り出しておく）
+typedef struct {
+	UserInfo*	user;
+	NSString*	keys[_USERINFO_FIELD_MAX];
+} _SortItem;
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// ユーザ比較（NSSortDescriptorのcompare:相当。正規化済みキーを文字単位で比較。nilは先頭）
+static NSComparisonResult _CompareUsers(const _SortItem* item1, const _SortItem* item2, const _SortSpec* spec)
+{
+	for (NSUInteger i = 0; i < spec->count; i++) {
+		NSString*			val1	= item1->keys[i];
+		NSString*			val2	= item2->keys[i];
+		NSComparisonResult	result	= NSOrderedSame;
+		if (val1 && val2) {
+			result = [val1 compare:val2 options:NSLiteralSearch];
+		} else if (val1) {
+			result = NSOrderedDescending;
+		} else if (val2) {
+			result = NSOrderedAscending;
+		}
+		if (result != NSOrderedSame) {
+			return spec->ascending[i] ? result : -result;
+		}
+	}
+	return NSOrderedSame;
+}
+
 /*============================================================================*
  * 内部クラス拡張
  *============================================================================*/
@@ -46,12 +85,19 @@ typedef NSMutableArray<NSImage*>		_IconList;
 
 @property(retain)	_UserList*		users;						// ユーザ一覧
 @property(retain)	NSPredicate*	userPredicate;				// ユーザ検索フィルタ
+@property(copy)		NSString*		searchWord;					// 検索語（正規化済み）
+@property(assign)	NSUInteger		searchFields;				// 検索対象項目（UserInfoFieldのビット）
+@property(assign)	NSUInteger		totalUserNum;				// 全ユーザ数
 @property(retain)	_UserList*		selectedUsers;				// 選択ユーザリスト
 @property(retain)	_AttachList*	attachments;				// 添付ファイル一覧
 @property(retain)	_IconList*		icons;						// アイコン一覧
 @property(retain)	id<NSObject>	userListChangedObserver;	// 通知オブサーバ
+@property(retain)	NSHashTable<UserInfo*>*	versionRequested;	// バージョン問い合わせ済みユーザ（追加・作り直されたユーザのみ問い合わせる）
 
 - (void)updateSearchFieldPlaceholder;
+- (void)requestVersionInfoIfNeeded;
+- (void)sortUsers;
+- (void)userListFiltered;
 
 @end
 
@@ -76,6 +122,8 @@ typedef NSMutableArray<NSImage*>		_IconList;
 		_selectedUsers	= [[NSMutableArray alloc] init];
 		_attachments	= [[_AttachList alloc] init];
 		_icons			= [[_IconList alloc] init];
+		_versionRequested	= [[NSHashTable alloc] initWithOptions:NSPointerFunctionsWeakMemory|NSPointerFunctionsObjectPointerPersonality
+														  capacity:0];
 		if (!gUserListColumns) {
 			gUserListColumns	= [[NSMutableDictionary alloc] init];
 		}
@@ -146,9 +194,11 @@ typedef NSMutableArray<NSImage*>		_IconList;
 		[NSNotificationCenter.defaultCenter removeObserver:_userListChangedObserver];
 		[_userListChangedObserver release];
 	}
+	[_versionRequested release];
 	[_icons release];
 	[_attachments release];
 	[_userPredicate release];
+	[_searchWord release];
 	[_selectedUsers release];
 	[_users release];
 	[_recvMsg release];
@@ -372,6 +422,11 @@ typedef NSMutableArray<NSImage*>		_IconList;
 		[gUserListColsLock unlock];
 		[sender setState:NSOnState];
 		[Config.sharedConfig setSendWindowUserListColumn:identifier hidden:NO];
+		if ([identifier isEqualToString:kIPMsgUserInfoVersionPropertyIdentifer]) {
+			// 非表示の間の変化は追っていないため表示中の全ユーザを対象にし直す
+			[self.versionRequested removeAllObjects];
+		}
+		[self requestVersionInfoIfNeeded];
 	}
 }
 
@@ -415,16 +470,23 @@ typedef NSMutableArray<NSImage*>		_IconList;
 - (void)userListChanged:(NSNotification*)aNotification
 {
 	[self.users setArray:UserManager.sharedManager.users];
-	NSInteger totalNum = self.users.count;
+	self.totalUserNum = self.users.count;
 	if (self.userPredicate) {
 		[self.users filterUsingPredicate:self.userPredicate];
 	}
-	[self.users sortUsingDescriptors:self.userTable.sortDescriptors];
+	[self sortUsers];
+	[self userListFiltered];
+}
+
+// 表示ユーザ確定後の処理
+- (void)userListFiltered
+{
 	// ユーザ数設定
-	NSString* label = [NSString stringWithFormat:NSLocalizedString(@"SendDlg.UserNumStr", nil), self.users.count, totalNum];
+	NSString* label = [NSString stringWithFormat:NSLocalizedString(@"SendDlg.UserNumStr", nil), self.users.count, self.totalUserNum];
 	[self.userNumLabel setStringValue:label];
 	// ユーザリストの再描画
 	[self.userTable reloadData];
+	[self requestVersionInfoIfNeeded];
 	// 再選択
 	[self.userTable deselectAll:self];
 	NSMutableIndexSet* selectIndexes = [NSMutableIndexSet indexSet];
@@ -440,6 +502,67 @@ typedef NSMutableArray<NSImage*>		_IconList;
 	}
 }
 
+// ユーザ一覧ソート（テーブルのソート条件に従う）
+- (void)sortUsers
+{
+	NSArray<NSSortDescriptor*>*	descs = self.userTable.sortDescriptors;
+	_SortSpec					spec;
+	spec.count = 0;
+	for (NSSortDescriptor* desc in descs) {
+		UserInfoField field = [UserInfo fieldForPropertyIdentifier:desc.key];
+		if ((field == USERINFO_FIELD_UNKNOWN) || (desc.selector != @selector(compare:)) || (spec.count >= _USERINFO_FIELD_MAX)) {
+			// 想定外の条件は汎用処理で
+			[self.users sortUsingDescriptors:descs];
+			return;
+		}
+		spec.fields[spec.count]		= field;
+		spec.ascending[spec.count]	= desc.ascending;
+		spec.count++;
+	}
+	if (spec.count == 0) {
+		return;
+	}
+	// キーはユーザ毎に1回だけ取り出し、安定ソート（mergesort）で並べ替える
+	NSUInteger	num		= self.users.count;
+	_SortItem*	items	= malloc(sizeof(_SortItem) * MAX(num, 1));
+	for (NSUInteger i = 0; i < num; i++) {
+		items[i].user = self.users[i];
+		for (NSUInteger j = 0; j < spec.count; j++) {
+			items[i].keys[j] = [items[i].user sortKeyForField:spec.fields[j]];
+		}
+	}
+	if (mergesort_b(items, num, sizeof(_SortItem), ^int(const void* p1, const void* p2) {
+		return (int)_CompareUsers(p1, p2, &spec);
+	}) == 0) {
+		NSMutableArray<UserInfo*>* sorted = [NSMutableArray arrayWithCapacity:num];
+		for (NSUInteger i = 0; i < num; i++) {
+			[sorted addObject:items[i].user];
+		}
+		[self.users setArray:sorted];
+	} else {
+		ERR(@"user sort error(%s)", strerror(errno));
+	}
+	free(items);
+}
+
+// バージョン列表示中のみ表示ユーザのバージョン情報を問い合わせる（前回から追加・作り直されたユーザのみ）
+- (void)requestVersionInfoIfNeeded
+{
+	if (![self.userTable tableColumnWithIdentifier:kIPMsgUserInfoVersionPropertyIdentifer]) {
+		return;
+	}
+	NSMutableArray<UserInfo*>* targets = [NSMutableArray array];
+	for (UserInfo* user in self.users) {
+		if (![self.versionRequested containsObject:user]) {
+			[self.versionRequested addObject:user];
+			[targets addObject:user];
+		}
+	}
+	if (targets.count > 0) {
+		[MessageCenter.sharedCenter requestVersionInfoForUsers:targets];
+	}
+}
+
 - (IBAction)searchUser:(id)sender
 {
 	NSResponder* firstResponder = self.window.firstResponder;
@@ -460,35 +583,47 @@ typedef NSMutableArray<NSImage*>		_IconList;
 
 - (IBAction)updateUserSearch:(id)sender
 {
-	NSString* searchWord = self.searchField.stringValue;
-	self.userPredicate = nil;
-	if (searchWord.length > 0) {
-		Config*				cfg	= Config.sharedConfig;
-		NSMutableString*	fmt	= [NSMutableString string];
-		if (cfg.sendSearchByUserName) {
-			[fmt appendFormat:@"%@ contains[c] '%@'", kIPMsgUserInfoUserNamePropertyIdentifier, searchWord];
-		}
-		if (cfg.sendSearchByGroupName) {
-			if (fmt.length > 0) {
-				[fmt appendString:@" OR "];
-			}
-			[fmt appendFormat:@"%@ contains[c] '%@'", kIPMsgUserInfoGroupNamePropertyIdentifier, searchWord];
-		}
-		if (cfg.sendSearchByHostName) {
-			if (fmt.length > 0) {
-				[fmt appendString:@" OR "];
-			}
-			[fmt appendFormat:@"%@ contains[c] '%@'", kIPMsgUserInfoHostNamePropertyIdentifier, searchWord];
-		}
-		if (cfg.sendSearchByLogOnName) {
-			if (fmt.length > 0) {
-				[fmt appendString:@" OR "];
+	// 検索語・対象項目（検索語はユーザ側の検索キーと同じ正規化を行う）
+	NSString*	word	= self.searchField.stringValue.searchKeyString;
+	Config*		cfg		= Config.sharedConfig;
+	NSUInteger	fields	= 0;
+	if (cfg.sendSearchByUserName) {
+		fields |= (1UL << USERINFO_FIELD_USERNAME);
+	}
+	if (cfg.sendSearchByGroupName) {
+		fields |= (1UL << USERINFO_FIELD_GROUPNAME);
+	}
+	if (cfg.sendSearchByHostName) {
+		fields |= (1UL << USERINFO_FIELD_HOSTNAME);
+	}
+	if (cfg.sendSearchByLogOnName) {
+		fields |= (1UL << USERINFO_FIELD_LOGONNAME);
+	}
+	NSPredicate* predicate = nil;
+	if ((word.length > 0) && (fields != 0)) {
+		predicate = [NSPredicate predicateWithBlock:^BOOL(UserInfo* user, NSDictionary* bindings) {
+			for (NSInteger field = 0; field < _USERINFO_FIELD_MAX; field++) {
+				if (!(fields & (1UL << field))) {
+					continue;
+				}
+				NSString* key = [user searchKeyForField:field];
+				if (key && ([key rangeOfString:word options:NSLiteralSearch].location != NSNotFound)) {
+					return YES;
+				}
 			}
-			[fmt appendFormat:@"%@ contains[c] '%@'", kIPMsgUserInfoLogOnNamePropertyIdentifier, searchWord];
-		}
-		if (fmt.length > 0) {
-			self.userPredicate = [NSPredicate predicateWithFormat:fmt];
-		}
+			return NO;
+		}];
+	}
+	// 検索語を付け足しただけなら表示中のユーザから絞り込む（並び順は変わらない）
+	BOOL narrow = (predicate && self.userPredicate &&
+				   (fields == self.searchFields) && [word containsString:self.searchWord]);
+	self.userPredicate	= predicate;
+	self.searchWord		= word;
+	self.searchFields	= fields;
+	if (narrow) {
+		[self.users filterUsingPredicate:predicate];
+		[self userListFiltered];
+		return;
 	}
 	[self userListChanged:nil];
 }
@@ -669,7 +804,7 @@ typedef NSMutableArray<NSImage*>		_IconList;
 - (void)tableView:(NSTableView*)aTableView sortDescriptorsDidChange:(NSArray*)oldDescriptors
 {
 	dispatch_async(dispatch_get_main_queue(), ^() {
-		[self.users sortUsingDescriptors:aTableView.sortDescriptors];
+		[self sortUsers];
 		[aTableView reloadData];
 		// 再選択
 		[self.userTable deselectAll:self];
@@ -846,7 +981,7 @@ typedef NSMutableArray<NSImage*>		_IconList;
 	}
 
 	// ユーザリストのソート設定反映
-	[self.users sortUsingDescriptors:self.userTable.sortDescriptors];
+	[self sortUsers];
 
 	// 検索フィールドのメニュー設定
 	[self.searchMenu itemWithTag:_SEARCH_MENUITEM_TAG_USER].state	= config.sendSearchByUserName ? NSOnState : NSOffState;
@@ -0,0 +1,48 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: SendFileCache.h
+ *	Module		: 送信添付ファイル共有マップクラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+@class BandwidthTransfer;
+
+/*============================================================================*
+ * 構造体定義
+ *============================================================================*/
+
+// 送信統計（全ファイル累計）
+typedef struct {
+	UInt64			pagesHit;		// 送信時にメモリ上にあったページ数
+	UInt64			pagesMissed;	// 送信時にディスク読み込みが必要だったページ数
+	UInt64			bytesSent;		// 送信バイト数
+	NSTimeInterval	activeTime;		// 送信中だった時間（同時送信は重複して数えない）
+} SendFileCacheStatistics;
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 同一ファイルを同時に送信する接続間で共有するメモリマップ
+@interface SendFileCache : NSObject
+
+@property(readonly)	NSString*	path;		// ファイルパス
+@property(readonly)	size_t		length;		// ファイルサイズ
+
+// 共有マップ取得（使用後はrelinquishCache:で返却する。マップできない場合nil）
++ (SendFileCache*)acquireCacheForPath:(NSString*)path;
++ (void)relinquishCache:(SendFileCache*)cache;
+
+// 送信統計取得
++ (SendFileCacheStatistics)statistics;
+
+// ファイル内容送信（帯域制御付き）
+- (BOOL)sendTo:(int)sock transfer:(BandwidthTransfer*)transfer;
+
+// ファイル内容の範囲送信（帯域制御付き。範囲はファイルサイズ内であること）
+- (BOOL)sendFrom:(size_t)start length:(size_t)len to:(int)sock transfer:(BandwidthTransfer*)transfer;
+
+@end
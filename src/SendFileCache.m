@@ -0,0 +1,324 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: SendFileCache.m
+ *	Module		: 送信添付ファイル共有マップクラス
+ *============================================================================*/
+
+#import "SendFileCache.h"
+#import "BandwidthShaper.h"
+#import "DebugLog.h"
+
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _SEND_CHUNK_SIZE	(256 * 1024)		// 送信単位
+#define _READ_AHEAD_SIZE	(4 * 1024 * 1024)	// 先読み指示範囲
+#define _MIN_PAGE_SIZE		(4 * 1024)			// 想定最小ページサイズ（ページ判定バッファ用）
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface SendFileCache()
+{
+	int				fd;			// ファイルディスクリプタ（送信データはここから読む）
+	const char*		base;		// マップ先頭（先読み指示・ヒット判定のみに使い、内容は参照しない）
+	struct stat		fileStat;	// マップ時のファイル情報
+}
+
+@property(assign)	NSInteger	users;			// 使用中の送信数
+@property(assign)	UInt64		pagesHit;		// ファイル毎ヒットページ数
+@property(assign)	UInt64		pagesMissed;	// ファイル毎ミスページ数
+@property(assign)	UInt64		bytesSent;		// ファイル毎送信バイト数
+
++ (void)senderStarted;
++ (void)senderFinished;
+- (instancetype)initWithPath:(NSString*)path descriptor:(int)desc stat:(const struct stat*)st;
+- (BOOL)isSameFile:(const struct stat*)st;
+
+@end
+
+/*============================================================================*
+ * 静的変数
+ *============================================================================*/
+
+static NSMutableDictionary<NSString*,SendFileCache*>*	_CacheMap		= nil;	// 使用中マップ（パス毎）
+static NSMutableSet<SendFileCache*>*					_Retired		= nil;	// 更新前ファイルの使用中マップ
+static SendFileCacheStatistics							_Stats;					// 送信統計
+static NSInteger										_ActiveSenders	= 0;	// 送信中の数
+static CFAbsoluteTime									_ActiveSince	= 0;	// 送信開始時刻（送信中の数が0→1）
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation SendFileCache
+
+/*----------------------------------------------------------------------------*
+ * 共有マップ管理
+ *----------------------------------------------------------------------------*/
+
+// 共有マップ取得
++ (SendFileCache*)acquireCacheForPath:(NSString*)path
+{
+	// 送信に使うファイルを開いてから確認する（パスに対するstatとの間に差し替えられない）
+	int desc = open(path.fileSystemRepresentation, O_RDONLY);
+	if (desc < 0) {
+		return nil;
+	}
+	struct stat st;
+	if ((fstat(desc, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size <= 0)) {
+		close(desc);
+		return nil;
+	}
+	@synchronized (self) {
+		if (!_CacheMap) {
+			_CacheMap	= [[NSMutableDictionary alloc] init];
+			_Retired	= [[NSMutableSet alloc] init];
+		}
+		SendFileCache* cache = _CacheMap[path];
+		if (cache && ![cache isSameFile:&st]) {
+			// 更新されたファイルは新たにマップ（旧マップは使用中の送信終了後に解放）
+			DBG(@"SendFileCache file updated -> remap(%@)", path);
+			[_Retired addObject:cache];
+			[_CacheMap removeObjectForKey:path];
+			cache = nil;
+		}
+		if (cache) {
+			// 使用中のマップを共用（開いたファイルは不要）
+			close(desc);
+		} else {
+			cache = [[[SendFileCache alloc] initWithPath:path descriptor:desc stat:&st] autorelease];
+			if (!cache) {
+				return nil;
+			}
+			_CacheMap[path] = cache;
+		}
+		cache.users++;
+		TRC(@"SendFileCache acquired(%@,users=%ld)", path, cache.users);
+		return [[cache retain] autorelease];
+	}
+}
+
+// 共有マップ返却
++ (void)relinquishCache:(SendFileCache*)cache
+{
+	@synchronized (self) {
+		cache.users--;
+		if (cache.users > 0) {
+			return;
+		}
+		UInt64 pages = cache.pagesHit + cache.pagesMissed;
+		DBG(@"SendFileCache closed(%@,%llu bytes sent,hit=%.1f%%)",
+								cache.path, cache.bytesSent, (pages > 0) ? (cache.pagesHit * 100.0 / pages) : 0.0);
+		if (_CacheMap[cache.path] == cache) {
+			[_CacheMap removeObjectForKey:cache.path];
+		}
+		[_Retired removeObject:cache];
+	}
+}
+
+// 送信統計取得
++ (SendFileCacheStatistics)statistics
+{
+	@synchronized (self) {
+		SendFileCacheStatistics stats = _Stats;
+		if (_ActiveSenders > 0) {
+			stats.activeTime += CFAbsoluteTimeGetCurrent() - _ActiveSince;
+		}
+		return stats;
+	}
+}
+
+// 送信開始記録
++ (void)senderStarted
+{
+	@synchronized (self) {
+		if (_ActiveSenders++ == 0) {
+			_ActiveSince = CFAbsoluteTimeGetCurrent();
+		}
+	}
+}
+
+// 送信終了記録
++ (void)senderFinished
+{
+	@synchronized (self) {
+		if (--_ActiveSenders == 0) {
+			_Stats.activeTime += CFAbsoluteTimeGetCurrent() - _ActiveSince;
+			UInt64 pages = _Stats.pagesHit + _Stats.pagesMissed;
+			DBG(@"SendFileCache total(hit=%.1f%%,egress=%.1fMB/s)",
+								(pages > 0) ? (_Stats.pagesHit * 100.0 / pages) : 0.0,
+								(_Stats.activeTime > 0) ? (_Stats.bytesSent / _Stats.activeTime / (1024.0 * 1024.0)) : 0.0);
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化（開いたファイルは解放時に閉じる）
+- (instancetype)initWithPath:(NSString*)path descriptor:(int)desc stat:(const struct stat*)st
+{
+	self = [super init];
+	if (self) {
+		fd			= desc;
+		fileStat	= *st;
+		void* addr = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			// ネットワークボリューム等でマップできない場合は呼び出し側で逐次読み込み
+			WRN(@"mmap error(%@,%s)", path, strerror(errno));
+			[self release];
+			return nil;
+		}
+		madvise(addr, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+		base	= addr;
+		_path	= [path copy];
+		_length	= (size_t)fileStat.st_size;
+		DBG(@"SendFileCache mapped(%@,%zu bytes)", path, _length);
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	if (base) {
+		munmap((void*)base, _length);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	[_path release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 送信
+ *----------------------------------------------------------------------------*/
+
+// ファイル内容送信
+- (BOOL)sendTo:(int)sock transfer:(BandwidthTransfer*)transfer
+{
+	return [self sendFrom:0 length:self.length to:sock transfer:transfer];
+}
+
+// ファイル内容の範囲送信
+- (BOOL)sendFrom:(size_t)start length:(size_t)len to:(int)sock transfer:(BandwidthTransfer*)transfer
+{
+	if ((start > self.length) || (len > self.length - start)) {
+		ERR(@"range invalid(%@,%zu+%zu/%zu)", self.path, start, len, self.length);
+		return NO;
+	}
+
+	// 送信データはマップからではなくpreadで読む（送信中に他プロセスがファイルを切り詰めても
+	// マップ範囲外アクセスのSIGBUSにならず、読み込みが足りないことで検出できる）
+	char* buf = malloc(_SEND_CHUNK_SIZE);
+	if (!buf) {
+		ERR(@"malloc error(%d)", _SEND_CHUNK_SIZE);
+		return NO;
+	}
+
+	size_t	pageSize	= (size_t)getpagesize();
+	char	vec[_SEND_CHUNK_SIZE / _MIN_PAGE_SIZE + 1];	// 範囲送信で先頭がページ途中の場合の1ページ分を含む
+	size_t	offset		= start;
+	size_t	end			= start + len;
+	BOOL	ret			= YES;
+
+	[SendFileCache senderStarted];
+	while (offset < end) {
+		size_t chunk = MIN((size_t)_SEND_CHUNK_SIZE, end - offset);
+
+		// 後続範囲の先読み指示（他の送信と重なれば既読ページを共用）
+		size_t ahead = (offset + chunk) & ~(pageSize - 1);
+		if (ahead < end) {
+			madvise((void*)&base[ahead], MIN((size_t)_READ_AHEAD_SIZE, end - ahead), MADV_WILLNEED);
+		}
+
+		// ヒット判定（送信前にメモリ上にあったページを数える。mincoreの先頭はページ境界に揃える）
+		size_t	top		= offset & ~(pageSize - 1);
+		UInt64	pages	= (offset + chunk - top + pageSize - 1) / pageSize;
+		UInt64	hit		= 0;
+		if ((pages <= sizeof(vec)) && (mincore(&base[top], offset + chunk - top, vec) == 0)) {
+			for (UInt64 i = 0; i < pages; i++) {
+				if (vec[i] & MINCORE_INCORE) {
+					hit++;
+				}
+			}
+		}
+
+		// 読み込み（ページキャッシュはマップと共用）
+		size_t got = 0;
+		while (got < chunk) {
+			ssize_t n = pread(fd, &buf[got], chunk - got, (off_t)(offset + got));
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				ERR(@"read error(%@,%zu,%s)", self.path, offset + got, strerror(errno));
+				break;
+			}
+			if (n == 0) {
+				ERR(@"file shrunk while sending(%@,%zu)", self.path, offset + got);
+				break;
+			}
+			got += (size_t)n;
+		}
+		if (got < chunk) {
+			ret = NO;
+			break;
+		}
+
+		// 送信（帯域制御は転送側で行う）
+		UInt64 before = transfer.bytesSent;
+		if (![transfer send:sock bytes:buf length:chunk]) {
+			ERR(@"send error(%@)", self.path);
+			ret = NO;
+		}
+		size_t sent = (size_t)(transfer.bytesSent - before);
+
+		// 統計更新
+		@synchronized (SendFileCache.class) {
+			self.pagesHit		+= hit;
+			self.pagesMissed	+= pages - hit;
+			self.bytesSent		+= sent;
+			_Stats.pagesHit		+= hit;
+			_Stats.pagesMissed	+= pages - hit;
+			_Stats.bytesSent	+= sent;
+		}
+		if (!ret) {
+			break;
+		}
+		offset += chunk;
+	}
+	[SendFileCache senderFinished];
+	free(buf);
+
+	TRC(@"SendFileCache sent(%@,%zu-%zu/%zu)", self.path, start, offset, self.length);
+	return ret;
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// マップ時から変更されていないか
+- (BOOL)isSameFile:(const struct stat*)st
+{
+	return ((st->st_dev == fileStat.st_dev) &&
+			(st->st_ino == fileStat.st_ino) &&
+			(st->st_size == fileStat.st_size) &&
+			(st->st_mtimespec.tv_sec == fileStat.st_mtimespec.tv_sec) &&
+			(st->st_mtimespec.tv_nsec == fileStat.st_mtimespec.tv_nsec));
+}
+
+@end
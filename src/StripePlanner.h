@@ -0,0 +1,46 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: StripePlanner.h
+ *	Module		: 並列範囲ダウンロード計画クラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// 1ファイルを範囲に分けて複数接続で取得する際の範囲割り当てと並列数調整
+// （並列数は受信速度が伸びる間だけ1本ずつ増やす）
+@interface StripePlanner : NSObject
+
+@property(readonly)	UInt64		length;			// ファイルサイズ
+@property(readonly)	UInt64		chunkSize;		// 1回の要求で取得する範囲の上限
+@property(readonly)	NSUInteger	maxStreams;		// 並列数上限
+@property(readonly)	NSUInteger	targetStreams;	// 現在の目標並列数
+@property(readonly)	NSUInteger	peakStreams;	// 実際に同時に動いた最大数
+@property(assign)	BOOL		adaptive;		// 並列数自動調整（NOの場合は最初から上限で固定）
+@property(readonly)	BOOL		finished;		// 全範囲取得済み
+@property(readonly)	BOOL		failed;			// 再試行上限超過・中止
+@property(readonly)	UInt64		receivedBytes;	// 受信済みバイト数（失敗した範囲の分は除く）
+
+// 初期化
+- (instancetype)initWithLength:(UInt64)length maxStreams:(NSUInteger)maxStreams;
+
+// 接続追加判定（YESの場合は接続を1本増やし、その接続でnextRange:を呼ぶ）
+- (BOOL)acquireStream;
+
+// 次の範囲を取得（NOの場合はその接続を終了する。未取得範囲がない・並列数を減らす場合）
+- (BOOL)nextRange:(UInt64*)offset length:(UInt64*)length;
+
+// 範囲取得結果
+- (void)addReceivedBytes:(UInt64)bytes;
+- (void)completeRange:(UInt64)offset length:(UInt64)length;
+- (void)failRange:(UInt64)offset length:(UInt64)length received:(UInt64)received;
+
+// 中止（取得中の範囲はそのまま、以降の割り当てを止める）
+- (void)cancel;
+
+@end
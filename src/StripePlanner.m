@@ -0,0 +1,256 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: StripePlanner.m
+ *	Module		: 並列範囲ダウンロード計画クラス
+ *============================================================================*/
+
+#import "StripePlanner.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+static const UInt64			_CHUNK_MIN			= (8ULL * 1024 * 1024);		// 範囲サイズ下限
+static const UInt64			_CHUNK_MAX			= (256ULL * 1024 * 1024);	// 範囲サイズ上限
+static const NSUInteger		_CHUNKS_PER_STREAM	= 4;						// 1接続あたりの目安範囲数（偏りを均す）
+static const NSUInteger		_INITIAL_STREAMS	= 2;						// 自動調整時の初期並列数
+static const NSUInteger		_RETRY_MAX			= 3;						// 同一範囲の再試行上限
+static const NSTimeInterval	_SAMPLE_INTERVAL	= 0.5;						// 受信速度の計測間隔（秒）
+static const double			_GAIN_RATIO			= 1.10;						// 増やした効果ありとみなす速度比
+static const double			_LOSS_RATIO			= 0.90;						// 増やして悪化したとみなす速度比
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface StripePlanner()
+{
+	BOOL	_failed;		// 再試行上限超過
+}
+
+@property(assign)	UInt64						cursor;			// 未割り当て範囲の先頭
+@property(retain)	NSMutableArray<NSValue*>*	retries;		// 再割り当て待ち範囲（NSRange）
+@property(retain)	NSMutableDictionary*		retryCounts;	// 範囲先頭毎の再試行回数
+@property(assign)	UInt64						completedBytes;	// 取得完了バイト数
+@property(assign)	NSUInteger					activeStreams;	// 動作中接続数
+@property(assign)	BOOL						canceled;
+@property(assign)	BOOL						converged;		// 並列数調整終了
+@property(assign)	BOOL						settling;		// 並列数変更直後（次の計測区間は捨てる）
+@property(assign)	double						bestRate;		// 直前の並列数での受信速度（バイト/秒）
+@property(assign)	UInt64						sampleBytes;	// 計測区間の受信バイト数
+@property(assign)	CFAbsoluteTime				sampleStart;	// 計測区間の開始時刻
+
+- (void)adjustStreams;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation StripePlanner
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)initWithLength:(UInt64)length maxStreams:(NSUInteger)maxStreams
+{
+	self = [super init];
+	if (self) {
+		_length			= length;
+		_maxStreams		= MAX(maxStreams, 1);
+		_chunkSize		= MIN(MAX(length / (_maxStreams * _CHUNKS_PER_STREAM), _CHUNK_MIN), _CHUNK_MAX);
+		_adaptive		= YES;
+		_targetStreams	= MIN(_INITIAL_STREAMS, _maxStreams);
+		_retries		= [[NSMutableArray alloc] init];
+		_retryCounts	= [[NSMutableDictionary alloc] init];
+		_settling		= YES;
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_retries release];
+	[_retryCounts release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * プロパティアクセス
+ *----------------------------------------------------------------------------*/
+
+// 並列数自動調整
+- (void)setAdaptive:(BOOL)adaptive
+{
+	@synchronized (self) {
+		_adaptive		= adaptive;
+		_targetStreams	= adaptive ? MIN(_INITIAL_STREAMS, self.maxStreams) : self.maxStreams;
+	}
+}
+
+// 全範囲取得済み
+- (BOOL)finished
+{
+	@synchronized (self) {
+		return (self.completedBytes >= self.length);
+	}
+}
+
+// 再試行上限超過・中止
+- (BOOL)failed
+{
+	@synchronized (self) {
+		return _failed || self.canceled;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 範囲割り当て
+ *----------------------------------------------------------------------------*/
+
+// 接続追加判定
+- (BOOL)acquireStream
+{
+	@synchronized (self) {
+		if (_failed || self.canceled) {
+			return NO;
+		}
+		if ((self.cursor >= self.length) && (self.retries.count == 0)) {
+			return NO;
+		}
+		if (self.activeStreams >= self.targetStreams) {
+			return NO;
+		}
+		self.activeStreams++;
+		_peakStreams = MAX(_peakStreams, self.activeStreams);
+		if (self.sampleStart == 0) {
+			self.sampleStart = CFAbsoluteTimeGetCurrent();
+		}
+		return YES;
+	}
+}
+
+// 次の範囲を取得
+- (BOOL)nextRange:(UInt64*)offset length:(UInt64*)length
+{
+	@synchronized (self) {
+		BOOL retire = (_failed || self.canceled || (self.activeStreams > self.targetStreams));
+		if (!retire) {
+			if (self.retries.count > 0) {
+				NSRange range = self.retries.firstObject.rangeValue;
+				[self.retries removeObjectAtIndex:0];
+				*offset	= range.location;
+				*length	= range.length;
+				return YES;
+			}
+			if (self.cursor < self.length) {
+				*offset	= self.cursor;
+				*length	= MIN(self.chunkSize, self.length - self.cursor);
+				self.cursor += *length;
+				return YES;
+			}
+		}
+		self.activeStreams--;
+		return NO;
+	}
+}
+
+// 受信量通知（計測区間毎に並列数を見直す）
+- (void)addReceivedBytes:(UInt64)bytes
+{
+	@synchronized (self) {
+		_receivedBytes		+= bytes;
+		self.sampleBytes	+= bytes;
+		if (CFAbsoluteTimeGetCurrent() - self.sampleStart >= _SAMPLE_INTERVAL) {
+			[self adjustStreams];
+		}
+	}
+}
+
+// 範囲取得完了
+- (void)completeRange:(UInt64)offset length:(UInt64)length
+{
+	@synchronized (self) {
+		self.completedBytes += length;
+		[self.retryCounts removeObjectForKey:@(offset)];
+	}
+}
+
+// 範囲取得失敗（再割り当て。受信済みの分は受信量から除く）
+- (void)failRange:(UInt64)offset length:(UInt64)length received:(UInt64)received
+{
+	@synchronized (self) {
+		_receivedBytes -= MIN(received, _receivedBytes);
+		NSUInteger count = [self.retryCounts[@(offset)] unsignedIntegerValue] + 1;
+		if (count > _RETRY_MAX) {
+			ERR(@"stripe range retry over(offset=%llu,length=%llu)", offset, length);
+			_failed = YES;
+			return;
+		}
+		self.retryCounts[@(offset)] = @(count);
+		[self.retries addObject:[NSValue valueWithRange:NSMakeRange((NSUInteger)offset, (NSUInteger)length)]];
+		WRN(@"stripe range retry(offset=%llu,length=%llu,count=%lu)", offset, length, count);
+		// 失敗が続く状況では並列数を増やさない
+		self.converged = YES;
+	}
+}
+
+// 中止
+- (void)cancel
+{
+	@synchronized (self) {
+		self.canceled = YES;
+	}
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// 並列数見直し（ロック中に呼ぶ）
+- (void)adjustStreams
+{
+	CFAbsoluteTime	now		= CFAbsoluteTimeGetCurrent();
+	double			rate	= self.sampleBytes / (now - self.sampleStart);
+	self.sampleBytes	= 0;
+	self.sampleStart	= now;
+	if (!self.adaptive || self.converged) {
+		return;
+	}
+	if (self.settling) {
+		// 並列数変更直後は接続確立・スロースタートの影響が大きいので捨てる
+		self.settling = NO;
+		return;
+	}
+	if (self.bestRate == 0) {
+		// 初回計測
+		self.bestRate = rate;
+	} else if (rate >= self.bestRate * _GAIN_RATIO) {
+		// 効果あり
+		self.bestRate = rate;
+	} else {
+		// 効果なし（悪化した場合は1本戻す）
+		if ((rate < self.bestRate * _LOSS_RATIO) && (_targetStreams > 1)) {
+			_targetStreams--;
+		}
+		self.converged = YES;
+		DBG(@"stripe streams converged(%lu,%.1fMB/s)", _targetStreams, self.bestRate / (1024.0 * 1024.0));
+		return;
+	}
+	if (_targetStreams < self.maxStreams) {
+		_targetStreams++;
+		self.settling = YES;
+		DBG(@"stripe streams -> %lu(%.1fMB/s)", _targetStreams, rate / (1024.0 * 1024.0));
+	} else {
+		self.converged = YES;
+	}
+}
+
+@end
@@ -23,6 +23,19 @@ extern NSString* const kIPMsgUserInfoLogOnNamePropertyIdentifier;
 extern NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier;
 extern NSString* const kIPMsgUserInfoVersionPropertyIdentifer;
 
+// 表示・検索項目（プロパティ識別子に対応）
+typedef NS_ENUM(NSInteger, UserInfoField)
+{
+	USERINFO_FIELD_UNKNOWN = -1,
+	USERINFO_FIELD_USERNAME,
+	USERINFO_FIELD_GROUPNAME,
+	USERINFO_FIELD_HOSTNAME,
+	USERINFO_FIELD_IPADDRESS,
+	USERINFO_FIELD_LOGONNAME,
+	USERINFO_FIELD_VERSION,
+	_USERINFO_FIELD_MAX
+};
+
 /*============================================================================*
  * クラス定義
  *============================================================================*/
@@ -36,8 +49,8 @@ extern NSString* const kIPMsgUserInfoVersionPropertyIdentifer;
 @property(readonly)	NSString*			ipAddress;			// IPアドレス（文字列）
 
 @property(copy)		NSString*			userName;			// IPMsgユーザ名（ニックネーム）
-@property(copy)		NSString*			groupName;			// IPMsgグループ名
-@property(copy)		NSString*			version;			// バージョン情報
+@property(copy)		NSString*			groupName;			// IPMsgグループ名（同値は共有）
+@property(copy)		NSString*			version;			// バージョン情報（同値は共有）
 @property(assign)	BOOL				inAbsence;			// 不在
 @property(assign)	BOOL				dialupConnect;		// ダイアルアップ接続
 @property(assign)	BOOL				supportsAttachment;	// ファイル添付サポート
@@ -46,6 +59,9 @@ extern NSString* const kIPMsgUserInfoVersionPropertyIdentifer;
 @property(retain)	CryptoCapability*	cryptoCapability;	// 暗号化能力
 @property(retain)	RSAPublicKey*		publicKey;			// 公開鍵
 @property(assign)	BOOL				supportsUTF8;		// UTF-8サポート
+@property(assign)	BOOL				supportsLargeMessage;	// 長文本文のTCP受け渡しサポート
+@property(assign)	BOOL				supportsEncryptedStream;	// 添付の暗号化転送サポート
+@property(assign)	BOOL				supportsRangeRequest;		// 添付の範囲指定取得サポート
 
 @property(readonly)	NSString*			summaryString;		// 表示用文字列
 
@@ -59,4 +75,22 @@ extern NSString* const kIPMsgUserInfoVersionPropertyIdentifer;
 					   logOnName:(NSString*)logOn
 						 address:(struct sockaddr_in*)addr;
 
+// 項目アクセス（識別子の解決は呼び出し側で一度だけ行う）
++ (UserInfoField)fieldForPropertyIdentifier:(NSString*)identifier;
+- (NSString*)stringForField:(UserInfoField)field;
+
+// 検索キー（正規化済み。値が変わった時だけ作り直す）
+- (NSString*)searchKeyForField:(UserInfoField)field;
+
+// 並び替えキー（合成済み形式。NSLiteralSearchで比較する。値が変わった時だけ作り直す）
+- (NSString*)sortKeyForField:(UserInfoField)field;
+
+// エントリ情報反映（一覧中のユーザを作り直さずに更新する。表示と競合しないようメインスレッドから呼ぶ）
+- (void)updateEntryFromUser:(UserInfo*)user;
+
+#if defined(IPMSG_DEBUG)
+// メモリ使用量測定（ユーザ当たりの常駐メモリ増分をデバッグログに出力。PeerSimulatorのrunBenchmarksから実行）
++ (void)benchmarkFootprint;
+#endif
+
 @end
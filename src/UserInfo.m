@@ -9,6 +9,7 @@
 #import "UserInfo.h"
 #import "RSAPublicKey.h"
 #import "NSData+IPMessenger.h"
+#import "NSString+IPMessenger.h"
 #import "DebugLog.h"
 
 #include <arpa/inet.h>
@@ -20,6 +21,60 @@ NSString* const kIPMsgUserInfoLogOnNamePropertyIdentifier	= @"LogOnName";
 NSString* const kIPMsgUserInfoVersionPropertyIdentifer		= @"Version";
 NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier	= @"IPAddress";
 
+#define _INTERN_MAX_LENGTH	(64)	// 共有する文字列長の上限（超えるものは共有しない）
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface UserInfo()
+{
+	NSString*	_userName;
+	NSString*	_groupName;								// 共有文字列
+	NSString*	_version;								// 共有文字列
+	BOOL		_inAbsence;
+	NSString*	summaryCache;							// 表示用文字列（表示項目の変更で破棄）
+	NSString*	searchSources[_USERINFO_FIELD_MAX];		// 検索キー作成元（変更検出用）
+	NSString*	searchKeys[_USERINFO_FIELD_MAX];		// 検索キー
+	NSString*	sortSources[_USERINFO_FIELD_MAX];		// 並び替えキー作成元（変更検出用）
+	NSString*	sortKeys[_USERINFO_FIELD_MAX];			// 並び替えキー
+}
+
+- (NSString*)makeSummaryString;
+
+@end
+
+/*============================================================================*
+ * ローカル関数
+ *============================================================================*/
+
+// 文字列共有（グループ名・バージョン等、多数のユーザで同じ値になるものを1インスタンスにまとめる）
+// 表は弱参照のため、使うユーザがいなくなった文字列は表からも消える
+static NSString* _InternString(NSString* str)
+{
+	static NSHashTable<NSString*>*	table = nil;
+	static dispatch_once_t			once;
+	if (!str) {
+		return nil;
+	}
+	if (str.length > _INTERN_MAX_LENGTH) {
+		// 長い文字列は共有しない（受信値による表の肥大化を防ぐ）
+		return [[str copy] autorelease];
+	}
+	dispatch_once(&once, ^{
+		table = [[NSHashTable weakObjectsHashTable] retain];
+	});
+	@synchronized (table) {
+		NSString* member = [table member:str];
+		if (member) {
+			return [[member retain] autorelease];
+		}
+		NSString* copied = [[str copy] autorelease];
+		[table addObject:copied];
+		return copied;
+	}
+}
+
 /*============================================================================*
  * クラス実装
  *============================================================================*/
@@ -80,6 +135,13 @@ NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier	= @"IPAddress";
 	[_cryptoCapability release];
 	[_publicKey release];
 	[_version release];
+	[summaryCache release];
+	for (NSInteger i = 0; i < _USERINFO_FIELD_MAX; i++) {
+		[searchSources[i] release];
+		[searchKeys[i] release];
+		[sortSources[i] release];
+		[sortKeys[i] release];
+	}
 	[super dealloc];
 }
 
@@ -87,8 +149,100 @@ NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier	= @"IPAddress";
 #pragma mark - プロパティアクセス
 //*---------------------------------------------------------------------------*
 
-// 表示文字列
+// ユーザ名
+- (NSString*)userName
+{
+	@synchronized (self) {
+		return [[_userName retain] autorelease];
+	}
+}
+
+- (void)setUserName:(NSString*)name
+{
+	@synchronized (self) {
+		if ((name == _userName) || [name isEqualToString:_userName]) {
+			// 変更なし（再ENTRY毎の再設定で表示・検索キーを作り直さない）
+			return;
+		}
+		[_userName release];
+		_userName = [name copy];
+		[summaryCache release];
+		summaryCache = nil;
+	}
+}
+
+// グループ名
+- (NSString*)groupName
+{
+	@synchronized (self) {
+		return [[_groupName retain] autorelease];
+	}
+}
+
+- (void)setGroupName:(NSString*)name
+{
+	@synchronized (self) {
+		if ((name == _groupName) || [name isEqualToString:_groupName]) {
+			return;
+		}
+		[_groupName release];
+		_groupName = [_InternString(name) retain];
+		[summaryCache release];
+		summaryCache = nil;
+	}
+}
+
+// バージョン情報
+- (NSString*)version
+{
+	@synchronized (self) {
+		return [[_version retain] autorelease];
+	}
+}
+
+- (void)setVersion:(NSString*)version
+{
+	@synchronized (self) {
+		if ((version == _version) || [version isEqualToString:_version]) {
+			return;
+		}
+		[_version release];
+		_version = [_InternString(version) retain];
+	}
+}
+
+// 不在
+- (BOOL)inAbsence
+{
+	@synchronized (self) {
+		return _inAbsence;
+	}
+}
+
+- (void)setInAbsence:(BOOL)absence
+{
+	@synchronized (self) {
+		if (absence != _inAbsence) {
+			_inAbsence = absence;
+			[summaryCache release];
+			summaryCache = nil;
+		}
+	}
+}
+
+// 表示文字列（ログ出力・通知等で繰り返し使われるためキャッシュする）
 - (NSString*)summaryString
+{
+	@synchronized (self) {
+		if (!summaryCache) {
+			summaryCache = [[self makeSummaryString] copy];
+		}
+		return [[summaryCache retain] autorelease];
+	}
+}
+
+// 表示文字列作成
+- (NSString*)makeSummaryString
 {
 	NSMutableString* desc = [NSMutableString string];
 
@@ -125,26 +279,117 @@ NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier	= @"IPAddress";
 }
 
 //*---------------------------------------------------------------------------*
-#pragma mark - NSObject
+#pragma mark - 項目アクセス
 //*---------------------------------------------------------------------------*
 
-// KVC
-- (id)valueForKey:(NSString*)key
+// プロパティ識別子→項目
++ (UserInfoField)fieldForPropertyIdentifier:(NSString*)identifier
+{
+	static NSDictionary<NSString*, NSNumber*>*	fields	= nil;
+	static dispatch_once_t						once;
+	dispatch_once(&once, ^{
+		fields = [@{
+			kIPMsgUserInfoUserNamePropertyIdentifier	: @(USERINFO_FIELD_USERNAME),
+			kIPMsgUserInfoGroupNamePropertyIdentifier	: @(USERINFO_FIELD_GROUPNAME),
+			kIPMsgUserInfoHostNamePropertyIdentifier	: @(USERINFO_FIELD_HOSTNAME),
+			kIPMsgUserInfoIPAddressPropertyIdentifier	: @(USERINFO_FIELD_IPADDRESS),
+			kIPMsgUserInfoLogOnNamePropertyIdentifier	: @(USERINFO_FIELD_LOGONNAME),
+			kIPMsgUserInfoVersionPropertyIdentifer		: @(USERINFO_FIELD_VERSION),
+		} retain];
+	});
+	NSNumber* field = identifier ? fields[identifier] : nil;
+	return field ? (UserInfoField)field.integerValue : USERINFO_FIELD_UNKNOWN;
+}
+
+// 項目値
+- (NSString*)stringForField:(UserInfoField)field
 {
-	if ([key isEqualToString:kIPMsgUserInfoUserNamePropertyIdentifier]) {
+	switch (field) {
+	case USERINFO_FIELD_USERNAME:
 		return self.userName;
-	} else if ([key isEqualToString:kIPMsgUserInfoGroupNamePropertyIdentifier]) {
+	case USERINFO_FIELD_GROUPNAME:
 		return self.groupName;
-	} else if ([key isEqualToString:kIPMsgUserInfoHostNamePropertyIdentifier]) {
+	case USERINFO_FIELD_HOSTNAME:
 		return self.hostName;
-	} else if ([key isEqualToString:kIPMsgUserInfoIPAddressPropertyIdentifier]) {
+	case USERINFO_FIELD_IPADDRESS:
 		return self.ipAddress;
-	} else if ([key isEqualToString:kIPMsgUserInfoLogOnNamePropertyIdentifier]) {
+	case USERINFO_FIELD_LOGONNAME:
 		return self.logOnName;
-	} else if ([key isEqualToString:kIPMsgUserInfoVersionPropertyIdentifer]) {
+	case USERINFO_FIELD_VERSION:
 		return self.version;
+	default:
+		return nil;
+	}
+}
+
+// 検索キー
+- (NSString*)searchKeyForField:(UserInfoField)field
+{
+	if ((field < 0) || (field >= _USERINFO_FIELD_MAX)) {
+		return nil;
+	}
+	// 検索は受信スレッドからの更新と並行するため排他する
+	@synchronized (self) {
+		NSString* source = [self stringForField:field];
+		if (source != searchSources[field]) {
+			// 値が変わった（copyプロパティのため変更時は別オブジェクトになる）
+			[searchSources[field] release];
+			[searchKeys[field] release];
+			searchSources[field]	= [source retain];
+			searchKeys[field]		= [source.searchKeyString retain];
+		}
+		return [[searchKeys[field] retain] autorelease];
+	}
+}
+
+// 並び替えキー
+- (NSString*)sortKeyForField:(UserInfoField)field
+{
+	if ((field < 0) || (field >= _USERINFO_FIELD_MAX)) {
+		return nil;
+	}
+	@synchronized (self) {
+		NSString* source = [self stringForField:field];
+		if (source != sortSources[field]) {
+			// 合成済み形式にしておけば比較は文字単位（NSLiteralSearch）で済む
+			[sortSources[field] release];
+			[sortKeys[field] release];
+			sortSources[field]	= [source retain];
+			sortKeys[field]		= [source.precomposedStringWithCanonicalMapping copy];
+		}
+		return [[sortKeys[field] retain] autorelease];
+	}
+}
+
+// エントリ情報反映（鍵・指紋等の識別情報は引き継ぐ）
+- (void)updateEntryFromUser:(UserInfo*)user
+{
+	self.userName					= user.userName;
+	self.groupName					= user.groupName;
+	self.version					= user.version;
+	self.inAbsence					= user.inAbsence;
+	self.dialupConnect				= user.dialupConnect;
+	self.supportsAttachment			= user.supportsAttachment;
+	self.supportsLargeMessage		= user.supportsLargeMessage;
+	self.supportsEncryptedStream	= user.supportsEncryptedStream;
+	self.supportsRangeRequest		= user.supportsRangeRequest;
+	self.supportsEncrypt			= user.supportsEncrypt;
+	self.supportsEncExtMsg			= user.supportsEncExtMsg;
+	self.supportsUTF8				= user.supportsUTF8;
+}
+
+//*---------------------------------------------------------------------------*
+#pragma mark - NSObject
+//*---------------------------------------------------------------------------*
+
+// KVC
+- (id)valueForKey:(NSString*)key
+{
+	UserInfoField field = [UserInfo fieldForPropertyIdentifier:key];
+	if (field == USERINFO_FIELD_UNKNOWN) {
+		return @"";
 	}
-	return @"";
+	return [self stringForField:field];
 }
 
 // 等価判定
@@ -158,10 +403,63 @@ NSString* const kIPMsgUserInfoIPAddressPropertyIdentifier	= @"IPAddress";
 	return NO;
 }
 
+// ハッシュ値（isEqual:と同じくログオン名とホスト名から算出）
+- (NSUInteger)hash
+{
+	return (self.logOnName.hash ^ self.hostName.hash);
+}
+
 // オブジェクト文字列表現
 - (NSString*)description
 {
 	return [NSString stringWithFormat:@"%@@%@", self.logOnName, self.hostName];
 }
 
+#if defined(IPMSG_DEBUG)
+//*---------------------------------------------------------------------------*
+#pragma mark - 性能測定
+//*---------------------------------------------------------------------------*
+
+// 10,000ユーザ分の常駐メモリ増分と表示文字列取得時間
++ (void)benchmarkFootprint
+{
+	const NSUInteger			num		= 10000;
+	NSMutableArray<UserInfo*>*	users	= [NSMutableArray arrayWithCapacity:num];
+	size_t						before	= IPMsgResidentSize();
+	for (NSUInteger i = 0; i < num; i++) {
+		@autoreleasepool {
+			// 受信時と同様に毎回別インスタンスの文字列から作成する
+			struct sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family			= AF_INET;
+			addr.sin_addr.s_addr	= htonl(0x0A000000 | (UInt32)i);
+			UserInfo* user = [UserInfo userWithHostName:[NSString stringWithFormat:@"host%05lu", i]
+											  logOnName:[NSString stringWithFormat:@"user%05lu", i]
+												address:&addr];
+			user.userName	= [NSString stringWithFormat:@"User %lu", i];
+			user.groupName	= [NSString stringWithFormat:@"Group %lu", i % 20];
+			user.version	= [NSString stringWithFormat:@"IP Messenger for macOS Version 5.%lu.0", i % 5];
+			[user summaryString];
+			[users addObject:user];
+		}
+	}
+	double growth = (double)IPMsgResidentSize() - (double)before;
+	DBG(@"benchmark %lu users RSS %+.1fKB (%.0fB/user)", num, growth / 1024.0, growth / num);
+
+	NSDate* start = [NSDate date];
+	for (UserInfo* user in users) {
+		@autoreleasepool {
+			[user makeSummaryString];
+		}
+	}
+	NSTimeInterval	build	= -start.timeIntervalSinceNow;
+	start = [NSDate date];
+	for (UserInfo* user in users) {
+		[user summaryString];
+	}
+	NSTimeInterval	cached	= -start.timeIntervalSinceNow;
+	DBG(@"benchmark summaryString build=%.1fms cached=%.1fms (%lu users)", build * 1000.0, cached * 1000.0, num);
+}
+#endif
+
 @end
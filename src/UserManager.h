@@ -35,6 +35,7 @@ extern NSString* const kIPMsgUserListChangedNotification;
 
 // ユーザ追加／削除
 - (void)appendUser:(UserInfo*)user;
+- (void)appendUsers:(NSArray<UserInfo*>*)users;
 - (void)removeUser:(UserInfo*)user;
 - (void)removeAllUsers;
 
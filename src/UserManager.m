@@ -8,6 +8,7 @@
 
 #import "UserManager.h"
 #import "UserInfo.h"
+#import "RuntimeMetrics.h"
 #import "DebugLog.h"
 
 /*============================================================================*
@@ -118,6 +119,33 @@ NSString* const kIPMsgUserListChangedNotification = @"IPMsgUserListChanged";
 	[self fireUserListChangeNotice];
 }
 
+// ユーザ一括追加（変更通知は1回のみ）
+- (void)appendUsers:(NSArray<UserInfo*>*)users
+{
+	if (users.count == 0) {
+		return;
+	}
+	@synchronized (self.userList) {
+		// 既存ユーザの位置を索引化して一覧の線形探索を避ける
+		NSMapTable<UserInfo*, NSNumber*>* indexes = [NSMapTable strongToStrongObjectsMapTable];
+		[self.userList enumerateObjectsUsingBlock:^(UserInfo* user, NSUInteger idx, BOOL* stop) {
+			[indexes setObject:@(idx) forKey:user];
+		}];
+		for (UserInfo* user in users) {
+			NSNumber* index = [indexes objectForKey:user];
+			if (index) {
+				// あれば置き換え
+				self.userList[index.unsignedIntegerValue] = user;
+			} else {
+				// なければ追加
+				[indexes setObject:@(self.userList.count) forKey:user];
+				[self.userList addObject:user];
+			}
+		}
+	}
+	[self fireUserListChangeNotice];
+}
+
 // ユーザ削除
 - (void)removeUser:(UserInfo*)user
 {
@@ -151,6 +179,9 @@ NSString* const kIPMsgUserListChangedNotification = @"IPMsgUserListChanged";
 // ユーザ一覧変更通知発行
 - (void)fireUserListChangeNotice
 {
+	@synchronized (self.userList) {
+		MetricsGaugeSet(METRICS_USER_COUNT, (SInt64)self.userList.count);
+	}
 	NSNotificationCenter* nc = NSNotificationCenter.defaultCenter;
 	[nc postNotificationName:kIPMsgUserListChangedNotification object:nil];
 }
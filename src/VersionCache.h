@@ -0,0 +1,38 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: VersionCache.h
+ *	Module		: ユーザバージョン情報キャッシュクラス
+ *============================================================================*/
+
+#import <Foundation/Foundation.h>
+
+@class UserInfo;
+
+/*============================================================================*
+ * クラス定義
+ *============================================================================*/
+
+// ホスト名＋ログオン名をキーとしたバージョン情報キャッシュ（ファイルに永続化）
+@interface VersionCache : NSObject
+
+@property(assign)	NSTimeInterval	timeToLive;		// 有効期間（超過したものは再取得対象）
+@property(assign)	NSTimeInterval	probeTimeout;	// 問い合わせ応答待ち期間（超過したら再問い合わせ可）
+
+// 共有インスタンス
++ (instancetype)sharedCache;
+
+// キャッシュ参照（有効期間切れでも値は返す）
+- (NSString*)versionForUser:(UserInfo*)user;
+
+// 問い合わせ要否判定（YESの場合は問い合わせ中として記録する）
+- (BOOL)beginProbeForUser:(UserInfo*)user;
+
+// キャッシュ更新（値が変化した場合YES）
+- (BOOL)setVersion:(NSString*)version forUser:(UserInfo*)user;
+
+// 永続化
+- (void)save;
+
+@end
@@ -0,0 +1,210 @@
+/*============================================================================*
+ * (C) 2001-2019 G.Ishiwata, All Rights Reserved.
+ *
+ *	Project		: IP Messenger for macOS
+ *	File		: VersionCache.m
+ *	Module		: ユーザバージョン情報キャッシュクラス
+ *============================================================================*/
+
+#import "VersionCache.h"
+#import "UserInfo.h"
+#import "DebugLog.h"
+
+/*============================================================================*
+ * 定数定義
+ *============================================================================*/
+
+#define _DEFAULT_TTL			(7 * 24 * 60 * 60.0)	// 有効期間（7日）
+#define _DEFAULT_PROBE_TIMEOUT	(60.0)					// 応答待ち期間（60秒）
+#define _DISCARD_FACTOR			(4)						// 読み込み時に破棄する期間（有効期間の倍数）
+
+static NSString* const _FILE_NAME		= @"VersionCache.plist";
+static NSString* const _KEY_VERSION		= @"Version";
+static NSString* const _KEY_DATE		= @"Date";
+
+/*============================================================================*
+ * 内部クラス拡張
+ *============================================================================*/
+
+@interface VersionCache()
+
+@property(copy)		NSString*										path;		// 保存先
+@property(retain)	NSMutableDictionary<NSString*,NSDictionary*>*	entries;	// キャッシュ
+@property(retain)	NSMutableDictionary<NSString*,NSDate*>*			probing;	// 問い合わせ中
+@property(assign)	BOOL											dirty;		// 未保存変更あり
+
+- (NSString*)keyForUser:(UserInfo*)user;
+
+@end
+
+/*============================================================================*
+ * クラス実装
+ *============================================================================*/
+
+@implementation VersionCache
+
+/*----------------------------------------------------------------------------*
+ * ファクトリ
+ *----------------------------------------------------------------------------*/
+
++ (instancetype)sharedCache
+{
+	static VersionCache*	sharedCache = nil;
+	static dispatch_once_t	once;
+
+	dispatch_once(&once, ^{
+		sharedCache = [[VersionCache alloc] init];
+	});
+
+	return sharedCache;
+}
+
+/*----------------------------------------------------------------------------*
+ * 初期化／解放
+ *----------------------------------------------------------------------------*/
+
+// 初期化
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		NSArray*	dirs	= NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+		NSString*	bundle	= NSBundle.mainBundle.bundleIdentifier;
+		NSString*	dir		= dirs.firstObject;
+		if (dir && bundle) {
+			dir		= [dir stringByAppendingPathComponent:bundle];
+			_path	= [[dir stringByAppendingPathComponent:_FILE_NAME] copy];
+		}
+		_timeToLive		= _DEFAULT_TTL;
+		_probeTimeout	= _DEFAULT_PROBE_TIMEOUT;
+		_entries		= [[NSMutableDictionary alloc] init];
+		_probing		= [[NSMutableDictionary alloc] init];
+
+		// 保存済みキャッシュ読み込み（古すぎるものは破棄）
+		NSDictionary* saved = _path ? [NSDictionary dictionaryWithContentsOfFile:_path] : nil;
+		NSTimeInterval limit = -(_timeToLive * _DISCARD_FACTOR);
+		[saved enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL* stop) {
+			if (![key isKindOfClass:NSString.class] || ![obj isKindOfClass:NSDictionary.class]) {
+				return;
+			}
+			NSString*	version	= obj[_KEY_VERSION];
+			NSDate*		date	= obj[_KEY_DATE];
+			if (![version isKindOfClass:NSString.class] || ![date isKindOfClass:NSDate.class]) {
+				return;
+			}
+			if (date.timeIntervalSinceNow < limit) {
+				return;
+			}
+			self->_entries[key] = obj;
+		}];
+		TRC(@"VersionCache loaded(%lu entries,path=%@)", _entries.count, _path);
+	}
+	return self;
+}
+
+// 解放
+- (void)dealloc
+{
+	[_path release];
+	[_entries release];
+	[_probing release];
+	[super dealloc];
+}
+
+/*----------------------------------------------------------------------------*
+ * 参照／更新
+ *----------------------------------------------------------------------------*/
+
+// キャッシュ参照
+- (NSString*)versionForUser:(UserInfo*)user
+{
+	NSString* key = [self keyForUser:user];
+	if (!key) {
+		return nil;
+	}
+	@synchronized(self) {
+		return [[[self.entries[key] objectForKey:_KEY_VERSION] retain] autorelease];
+	}
+}
+
+// 問い合わせ要否判定
+- (BOOL)beginProbeForUser:(UserInfo*)user
+{
+	NSString* key = [self keyForUser:user];
+	if (!key) {
+		return NO;
+	}
+	@synchronized(self) {
+		NSDate* date = [self.entries[key] objectForKey:_KEY_DATE];
+		if (date && (-date.timeIntervalSinceNow < self.timeToLive)) {
+			// キャッシュ有効
+			return NO;
+		}
+		NSDate* sent = self.probing[key];
+		if (sent && (-sent.timeIntervalSinceNow < self.probeTimeout)) {
+			// 問い合わせ中（応答待ち）
+			return NO;
+		}
+		self.probing[key] = [NSDate date];
+	}
+	return YES;
+}
+
+// キャッシュ更新
+- (BOOL)setVersion:(NSString*)version forUser:(UserInfo*)user
+{
+	NSString* key = [self keyForUser:user];
+	if (!key || !version) {
+		return NO;
+	}
+	BOOL changed;
+	@synchronized(self) {
+		NSString* old = [self.entries[key] objectForKey:_KEY_VERSION];
+		changed = ![old isEqualToString:version];
+		self.entries[key] = @{ _KEY_VERSION: version, _KEY_DATE: [NSDate date] };
+		[self.probing removeObjectForKey:key];
+		self.dirty = YES;
+	}
+	return changed;
+}
+
+// 永続化
+- (void)save
+{
+	NSDictionary* dict = nil;
+	@synchronized(self) {
+		if (!self.dirty || !self.path) {
+			return;
+		}
+		dict		= [[self.entries copy] autorelease];
+		self.dirty	= NO;
+	}
+	NSError* err = nil;
+	if (![NSFileManager.defaultManager createDirectoryAtPath:self.path.stringByDeletingLastPathComponent
+								 withIntermediateDirectories:YES
+												  attributes:nil
+													   error:&err]) {
+		ERR(@"cache directory create error(%@)", err);
+		return;
+	}
+	if (![dict writeToFile:self.path atomically:YES]) {
+		ERR(@"VersionCache save error(%@)", self.path);
+		return;
+	}
+	TRC(@"VersionCache saved(%lu entries)", dict.count);
+}
+
+/*----------------------------------------------------------------------------*
+ * 内部利用
+ *----------------------------------------------------------------------------*/
+
+// キャッシュキー（ホスト名＋ログオン名）
+- (NSString*)keyForUser:(UserInfo*)user
+{
+	if (!user.hostName || !user.logOnName) {
+		return nil;
+	}
+	return [NSString stringWithFormat:@"%@@%@", user.logOnName, user.hostName];
+}
+
+@end